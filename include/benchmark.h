@@ -0,0 +1,102 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_BENCHMARK_H
+#define DOSBOX_BENCHMARK_H
+
+/*  Benchmark Mode
+ *  --------------
+ *  Started with '--benchmark <seconds>'. The machine runs headless, with the
+ *  dummy video and audio drivers of SDL and the mixer in nosound mode, for
+ *  the given number of emulated seconds, counted from the start of the
+ *  machine. Then the report is printed to stdout as a JSON object and the
+ *  emulator exits.
+ *
+ *  With fixed cycles, the emulation isn't paced to the host's clock but runs
+ *  as fast as it can, like in fast forward mode. With 'cycles = max' or
+ *  'auto' it's paced as usual, so the cycles settle where the host can keep
+ *  up.
+ *
+ *  The report holds the emulated instructions per host second (the cores
+ *  count one cycle per instruction, the cycles a halted CPU idles away and
+ *  the removed IO delays don't count), the frames rendered, the audio frames
+ *  mixed, the host time spent in the CPU core, the PIC event queue, VGA
+ *  drawing and the mixer, and the peak resident set size of the process.
+ *  With 'cycles = max' or 'auto' it also holds the last update of the cycle
+ *  governor: its target and measured share of host time, and the error.
+ */
+
+#include <cstdint>
+
+enum class BenchmarkSection : uint8_t { Cpu, PicQueue, VgaDraw, Mixer, NumSections };
+
+// Set while the benchmark runs; the hooks below do nothing otherwise
+extern bool benchmark_running;
+
+void BENCHMARK_Start(int emulated_seconds);
+
+// Called at the start of every emulated millisecond
+void BENCHMARK_Tick();
+
+// Called when the emulated millisecond has run, counts the cycles it
+// executed. Prints the report and requests the exit once the benchmark has
+// run its course.
+void BENCHMARK_EndTick();
+
+void BENCHMARK_AddFrame();
+void BENCHMARK_AddAudioFrames(int num_frames);
+
+// Counts the VGA frames drawn in one go, and the ones drawn in parts
+void BENCHMARK_AddVgaFrame(bool is_batched);
+
+// Adds the host time until the end of the scope to the given section. Time
+// spent in nested scopes only counts for the innermost one, so VGA drawing
+// run by the PIC queue isn't counted twice.
+class BenchmarkScope {
+public:
+	explicit BenchmarkScope(const BenchmarkSection section)
+	{
+		if (benchmark_running) {
+			Enter(section);
+		}
+	}
+
+	~BenchmarkScope()
+	{
+		if (active) {
+			Leave();
+		}
+	}
+
+	BenchmarkScope(const BenchmarkScope&)            = delete;
+	BenchmarkScope& operator=(const BenchmarkScope&) = delete;
+
+private:
+	void Enter(BenchmarkSection section);
+	void Leave();
+
+	BenchmarkScope* parent   = nullptr;
+	int64_t start_ns         = 0;
+	int64_t nested_ns        = 0;
+	BenchmarkSection section = BenchmarkSection::Cpu;
+	bool active              = false;
+};
+
+#endif
@@ -52,6 +52,11 @@ enum class ArchitectureType {
 	Mixed           = 0xff,
 };
 
+// What the normal core charges per instruction: one cycle with Flat, or the
+// clock count of the instruction on the given processor, so the cycles
+// setting becomes the clock rate in kHz
+enum class CycleTiming { Flat, Intel8086, Intel286, Intel386, Intel486 };
+
 /* CPU Cycle Timing */
 extern int32_t CPU_Cycles;
 extern int32_t CPU_CycleLeft;
@@ -80,6 +85,7 @@ constexpr bool CPU_UseRwxMemProtect = true;
 
 Bits CPU_Core_Normal_Run() noexcept;
 Bits CPU_Core_Normal_Trap_Run() noexcept;
+void CPU_Core_Normal_SetTiming(CycleTiming timing);
 Bits CPU_Core_Simple_Run() noexcept;
 Bits CPU_Core_Simple_Trap_Run() noexcept;
 Bits CPU_Core_Full_Run() noexcept;
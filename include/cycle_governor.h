@@ -0,0 +1,74 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CYCLE_GOVERNOR_H
+#define DOSBOX_CYCLE_GOVERNOR_H
+
+/*  Cycle Governor
+ *  --------------
+ *  Adjusts CPU_CycleMax for 'cycles = auto' and 'cycles = max' so that
+ *  emulating one millisecond takes the configured share of the host's time.
+ *
+ *  The main loop reports how many milliseconds were emulated, and how much
+ *  host time passed and was slept, in microseconds. The governor then adjusts
+ *  the cycles using the policy selected with the 'cycle_governor' setting:
+ *
+ *    legacy:  The original heuristic. It updates about every 250 ms and
+ *             divides the cycles by three whenever emulation falls far
+ *             behind.
+ *
+ *    pid:     A PID controller that works on the logarithm of the cycles.
+ *             It updates every 50 ms, and when emulation misses its
+ *             deadline it corrects at once instead of overshooting.
+ */
+
+#include <cstdint>
+#include <string>
+
+enum class CycleGovernorPolicy { Legacy, Pid };
+
+struct CycleGovernorStats {
+	// share of host time that should be spent emulating, 0.9 = 90%
+	double target = 0.0;
+	// share of host time that was spent emulating during the last update
+	double measured = 0.0;
+	// relative error the last update corrected, positive means headroom
+	double error = 0.0;
+	int32_t cycles = 0;
+	uint32_t updates = 0;
+};
+
+void CYCLE_GOVERNOR_SetPolicy(const std::string& policy_name);
+CycleGovernorPolicy CYCLE_GOVERNOR_GetPolicy();
+
+// Forget the time measured so far, e.g. after the cycles were changed by hand
+void CYCLE_GOVERNOR_Reset();
+
+// The main loop slept for the given number of microseconds because the
+// emulation was ahead of the host's clock
+void CYCLE_GOVERNOR_AddSleep(int64_t slept_us);
+
+// The main loop is about to emulate 'scheduled_ms' milliseconds, after
+// 'elapsed_us' microseconds of host time passed since the previous call
+void CYCLE_GOVERNOR_AddTicks(int64_t elapsed_us, int64_t scheduled_ms);
+
+CycleGovernorStats CYCLE_GOVERNOR_GetStats();
+
+#endif
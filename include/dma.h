@@ -36,6 +36,8 @@ enum DMAEvent {
 };
 
 class DmaChannel;
+class SaveStateReader;
+class SaveStateWriter;
 using DMA_CallBack = std::function<void(DmaChannel *chan, DMAEvent event)>;
 
 class DmaChannel {
@@ -136,6 +138,9 @@ public:
 
 	void WriteControllerReg(io_port_t reg, io_val_t value, io_width_t width);
 	uint16_t ReadControllerReg(io_port_t reg, io_width_t width);
+
+	void SaveState(SaveStateWriter& writer) const;
+	void LoadState(SaveStateReader& reader);
 };
 
 DmaChannel * GetDMAChannel(uint8_t chan);
@@ -49,6 +49,8 @@ const char *DOSBOX_GetDetailedVersion() noexcept;
 double DOSBOX_GetUptime();
 
 void DOSBOX_RunMachine();
+// The number of nested DOSBOX_RunMachine calls
+int DOSBOX_GetRunDepth();
 void DOSBOX_SetLoop(LoopHandler * handler);
 void DOSBOX_SetNormalLoop();
 
@@ -28,6 +28,8 @@
 #include "mem.h"
 #endif
 
+#include "fpu_float.h"
+
 void FPU_ESC0_Normal(Bitu rm);
 void FPU_ESC0_EA(Bitu func,PhysPt ea);
 void FPU_ESC1_Normal(Bitu rm);
@@ -83,7 +85,7 @@ enum FPU_Round : uint8_t {
 };
 
 struct FPU_rec {
-	FPU_Reg regs[9]      = {};
+	FPU_Float regs[9]    = {};
 	FPU_P_Reg p_regs[9]  = {};
 	FPU_Tag tags[9]      = {};
 	uint16_t cw          = 0;
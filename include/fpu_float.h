@@ -0,0 +1,595 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_FPU_FLOAT_H
+#define DOSBOX_FPU_FLOAT_H
+
+/*  FPU Float
+ *  ---------
+ *  The number type of the portable FPU core. The x87 keeps its registers in
+ *  an 80-bit format with a 64-bit significand, more than the 53 bits of a
+ *  double, so programs that accumulate results on the FPU stack drift when
+ *  emulated with doubles.
+ *
+ *  When the host's long double has a 64-bit significand (x86 hosts built
+ *  with GCC or Clang) it's exactly the x87 format and is used directly.
+ *  Elsewhere long double is either just a double (MSVC, ARM64 macOS) or a
+ *  128-bit type that's emulated in software (ARM64 Linux), so a
+ *  double-double is used instead: the unevaluated sum of two doubles, which
+ *  holds a 106-bit significand and does the basic arithmetic with a handful
+ *  of double operations. It keeps the exponent range of a double.
+ *
+ *  Both types are used through the same set of fpu_* functions. The
+ *  transcendental functions of the double-double are the double results
+ *  with a first-order correction for the low part.
+ */
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+// The double-double relies on the rounding error of each operation and on
+// NaN checks, which the release builds' fast floating-point model would
+// fold away; the meson build turns it off for the FPU and CPU sources
+#ifdef _MSC_VER
+#pragma float_control(precise, on, push)
+#endif
+
+struct FPU_DoubleDouble {
+	double hi = 0.0;
+	double lo = 0.0;
+
+	constexpr FPU_DoubleDouble() = default;
+	constexpr FPU_DoubleDouble(const double d) : hi(d) {}
+	constexpr FPU_DoubleDouble(const double h, const double l) : hi(h), lo(l)
+	{}
+};
+
+#if LDBL_MANT_DIG == 64
+using FPU_Float = long double;
+#else
+using FPU_Float = FPU_DoubleDouble;
+#endif
+
+// The x87 extended format as it's stored in memory
+struct FPU_Float80 {
+	uint64_t mantissa      = 0;
+	uint16_t sign_exponent = 0;
+};
+
+constexpr int fpu_float80_bias = 16383;
+
+// Constants loaded by FLDPI, FLDL2T, and so on, rounded to 64 bits like the
+// ones in the x87's ROM
+constexpr FPU_Float80 fpu_const_pi  = {0xc90fdaa22168c235, 0x4000};
+constexpr FPU_Float80 fpu_const_l2t = {0xd49a784bcd1b8afe, 0x4000};
+constexpr FPU_Float80 fpu_const_l2e = {0xb8aa3b295c17f0bc, 0x3fff};
+constexpr FPU_Float80 fpu_const_lg2 = {0x9a209a84fbcff799, 0x3ffd};
+constexpr FPU_Float80 fpu_const_ln2 = {0xb17217f7d1cf79ac, 0x3ffe};
+
+// Double-double building blocks, see "Library for Double-Double and
+// Quad-Double Arithmetic" by Hida, Li and Bailey
+
+// a + b exactly, if |a| >= |b|
+static inline FPU_DoubleDouble fpu_dd_quick_two_sum(const double a, const double b)
+{
+	const double s = a + b;
+	return {s, b - (s - a)};
+}
+
+// a + b exactly
+static inline FPU_DoubleDouble fpu_dd_two_sum(const double a, const double b)
+{
+	const double s  = a + b;
+	const double bb = s - a;
+	return {s, (a - (s - bb)) + (b - bb)};
+}
+
+// a * b exactly
+static inline FPU_DoubleDouble fpu_dd_two_prod(const double a, const double b)
+{
+	const double p = a * b;
+	return {p, std::fma(a, b, -p)};
+}
+
+static inline FPU_DoubleDouble operator-(const FPU_DoubleDouble a)
+{
+	return {-a.hi, -a.lo};
+}
+
+static inline FPU_DoubleDouble operator+(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	auto s = fpu_dd_two_sum(a.hi, b.hi);
+	if (!std::isfinite(s.hi)) {
+		return {s.hi, 0.0};
+	}
+	const auto t = fpu_dd_two_sum(a.lo, b.lo);
+	s            = fpu_dd_quick_two_sum(s.hi, s.lo + t.hi);
+	return fpu_dd_quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+static inline FPU_DoubleDouble operator-(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	return a + (-b);
+}
+
+static inline FPU_DoubleDouble operator*(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	const auto p = fpu_dd_two_prod(a.hi, b.hi);
+	if (!std::isfinite(p.hi)) {
+		return {p.hi, 0.0};
+	}
+	return fpu_dd_quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+static inline FPU_DoubleDouble operator/(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	const double q1 = a.hi / b.hi;
+	if (!std::isfinite(q1) || q1 == 0.0) {
+		return {q1, 0.0};
+	}
+	auto r          = a - b * q1;
+	const double q2 = r.hi / b.hi;
+	r               = r - b * q2;
+	const double q3 = r.hi / b.hi;
+	return fpu_dd_quick_two_sum(q1, q2) + q3;
+}
+
+static inline FPU_DoubleDouble& operator+=(FPU_DoubleDouble& a, const FPU_DoubleDouble b)
+{
+	return a = a + b;
+}
+
+static inline FPU_DoubleDouble& operator*=(FPU_DoubleDouble& a, const FPU_DoubleDouble b)
+{
+	return a = a * b;
+}
+
+static inline bool operator==(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	return a.hi == b.hi && a.lo == b.lo;
+}
+
+static inline bool operator!=(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	return !(a == b);
+}
+
+static inline bool operator<(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+static inline bool operator>(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	return b < a;
+}
+
+static inline bool operator<=(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo <= b.lo);
+}
+
+static inline bool operator>=(const FPU_DoubleDouble a, const FPU_DoubleDouble b)
+{
+	return b <= a;
+}
+
+// Conversions
+
+template <typename T>
+static inline T fpu_from_int64(const int64_t val);
+
+template <>
+inline long double fpu_from_int64(const int64_t val)
+{
+	return static_cast<long double>(val);
+}
+
+template <>
+inline FPU_DoubleDouble fpu_from_int64(const int64_t val)
+{
+	// both halves convert exactly
+	const auto upper = static_cast<double>(val >> 32) * 4294967296.0;
+	const auto lower = static_cast<double>(static_cast<uint32_t>(val));
+	return fpu_dd_two_sum(upper, lower);
+}
+
+// Only for integral values within the range of an int64_t
+static inline int64_t fpu_to_int64(const long double val)
+{
+	return static_cast<int64_t>(val);
+}
+
+static inline int64_t fpu_to_int64(const FPU_DoubleDouble val)
+{
+	// hi can be 2^63 with a negative lo, so the sum is done unsigned
+	const auto upper = val.hi < 0.0 ? 0 - static_cast<uint64_t>(-val.hi)
+	                                : static_cast<uint64_t>(val.hi);
+	const auto lower = static_cast<uint64_t>(static_cast<int64_t>(val.lo));
+	return static_cast<int64_t>(upper + lower);
+}
+
+static inline double fpu_to_double(const long double val)
+{
+	return static_cast<double>(val);
+}
+
+static inline double fpu_to_double(const FPU_DoubleDouble val)
+{
+	// a normalised double-double has hi = round(hi + lo)
+	return val.hi;
+}
+
+template <typename T>
+static inline T fpu_from_float80(const FPU_Float80 val);
+
+template <>
+inline long double fpu_from_float80(const FPU_Float80 val)
+{
+	const bool negative = val.sign_exponent & 0x8000;
+	const int exponent  = val.sign_exponent & 0x7fff;
+
+	long double result = 0.0L;
+	if (exponent == 0x7fff) {
+		result = (val.mantissa << 1) ? NAN : INFINITY;
+	} else if (val.mantissa) {
+		// denormals have the exponent of the smallest normal
+		const int shift = (exponent ? exponent : 1) - fpu_float80_bias - 63;
+		result = std::ldexp(static_cast<long double>(val.mantissa), shift);
+	}
+	return negative ? -result : result;
+}
+
+template <>
+inline FPU_DoubleDouble fpu_from_float80(const FPU_Float80 val)
+{
+	const bool negative = val.sign_exponent & 0x8000;
+	const int exponent  = val.sign_exponent & 0x7fff;
+
+	FPU_DoubleDouble result = {};
+	if (exponent == 0x7fff) {
+		result.hi = (val.mantissa << 1) ? NAN : INFINITY;
+	} else if (val.mantissa) {
+		const int shift = (exponent ? exponent : 1) - fpu_float80_bias - 63;
+		// the upper 53 and lower 11 bits convert exactly
+		const auto upper = static_cast<double>(val.mantissa & ~uint64_t{0x7ff});
+		const auto lower = static_cast<double>(val.mantissa & 0x7ff);
+		result = fpu_dd_quick_two_sum(std::ldexp(upper, shift),
+		                              std::ldexp(lower, shift));
+	}
+	return negative ? -result : result;
+}
+
+static inline FPU_Float80 fpu_float80_special(const bool negative, const uint64_t mantissa)
+{
+	return {mantissa, static_cast<uint16_t>((negative ? 0x8000 : 0) | 0x7fff)};
+}
+
+static inline FPU_Float80 fpu_to_float80(const long double val)
+{
+	const bool negative = std::signbit(val);
+	if (std::isnan(val)) {
+		return fpu_float80_special(negative, 0xc000000000000000);
+	}
+	if (std::isinf(val)) {
+		return fpu_float80_special(negative, 0x8000000000000000);
+	}
+	const auto abs_val = std::fabs(val);
+	const uint16_t sign = negative ? 0x8000 : 0;
+	if (abs_val == 0.0L) {
+		return {0, sign};
+	}
+	int exponent = 0;
+	std::frexp(abs_val, &exponent);
+	int biased = exponent - 1 + fpu_float80_bias;
+	if (biased <= 0) {
+		// denormal
+		const auto mantissa = std::ldexp(abs_val, fpu_float80_bias - 1 + 63);
+		return {static_cast<uint64_t>(mantissa), sign};
+	}
+	const auto mantissa = std::ldexp(abs_val, 64 - exponent);
+	return {static_cast<uint64_t>(mantissa), static_cast<uint16_t>(sign | biased)};
+}
+
+static inline FPU_Float80 fpu_to_float80(const FPU_DoubleDouble val)
+{
+	const bool negative = std::signbit(val.hi);
+	if (std::isnan(val.hi)) {
+		return fpu_float80_special(negative, 0xc000000000000000);
+	}
+	if (std::isinf(val.hi)) {
+		return fpu_float80_special(negative, 0x8000000000000000);
+	}
+	const uint16_t sign = negative ? 0x8000 : 0;
+	if (val.hi == 0.0) {
+		return {0, sign};
+	}
+	const auto abs_val = negative ? -val : val;
+
+	// Scaled so that hi has its top bit at bit 63 or 64, it's an integer
+	// and lo adds less than half a unit of hi to it. A hi at bit 64 wraps
+	// around, the sum with the negative lo doesn't.
+	const auto scaled_mantissa = [&](const int shift) {
+		const auto upper = static_cast<uint64_t>(std::ldexp(abs_val.hi, shift - 1)) << 1;
+		const auto lower = std::nearbyint(std::ldexp(abs_val.lo, shift));
+		return upper + static_cast<uint64_t>(static_cast<int64_t>(lower));
+	};
+	int exponent = 0;
+	if (std::frexp(abs_val.hi, &exponent) == 0.5 && abs_val.lo < 0.0) {
+		// hi is a power of two and the sum is just below it
+		--exponent;
+	}
+	auto mantissa = scaled_mantissa(64 - exponent);
+	if (!mantissa) {
+		// lo was too small to matter after all and the sum rounded up
+		++exponent;
+		mantissa = uint64_t{1} << 63;
+	}
+	const auto biased = static_cast<uint16_t>(exponent - 1 + fpu_float80_bias);
+	return {mantissa, static_cast<uint16_t>(sign | biased)};
+}
+
+// Rounding to integers
+
+static inline long double fpu_floor(const long double val)
+{
+	return std::floor(val);
+}
+
+static inline FPU_DoubleDouble fpu_floor(const FPU_DoubleDouble val)
+{
+	const double hi = std::floor(val.hi);
+	if (hi != val.hi) {
+		return {hi, 0.0};
+	}
+	return fpu_dd_quick_two_sum(hi, std::floor(val.lo));
+}
+
+static inline long double fpu_ceil(const long double val)
+{
+	return std::ceil(val);
+}
+
+static inline FPU_DoubleDouble fpu_ceil(const FPU_DoubleDouble val)
+{
+	return -fpu_floor(-val);
+}
+
+static inline long double fpu_trunc(const long double val)
+{
+	return std::trunc(val);
+}
+
+static inline FPU_DoubleDouble fpu_trunc(const FPU_DoubleDouble val)
+{
+	return val.hi < 0.0 ? fpu_ceil(val) : fpu_floor(val);
+}
+
+// Rounds to the nearest integer, ties to even
+static inline long double fpu_round_nearest(const long double val)
+{
+	return std::nearbyint(val);
+}
+
+static inline FPU_DoubleDouble fpu_round_nearest(const FPU_DoubleDouble val)
+{
+	const auto lower    = fpu_floor(val);
+	const auto fraction = val - lower;
+	if (fraction < 0.5) {
+		return lower;
+	}
+	if (fraction > 0.5) {
+		return lower + 1.0;
+	}
+	const double last = lower.lo != 0.0 ? lower.lo : lower.hi;
+	return std::fmod(last, 2.0) != 0.0 ? lower + 1.0 : lower;
+}
+
+// Miscellaneous
+
+static inline bool fpu_isnan(const long double val)
+{
+	return std::isnan(val);
+}
+
+static inline bool fpu_isnan(const FPU_DoubleDouble val)
+{
+	return std::isnan(val.hi);
+}
+
+static inline int fpu_fpclassify(const long double val)
+{
+	return std::fpclassify(val);
+}
+
+static inline int fpu_fpclassify(const FPU_DoubleDouble val)
+{
+	return std::fpclassify(val.hi);
+}
+
+static inline bool fpu_signbit(const long double val)
+{
+	return std::signbit(val);
+}
+
+static inline bool fpu_signbit(const FPU_DoubleDouble val)
+{
+	return std::signbit(val.hi);
+}
+
+static inline long double fpu_fabs(const long double val)
+{
+	return std::fabs(val);
+}
+
+static inline FPU_DoubleDouble fpu_fabs(const FPU_DoubleDouble val)
+{
+	return std::signbit(val.hi) ? -val : val;
+}
+
+static inline long double fpu_ldexp(const long double val, const int exponent)
+{
+	return std::ldexp(val, exponent);
+}
+
+static inline FPU_DoubleDouble fpu_ldexp(const FPU_DoubleDouble val, const int exponent)
+{
+	return {std::ldexp(val.hi, exponent), std::ldexp(val.lo, exponent)};
+}
+
+// Significand in [0.5, 1) and exponent, like frexp()
+static inline long double fpu_frexp(const long double val, int* exponent)
+{
+	return std::frexp(val, exponent);
+}
+
+static inline FPU_DoubleDouble fpu_frexp(const FPU_DoubleDouble val, int* exponent)
+{
+	const double hi = std::frexp(val.hi, exponent);
+	if (!std::isfinite(val.hi) || val.hi == 0.0) {
+		return {hi, 0.0};
+	}
+	auto result = FPU_DoubleDouble(hi, std::ldexp(val.lo, -*exponent));
+	// hi is exactly 0.5 and lo is negative
+	if (result.hi == 0.5 && result.lo < 0.0) {
+		--*exponent;
+		result = fpu_ldexp(result, 1);
+	}
+	return result;
+}
+
+static inline long double fpu_sqrt(const long double val)
+{
+	return std::sqrt(val);
+}
+
+static inline FPU_DoubleDouble fpu_sqrt(const FPU_DoubleDouble val)
+{
+	const double root = std::sqrt(val.hi);
+	if (!std::isfinite(root) || root == 0.0) {
+		return {root, 0.0};
+	}
+	// one Newton step
+	const auto error = val - fpu_dd_two_prod(root, root);
+	return fpu_dd_two_sum(root, error.hi * 0.5 / root);
+}
+
+// Transcendental functions
+
+constexpr long double fpu_ln2 = 0.693147180559945309417232121458176568L;
+
+static inline long double fpu_sin(const long double val)
+{
+	return std::sin(val);
+}
+
+static inline FPU_DoubleDouble fpu_sin(const FPU_DoubleDouble val)
+{
+	return fpu_dd_two_sum(std::sin(val.hi), std::cos(val.hi) * val.lo);
+}
+
+static inline long double fpu_cos(const long double val)
+{
+	return std::cos(val);
+}
+
+static inline FPU_DoubleDouble fpu_cos(const FPU_DoubleDouble val)
+{
+	return fpu_dd_two_sum(std::cos(val.hi), -std::sin(val.hi) * val.lo);
+}
+
+static inline long double fpu_tan(const long double val)
+{
+	return std::tan(val);
+}
+
+static inline FPU_DoubleDouble fpu_tan(const FPU_DoubleDouble val)
+{
+	const double t = std::tan(val.hi);
+	return fpu_dd_two_sum(t, (1.0 + t * t) * val.lo);
+}
+
+static inline long double fpu_atan2(const long double y, const long double x)
+{
+	return std::atan2(y, x);
+}
+
+static inline FPU_DoubleDouble fpu_atan2(const FPU_DoubleDouble y, const FPU_DoubleDouble x)
+{
+	const double angle = std::atan2(y.hi, x.hi);
+	const double norm  = x.hi * x.hi + y.hi * y.hi;
+	if (!std::isfinite(norm) || norm == 0.0) {
+		return {angle, 0.0};
+	}
+	return fpu_dd_two_sum(angle, (x.hi * y.lo - y.hi * x.lo) / norm);
+}
+
+static inline long double fpu_log2(const long double val)
+{
+	return std::log2(val);
+}
+
+static inline FPU_DoubleDouble fpu_log2(const FPU_DoubleDouble val)
+{
+	const double result = std::log2(val.hi);
+	if (!std::isfinite(result)) {
+		return {result, 0.0};
+	}
+	return fpu_dd_two_sum(result, val.lo / (val.hi * static_cast<double>(fpu_ln2)));
+}
+
+// log2(1 + val), accurate for small values
+static inline long double fpu_log2_1p(const long double val)
+{
+	return std::log1p(val) / fpu_ln2;
+}
+
+static inline FPU_DoubleDouble fpu_log2_1p(const FPU_DoubleDouble val)
+{
+	constexpr auto ln2 = static_cast<double>(fpu_ln2);
+	const double result = std::log1p(val.hi) / ln2;
+	if (!std::isfinite(result)) {
+		return {result, 0.0};
+	}
+	return fpu_dd_two_sum(result, val.lo / ((1.0 + val.hi) * ln2));
+}
+
+// 2^val - 1, accurate for small values
+static inline long double fpu_exp2_m1(const long double val)
+{
+	return std::expm1(val * fpu_ln2);
+}
+
+static inline FPU_DoubleDouble fpu_exp2_m1(const FPU_DoubleDouble val)
+{
+	constexpr auto ln2 = static_cast<double>(fpu_ln2);
+	const double result = std::expm1(val.hi * ln2);
+	if (!std::isfinite(result)) {
+		return {result, 0.0};
+	}
+	return fpu_dd_two_sum(result, (result + 1.0) * ln2 * val.lo);
+}
+
+#ifdef _MSC_VER
+#pragma float_control(pop)
+#endif
+
+#endif
@@ -58,6 +58,10 @@ bool MEM_ReAllocatePages(MemHandle &handle, Bitu pages, bool sequence);
 void MEM_RemoveEMSPageFrame();
 void MEM_PreparePCJRCartRom();
 
+// Writes the RAM to the image file set with 'memimage' if it doesn't exist
+// yet, so the following sessions can map it
+bool MEM_WriteImage();
+
 MemHandle MEM_NextHandle(MemHandle handle);
 MemHandle MEM_NextHandleAt(MemHandle handle, Bitu where);
 
@@ -75,6 +75,10 @@ void MOUSE_EventButton(const uint8_t idx, const bool pressed,
 void MOUSE_EventWheel(const int16_t w_rel);
 void MOUSE_EventWheel(const int16_t w_rel, const MouseInterfaceId device_id);
 
+// Delivers a recorded event, past the checks of the host state
+struct ReplayEvent;
+void MOUSE_ReplayEvent(const ReplayEvent& event);
+
 // Notify that guest OS is being booted, so that certain
 // parts of the emulation (like DOS driver) should be disabled
 void MOUSE_NotifyBooting();
@@ -25,23 +25,13 @@
 
 #include "mem.h"
 
-// disable this to reduce the size of the TLB
-// NOTE: does not work with the dynamic core (dynrec is fine)
-#define USE_FULL_TLB
-
 class PageDirectory;
 
 #define MEM_PAGE_SIZE	(4096)
 #define XMS_START		(0x110)
 
-#if defined(USE_FULL_TLB)
+// one TLB entry for each page of the 4 GB linear address space
 #define TLB_SIZE		(1024*1024)
-#else
-#define TLB_SIZE		65536	// This must a power of 2 and greater then LINK_START
-#define BANK_SHIFT		28
-#define BANK_MASK		0xffff // always the same as TLB_SIZE-1?
-#define TLB_BANKS		((1024*1024/TLB_SIZE)-1)
-#endif
 
 #define PFLAG_READABLE		0x1
 #define PFLAG_WRITEABLE		0x2
@@ -54,6 +44,14 @@ class PageDirectory;
 
 #define LINK_START	((1024+64)/4)			//Start right after the HMA
 
+// CR4 bits supported by the paging unit
+#define CR4_PSE		0x10	// 4 MB pages
+#define CR4_PGE		0x80	// global pages survive CR3 reloads
+
+// Flags of the TLB entries
+#define TLB_GLOBAL	0x1	// mapped by a global page
+#define TLB_LARGE	0x2	// mapped by a 4 MB page
+
 //Allow 128 mb of memory to be linked
 #define PAGING_LINKS (128*1024/4)
 
@@ -85,8 +83,16 @@ bool PAGING_Enabled();
 
 Bitu PAGING_GetDirBase();
 void PAGING_SetDirBase(Bitu cr3);
+Bitu PAGING_GetCR4();
+void PAGING_SetCR4(Bitu cr4);
 void PAGING_InitTLB();
 void PAGING_ClearTLB();
+// Invalidate the TLB entry of a single linear address (INVLPG)
+void PAGING_InvalidatePage(PhysPt lin_addr);
+// Invalidate the TLB entries that map any of the given physical pages
+void PAGING_UnlinkPhysPages(Bitu phys_page, Bitu pages);
+void PAGING_LogTLBStats();
+void PAGING_ResetTLBStats();
 
 void PAGING_LinkPage(uint32_t lin_page,uint32_t phys_page);
 void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page);
@@ -141,26 +147,14 @@ union X86PageEntry {
 	X86_PageEntryBlock block;
 };
 
-#if !defined(USE_FULL_TLB)
-typedef struct {
-	HostPt read  = {};
-	HostPt write = {};
-
-	PageHandler* readhandler  = {};
-	PageHandler* writehandler = {};
-
-	uint32_t phys_page = {};
-} tlb_entry = {};
-#endif
-
 struct PagingBlock {
 	uint32_t cr3 = 0;
 	uint32_t cr2 = 0;
+	uint32_t cr4 = 0;
 	struct {
 		uint32_t page = 0;
 		PhysPt addr   = {};
 	} base = {};
-#if defined(USE_FULL_TLB)
 	struct {
 		HostPt read[TLB_SIZE]  = {};
 		HostPt write[TLB_SIZE] = {};
@@ -169,11 +163,20 @@ struct PagingBlock {
 		std::vector<PageHandler*> writehandler = std::vector<PageHandler*>(TLB_SIZE);
 
 		std::vector<uint32_t> phys_page = std::vector<uint32_t>(TLB_SIZE);
+		std::vector<uint8_t> flags      = std::vector<uint8_t>(TLB_SIZE);
 	} tlb = {};
-#else
-	std::vector<tlb_entry> tlbh        = std::vector<tlb_entry>(TLB_SIZE);
-	std::vector<tlb_entry*> tlbh_banks = std::vector<tlb_entry*>(TLB_BANKS);
-#endif
+	// Counters shown by the debugger's TLB command. Accesses that hit
+	// a host pointer in the TLB aren't counted to keep that path short.
+	struct {
+		uint64_t misses           = 0; // page walks on a TLB miss
+		uint64_t large_page_walks = 0; // misses resolved by a 4 MB page
+		uint64_t full_flushes     = 0;
+		uint64_t flushed_entries  = 0;
+		uint64_t cr3_reloads      = 0;
+		uint64_t global_kept      = 0; // entries kept over CR3 reloads
+		uint64_t page_invalidates = 0; // INVLPG
+		uint64_t phys_invalidates = 0; // physical page handler changes
+	} stats = {};
 	struct {
 		uint32_t used = 0;
 		std::vector<uint32_t> entries = std::vector<uint32_t>(PAGING_LINKS);
@@ -201,8 +204,6 @@ bool mem_unalignedreadd_checked(PhysPt address,uint32_t * val);
 bool mem_unalignedwritew_checked(PhysPt address,uint16_t val);
 bool mem_unalignedwrited_checked(PhysPt address,uint32_t val);
 
-#if defined(USE_FULL_TLB)
-
 inline HostPt* PAGING_GetReadBaseAddress()
 {
 	return &(paging.tlb.read[0]);
@@ -236,167 +237,156 @@ static inline PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 	return (paging.tlb.phys_page[linAddr>>12]<<12)|(linAddr&0xfff);
 }
 
-#else
-
-void PAGING_InitTLBBank(tlb_entry **bank);
-
-static inline tlb_entry *get_tlb_entry(PhysPt address) {
-	Bitu index=(address>>12);
-	if (TLB_BANKS && (index >= TLB_SIZE)) {
-		Bitu bank=(address>>BANK_SHIFT) - 1;
-		if (!paging.tlbh_banks[bank])
-			PAGING_InitTLBBank(&paging.tlbh_banks[bank]);
-		return &paging.tlbh_banks[bank][index & BANK_MASK];
-	}
-	return &paging.tlbh[index];
+/* Special inlined memory reading/writing
+
+   The inlined accessors only deal with accesses within a single page that's
+   mapped to host memory, which covers nearly all accesses to RAM and ROM.
+   Everything else, i.e. pages backed by a handler (MMIO, VGA memory, code
+   pages of the dynamic cores, pages not linked into the TLB yet) and
+   accesses crossing a page boundary, goes through the out-of-line
+   mem_*_slow functions. This keeps the code inlined into every memory
+   operand of the CPU cores down to a TLB lookup and a host memory access.
+*/
+
+uint8_t mem_readb_slow(PhysPt address) GCC_ATTRIBUTE(cold);
+uint16_t mem_readw_slow(PhysPt address) GCC_ATTRIBUTE(cold);
+uint32_t mem_readd_slow(PhysPt address) GCC_ATTRIBUTE(cold);
+void mem_writeb_slow(PhysPt address, uint8_t val) GCC_ATTRIBUTE(cold);
+void mem_writew_slow(PhysPt address, uint16_t val) GCC_ATTRIBUTE(cold);
+void mem_writed_slow(PhysPt address, uint32_t val) GCC_ATTRIBUTE(cold);
+
+bool mem_readb_checked_slow(PhysPt address, uint8_t* val) GCC_ATTRIBUTE(cold);
+bool mem_readw_checked_slow(PhysPt address, uint16_t* val) GCC_ATTRIBUTE(cold);
+bool mem_readd_checked_slow(PhysPt address, uint32_t* val) GCC_ATTRIBUTE(cold);
+bool mem_writeb_checked_slow(PhysPt address, uint8_t val) GCC_ATTRIBUTE(cold);
+bool mem_writew_checked_slow(PhysPt address, uint16_t val) GCC_ATTRIBUTE(cold);
+bool mem_writed_checked_slow(PhysPt address, uint32_t val) GCC_ATTRIBUTE(cold);
+
+// True if an access of the given type at the address stays within its page
+template <typename T>
+static inline bool mem_access_in_page(const PhysPt address)
+{
+	return (address & 0xfff) <= (MEM_PAGE_SIZE - sizeof(T));
 }
 
-static inline HostPt get_tlb_read(PhysPt address) {
-	return get_tlb_entry(address)->read;
-}
-static inline HostPt get_tlb_write(PhysPt address) {
-	return get_tlb_entry(address)->write;
+// Host pointer to access an object of the given type at the linear address
+// through, or nullptr if the access has to take the slow path
+template <typename T>
+static inline HostPt mem_host_read_pt(const PhysPt address)
+{
+	const HostPt tlb_addr = get_tlb_read(address);
+	if (GCC_LIKELY(tlb_addr && mem_access_in_page<T>(address)))
+		return tlb_addr + address;
+	return nullptr;
 }
 
-inline HostPt* PAGING_GetReadBaseAddress()
+template <typename T>
+static inline HostPt mem_host_write_pt(const PhysPt address)
 {
-	return get_tlb_read(0);
+	const HostPt tlb_addr = get_tlb_write(address);
+	if (GCC_LIKELY(tlb_addr && mem_access_in_page<T>(address)))
+		return tlb_addr + address;
+	return nullptr;
 }
 
-inline HostPt* PAGING_GetWriteBaseAddress()
+static inline uint8_t mem_readb_inline(const PhysPt address)
 {
-	return get_tlb_write(0);
+	if (const auto host_pt = mem_host_read_pt<uint8_t>(address))
+		return host_readb(host_pt);
+	return mem_readb_slow(address);
 }
 
-static inline PageHandler* get_tlb_readhandler(PhysPt address)
+static inline uint16_t mem_readw_inline(const PhysPt address)
 {
-	return get_tlb_entry(address)->readhandler;
-}
-static inline PageHandler* get_tlb_writehandler(PhysPt address) {
-	return get_tlb_entry(address)->writehandler;
+	if (const auto host_pt = mem_host_read_pt<uint16_t>(address))
+		return host_readw(host_pt);
+	return mem_readw_slow(address);
 }
 
-/* Use these helper functions to access linear addresses in readX/writeX functions */
-static inline PhysPt PAGING_GetPhysicalPage(PhysPt linePage) {
-	tlb_entry *entry = get_tlb_entry(linePage);
-	return (entry->phys_page<<12);
+static inline uint32_t mem_readd_inline(const PhysPt address)
+{
+	if (const auto host_pt = mem_host_read_pt<uint32_t>(address))
+		return host_readd(host_pt);
+	return mem_readd_slow(address);
 }
 
-static inline PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
-	tlb_entry *entry = get_tlb_entry(linAddr);
-	return (entry->phys_page<<12)|(linAddr&0xfff);
+static inline void mem_writeb_inline(const PhysPt address, const uint8_t val)
+{
+	if (const auto host_pt = mem_host_write_pt<uint8_t>(address))
+		host_writeb(host_pt, val);
+	else
+		mem_writeb_slow(address, val);
 }
-#endif
 
-/* Special inlined memory reading/writing */
-
-static inline uint8_t mem_readb_inline(PhysPt address) {
-	HostPt tlb_addr=get_tlb_read(address);
-	if (tlb_addr) return host_readb(tlb_addr+address);
+static inline void mem_writew_inline(const PhysPt address, const uint16_t val)
+{
+	if (const auto host_pt = mem_host_write_pt<uint16_t>(address))
+		host_writew(host_pt, val);
 	else
-		return (get_tlb_readhandler(address))->readb(address);
+		mem_writew_slow(address, val);
 }
 
-static inline uint16_t mem_readw_inline(PhysPt address) {
-	if ((address & 0xfff)<0xfff) {
-		HostPt tlb_addr=get_tlb_read(address);
-		if (tlb_addr) return host_readw(tlb_addr+address);
-		else
-			return (get_tlb_readhandler(address))->readw(address);
-	} else return mem_unalignedreadw(address);
+static inline void mem_writed_inline(const PhysPt address, const uint32_t val)
+{
+	if (const auto host_pt = mem_host_write_pt<uint32_t>(address))
+		host_writed(host_pt, val);
+	else
+		mem_writed_slow(address, val);
 }
 
-static inline uint32_t mem_readd_inline(PhysPt address)
+// The checked variants return true if the access caused a page fault
+static inline bool mem_readb_checked(const PhysPt address, uint8_t* val)
 {
-	if ((address & 0xfff) < 0xffd) {
-		HostPt tlb_addr = get_tlb_read(address);
-		if (tlb_addr)
-			return host_readd(tlb_addr + address);
-		else
-			return get_tlb_readhandler(address)->readd(address);
-	} else {
-		return mem_unalignedreadd(address);
+	if (const auto host_pt = mem_host_read_pt<uint8_t>(address)) {
+		*val = host_readb(host_pt);
+		return false;
 	}
+	return mem_readb_checked_slow(address, val);
 }
 
-static inline void mem_writeb_inline(PhysPt address,uint8_t val) {
-	HostPt tlb_addr=get_tlb_write(address);
-	if (tlb_addr) host_writeb(tlb_addr+address,val);
-	else (get_tlb_writehandler(address))->writeb(address,val);
-}
-
-static inline void mem_writew_inline(PhysPt address,uint16_t val) {
-	if ((address & 0xfff)<0xfff) {
-		HostPt tlb_addr=get_tlb_write(address);
-		if (tlb_addr) host_writew(tlb_addr+address,val);
-		else (get_tlb_writehandler(address))->writew(address,val);
-	} else mem_unalignedwritew(address,val);
-}
-
-static inline void mem_writed_inline(PhysPt address,uint32_t val) {
-	if ((address & 0xfff)<0xffd) {
-		HostPt tlb_addr=get_tlb_write(address);
-		if (tlb_addr) host_writed(tlb_addr+address,val);
-		else (get_tlb_writehandler(address))->writed(address,val);
-	} else mem_unalignedwrited(address,val);
-}
-
-
-static inline bool mem_readb_checked(PhysPt address, uint8_t * val) {
-	HostPt tlb_addr=get_tlb_read(address);
-	if (tlb_addr) {
-		*val=host_readb(tlb_addr+address);
+static inline bool mem_readw_checked(const PhysPt address, uint16_t* val)
+{
+	if (const auto host_pt = mem_host_read_pt<uint16_t>(address)) {
+		*val = host_readw(host_pt);
 		return false;
-	} else return (get_tlb_readhandler(address))->readb_checked(address, val);
-}
-
-static inline bool mem_readw_checked(PhysPt address, uint16_t * val) {
-	if ((address & 0xfff)<0xfff) {
-		HostPt tlb_addr=get_tlb_read(address);
-		if (tlb_addr) {
-			*val=host_readw(tlb_addr+address);
-			return false;
-		} else return (get_tlb_readhandler(address))->readw_checked(address, val);
-	} else return mem_unalignedreadw_checked(address, val);
+	}
+	return mem_readw_checked_slow(address, val);
 }
 
-static inline bool mem_readd_checked(PhysPt address, uint32_t * val) {
-	if ((address & 0xfff)<0xffd) {
-		HostPt tlb_addr=get_tlb_read(address);
-		if (tlb_addr) {
-			*val=host_readd(tlb_addr+address);
-			return false;
-		} else return (get_tlb_readhandler(address))->readd_checked(address, val);
-	} else return mem_unalignedreadd_checked(address, val);
+static inline bool mem_readd_checked(const PhysPt address, uint32_t* val)
+{
+	if (const auto host_pt = mem_host_read_pt<uint32_t>(address)) {
+		*val = host_readd(host_pt);
+		return false;
+	}
+	return mem_readd_checked_slow(address, val);
 }
 
-static inline bool mem_writeb_checked(PhysPt address,uint8_t val) {
-	HostPt tlb_addr=get_tlb_write(address);
-	if (tlb_addr) {
-		host_writeb(tlb_addr+address,val);
+static inline bool mem_writeb_checked(const PhysPt address, const uint8_t val)
+{
+	if (const auto host_pt = mem_host_write_pt<uint8_t>(address)) {
+		host_writeb(host_pt, val);
 		return false;
-	} else return (get_tlb_writehandler(address))->writeb_checked(address,val);
+	}
+	return mem_writeb_checked_slow(address, val);
 }
 
-static inline bool mem_writew_checked(PhysPt address,uint16_t val) {
-	if ((address & 0xfff)<0xfff) {
-		HostPt tlb_addr=get_tlb_write(address);
-		if (tlb_addr) {
-			host_writew(tlb_addr+address,val);
-			return false;
-		} else return (get_tlb_writehandler(address))->writew_checked(address,val);
-	} else return mem_unalignedwritew_checked(address,val);
+static inline bool mem_writew_checked(const PhysPt address, const uint16_t val)
+{
+	if (const auto host_pt = mem_host_write_pt<uint16_t>(address)) {
+		host_writew(host_pt, val);
+		return false;
+	}
+	return mem_writew_checked_slow(address, val);
 }
 
-static inline bool mem_writed_checked(PhysPt address,uint32_t val) {
-	if ((address & 0xfff)<0xffd) {
-		HostPt tlb_addr=get_tlb_write(address);
-		if (tlb_addr) {
-			host_writed(tlb_addr+address,val);
-			return false;
-		} else return (get_tlb_writehandler(address))->writed_checked(address,val);
-	} else return mem_unalignedwrited_checked(address,val);
+static inline bool mem_writed_checked(const PhysPt address, const uint32_t val)
+{
+	if (const auto host_pt = mem_host_write_pt<uint32_t>(address)) {
+		host_writed(host_pt, val);
+		return false;
+	}
+	return mem_writed_checked_slow(address, val);
 }
 
-
 #endif
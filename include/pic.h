@@ -31,6 +31,12 @@ extern int32_t CPU_CycleMax;
 typedef void(PIC_EOIHandler)();
 typedef void (*PIC_EventHandler)(uint32_t val);
 
+// Identifies a scheduled event, see PIC_RemoveEvent
+struct PIC_EventHandle {
+	uint32_t slot   = UINT32_MAX;
+	uint32_t serial = 0;
+};
+
 extern uint32_t PIC_IRQCheck;
 
 // Elapsed milliseconds since starting DOSBox
@@ -69,7 +75,9 @@ void PIC_runIRQs();
 bool PIC_RunQueue();
 
 //Delay in milliseconds
-void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val = 0);
+PIC_EventHandle PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val = 0);
+// Returns false if the event already ran or was removed before
+bool PIC_RemoveEvent(PIC_EventHandle handle);
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val);
 
@@ -0,0 +1,276 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_PIC_EVENT_QUEUE_H
+#define DOSBOX_PIC_EVENT_QUEUE_H
+
+/*  PIC Event Queue
+ *  ---------------
+ *  An indexed binary min-heap holding the scheduled PIC events, ordered by
+ *  their index (the time they're due at, in milliseconds relative to the
+ *  start of the current tick). Events that are due at the same index are
+ *  serviced in the order they were added.
+ *
+ *  Every event lives in a slot that remembers its position in the heap, so an
+ *  event can be cancelled through the handle returned when it was added
+ *  without searching the queue. Slots are recycled and carry a serial number,
+ *  which makes handles of events that already ran or were cancelled go stale
+ *  instead of matching a newer event.
+ *
+ *  Inserting, popping and cancelling by handle are O(log n). The queue grows
+ *  as needed, so there's no capacity limit.
+ */
+
+#include "pic.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+class PIC_EventQueue {
+public:
+	struct Event {
+		double index             = 0.0;
+		PIC_EventHandler handler = nullptr;
+		uint32_t value           = 0;
+	};
+
+	PIC_EventQueue()                                       = default;
+	PIC_EventQueue(const PIC_EventQueue& other)            = delete;
+	PIC_EventQueue& operator=(const PIC_EventQueue& other) = delete;
+
+	bool IsEmpty() const
+	{
+		return heap.empty();
+	}
+
+	size_t Size() const
+	{
+		return heap.size();
+	}
+
+	// The event that's due first, the queue must not be empty
+	const Event& Top() const
+	{
+		assert(!heap.empty());
+		return slots[heap.front()].event;
+	}
+
+	PIC_EventHandle Add(const Event& event)
+	{
+		uint32_t slot_num = 0;
+		if (free_slots.empty()) {
+			slot_num = static_cast<uint32_t>(slots.size());
+			slots.emplace_back();
+		} else {
+			slot_num = free_slots.back();
+			free_slots.pop_back();
+		}
+		auto& slot    = slots[slot_num];
+		slot.event    = event;
+		slot.sequence = next_sequence++;
+		slot.position = heap.size();
+		slot.in_use   = true;
+
+		heap.push_back(slot_num);
+		SiftUp(slot.position);
+
+		return {slot_num, slot.serial};
+	}
+
+	// Remove and return the event that's due first
+	Event Pop()
+	{
+		assert(!heap.empty());
+		const auto event = slots[heap.front()].event;
+		RemoveAt(0);
+		return event;
+	}
+
+	// Returns false if the event already ran or was cancelled before
+	bool Remove(const PIC_EventHandle handle)
+	{
+		if (!IsPending(handle)) {
+			return false;
+		}
+		RemoveAt(slots[handle.slot].position);
+		return true;
+	}
+
+	bool IsPending(const PIC_EventHandle handle) const
+	{
+		return handle.slot < slots.size() && slots[handle.slot].in_use &&
+		       slots[handle.slot].serial == handle.serial;
+	}
+
+	// Remove all events the predicate returns true for, in O(n)
+	template <typename Predicate>
+	void RemoveIf(Predicate predicate)
+	{
+		size_t kept = 0;
+		for (const auto slot_num : heap) {
+			if (predicate(static_cast<const Event&>(slots[slot_num].event))) {
+				ReleaseSlot(slot_num);
+			} else {
+				heap[kept++] = slot_num;
+			}
+		}
+		if (kept == heap.size()) {
+			return;
+		}
+		heap.resize(kept);
+		for (size_t pos = 0; pos < heap.size(); ++pos) {
+			slots[heap[pos]].position = pos;
+		}
+		// restore the heap property bottom-up
+		for (size_t pos = heap.size() / 2; pos-- > 0;) {
+			SiftDown(pos);
+		}
+	}
+
+	// Move all events closer by the given amount; as every index changes by
+	// the same amount the order of the events stays the same
+	void ShiftIndexes(const double amount)
+	{
+		for (const auto slot_num : heap) {
+			slots[slot_num].event.index -= amount;
+		}
+	}
+
+	// All events in the order they're serviced in; adding them in this
+	// order to an empty queue recreates it
+	std::vector<Event> GetEvents() const
+	{
+		auto order = heap;
+		std::sort(order.begin(),
+		          order.end(),
+		          [this](const uint32_t a, const uint32_t b) {
+			          return IsBefore(a, b);
+		          });
+		std::vector<Event> events = {};
+		events.reserve(order.size());
+		for (const auto slot_num : order) {
+			events.push_back(slots[slot_num].event);
+		}
+		return events;
+	}
+
+	void Clear()
+	{
+		for (const auto slot_num : heap) {
+			ReleaseSlot(slot_num);
+		}
+		heap.clear();
+	}
+
+private:
+	struct Slot {
+		Event event       = {};
+		uint64_t sequence = 0; // orders events that are due at the same index
+		size_t position   = 0; // position of the slot in the heap
+		uint32_t serial   = 0; // incremented every time the slot is released
+		bool in_use       = false;
+	};
+
+	bool IsBefore(const uint32_t a, const uint32_t b) const
+	{
+		const auto& slot_a = slots[a];
+		const auto& slot_b = slots[b];
+		if (slot_a.event.index != slot_b.event.index) {
+			return slot_a.event.index < slot_b.event.index;
+		}
+		return slot_a.sequence < slot_b.sequence;
+	}
+
+	void Place(const size_t pos, const uint32_t slot_num)
+	{
+		heap[pos]                = slot_num;
+		slots[slot_num].position = pos;
+	}
+
+	void SiftUp(size_t pos)
+	{
+		const auto slot_num = heap[pos];
+		while (pos > 0) {
+			const auto parent = (pos - 1) / 2;
+			if (!IsBefore(slot_num, heap[parent])) {
+				break;
+			}
+			Place(pos, heap[parent]);
+			pos = parent;
+		}
+		Place(pos, slot_num);
+	}
+
+	void SiftDown(size_t pos)
+	{
+		const auto slot_num = heap[pos];
+		const auto size     = heap.size();
+		while (true) {
+			auto child = pos * 2 + 1;
+			if (child >= size) {
+				break;
+			}
+			if (child + 1 < size && IsBefore(heap[child + 1], heap[child])) {
+				++child;
+			}
+			if (!IsBefore(heap[child], slot_num)) {
+				break;
+			}
+			Place(pos, heap[child]);
+			pos = child;
+		}
+		Place(pos, slot_num);
+	}
+
+	void RemoveAt(const size_t pos)
+	{
+		assert(pos < heap.size());
+		ReleaseSlot(heap[pos]);
+
+		const auto last = heap.back();
+		heap.pop_back();
+		if (pos == heap.size()) {
+			return;
+		}
+		Place(pos, last);
+		if (pos > 0 && IsBefore(last, heap[(pos - 1) / 2])) {
+			SiftUp(pos);
+		} else {
+			SiftDown(pos);
+		}
+	}
+
+	void ReleaseSlot(const uint32_t slot_num)
+	{
+		auto& slot  = slots[slot_num];
+		slot.in_use = false;
+		++slot.serial;
+		free_slots.push_back(slot_num);
+	}
+
+	std::vector<Slot> slots          = {};
+	std::vector<uint32_t> heap       = {}; // slot numbers, ordered as a heap
+	std::vector<uint32_t> free_slots = {};
+	uint64_t next_sequence           = 0;
+};
+
+#endif
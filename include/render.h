@@ -104,6 +104,9 @@ void RENDER_SetSize(uint32_t width, uint32_t height, unsigned bpp, double fps,
 
 bool RENDER_StartUpdate(void);
 void RENDER_EndUpdate(bool abort);
+// Waits for the render thread to finish the lines queued so far, so the frame
+// buffer is safe to hand back to the video output
+void RENDER_FlushQueuedFrame();
 void RENDER_InitShaderSource([[maybe_unused]] Section *sec);
 void RENDER_SetPal(uint8_t entry, uint8_t red, uint8_t green, uint8_t blue);
 
@@ -0,0 +1,118 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_REPLAY_H
+#define DOSBOX_REPLAY_H
+
+/*  Input Recording and Replay
+ *  --------------------------
+ *  Started with '--record <file>', everything from the host that steers the
+ *  emulation is logged: the keyboard and mouse input, and the cycles the CPU
+ *  runs in each emulated millisecond, which follow the speed of the host with
+ *  'cycles = auto' or 'max', or when changed with the hotkeys. Each event is
+ *  stamped with the emulated millisecond it's delivered on. Input from the
+ *  host is held back until the next millisecond boundary, so its effect
+ *  doesn't depend on when exactly the host produced it.
+ *
+ *  Started with '--replay <file>', the input of the host is ignored and the
+ *  recorded events are delivered at the same points, with the emulation
+ *  running as fast as it can. With the same configuration and the same
+ *  files, the session replays bit-identically, so it can serve as the
+ *  workload of a benchmark (see benchmark.h). The emulator exits at the end
+ *  of the replay.
+ *
+ *  To keep the host's clock out of the emulation in both modes, the date and
+ *  time of the guest start at the time the recording began and advance with
+ *  the emulated time, and the mixer runs in nosound mode, as the pace of the
+ *  audio device decides how much the emulated sound cards generate.
+ *  Joysticks are neither recorded nor replayed.
+ *
+ *  The file starts with a magic string, the format version and the start
+ *  time. Then each event follows as a variable-length tick delta, the event
+ *  type and its payload, with integers as variable-length quantities.
+ */
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+enum class ReplayEventType : uint8_t {
+	End,
+	Cycles,
+	Key,
+	ClearKeyboard,
+	MouseMoved,
+	MouseButton,
+	MouseWheel,
+};
+
+struct ReplayEvent {
+	ReplayEventType type = ReplayEventType::End;
+
+	// Cycles
+	int32_t cycle_max      = 0;
+	bool cycle_auto_adjust = false;
+
+	// Key (KBD_KEYS) or MouseButton
+	uint8_t code = 0;
+	bool pressed = false;
+
+	// Mouse events, MouseInterfaceId::None for the host pointer
+	uint8_t mouse_interface = 0;
+	float x_rel             = 0.0f;
+	float y_rel             = 0.0f;
+	uint32_t x_abs          = 0;
+	uint32_t y_abs          = 0;
+	int16_t wheel           = 0;
+
+	bool operator==(const ReplayEvent& other) const;
+};
+
+// Set while recording or replaying
+extern bool replay_active;
+
+bool REPLAY_StartRecording(const std::string& path);
+bool REPLAY_StartReplay(const std::string& path);
+
+// Finishes the recording
+void REPLAY_Stop();
+
+// Called on every emulated millisecond boundary, before the tick runs
+void REPLAY_Tick();
+
+// Called by the input paths with an event from the host. Returns true if the
+// event was taken over, that is held back for the next tick when recording
+// or dropped when replaying, and false if it should be processed as usual.
+bool REPLAY_InterceptEvent(const ReplayEvent& event);
+
+// The local date and time of the guest: the host's, or the emulated one
+// while recording or replaying
+void REPLAY_GetLocalTime(struct tm& datetime, uint32_t& milliseconds);
+
+// The file format, exposed for testing
+void REPLAY_EncodeEvent(std::vector<uint8_t>& out, int64_t tick_delta,
+                        const ReplayEvent& event);
+
+// Returns false if the data is truncated or malformed
+bool REPLAY_DecodeEvent(const uint8_t*& pos, const uint8_t* end,
+                        int64_t& tick_delta, ReplayEvent& event);
+
+#endif
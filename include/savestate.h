@@ -0,0 +1,173 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SAVESTATE_H
+#define DOSBOX_SAVESTATE_H
+
+/*  Save States
+ *  -----------
+ *  A snapshot of the machine is made of memory regions, the guest RAM and
+ *  the video memory, and of components, the state of a device or module
+ *  written by its save handler. Each module registers its component under a
+ *  name and a version, which is bumped whenever the layout of its state
+ *  changes.
+ *
+ *  States are saved into slot files in the 'savestates' directory of the
+ *  configuration directory, with the hotkeys to save, load and select the
+ *  next slot. Both run on the next emulated millisecond boundary, where no
+ *  instruction or event is half-way done.
+ *
+ *  A slot file holds a header and one or more records, each compressed with
+ *  zlib. The first record holds every page of the memory regions. Saving to
+ *  the slot that was saved or loaded last appends a record with only the
+ *  pages that changed since, found by comparing against a copy of the
+ *  regions kept at that point, so saves are quick; after a number of
+ *  appended records the slot is written anew. Every record holds the state
+ *  of all components, and loading applies the page records in order and
+ *  then the components of the last record.
+ *
+ *  The state refers to functions of the emulator (the pending PIC events,
+ *  the CPU core), so a state can only be loaded by the same build, with the
+ *  same configuration, and with the machine at the same depth of nested
+ *  runs, which the host-side DOS shell and callbacks leave on the host's
+ *  stack. Loading checks all of these and refuses otherwise. The run depth
+ *  is kept in the uncompressed header of each record, so a state given on
+ *  the command line can wait for its depth without loading the file.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "std_filesystem.h"
+
+class SaveStateWriter {
+public:
+	template <typename T>
+	void Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		WriteBytes(&value, sizeof(value));
+	}
+
+	void WriteBytes(const void* bytes, size_t num_bytes);
+	void WriteString(const std::string& value);
+
+	// Functions are written as offsets within the binary, which stay the
+	// same when the binary is loaded at a different address
+	template <typename F>
+	void WriteFunction(F* function)
+	{
+		static_assert(std::is_function_v<F>);
+		WriteFunctionAddress(reinterpret_cast<uintptr_t>(function));
+	}
+
+	const std::vector<uint8_t>& GetData() const
+	{
+		return data;
+	}
+
+private:
+	void WriteFunctionAddress(uintptr_t address);
+
+	std::vector<uint8_t> data = {};
+};
+
+class SaveStateReader {
+public:
+	SaveStateReader(const uint8_t* bytes, size_t num_bytes)
+	        : pos(bytes),
+	          end(bytes + num_bytes)
+	{}
+
+	template <typename T>
+	void Read(T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		ReadBytes(&value, sizeof(value));
+	}
+
+	// Reading past the end fails the reader and yields zeroes
+	void ReadBytes(void* bytes, size_t num_bytes);
+	std::string ReadString();
+
+	// Returns the next bytes in place, or nullptr past the end
+	const uint8_t* ReadSpan(size_t num_bytes);
+
+	template <typename F>
+	void ReadFunction(F*& function)
+	{
+		static_assert(std::is_function_v<F>);
+		function = reinterpret_cast<F*>(ReadFunctionAddress());
+	}
+
+	bool IsOk() const
+	{
+		return ok;
+	}
+
+	bool AtEnd() const
+	{
+		return pos == end;
+	}
+
+private:
+	uintptr_t ReadFunctionAddress();
+
+	const uint8_t* pos = nullptr;
+	const uint8_t* end = nullptr;
+	bool ok            = true;
+};
+
+using SAVESTATE_SaveHandler = void (*)(SaveStateWriter& writer);
+using SAVESTATE_LoadHandler = void (*)(SaveStateReader& reader);
+
+// Components are loaded in the order they were first added; adding one
+// with a name that's already taken replaces its handlers
+void SAVESTATE_AddComponent(const std::string& name, uint32_t version,
+                            SAVESTATE_SaveHandler save_handler,
+                            SAVESTATE_LoadHandler load_handler);
+void SAVESTATE_RemoveComponent(const std::string& name);
+
+// Memory regions are restored before the components are loaded
+void SAVESTATE_AddRegion(const std::string& name, uint8_t* data, size_t size);
+void SAVESTATE_RemoveRegion(const std::string& name);
+
+// Set when a hotkey asked to save or load a state
+extern bool savestate_pending;
+
+void SAVESTATE_Init();
+
+// Called on an emulated millisecond boundary to save or load the state the
+// hotkeys asked for
+void SAVESTATE_RunPending();
+
+// Loads the state on the first emulated millisecond boundary at the run
+// depth it was saved at, typically once the autoexec has started the same
+// program again; the RAM image set in the configuration is written from it
+void SAVESTATE_LoadAtStart(const std_fs::path& path);
+
+// Save and load right away; the caller has to be at a safe point
+bool SAVESTATE_Save(const std_fs::path& path);
+bool SAVESTATE_Load(const std_fs::path& path);
+
+#endif
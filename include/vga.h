@@ -22,15 +22,15 @@
 #include "dosbox.h"
 
 #include <utility>
+#include <vector>
 
 #include "bit_view.h"
 #include "control.h"
 #include "inout.h"
 
-//Don't enable keeping changes and mapping lfb probably...
+// Map the linear framebuffer directly, unless video memory writes are tracked
 #define VGA_LFB_MAPPED
-//#define VGA_KEEP_CHANGES
-#define VGA_CHANGE_SHIFT	9
+#define VGA_CHANGE_SHIFT	7
 
 class PageHandler;
 
@@ -479,16 +479,20 @@ struct VGA_Memory {
 	uint8_t* linear = {};
 };
 
+// Tracks the spans of video memory (1 << VGA_CHANGE_SHIFT bytes each) that
+// were written since they were last drawn. The memory handlers set the write
+// bit of a span; each drawn frame checks both bits and then clears the one the
+// previous frame wrote, while the writes during the frame go to the other one.
 struct VGA_Changes {
-	//Add a few more just to be safe
-	uint8_t *map = nullptr; /* allocated dynamically: [(VGA_MEMORY >> VGA_CHANGE_SHIFT) + 32] */
-	uint8_t checkMask = 0;
-	uint8_t frame = 0;
-	uint8_t writeMask = 0;
-	bool active = 0;
-	uint32_t clearMask = 0;
-	uint32_t start = 0, last = 0;
-	uint32_t lastAddress = 0;
+	std::vector<uint8_t> map = {};
+	uint8_t write_mask       = 1;
+	uint8_t check_mask       = 0;
+	uint8_t clear_mask       = 0xff;
+	bool is_enabled          = false; // the memory handlers track all writes
+	bool is_active           = false; // this frame skips the unchanged lines
+	bool needs_full_frame    = true;
+	uint32_t line_bytes      = 0;
+	uint32_t first_span = 0, last_span = 0;
 };
 
 struct VGA_LFB {
@@ -523,9 +527,7 @@ struct VGA_Type {
 	 // always twice as big as vmemsize
 	uint8_t* fastmem  = {};
 	uint32_t vmemsize = 0;
-#ifdef VGA_KEEP_CHANGES
 	VGA_Changes changes = {};
-#endif
 	VGA_LFB lfb = {};
 	// Composite video mode parameters
 	int ri = 0, rq = 0, gi = 0, gq = 0, bi = 0, bq = 0;
@@ -610,6 +612,35 @@ bool VGA_IsDoubleScanningSub350LineModes();
 
 extern VGA_Type vga;
 
+// Converts the 4-plane EGA/VGA memory to 4-bit pixels. Each group holds the
+// bytes of planes 0 to 3 for 8 pixels, and becomes 8 pixels with the leftmost
+// one, taken from the high bits, first.
+void VGA_PlanesToPixels(const uint8_t* planes, uint8_t* pixels, size_t num_groups);
+
+// Records a write to the video memory at the given address, in the address
+// space the lines are drawn from
+static inline void VGA_MemoryChanged(const uint32_t address)
+{
+	auto& changes = vga.changes;
+	// the handlers of the planar modes mark every write, tracking or not
+	if (!changes.is_enabled) {
+		return;
+	}
+	changes.map[(address >> VGA_CHANGE_SHIFT) & (changes.map.size() - 1)] |=
+	        changes.write_mask;
+}
+
+// Draws every line of the current and the next frame, for changes to the
+// picture that don't go through the video memory
+void VGA_RedrawFrame();
+
+// Draws the frames in one go unless the registers change mid-frame
+void VGA_SetFrameBatching(bool enabled);
+
+// Called on writes to the registers that take effect on the next line drawn,
+// such as the palette, to draw the frames in parts while programs do so
+void VGA_ChangedRasterRegister();
+
 /* Support for modular SVGA implementation */
 /* Video mode extra data to be passed to FinishSetMode_SVGA().
    This structure will be in flux until all drivers (including S3)
@@ -679,7 +710,6 @@ extern int CGA_Composite_Table[1024];
 extern uint32_t TXT_Font_Table[16];
 extern uint32_t TXT_FG_Table[16];
 extern uint32_t TXT_BG_Table[16];
-extern uint32_t Expand16Table[4][16];
 extern uint32_t Expand16BigTable[0x10000];
 
 #endif
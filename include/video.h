@@ -72,6 +72,9 @@ void GFX_Start(void);
 void GFX_Stop(void);
 void GFX_SwitchFullScreen(void);
 bool GFX_StartUpdate(uint8_t * &pixels, int &pitch);
+// True if GFX_StartUpdate only hands out a buffer in memory, so it's safe to
+// call from another thread than the one that owns the video driver
+bool GFX_HasMemoryFrameBuffer();
 void GFX_EndUpdate( const uint16_t *changedLines );
 void GFX_GetSize(int &width, int &height, bool &fullscreen);
 void GFX_LosingFocus();
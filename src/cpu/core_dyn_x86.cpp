@@ -51,9 +51,8 @@
 #include "tracy.h"
 
 #define CACHE_MAXSIZE	(4096*3)
-#define CACHE_TOTAL		(1024*1024*8)
-#define CACHE_PAGES		(512)
-#define CACHE_BLOCKS	(64*1024)
+#define CACHE_PAGES_PER_MB	(64)
+#define CACHE_BLOCKS_PER_MB	(8*1024)
 #define CACHE_ALIGN		(16)
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
@@ -157,6 +156,7 @@ static struct {
 
 #define dyn_return(a,b) gen_return(a)
 #include "dyn_cache.h"
+#include "dyn_profile.h"
 
 static struct {
 	Bitu callback;
@@ -285,7 +285,7 @@ static BlockReturn sync_normal_fpu_and_run_dyn_code(const uint8_t* code) noexcep
 	return gen_runcode(code);
 }
 
-static Bits sync_dh_fpu_and_run_normal_core() noexcept
+static void sync_dh_fpu_to_normal() noexcept
 {
 	if (last_core == CoreType::Dynamic) {
 		maybe_sync_host_fpu_to_dh();
@@ -296,6 +296,11 @@ static Bits sync_dh_fpu_and_run_normal_core() noexcept
 		FPU_SetPRegsFrom(dyn_dh_fpu.state.st_reg);
 		last_core = CoreType::Normal;
 	}
+}
+
+static Bits sync_dh_fpu_and_run_normal_core() noexcept
+{
+	sync_dh_fpu_to_normal();
 	assert(!dyn_dh_fpu.state_used);
 	return CPU_Core_Normal_Run();
 }
@@ -340,7 +345,26 @@ restart_core:
 	/* Find correct Dynamic Block to run */
 	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
 	if (!block) {
-		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+		if (GCC_UNLIKELY(chandler->IsDemoted(ip_point&4095))) {
+			// the code around here keeps being modified, let the
+			// normal core run a slice of it instead of translating
+			// it over and over again
+			chandler->AgeDemoted();
+			const int32_t old_cycles = CPU_Cycles;
+			const int32_t slice = std::clamp<int32_t>(old_cycles, 1, DYN_SMC_SLICE);
+			CPU_Cycles = slice;
+
+			const auto nc_retcode = sync_dh_fpu_and_run_normal_core();
+
+			if (!nc_retcode) {
+				CPU_Cycles += old_cycles - slice;
+				if (CPU_Cycles <= 0)
+					return CBRET_NONE;
+				goto restart_core;
+			}
+			CPU_CycleLeft += old_cycles - slice;
+			return nc_retcode;
+		} else if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
 			block=CreateCacheBlock(chandler,ip_point,32);
 		} else {
 			int32_t old_cycles=CPU_Cycles;
@@ -358,7 +382,9 @@ restart_core:
 	}
 run_block:
 	cache.block.running=0;
+	if (GCC_UNLIKELY(dyn_profile.enabled)) dyn_profile_enter(block);
 	const auto ret = sync_normal_fpu_and_run_dyn_code(block->cache.start);
+	if (GCC_UNLIKELY(dyn_profile.enabled)) dyn_profile_leave();
 #	if C_DEBUG
 	cycle_count += 32;
 #endif
@@ -416,7 +442,9 @@ run_block:
 			if (temp_handler->flags & (cpu.code.big ? PFLAG_HASCODE32:PFLAG_HASCODE16)) {
 				block=temp_handler->FindCacheBlock(temp_ip & 4095);
 				if (!block || !cache.block.running) goto restart_core;
-				cache.block.running->LinkTo(ret==BR_Link2,block);
+				// profiling needs every block to return here
+				if (!dyn_profile.enabled)
+					cache.block.running->LinkTo(ret==BR_Link2,block);
 				goto run_block;
 			}
 		}
@@ -506,15 +534,46 @@ void CPU_Core_Dyn_X86_Init(void) {
 #	endif
 }
 
+void CPU_Core_Dyn_X86_Cache_SetSize(int megabytes) {
+	cache_set_size(megabytes);
+}
+
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache) {
 	/* Initialize code cache and dynamic blocks */
 	cache_init(enable_cache);
 }
 
 void CPU_Core_Dyn_X86_Cache_Close(void) {
+	if (dyn_profile.enabled) {
+		dyn_profile_report("DYN_X86");
+		dyn_smc_report("DYN_X86");
+	}
 	cache_close();
 }
 
+void CPU_Core_Dyn_X86_Cache_Flush()
+{
+	cache_flush();
+}
+
+// Brings the emulated FPU up to date with the dynamic core's, which picks it
+// up again on its next run
+void CPU_Core_Dyn_X86_SyncFPU() noexcept
+{
+#if defined(X86_DYNFPU_DH_ENABLED)
+	sync_dh_fpu_to_normal();
+#endif
+}
+
+void CPU_Core_Dyn_X86_SetProfiling(bool enable) {
+	dyn_profile.enabled = enable;
+}
+
+void CPU_Core_Dyn_X86_ProfileReport(void) {
+	dyn_profile_report("DYN_X86");
+	dyn_smc_report("DYN_X86");
+}
+
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu) {
 #if defined(X86_DYNFPU_DH_ENABLED)
 	dyn_dh_fpu.dh_fpu_enabled=dh_fpu;
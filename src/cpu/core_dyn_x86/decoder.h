@@ -2254,12 +2254,14 @@ restart_prefix:
 		if (!decode.page.invmap) opcode=decode_fetchb();
 		else {
 			if (decode.page.index<4096) {
-				if (GCC_UNLIKELY(decode.page.invmap[decode.page.index]>=4)) goto illegalopcode;
+				if (GCC_UNLIKELY(decode.page.invmap[decode.page.index]>=4 ||
+					decode.page.code->IsDemoted(decode.page.index))) goto illegalopcode;
 				opcode=decode_fetchb();
 			} else {
 				opcode=decode_fetchb();
 				if (GCC_UNLIKELY(decode.page.invmap && 
-					(decode.page.invmap[decode.page.index-1]>=4))) goto illegalopcode;
+					(decode.page.invmap[decode.page.index-1]>=4 ||
+					 decode.page.code->IsDemoted(decode.page.index-1)))) goto illegalopcode;
 			}
 		}
 		switch (opcode) {
@@ -16,10 +16,36 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../string_bulk.h"
 #include "../string_ops.h"
 
 #include <cassert>
 
+// Called before the generated REP MOVS/STOS loop, does as much of the
+// operation as possible on host memory and leaves the rest to the loop
+static void dyn_string_bulk(PhysPt si_base, PhysPt di_base, uint32_t op, uint32_t big_addr) {
+	if (CPU_Cycles<=0) return;
+	const uint32_t add_mask=big_addr ? 0xffffffff : 0xffff;
+	const uint32_t count=std::min(reg_ecx & add_mask,static_cast<uint32_t>(CPU_Cycles));
+	uint32_t si_index=reg_esi & add_mask;
+	uint32_t di_index=reg_edi & add_mask;
+	uint32_t done=0;
+	switch (op) {
+	case R_MOVSB: done=STRING_BulkMovs<uint8_t>(si_base,si_index,di_base,di_index,add_mask,count);break;
+	case R_MOVSW: done=STRING_BulkMovs<uint16_t>(si_base,si_index,di_base,di_index,add_mask,count);break;
+	case R_MOVSD: done=STRING_BulkMovs<uint32_t>(si_base,si_index,di_base,di_index,add_mask,count);break;
+	case R_STOSB: done=STRING_BulkStos<uint8_t>(di_base,di_index,add_mask,count,reg_al);break;
+	case R_STOSW: done=STRING_BulkStos<uint16_t>(di_base,di_index,add_mask,count,reg_ax);break;
+	case R_STOSD: done=STRING_BulkStos<uint32_t>(di_base,di_index,add_mask,count,reg_eax);break;
+	default: break;
+	}
+	if (!done) return;
+	reg_esi=(reg_esi & ~add_mask) | si_index;
+	reg_edi=(reg_edi & ~add_mask) | di_index;
+	reg_ecx=(reg_ecx & ~add_mask) | ((reg_ecx-done) & add_mask);
+	CPU_Cycles-=static_cast<int32_t>(done);
+}
+
 static void dyn_string(STRING_OP op) {
 	DynReg * si_base=decode.segprefix ? decode.segprefix : DREG(DS);
 	DynReg * di_base=DREG(ES);
@@ -30,6 +56,15 @@ static void dyn_string(STRING_OP op) {
 		gen_releasereg(DREG(CYCLES));
 		decode.cycles=0;
 	}
+	if (decode.rep && ((op>=R_MOVSB && op<=R_MOVSD) || (op>=R_STOSB && op<=R_STOSD))) {
+		/* The helper works on the registers in memory */
+		gen_releasereg(DREG(EAX));
+		gen_releasereg(DREG(ECX));
+		gen_releasereg(DREG(ESI));
+		gen_releasereg(DREG(EDI));
+		gen_call_function((void*)&dyn_string_bulk,"%Dd%Dd%Id%Id",si_base,di_base,
+			static_cast<uint32_t>(op),static_cast<uint32_t>(decode.big_addr));
+	}
 	/* Check what each string operation will be using */
 	switch (op) {
 	case R_MOVSB:	case R_MOVSW:	case R_MOVSD:
@@ -52,13 +52,14 @@
 #include "tracy.h"
 
 #define CACHE_MAXSIZE	(4096*2)
-#define CACHE_TOTAL		(1024*1024*8)
-#define CACHE_PAGES		(512)
-#define CACHE_BLOCKS	(128*1024)
+#define CACHE_PAGES_PER_MB	(64)
+#define CACHE_BLOCKS_PER_MB	(16*1024)
 #define CACHE_ALIGN		(16)
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
+// blocks entered this often are translated again as superblocks
+#define DYN_SUPERBLOCK_HOT	(64)
 
 
 //#define DYN_LOG 1 //Turn Logging on.
@@ -147,6 +148,8 @@ static_assert(offsetof(core_dynrec_t, readdata) % sizeof(uint32_t) == 0,
               "core_dynrec.readdata must be double-word aligned");
 
 #include "dyn_cache.h"
+#include "dyn_profile.h"
+#include "core_dynrec/dyn_persist.h"
 
 #define X86			0x01
 #define X86_64		0x02
@@ -180,6 +183,23 @@ static_assert(offsetof(core_dynrec_t, readdata) % sizeof(uint32_t) == 0,
 
 #include "core_dynrec/decoder.h"
 
+// A hot block that was linked to its successors is worth being translated
+// again as a superblock that continues across its jumps (see decoder.h).
+static bool WantSuperblock(const CacheBlock *block, const CodePageHandler *chandler)
+{
+	if (block->superblock || block->exec_count < DYN_SUPERBLOCK_HOT) {
+		return false;
+	}
+	// leave code that is known to be modified and blocks crossing a
+	// page boundary alone
+	if (chandler->IsModified(block->page.start, block->page.end) ||
+	    block->crossblock) {
+		return false;
+	}
+	return block->link[0].to != &link_blocks[0] ||
+	       block->link[1].to != &link_blocks[1];
+}
+
 CacheBlock *LinkBlocks(BlockReturn ret)
 {
 	// the last instruction was a control flow modifying instruction
@@ -207,8 +227,11 @@ CacheBlock *LinkBlocks(BlockReturn ret)
 		return nullptr;
 	}
 
-	// found it, link the current block to
-	cache.block.running->LinkTo(ret == BR_Link2, cache_block);
+	// found it, link the current block to it unless the blocks are
+	// profiled, which needs every block to return to the run loop
+	if (!dyn_profile.enabled) {
+		cache.block.running->LinkTo(ret == BR_Link2, cache_block);
+	}
 	return cache_block;
 }
 
@@ -248,12 +271,39 @@ Bits CPU_Core_Dynrec_Run() noexcept
 
 		// find correct Dynamic Block to run
 		CacheBlock *block = chandler->FindCacheBlock(ip_point & 4095);
-		if (!block) {
+		if (block && WantSuperblock(block, chandler)) {
+			// replace the block by a superblock of up to 32 instructions
+			block->Clear();
+			block=CreateCacheBlock(chandler,ip_point,32,true);
+		} else if (!block) {
 			// no block found, thus translate the instruction stream
 			// unless the instruction is known to be modified
-			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+			const Bitu page_ip = ip_point & 4095;
+			if (GCC_UNLIKELY(chandler->IsDemoted(page_ip))) {
+				// the code around here keeps being modified, let
+				// the normal core run a slice of it instead of
+				// translating it over and over again
+				chandler->AgeDemoted();
+				const int32_t old_cycles = CPU_Cycles;
+				const int32_t slice = std::clamp<int32_t>(old_cycles, 1, DYN_SMC_SLICE);
+				CPU_Cycles = slice;
+				const Bits nc_retcode = CPU_Core_Normal_Run();
+				if (!nc_retcode) {
+					CPU_Cycles += old_cycles - slice;
+					if (CPU_Cycles <= 0)
+						return CBRET_NONE;
+					continue;
+				}
+				CPU_CycleLeft += old_cycles - slice;
+				return nc_retcode;
+			} else if (!chandler->IsModified(page_ip, page_ip)) {
+				// reuse a translation from an earlier run if possible,
+				// otherwise translate up to 32 instructions
+				block=dyn_persist_lookup(chandler,ip_point);
+				if (!block) block=CreateCacheBlock(chandler,ip_point,32,false);
+			} else if (chandler->invalidation_map[page_ip]<4) {
 				// translate up to 32 instructions
-				block=CreateCacheBlock(chandler,ip_point,32);
+				block=CreateCacheBlock(chandler,ip_point,32,false);
 			} else {
 				// let the normal core handle this instruction to avoid zero-sized blocks
 				Bitu old_cycles=CPU_Cycles;
@@ -272,7 +322,9 @@ run_block:
 		cache.block.running=0;
 		// now we're ready to run the dynamic code block
 //		BlockReturn ret=((BlockReturn (*)(void))(block->cache.start))();
+		if (GCC_UNLIKELY(dyn_profile.enabled)) dyn_profile_enter(block);
 		BlockReturn ret=core_dynrec.runcode(block->cache.start);
+		if (GCC_UNLIKELY(dyn_profile.enabled)) dyn_profile_leave();
 
 		switch (ret) {
 		case BR_Iret:
@@ -373,13 +425,77 @@ Bits CPU_Core_Dynrec_Trap_Run() noexcept
 void CPU_Core_Dynrec_Init(void) {
 }
 
+void CPU_Core_Dynrec_Cache_SetSize(int megabytes) {
+	cache_set_size(megabytes);
+}
+
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
 	// Initialize code cache and dynamic blocks
 	cache_init(enable_cache);
 }
 
 void CPU_Core_Dynrec_Cache_Close(void) {
+	if (dyn_persist.enabled) {
+		dyn_persist_report();
+		dyn_persist_save();
+	}
+	if (dyn_profile.enabled) {
+		dyn_profile_report("DYNREC");
+		dyn_smc_report("DYNREC");
+#ifdef CPU_FPU
+		dyn_fpu_run_report("DYNREC");
+#endif
+	}
 	cache_close();
 }
 
+void CPU_Core_Dynrec_Cache_Flush()
+{
+	cache_flush();
+}
+
+void CPU_Core_Dynrec_SetProfiling(bool enable) {
+	dyn_profile.enabled = enable;
+}
+
+void CPU_Core_Dynrec_ProfileReport(void) {
+	dyn_profile_report("DYNREC");
+	dyn_smc_report("DYNREC");
+#ifdef CPU_FPU
+	dyn_fpu_run_report("DYNREC");
+#endif
+}
+
+// Bytes of host code in the translated blocks
+size_t CPU_Core_Dynrec_CodeSize()
+{
+	size_t bytes = 0;
+	for (const auto& block : cache_blocks) {
+		if (block.page.handler) {
+			bytes += block.cache.size;
+		}
+	}
+	return bytes;
+}
+
+#ifdef CPU_FPU
+void CPU_Core_Dynrec_GetFpuRunStats(uint64_t& instructions, uint64_t& calls)
+{
+	instructions = dyn_fpu_run_stats.instructions;
+	calls        = dyn_fpu_run_stats.calls;
+}
+#endif
+
+void CPU_Core_Dynrec_SetPersistentCache(bool enable) {
+	if (!enable || dyn_persist.enabled) {
+		return;
+	}
+#if defined(DRC_PERSISTENT_CACHE)
+	dyn_persist.enabled = true;
+	dyn_persist_load();
+#else
+	LOG_WARNING("DYNREC: The translation cache is not supported on this platform");
+#endif
+}
+
 #endif
@@ -29,7 +29,7 @@
 	instruction is encountered.
 */
 
-static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bitu max_opcodes)
+static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bitu max_opcodes, bool superblock)
 {
 	// initialize a load of variables
 	decode.code_start=start;
@@ -39,9 +39,14 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	decode.page.wmap=codepage->write_map;
 	decode.page.invmap=codepage->invalidation_map;
 	decode.page.first=start >> 12;
+	decode.trace.active=superblock;
+	decode.trace.side_exit=false;
+	decode.trace.eip=reg_eip;
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=(uint16_t)decode.page.index;
+	decode.block->superblock=superblock;
 	codepage->AddCacheBlock(decode.block);
+	dyn_persist_begin_block();
 
 	auto cache_addr = static_cast<void *>(
 	        const_cast<uint8_t *>(decode.block->cache.start));
@@ -50,6 +55,9 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	dyn_mem_write(cache_addr, cache_bytes);
 
 	InitFlagsOptimization();
+#ifdef CPU_FPU
+	dyn_fpu_reset_run();
+#endif
 
 	// every codeblock that is run sets cache.block.running to itself
 	// so the block linking knows the last executed block
@@ -61,6 +69,9 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	save_info_dynrec[used_save_info_dynrec].type=cycle_check;
 	used_save_info_dynrec++;
 
+	// count the block entries, hot blocks are spared by the cache eviction
+	gen_add_direct_word(&decode.block->exec_count,1,true);
+
 	decode.cycles=0;
 	while (max_opcodes--) {
 		// Init prefixes
@@ -78,15 +89,21 @@ restart_prefix:
 			// some entries in the invalidation map, see if the next
 			// instruction is known to be modified a lot
 			if (decode.page.index<4096) {
-				if (GCC_UNLIKELY(decode.page.invmap[decode.page.index]>=4)) goto illegalopcode;
+				if (GCC_UNLIKELY(decode.page.invmap[decode.page.index]>=4 ||
+					decode.page.code->IsDemoted(decode.page.index))) goto illegalopcode;
 				opcode=decode_fetchb();
 			} else {
 				// switch to the next page
 				opcode=decode_fetchb();
 				if (GCC_UNLIKELY(decode.page.invmap && 
-					(decode.page.invmap[decode.page.index-1]>=4))) goto illegalopcode;
+					(decode.page.invmap[decode.page.index-1]>=4 ||
+					 decode.page.code->IsDemoted(decode.page.index-1)))) goto illegalopcode;
 			}
 		}
+#ifdef CPU_FPU
+		// do the pending FPU instructions before anything else
+		if (!dyn_fpu_continues_run(opcode)) dyn_fpu_flush();
+#endif
 		switch (opcode) {
 		// instructions 'op reg8,reg8' and 'op [],reg8'
 		case 0x00:dyn_dop_ebgb(DOP_ADD);break;
@@ -199,8 +216,12 @@ restart_prefix:
 				// short conditional jumps
 				case 0x80:case 0x81:case 0x82:case 0x83:case 0x84:case 0x85:case 0x86:case 0x87:	
 				case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8c:case 0x8d:case 0x8e:case 0x8f:	
-					dyn_branched_exit((BranchTypes)(dual_code&0xf),
-						decode.big_op ? (int32_t)decode_fetchd() : (int16_t)decode_fetchw());
+					{
+						const int32_t eip_add=decode.big_op ? (int32_t)decode_fetchd() : (int16_t)decode_fetchw();
+						if (dyn_trace_side_exit((BranchTypes)(dual_code&0xf),eip_add)) break;
+						if (decode.trace.side_exit) goto trace_close_block;
+						dyn_branched_exit((BranchTypes)(dual_code&0xf),eip_add);
+					}
 					goto finish_block;
 
 				// conditional byte set instructions
@@ -302,7 +323,12 @@ restart_prefix:
 		// short conditional jumps
 		case 0x70:case 0x71:case 0x72:case 0x73:case 0x74:case 0x75:case 0x76:case 0x77:	
 		case 0x78:case 0x79:case 0x7a:case 0x7b:case 0x7c:case 0x7d:case 0x7e:case 0x7f:	
-			dyn_branched_exit((BranchTypes)(opcode&0xf),(int8_t)decode_fetchb());	
+			{
+				const int32_t eip_add=(int8_t)decode_fetchb();
+				if (dyn_trace_side_exit((BranchTypes)(opcode&0xf),eip_add)) break;
+				if (decode.trace.side_exit) goto trace_close_block;
+				dyn_branched_exit((BranchTypes)(opcode&0xf),eip_add);
+			}
 			goto finish_block;
 
 		// 'op []/reg8,imm8'
@@ -497,10 +523,16 @@ restart_prefix:
 
 
 		// loop instructions
-		case 0xe0:dyn_loop(LOOP_NE);goto finish_block;
-		case 0xe1:dyn_loop(LOOP_E);goto finish_block;
-		case 0xe2:dyn_loop(LOOP_NONE);goto finish_block;
-		case 0xe3:dyn_loop(LOOP_JCXZ);goto finish_block;
+		case 0xe0:case 0xe1:case 0xe2:case 0xe3:
+			// both links are needed, so they can't follow a side exit
+			if (decode.trace.side_exit) goto trace_close_block;
+			switch (opcode) {
+			case 0xe0:dyn_loop(LOOP_NE);break;
+			case 0xe1:dyn_loop(LOOP_E);break;
+			case 0xe2:dyn_loop(LOOP_NONE);break;
+			case 0xe3:dyn_loop(LOOP_JCXZ);break;
+			}
+			goto finish_block;
 
 
 		// 'in al/ax/eax,port_imm'
@@ -524,7 +556,11 @@ restart_prefix:
 			goto finish_block;
 		// 'jmp near imm16/32'
 		case 0xe9:
-			dyn_exit_link(decode.big_op ? (int32_t)decode_fetchd() : (int16_t)decode_fetchw());
+			{
+				const Bits eip_change=decode.big_op ? (int32_t)decode_fetchd() : (int16_t)decode_fetchw();
+				if (dyn_trace_follow_jump(eip_change)) break;
+				dyn_exit_link(eip_change);
+			}
 			goto finish_block;
 		// 'jmp far'
 		case 0xea:
@@ -532,7 +568,11 @@ restart_prefix:
 			goto finish_block;
 		// 'jmp short imm8'
 		case 0xeb:
-			dyn_exit_link((int8_t)decode_fetchb());
+			{
+				const Bits eip_change=(int8_t)decode_fetchb();
+				if (dyn_trace_follow_jump(eip_change)) break;
+				dyn_exit_link(eip_change);
+			}
 			goto finish_block;
 
 
@@ -549,9 +589,11 @@ restart_prefix:
 			break;
 		case 0xf8:		//CLC
 			gen_call_function_raw((void*)dynrec_clc);
+			InvalidateFlagsMask(FLAG_CF);
 			break;
 		case 0xf9:		//STC
 			gen_call_function_raw((void*)dynrec_stc);
+			InvalidateFlagsMask(FLAG_CF);
 			break;
 
 		case 0xf6:dyn_grp3_eb();break;
@@ -598,18 +640,39 @@ restart_prefix:
 		}
 	}
 	// link to next block because the maximum number of opcodes has been reached
+#ifdef CPU_FPU
+	dyn_fpu_flush();
+#endif
 	dyn_set_eip_end();
 	dyn_reduce_cycles();
 	gen_jmp_ptr(&decode.block->link[0].to, offsetof(CacheBlock, cache.start));
 	dyn_closeblock();
     goto finish_block;
 core_close_block:
+#ifdef CPU_FPU
+	dyn_fpu_flush();
+#endif
 	dyn_reduce_cycles();
 	dyn_return(BR_Normal);
 	dyn_closeblock();
 	goto finish_block;
+trace_close_block:
+	// the current instruction needs link[1] which is taken by a side
+	// exit already, end the superblock right before it
+	decode.cycles--;
+#ifdef CPU_FPU
+	dyn_fpu_flush();
+#endif
+	dyn_set_eip_last();
+	dyn_reduce_cycles();
+	gen_jmp_ptr(&decode.block->link[0].to, offsetof(CacheBlock, cache.start));
+	dyn_closeblock();
+	goto finish_block;
 illegalopcode:
 	// some unhandled opcode has been encountered
+#ifdef CPU_FPU
+	dyn_fpu_flush();
+#endif
 	dyn_set_eip_last();
 	dyn_reduce_cycles();
 	dyn_return(BR_Opcode);	// tell the core what happened
@@ -620,6 +683,7 @@ finish_block:
 	// setup the correct end-address
 	decode.page.index--;
 	decode.active_block->page.end=(uint16_t)decode.page.index;
+	dyn_persist_capture(decode.block,start,cache.pos);
 	dyn_mem_execute(cache_addr, cache_bytes);
 	const auto cache_flush_bytes = static_cast<size_t>(decode.block->cache.size);
 	dyn_cache_invalidate(cache_addr, cache_flush_bytes);
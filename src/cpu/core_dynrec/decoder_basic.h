@@ -114,6 +114,13 @@ static struct DynDecode {
 		uint_fast8_t rm;
 		uint_fast8_t reg;
 	} modrm;
+
+	// superblock translation state
+	struct {
+		bool active;		// follow jumps and conditional branches
+		bool side_exit;		// link[1] is used by a side exit
+		uint32_t eip;		// guest eip at code_start
+	} trace;
 } decode;
 
 static bool MakeCodePage(Bitu lin_addr, CodePageHandler *&cph)
@@ -593,7 +600,7 @@ static inline const uint8_t* gen_call_function_mm(void * func,Bitu op1,Bitu op2)
 
 
 
-enum save_info_type {db_exception, cycle_check, string_break};
+enum save_info_type {db_exception, cycle_check, string_break, trace_exit};
 
 
 // function that is called on exceptions
@@ -613,6 +620,7 @@ static struct {
 	const uint8_t* branch_pos;
 	uint32_t eip_change;
 	Bitu cycles;
+	bool big_op;
 } save_info_dynrec[512];
 
 Bitu used_save_info_dynrec=0;
@@ -653,6 +661,12 @@ static void dyn_fill_blocks(void) {
 				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,decode.big_op);
 				dyn_return(BR_Cycles);
 				break;
+			case trace_exit:
+				// taken conditional branch that leaves a superblock
+				gen_sub_direct_word(&CPU_Cycles,save_info_dynrec[sct].cycles,true);
+				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,save_info_dynrec[sct].big_op);
+				gen_jmp_ptr(&decode.block->link[1].to, offsetof(CacheBlock, cache.start));
+				break;
 		}
 	}
 	used_save_info_dynrec=0;
@@ -1178,71 +1192,111 @@ static void gen_restore_reg(HostReg reg,HostReg dest_reg) {
 // they try to find out if a function can be replaced by another
 // one that does not generate any flags at all
 
+// Every queued function is tracked together with the flags it sets that
+// may still be read. Instructions that overwrite flags remove them from
+// this set, instructions that read flags take the functions that set
+// them out of the queue. Once none of its flags are live anymore, a
+// function is replaced by its simple variant. Functions still queued
+// when the block ends keep generating flags, as the code that runs next
+// may need them.
+
 static Bitu mf_functions_num=0;
 static struct {
 	const uint8_t* pos;
 	void* fct_ptr;
 	Bitu ftype;
+	Bitu live;		// flags set by the function that may still be read
 } mf_functions[64];
 
 static void InitFlagsOptimization(void) {
 	mf_functions_num=0;
 }
 
-// replace all queued functions with their simpler variants
-// because the current instruction destroys all condition flags and
-// the flags are not required before
-static void InvalidateFlags(void) {
 #ifdef DRC_FLAGS_INVALIDATION
+// queue a function that sets the flags in flags_mask
+static void EnqueueFlagsFunction(const uint8_t* cpos,void* current_simple_function,Bitu flags_type,Bitu flags_mask) {
+	// if the queue is full the function simply keeps generating flags
+	if (mf_functions_num>=(sizeof(mf_functions)/sizeof(mf_functions[0]))) return;
+	mf_functions[mf_functions_num].pos=cpos;
+	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
+	mf_functions[mf_functions_num].ftype=flags_type;
+	mf_functions[mf_functions_num].live=flags_mask;
+	mf_functions_num++;
+}
+#endif
+
+// the flags in flags_mask are overwritten by the current instruction,
+// replace all queued functions that set no other live flags
+static void InvalidateFlagsMask([[maybe_unused]] Bitu flags_mask) {
+#ifdef DRC_FLAGS_INVALIDATION
+	Bitu kept=0;
 	for (Bitu ct=0; ct<mf_functions_num; ct++) {
-		gen_fill_function_ptr(mf_functions[ct].pos,mf_functions[ct].fct_ptr,mf_functions[ct].ftype);
+		mf_functions[ct].live&=~flags_mask;
+		if (!mf_functions[ct].live) {
+			gen_fill_function_ptr(mf_functions[ct].pos,mf_functions[ct].fct_ptr,mf_functions[ct].ftype);
+		} else {
+			mf_functions[kept++]=mf_functions[ct];
+		}
 	}
-	mf_functions_num=0;
+	mf_functions_num=kept;
 #endif
 }
 
 // replace all queued functions with their simpler variants
 // because the current instruction destroys all condition flags and
 // the flags are not required before
-static void InvalidateFlags(void* current_simple_function,Bitu flags_type) {
+static void InvalidateFlags(void) {
+	InvalidateFlagsMask(FMASK_TEST);
+}
+
+// replace all queued functions with their simpler variants
+// because the current instruction destroys all condition flags and
+// the flags are not required before
+static void InvalidateFlags([[maybe_unused]] void* current_simple_function,[[maybe_unused]] Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
-	for (Bitu ct=0; ct<mf_functions_num; ct++) {
-		gen_fill_function_ptr(mf_functions[ct].pos,mf_functions[ct].fct_ptr,mf_functions[ct].ftype);
-	}
-	mf_functions_num=1;
-	mf_functions[0].pos=cache.pos;
-	mf_functions[0].fct_ptr=current_simple_function;
-	mf_functions[0].ftype=flags_type;
+	InvalidateFlagsMask(FMASK_TEST);
+	EnqueueFlagsFunction(cache.pos,current_simple_function,flags_type,FMASK_TEST);
+#endif
+}
+
+// the current instruction always overwrites the flags in flags_mask and
+// leaves the others alone, enqueue it like InvalidateFlagsPartially but
+// replace the queued functions whose flags are all overwritten now
+static void InvalidateFlagsMasked([[maybe_unused]] void* current_simple_function,[[maybe_unused]] Bitu flags_type,[[maybe_unused]] Bitu flags_mask) {
+#ifdef DRC_FLAGS_INVALIDATION
+	InvalidateFlagsMask(flags_mask);
+	EnqueueFlagsFunction(cache.pos,current_simple_function,flags_type,flags_mask);
 #endif
 }
 
 // enqueue this instruction, if later an instruction is encountered that
 // destroys all condition flags and the flags weren't needed in-between
 // this function can be replaced by a simpler one as well
-static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_type) {
+static void InvalidateFlagsPartially([[maybe_unused]] void* current_simple_function,[[maybe_unused]] Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
-	mf_functions[mf_functions_num].pos=cache.pos;
-	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
-	mf_functions[mf_functions_num].ftype=flags_type;
-	mf_functions_num++;
+	EnqueueFlagsFunction(cache.pos,current_simple_function,flags_type,FMASK_TEST);
 #endif
 }
 
 // enqueue this instruction, if later an instruction is encountered that
 // destroys all condition flags and the flags weren't needed in-between
 // this function can be replaced by a simpler one as well
-static void InvalidateFlagsPartially(void* current_simple_function,const uint8_t* cpos,Bitu flags_type) {
+static void InvalidateFlagsPartially([[maybe_unused]] void* current_simple_function,[[maybe_unused]] const uint8_t* cpos,[[maybe_unused]] Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
-	mf_functions[mf_functions_num].pos=cpos;
-	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
-	mf_functions[mf_functions_num].ftype=flags_type;
-	mf_functions_num++;
+	EnqueueFlagsFunction(cpos,current_simple_function,flags_type,FMASK_TEST);
 #endif
 }
 
-// the current function needs the condition flags thus reset the queue
+// the current function needs the flags in flags_mask, so the queued
+// functions that set one of them have to keep generating flags
 static void AcquireFlags([[maybe_unused]] Bitu flags_mask) {
 #ifdef DRC_FLAGS_INVALIDATION
-	mf_functions_num=0;
+	Bitu kept=0;
+	for (Bitu ct=0; ct<mf_functions_num; ct++) {
+		if (!(mf_functions[ct].live & flags_mask)) {
+			mf_functions[kept++]=mf_functions[ct];
+		}
+	}
+	mf_functions_num=kept;
 #endif
 }
@@ -1000,7 +1000,8 @@ static bool dyn_grp7(void) {
 			case 0x07:	// INVLPG
 //				if (cpu.pmode && cpu.cpl) EXCEPTION(EXCEPTION_GP);
 				if (cpu.pmode && cpu.cpl) IllegalOptionDynrec("invlpg nonpriviledged");
-				gen_call_function_raw((void*)PAGING_ClearTLB);
+				dyn_fill_ea(FC_ADDR);
+				gen_call_function_R((void*)PAGING_InvalidatePage,FC_ADDR);
 				break;
 			default: IllegalOptionDynrec("dyn_grp7_1");
 		}
@@ -1092,7 +1093,8 @@ static void dyn_cwd(void) {
 static void dyn_sahf(void) {
 	MOV_REG_WORD16_TO_HOST_REG(FC_OP1,DRC_REG_EAX);
 	gen_call_function_raw((void *)&dynrec_sahf);
-	InvalidateFlags();
+	// the overflow flag is not changed by sahf
+	InvalidateFlagsMask(FLAG_SF|FLAG_ZF|FLAG_AF|FLAG_PF|FLAG_CF);
 }
 
 
@@ -1122,6 +1124,60 @@ static void dyn_branched_exit(BranchTypes btype,int32_t eip_add) {
 	dyn_closeblock();
 }
 
+
+/*
+	Superblocks are translated from hot blocks that were linked to other
+	blocks. Forward jumps within the page are followed instead of ending
+	the block, and the first forward conditional branch becomes a side
+	exit through link[1] while translation continues with the next
+	instruction. The whole chain shares the cycle check at its start.
+*/
+
+// continue the translation at the target of a jump, returns false
+// if the block has to end with the jump instead
+static bool dyn_trace_follow_jump(Bits eip_change) {
+	if (!decode.trace.active || decode.active_block!=decode.block) return false;
+	if (eip_change<=0 || decode.page.index+eip_change>=4096) return false;
+
+	const Bitu eip_base=decode.code-decode.code_start;
+	const uint64_t target_eip=(uint64_t)decode.trace.eip+eip_base+eip_change;
+	if (target_eip>(decode.big_op ? 0xffffffffULL : 0xffffULL)) return false;
+
+	gen_add_direct_word(&reg_eip,eip_base+eip_change,decode.big_op);
+
+	// the skipped bytes are accounted to this block as if they were
+	// code, so writes to them invalidate the block as well
+	for (Bitu i=decode.page.index; i<decode.page.index+eip_change; i++)
+		decode.page.wmap[i]++;
+
+	decode.code+=eip_change;
+	decode.page.index+=eip_change;
+	decode.code_start=decode.code;
+	decode.trace.eip=(uint32_t)target_eip;
+	return true;
+}
+
+// turn a conditional branch into a side exit, returns false if the
+// block has to end with the branch instead
+static bool dyn_trace_side_exit(BranchTypes btype,int32_t eip_add) {
+	// backward branches usually close a loop, end the block there
+	if (!decode.trace.active || decode.trace.side_exit || eip_add<=0) return false;
+
+	// translation goes on behind the branch, so later instructions could
+	// drop the flags of queued functions that the exit target still needs
+	AcquireFlags(FMASK_TEST);
+	dyn_branchflag_to_reg(btype);
+	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_nonzero(FC_RETOP,true);
+	save_info_dynrec[used_save_info_dynrec].cycles=decode.cycles;
+	save_info_dynrec[used_save_info_dynrec].eip_change=(uint32_t)(decode.code-decode.code_start+eip_add);
+	save_info_dynrec[used_save_info_dynrec].big_op=decode.big_op;
+	save_info_dynrec[used_save_info_dynrec].type=trace_exit;
+	used_save_info_dynrec++;
+
+	decode.trace.side_exit=true;
+	return true;
+}
+
 /*
 static void dyn_set_byte_on_condition(BranchTypes btype) {
 	dyn_get_modrm();
@@ -100,8 +100,383 @@ static void dyn_eatree() {
 	}
 }
 
+/*  FPU instruction runs
+ *  --------------------
+ *  Most FPU instructions only work on the FPU state, so there's no need to
+ *  return to the generated code between two of them. While decoding, such
+ *  instructions are collected in a run that is done by a single call to
+ *  dyn_fpu_run. The run is emitted before the next instruction that isn't
+ *  an FPU one, at the end of the block, or when it's full.
+ *
+ *  Each instruction is encoded in 16 bits: the kind in the low byte, the
+ *  arithmetic group and the ST(i) offset above it. Up to six of them are
+ *  passed as three immediates, which keeps the blocks valid for the
+ *  translation cache on disk. The generated code stores the effective
+ *  addresses of the memory operands in dyn_fpu_run_addr, in order, when it
+ *  passes each instruction; the integer registers can't change within a
+ *  run.
+ */
+
+enum DynFpuRunKind : uint8_t {
+	DFR_END = 0,
+	DFR_ARITH_ST,      // ST,ST(i) arithmetic and compares
+	DFR_ARITH_STI,     // ST(i),ST arithmetic
+	DFR_ARITH_STI_POP, // ST(i),ST arithmetic, then pop
+	DFR_ARITH_F32,
+	DFR_ARITH_F64,
+	DFR_ARITH_I32,
+	DFR_ARITH_I16,
+	DFR_FLD_STI,
+	DFR_FXCH,
+	DFR_FST_STI,
+	DFR_FSTP_STI,
+	DFR_FLD_F32,
+	DFR_FLD_F64,
+	DFR_FILD_I16,
+	DFR_FILD_I32,
+	DFR_FST_F32,
+	DFR_FSTP_F32,
+	DFR_FST_F64,
+	DFR_FSTP_F64,
+	DFR_FIST_I16,
+	DFR_FISTP_I16,
+	DFR_FIST_I32,
+	DFR_FISTP_I32,
+	DFR_FCHS,
+	DFR_FABS,
+	DFR_FLD1,
+	DFR_FLDZ,
+	DFR_FSQRT,
+	DFR_FSIN,
+	DFR_FCOS,
+	DFR_NUM_KINDS
+};
+
+// Helper calls the instructions took when each was translated on its own,
+// not counting the extra pop of FCOMP
+static constexpr uint8_t dyn_fpu_single_calls[DFR_NUM_KINDS] = {
+	0, 1, 1, 2, 2, 2, 2, 2, 2, 1, 1, 2, 2, 2, 2, 2,
+	1, 2, 1, 2, 1, 2, 1, 2, 1, 1, 1, 1, 1, 1, 1};
+
+constexpr int dyn_fpu_run_max = 6;
+
+static struct {
+	uint16_t ops[dyn_fpu_run_max];
+	int num_ops;
+	int num_addrs;
+} dyn_fpu_pending = {};
+
+static PhysPt dyn_fpu_run_addr[dyn_fpu_run_max];
+
+// Only counted while dynamic_core_profile is enabled
+static struct {
+	uint64_t instructions;
+	uint64_t calls;
+	uint64_t single_calls;
+} dyn_fpu_run_stats = {};
+
+// Groups 4 to 7 are in the order of the ST,ST(i) forms, the ST(i),ST forms
+// swap the normal and reversed subtraction and division
+static void dyn_fpu_run_arith(const Bitu group, const Bitu op1, const Bitu op2)
+{
+	switch (group) {
+	case 0x00: FPU_FADD(op1, op2); break;
+	case 0x01: FPU_FMUL(op1, op2); break;
+	case 0x02: FPU_FCOM(op1, op2); break;
+	case 0x03:
+		FPU_FCOM(op1, op2);
+		FPU_FPOP();
+		break;
+	case 0x04: FPU_FSUB(op1, op2); break;
+	case 0x05: FPU_FSUBR(op1, op2); break;
+	case 0x06: FPU_FDIV(op1, op2); break;
+	case 0x07: FPU_FDIVR(op1, op2); break;
+	}
+}
+
+// The memory operand has been loaded into fpu.regs[8] already
+static void dyn_fpu_run_arith_ea(const Bitu group)
+{
+	const Bitu top = TOP;
+	switch (group) {
+	case 0x00: FPU_FADD_EA(top); break;
+	case 0x01: FPU_FMUL_EA(top); break;
+	case 0x02: FPU_FCOM_EA(top); break;
+	case 0x03:
+		FPU_FCOM_EA(top);
+		FPU_FPOP();
+		break;
+	case 0x04: FPU_FSUB_EA(top); break;
+	case 0x05: FPU_FSUBR_EA(top); break;
+	case 0x06: FPU_FDIV_EA(top); break;
+	case 0x07: FPU_FDIVR_EA(top); break;
+	}
+}
+
+static void dyn_fpu_run(const Bitu ops_0_1, const Bitu ops_2_3, const Bitu ops_4_5)
+{
+	const Bitu words[dyn_fpu_run_max / 2] = {ops_0_1, ops_2_3, ops_4_5};
+
+	// take a copy, a page fault handler could run another block
+	PhysPt addrs[dyn_fpu_run_max];
+	for (int i = 0; i < dyn_fpu_run_max; ++i) {
+		addrs[i] = dyn_fpu_run_addr[i];
+	}
+	const PhysPt* addr = addrs;
+
+	int num = 0;
+	for (; num < dyn_fpu_run_max; ++num) {
+		const auto op = static_cast<uint16_t>(words[num / 2] >> ((num & 1) * 16));
+		const auto kind = static_cast<uint8_t>(op & 0xff);
+		if (kind == DFR_END) {
+			break;
+		}
+		const Bitu group = (op >> 8) & 7;
+		const Bitu sti   = (TOP + (op >> 11)) & 7;
+
+		switch (kind) {
+		case DFR_ARITH_ST: dyn_fpu_run_arith(group, TOP, sti); break;
+		case DFR_ARITH_STI: dyn_fpu_run_arith(group, sti, TOP); break;
+		case DFR_ARITH_STI_POP:
+			dyn_fpu_run_arith(group, sti, TOP);
+			FPU_FPOP();
+			break;
+		case DFR_ARITH_F32:
+			FPU_FLD_F32_EA(*addr++);
+			dyn_fpu_run_arith_ea(group);
+			break;
+		case DFR_ARITH_F64:
+			FPU_FLD_F64_EA(*addr++);
+			dyn_fpu_run_arith_ea(group);
+			break;
+		case DFR_ARITH_I32:
+			FPU_FLD_I32_EA(*addr++);
+			dyn_fpu_run_arith_ea(group);
+			break;
+		case DFR_ARITH_I16:
+			FPU_FLD_I16_EA(*addr++);
+			dyn_fpu_run_arith_ea(group);
+			break;
+		case DFR_FLD_STI:
+			FPU_PREP_PUSH();
+			FPU_FST(sti, TOP);
+			break;
+		case DFR_FXCH: FPU_FXCH(TOP, sti); break;
+		case DFR_FST_STI: FPU_FST(TOP, sti); break;
+		case DFR_FSTP_STI:
+			FPU_FST(TOP, sti);
+			FPU_FPOP();
+			break;
+		case DFR_FLD_F32:
+			FPU_PREP_PUSH();
+			FPU_FLD_F32(*addr++, TOP);
+			break;
+		case DFR_FLD_F64:
+			FPU_PREP_PUSH();
+			FPU_FLD_F64(*addr++, TOP);
+			break;
+		case DFR_FILD_I16:
+			FPU_PREP_PUSH();
+			FPU_FLD_I16(*addr++, TOP);
+			break;
+		case DFR_FILD_I32:
+			FPU_PREP_PUSH();
+			FPU_FLD_I32(*addr++, TOP);
+			break;
+		case DFR_FST_F32: FPU_FST_F32(*addr++); break;
+		case DFR_FSTP_F32:
+			FPU_FST_F32(*addr++);
+			FPU_FPOP();
+			break;
+		case DFR_FST_F64: FPU_FST_F64(*addr++); break;
+		case DFR_FSTP_F64:
+			FPU_FST_F64(*addr++);
+			FPU_FPOP();
+			break;
+		case DFR_FIST_I16: FPU_FST_I16(*addr++); break;
+		case DFR_FISTP_I16:
+			FPU_FST_I16(*addr++);
+			FPU_FPOP();
+			break;
+		case DFR_FIST_I32: FPU_FST_I32(*addr++); break;
+		case DFR_FISTP_I32:
+			FPU_FST_I32(*addr++);
+			FPU_FPOP();
+			break;
+		case DFR_FCHS: FPU_FCHS(); break;
+		case DFR_FABS: FPU_FABS(); break;
+		case DFR_FLD1: FPU_FLD1(); break;
+		case DFR_FLDZ: FPU_FLDZ(); break;
+		case DFR_FSQRT: FPU_FSQRT(); break;
+		case DFR_FSIN: FPU_FSIN(); break;
+		case DFR_FCOS: FPU_FCOS(); break;
+		default: break;
+		}
+	}
+	if (dyn_profile.enabled) {
+		for (int i = 0; i < num; ++i) {
+			const auto op = words[i / 2] >> ((i & 1) * 16);
+			dyn_fpu_run_stats.single_calls += dyn_fpu_single_calls[op & 0xff];
+		}
+		dyn_fpu_run_stats.instructions += static_cast<uint64_t>(num);
+		++dyn_fpu_run_stats.calls;
+	}
+}
+
+// Emit the pending run, if any
+static void dyn_fpu_flush()
+{
+	if (!dyn_fpu_pending.num_ops) {
+		return;
+	}
+	uint32_t words[dyn_fpu_run_max / 2] = {};
+	for (int i = 0; i < dyn_fpu_pending.num_ops; ++i) {
+		words[i / 2] |= static_cast<uint32_t>(dyn_fpu_pending.ops[i]) << ((i & 1) * 16);
+	}
+	gen_call_function_III((void*)&dyn_fpu_run, words[0], words[1], words[2]);
+	dyn_fpu_pending.num_ops   = 0;
+	dyn_fpu_pending.num_addrs = 0;
+}
+
+static void dyn_fpu_reset_run()
+{
+	dyn_fpu_pending.num_ops   = 0;
+	dyn_fpu_pending.num_addrs = 0;
+}
+
+// The FPU instructions, and the prefixes and WAIT that can come between
+// them, don't end the pending run
+static bool dyn_fpu_continues_run(const Bitu opcode)
+{
+	switch (opcode) {
+	case 0xd8: case 0xd9: case 0xda: case 0xdb:
+	case 0xdc: case 0xdd: case 0xde: case 0xdf:
+	case 0x26: case 0x2e: case 0x36: case 0x3e:
+	case 0x64: case 0x65: case 0x66: case 0x67:
+	case 0x9b:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void dyn_fpu_queue(const DynFpuRunKind kind, const Bitu group = 0, const Bitu sti = 0)
+{
+	dyn_fpu_pending.ops[dyn_fpu_pending.num_ops++] =
+	        static_cast<uint16_t>(kind | (group << 8) | (sti << 11));
+	if (dyn_fpu_pending.num_ops == dyn_fpu_run_max) {
+		dyn_fpu_flush();
+	}
+}
+
+static void dyn_fpu_queue_ea(const DynFpuRunKind kind, const Bitu group = 0)
+{
+	dyn_fill_ea(FC_ADDR);
+	gen_mov_word_from_reg(FC_ADDR, &dyn_fpu_run_addr[dyn_fpu_pending.num_addrs++], true);
+	dyn_fpu_queue(kind, group);
+}
+
+// Adds the decoded instruction of the given escape to the pending run,
+// returns false if it has to be translated on its own
+static bool dyn_fpu_queue_instruction(const Bitu esc)
+{
+	const Bitu reg = decode.modrm.reg;
+	const Bitu rm  = decode.modrm.rm;
+
+	if (decode.modrm.mod == 3) {
+		switch (esc) {
+		case 0x00: dyn_fpu_queue(DFR_ARITH_ST, reg, rm); return true;
+		case 0x01:
+			switch (reg) {
+			case 0x00: dyn_fpu_queue(DFR_FLD_STI, 0, rm); return true;
+			case 0x01: dyn_fpu_queue(DFR_FXCH, 0, rm); return true;
+			case 0x03: dyn_fpu_queue(DFR_FSTP_STI, 0, rm); return true;
+			case 0x04:
+				if (rm == 0x00) { dyn_fpu_queue(DFR_FCHS); return true; }
+				if (rm == 0x01) { dyn_fpu_queue(DFR_FABS); return true; }
+				return false;
+			case 0x05:
+				if (rm == 0x00) { dyn_fpu_queue(DFR_FLD1); return true; }
+				if (rm == 0x06) { dyn_fpu_queue(DFR_FLDZ); return true; }
+				return false;
+			case 0x07:
+				if (rm == 0x02) { dyn_fpu_queue(DFR_FSQRT); return true; }
+				if (rm == 0x06) { dyn_fpu_queue(DFR_FSIN); return true; }
+				if (rm == 0x07) { dyn_fpu_queue(DFR_FCOS); return true; }
+				return false;
+			default: return false;
+			}
+		case 0x04:
+		case 0x06:
+			// the compares of these escapes are left to the regular path
+			if (reg == 0x02 || reg == 0x03) {
+				return false;
+			}
+			dyn_fpu_queue(esc == 0x04 ? DFR_ARITH_STI : DFR_ARITH_STI_POP,
+			              reg < 4 ? reg : reg ^ 1, rm);
+			return true;
+		case 0x05:
+			switch (reg) {
+			case 0x01: dyn_fpu_queue(DFR_FXCH, 0, rm); return true;
+			case 0x02: dyn_fpu_queue(DFR_FST_STI, 0, rm); return true;
+			case 0x03: dyn_fpu_queue(DFR_FSTP_STI, 0, rm); return true;
+			default: return false;
+			}
+		case 0x07:
+			switch (reg) {
+			case 0x01: dyn_fpu_queue(DFR_FXCH, 0, rm); return true;
+			case 0x02:
+			case 0x03: dyn_fpu_queue(DFR_FSTP_STI, 0, rm); return true;
+			default: return false;
+			}
+		default: return false;
+		}
+	}
+
+	switch (esc) {
+	case 0x00: dyn_fpu_queue_ea(DFR_ARITH_F32, reg); return true;
+	case 0x02: dyn_fpu_queue_ea(DFR_ARITH_I32, reg); return true;
+	case 0x04: dyn_fpu_queue_ea(DFR_ARITH_F64, reg); return true;
+	case 0x06: dyn_fpu_queue_ea(DFR_ARITH_I16, reg); return true;
+	case 0x01:
+	case 0x03:
+	case 0x05:
+	case 0x07: {
+		// loads and stores, in the order FLD/FILD, FST/FIST, FSTP/FISTP
+		static constexpr DynFpuRunKind kinds[4][3] = {
+		        {DFR_FLD_F32, DFR_FST_F32, DFR_FSTP_F32},
+		        {DFR_FILD_I32, DFR_FIST_I32, DFR_FISTP_I32},
+		        {DFR_FLD_F64, DFR_FST_F64, DFR_FSTP_F64},
+		        {DFR_FILD_I16, DFR_FIST_I16, DFR_FISTP_I16},
+		};
+		if (reg == 0x01 || reg > 0x03) {
+			return false;
+		}
+		dyn_fpu_queue_ea(kinds[esc / 2][reg ? reg - 1 : 0]);
+		return true;
+	}
+	default: return false;
+	}
+}
+
+static void dyn_fpu_run_report(const char* core_name)
+{
+	if (!dyn_fpu_run_stats.calls) {
+		return;
+	}
+	LOG_MSG("%s: Ran %llu FPU instructions in %llu calls, they took %llu calls one by one",
+	        core_name,
+	        static_cast<unsigned long long>(dyn_fpu_run_stats.instructions),
+	        static_cast<unsigned long long>(dyn_fpu_run_stats.calls),
+	        static_cast<unsigned long long>(dyn_fpu_run_stats.single_calls));
+}
+
 static void dyn_fpu_esc0(){
 	dyn_get_modrm(); 
+	if (dyn_fpu_queue_instruction(0)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) {
 	if (decode.modrm.mod == 3) { 
 		dyn_fpu_top();
@@ -145,6 +520,10 @@ static void dyn_fpu_esc0(){
 
 static void dyn_fpu_esc1(){
 	dyn_get_modrm();  
+	if (dyn_fpu_queue_instruction(1)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch (decode.modrm.reg){
@@ -333,6 +712,10 @@ static void dyn_fpu_esc1(){
 
 static void dyn_fpu_esc2(){
 	dyn_get_modrm();  
+	if (dyn_fpu_queue_instruction(2)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch(decode.modrm.reg){
@@ -367,6 +750,10 @@ static void dyn_fpu_esc2(){
 static void dyn_fpu_esc3()
 {
 	dyn_get_modrm();  
+	if (dyn_fpu_queue_instruction(3)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch (decode.modrm.reg) {
@@ -434,6 +821,10 @@ static void dyn_fpu_esc3()
 
 static void dyn_fpu_esc4(){
 	dyn_get_modrm();  
+	if (dyn_fpu_queue_instruction(4)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch(decode.modrm.reg){
@@ -483,6 +874,10 @@ static void dyn_fpu_esc4(){
 
 static void dyn_fpu_esc5(){
 	dyn_get_modrm();  
+	if (dyn_fpu_queue_instruction(5)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		dyn_fpu_top();
@@ -554,6 +949,10 @@ static void dyn_fpu_esc5(){
 
 static void dyn_fpu_esc6(){
 	dyn_get_modrm();  
+	if (dyn_fpu_queue_instruction(6)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch(decode.modrm.reg){
@@ -611,6 +1010,10 @@ static void dyn_fpu_esc6(){
 
 static void dyn_fpu_esc7(){
 	dyn_get_modrm();  
+	if (dyn_fpu_queue_instruction(7)) {
+		return;
+	}
+	dyn_fpu_flush();
 //	if (decode.modrm.val >= 0xc0) { 
 	if (decode.modrm.mod == 3) {
 		switch (decode.modrm.reg){
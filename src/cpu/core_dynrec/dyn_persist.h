@@ -0,0 +1,583 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+	Persistent translation cache.
+
+	Every block translated by the decoder is captured together with the
+	guest code it was created from and a list of relocations, which are
+	the address-dependent fields the backend emitted into the block.
+	When the core misses a block, the captured blocks are looked up by a
+	hash of the first guest bytes at the entry point. A candidate is only
+	used if all of its guest bytes and the CPU mode it was translated in
+	match, otherwise the instruction stream is translated as usual.
+
+	The captured blocks are written to a file when the core shuts down
+	and loaded again on the next run. Generated code refers to host data
+	and functions by their address. These are stored relative to a
+	reference function and relocated on load, so the file stays valid
+	when the executable is loaded at a different address (PIE, ASLR). The
+	file is only accepted if it was written by the same build; the header
+	stores the offsets of a set of anchors that are compared on load.
+
+	Only backends that report their relocations (DRC_PERSISTENT_CACHE)
+	support this. Blocks that span two pages or that point directly into
+	guest memory (write map masks) are never captured.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include "cross.h"
+
+#define XXH_INLINE_ALL 1
+#define XXH_NO_INLINE_HINTS 1
+#define XXH_STATIC_LINKING_ONLY 1
+#include "../libs/decoders/xxhash.h"
+
+// number of guest bytes at the entry point that make up the lookup key
+#define DYN_PERSIST_KEY_BYTES	(16)
+// maximum number of address-dependent fields in a single block
+#define DYN_PERSIST_MAX_RELOCS	(512)
+// upper limit for the amount of host code kept in the store
+#define DYN_PERSIST_MAX_CODE	(32*1024*1024)
+
+// RipRel32 and Abs64 targets are stored relative to dyn_persist_reference()
+enum class DynRelocType : uint8_t {
+	RipRel32,   // 32bit displacement relative to the end of the instruction
+	Abs32,      // absolute 32bit address
+	Abs64,      // 64bit address
+	BlockAbs32, // absolute 32bit address into the owning CacheBlock
+	BlockAbs64, // absolute 64bit address into the owning CacheBlock
+	BlockRipRel32, // 32bit displacement to a field of the owning CacheBlock
+};
+
+struct DynReloc {
+	uint16_t offset   = 0; // position of the field in the host code
+	DynRelocType type = DynRelocType::RipRel32;
+	uint8_t tail      = 0; // instruction bytes following a RipRel32 field
+	int64_t target    = 0; // offset from the reference or into the CacheBlock
+};
+
+struct DynPersistBlock {
+	uint8_t mode        = 0; // CPU mode the block was translated in
+	uint16_t page_start = 0;
+	uint16_t page_end   = 0;
+	std::vector<uint8_t> guest_code = {};
+	std::vector<uint8_t> host_code  = {};
+	std::vector<DynReloc> relocs    = {};
+};
+
+static struct {
+	bool enabled = false;
+
+	// relocations reported by the backend for the block being translated
+	struct {
+		const uint8_t* field = nullptr;
+		uintptr_t target     = 0;
+		DynRelocType type    = DynRelocType::RipRel32;
+		uint8_t tail         = 0;
+	} pending[DYN_PERSIST_MAX_RELOCS] = {};
+	Bitu num_pending = 0;
+	bool overflow    = false;
+
+	std::unordered_multimap<uint64_t, DynPersistBlock> store = {};
+	size_t stored_code = 0;
+
+	struct {
+		uint32_t hits       = 0; // blocks reused from the store
+		uint32_t misses     = 0; // blocks that had to be translated
+		uint32_t mismatches = 0; // candidates rejected by validation
+		uint32_t captured   = 0; // blocks added to the store
+		uint32_t loaded     = 0; // blocks read from the cache file
+	} stats = {};
+} dyn_persist = {};
+
+// called by the backend whenever an address-dependent field is emitted
+static inline void dyn_persist_note_reloc(const DynRelocType type,
+                                          const uint8_t* field,
+                                          const void* target,
+                                          const uint8_t tail = 0)
+{
+	if (!dyn_persist.enabled)
+		return;
+	if (dyn_persist.num_pending >= DYN_PERSIST_MAX_RELOCS) {
+		dyn_persist.overflow = true;
+		return;
+	}
+	auto& reloc  = dyn_persist.pending[dyn_persist.num_pending++];
+	reloc.field  = field;
+	reloc.target = reinterpret_cast<uintptr_t>(target);
+	reloc.type   = type;
+	reloc.tail   = tail;
+}
+
+// called by the backend when it overwrites a noted field
+static inline void dyn_persist_drop_reloc(const uint8_t* field)
+{
+	if (!dyn_persist.enabled)
+		return;
+	for (Bitu i = 0; i < dyn_persist.num_pending; ++i) {
+		if (dyn_persist.pending[i].field == field) {
+			dyn_persist.pending[i] =
+			        dyn_persist.pending[--dyn_persist.num_pending];
+			return;
+		}
+	}
+}
+
+static inline void dyn_persist_begin_block()
+{
+	dyn_persist.num_pending = 0;
+	dyn_persist.overflow    = false;
+}
+
+// the translation depends on the code size and on privilege checks
+static inline uint8_t dyn_persist_mode()
+{
+	return static_cast<uint8_t>((cpu.code.big ? 0x01 : 0) |
+	                            (cpu.pmode ? 0x02 : 0) |
+	                            ((reg_flags & FLAG_VM) ? 0x04 : 0) |
+	                            ((cpu.cpl & 3) << 3));
+}
+
+static uint64_t dyn_persist_key(const PhysPt ip_point, const uint8_t mode)
+{
+	const auto start = ip_point & 4095;
+	const auto count = std::min<PhysPt>(DYN_PERSIST_KEY_BYTES, 4096 - start);
+	uint8_t bytes[DYN_PERSIST_KEY_BYTES];
+	for (PhysPt i = 0; i < count; ++i)
+		bytes[i] = mem_readb(ip_point + i);
+	return XXH3_64bits_withSeed(bytes, count, mode);
+}
+
+// Host addresses are stored relative to this function, the whole executable
+// moves with it
+static uintptr_t dyn_persist_reference()
+{
+	return reinterpret_cast<uintptr_t>(&CPU_Core_Dynrec_Run);
+}
+
+static bool dyn_persist_is_stored(const uint64_t key, const DynPersistBlock& block)
+{
+	const auto range = dyn_persist.store.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it) {
+		const auto& other = it->second;
+		if (other.mode == block.mode &&
+		    other.page_start == block.page_start &&
+		    other.guest_code == block.guest_code)
+			return true;
+	}
+	return false;
+}
+
+// capture a freshly translated block, code_end is the end of its host code
+static void dyn_persist_capture(const CacheBlock* block, const PhysPt ip_point,
+                                const uint8_t* code_end)
+{
+	if (!dyn_persist.enabled || dyn_persist.overflow)
+		return;
+	if (block->crossblock || block->cache.wmapmask)
+		return;
+	if (dyn_persist.stored_code >= DYN_PERSIST_MAX_CODE)
+		return;
+
+	const auto code_start = block->cache.start;
+	const auto code_size  = static_cast<size_t>(code_end - code_start);
+	if (code_size > CACHE_MAXSIZE)
+		return;
+
+	DynPersistBlock entry = {};
+	entry.mode       = dyn_persist_mode();
+	entry.page_start = block->page.start;
+	entry.page_end   = block->page.end;
+
+	const auto block_lo  = reinterpret_cast<uintptr_t>(block);
+	const auto block_hi  = block_lo + sizeof(CacheBlock);
+	const auto reference = dyn_persist_reference();
+	for (Bitu i = 0; i < dyn_persist.num_pending; ++i) {
+		const auto& pending = dyn_persist.pending[i];
+		const bool in_block = pending.target >= block_lo &&
+		                      pending.target < block_hi;
+		DynReloc reloc = {};
+		reloc.offset = static_cast<uint16_t>(pending.field - code_start);
+		reloc.tail   = pending.tail;
+		switch (pending.type) {
+		case DynRelocType::RipRel32:
+			if (in_block) {
+				reloc.type   = DynRelocType::BlockRipRel32;
+				reloc.target = static_cast<int64_t>(pending.target -
+				                                    block_lo);
+			} else {
+				reloc.type   = DynRelocType::RipRel32;
+				reloc.target = static_cast<int64_t>(pending.target -
+				                                    reference);
+			}
+			break;
+		case DynRelocType::Abs32:
+			// 32bit values are constants, or addresses in an executable
+			// that is always loaded at the same place
+			if (!in_block)
+				continue;
+			reloc.type   = DynRelocType::BlockAbs32;
+			reloc.target = static_cast<int64_t>(pending.target - block_lo);
+			break;
+		case DynRelocType::Abs64:
+			if (in_block) {
+				reloc.type   = DynRelocType::BlockAbs64;
+				reloc.target = static_cast<int64_t>(pending.target -
+				                                    block_lo);
+			} else {
+				reloc.type   = DynRelocType::Abs64;
+				reloc.target = static_cast<int64_t>(pending.target -
+				                                    reference);
+			}
+			break;
+		default: return;
+		}
+		entry.relocs.push_back(reloc);
+	}
+
+	const auto guest_size = entry.page_end - entry.page_start + 1;
+	entry.guest_code.resize(guest_size);
+	for (int i = 0; i < guest_size; ++i)
+		entry.guest_code[i] = mem_readb(ip_point + i);
+	entry.host_code.assign(code_start, code_end);
+
+	const auto key = dyn_persist_key(ip_point, entry.mode);
+	if (dyn_persist_is_stored(key, entry))
+		return;
+
+	dyn_persist.stored_code += entry.host_code.size();
+	dyn_persist.store.emplace(key, std::move(entry));
+	++dyn_persist.stats.captured;
+}
+
+// check if the relocations can be applied for a block at the given place
+static bool dyn_persist_can_relocate(const DynPersistBlock& entry,
+                                     const CacheBlock* block,
+                                     const uint8_t* code)
+{
+	const auto block_addr = reinterpret_cast<uintptr_t>(block);
+	const auto reference  = static_cast<int64_t>(dyn_persist_reference());
+	for (const auto& reloc : entry.relocs) {
+		if (reloc.type == DynRelocType::RipRel32 ||
+		    reloc.type == DynRelocType::BlockRipRel32) {
+			const auto target = (reloc.type == DynRelocType::RipRel32)
+			                          ? reference + reloc.target
+			                          : static_cast<int64_t>(block_addr) +
+			                                    reloc.target;
+			const auto next = reinterpret_cast<int64_t>(code) +
+			                  reloc.offset + 4 + reloc.tail;
+			const auto disp = target - next;
+			if (disp != static_cast<int32_t>(disp))
+				return false;
+		} else if (reloc.type == DynRelocType::BlockAbs32) {
+			if (block_addr + reloc.target > UINT32_MAX)
+				return false;
+		}
+	}
+	return true;
+}
+
+static void dyn_persist_relocate(const DynPersistBlock& entry,
+                                 const CacheBlock* block, const uint8_t* code)
+{
+	const auto block_addr = reinterpret_cast<uintptr_t>(block);
+	const auto reference  = static_cast<int64_t>(dyn_persist_reference());
+	for (const auto& reloc : entry.relocs) {
+		const auto field = code + reloc.offset;
+		switch (reloc.type) {
+		case DynRelocType::RipRel32: {
+			const auto next = reinterpret_cast<int64_t>(field) + 4 +
+			                  reloc.tail;
+			const auto target = reference + reloc.target;
+			cache_addd(static_cast<uint32_t>(target - next), field);
+			break;
+		}
+		case DynRelocType::Abs64:
+			cache_addq(static_cast<uint64_t>(reference + reloc.target),
+			           field);
+			break;
+		case DynRelocType::BlockRipRel32: {
+			const auto next = reinterpret_cast<int64_t>(field) + 4 +
+			                  reloc.tail;
+			const auto target = static_cast<int64_t>(block_addr) +
+			                    reloc.target;
+			cache_addd(static_cast<uint32_t>(target - next), field);
+			break;
+		}
+		case DynRelocType::BlockAbs32:
+			cache_addd(static_cast<uint32_t>(block_addr + reloc.target),
+			           field);
+			break;
+		case DynRelocType::BlockAbs64:
+			cache_addq(static_cast<uint64_t>(block_addr + reloc.target),
+			           field);
+			break;
+		default: break;
+		}
+	}
+}
+
+// install a stored block into the code cache
+static CacheBlock* dyn_persist_install(const DynPersistBlock& entry,
+                                       CodePageHandler* codepage)
+{
+	// an opened block that isn't added to a page is handed out again
+	// by the next cache_openblock() call
+	CacheBlock* block = cache_openblock();
+	if (!dyn_persist_can_relocate(entry, block, block->cache.start))
+		return nullptr;
+
+	block->page.start = entry.page_start;
+	codepage->AddCacheBlock(block);
+
+	auto cache_addr = static_cast<void*>(
+	        const_cast<uint8_t*>(block->cache.start));
+	constexpr size_t cache_bytes = CACHE_MAXSIZE;
+	dyn_mem_write(cache_addr, cache_bytes);
+
+	memcpy(cache_addr, entry.host_code.data(), entry.host_code.size());
+	dyn_persist_relocate(entry, block, block->cache.start);
+	cache.pos = block->cache.start + entry.host_code.size();
+
+	cache_block_before_close();
+	cache_closeblock();
+	cache_block_closing(block->cache.start, block->cache.size);
+
+	block->page.end = entry.page_end;
+	for (Bitu i = entry.page_start; i <= entry.page_end; ++i)
+		codepage->write_map[i]++;
+
+	dyn_mem_execute(cache_addr, cache_bytes);
+	dyn_cache_invalidate(cache_addr, static_cast<size_t>(block->cache.size));
+	return block;
+}
+
+// try to find a stored translation for the code starting at ip_point
+static CacheBlock* dyn_persist_lookup(CodePageHandler* codepage, const PhysPt ip_point)
+{
+	if (!dyn_persist.enabled)
+		return nullptr;
+
+	const auto mode  = dyn_persist_mode();
+	const auto start = static_cast<uint16_t>(ip_point & 4095);
+	const auto key   = dyn_persist_key(ip_point, mode);
+
+	const auto range = dyn_persist.store.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it) {
+		const auto& entry = it->second;
+		if (entry.mode != mode || entry.page_start != start)
+			continue;
+		bool identical = true;
+		for (size_t i = 0; identical && i < entry.guest_code.size(); ++i)
+			identical = (mem_readb(ip_point + i) == entry.guest_code[i]);
+		if (!identical) {
+			++dyn_persist.stats.mismatches;
+			continue;
+		}
+		auto block = dyn_persist_install(entry, codepage);
+		if (block) {
+			++dyn_persist.stats.hits;
+			return block;
+		}
+	}
+	++dyn_persist.stats.misses;
+	return nullptr;
+}
+
+// Cache file handling
+
+constexpr char dyn_persist_magic[8] = {'D', 'B', 'D', 'Y', 'N', 'R', 'E', 'C'};
+constexpr uint32_t dyn_persist_version = 3;
+
+static std_fs::path dyn_persist_path()
+{
+	return get_platform_config_dir() / "dynrec_cache.bin";
+}
+
+// offsets of data and functions that generated code depends on; a cache
+// file written by a different build won't match these
+static std::vector<uint64_t> dyn_persist_anchors()
+{
+	const auto reference = dyn_persist_reference();
+	auto addr = [reference](const void* ptr) {
+		return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr) -
+		                             reference);
+	};
+	return {addr(&cpu_regs),
+	        addr(&cpu),
+	        addr(&Segs),
+	        addr(&lflags),
+	        addr(&core_dynrec),
+	        addr(&cache),
+	        addr(&CPU_Cycles),
+	        addr(reinterpret_cast<const void*>(&mem_readb)),
+	        addr(reinterpret_cast<const void*>(&CPU_Exception)),
+	        addr(reinterpret_cast<const void*>(&CPU_Core_Normal_Run)),
+	        static_cast<uint64_t>(sizeof(CacheBlock)),
+	        static_cast<uint64_t>(CACHE_MAXSIZE)};
+}
+
+template <typename T>
+static void dyn_persist_put(std::ofstream& out, const T& val)
+{
+	out.write(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template <typename T>
+static bool dyn_persist_get(std::ifstream& in, T& val)
+{
+	return static_cast<bool>(
+	        in.read(reinterpret_cast<char*>(&val), sizeof(T)));
+}
+
+static void dyn_persist_load()
+{
+	const auto path = dyn_persist_path();
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		return;
+
+	char magic[sizeof(dyn_persist_magic)] = {};
+	uint32_t version = 0;
+	in.read(magic, sizeof(magic));
+	if (!in || memcmp(magic, dyn_persist_magic, sizeof(magic)) != 0 ||
+	    !dyn_persist_get(in, version) || version != dyn_persist_version) {
+		LOG_WARNING("DYNREC: Ignoring invalid translation cache '%s'",
+		            path.string().c_str());
+		return;
+	}
+
+	uint32_t version_len = 0;
+	dyn_persist_get(in, version_len);
+	std::string build(version_len, '\0');
+	in.read(build.data(), version_len);
+	bool matches = in && build == VERSION;
+	for (const auto anchor : dyn_persist_anchors()) {
+		uint64_t val = 0;
+		matches = matches && dyn_persist_get(in, val) && val == anchor;
+	}
+	if (!matches) {
+		LOG_MSG("DYNREC: Translation cache was created by a different build, discarding it");
+		return;
+	}
+
+	uint32_t count = 0;
+	dyn_persist_get(in, count);
+	for (uint32_t n = 0; n < count; ++n) {
+		uint64_t key       = 0;
+		uint16_t guest_len = 0;
+		uint16_t host_len  = 0;
+		uint16_t num_reloc = 0;
+		DynPersistBlock entry = {};
+		if (!dyn_persist_get(in, key) || !dyn_persist_get(in, entry.mode) ||
+		    !dyn_persist_get(in, entry.page_start) ||
+		    !dyn_persist_get(in, entry.page_end) ||
+		    !dyn_persist_get(in, guest_len) ||
+		    !dyn_persist_get(in, host_len) || !dyn_persist_get(in, num_reloc))
+			break;
+		if (entry.page_end < entry.page_start || entry.page_end > 4095 ||
+		    guest_len != entry.page_end - entry.page_start + 1 ||
+		    host_len > CACHE_MAXSIZE)
+			break;
+		entry.guest_code.resize(guest_len);
+		entry.host_code.resize(host_len);
+		entry.relocs.resize(num_reloc);
+		in.read(reinterpret_cast<char*>(entry.guest_code.data()), guest_len);
+		in.read(reinterpret_cast<char*>(entry.host_code.data()), host_len);
+		bool relocs_valid = true;
+		for (auto& reloc : entry.relocs) {
+			relocs_valid = relocs_valid &&
+			               dyn_persist_get(in, reloc.offset) &&
+			               dyn_persist_get(in, reloc.type) &&
+			               dyn_persist_get(in, reloc.tail) &&
+			               dyn_persist_get(in, reloc.target);
+			const auto field_size = (reloc.type == DynRelocType::Abs64 ||
+			                         reloc.type == DynRelocType::BlockAbs64)
+			                              ? 8u
+			                              : 4u;
+			relocs_valid = relocs_valid &&
+			               reloc.offset + field_size <= host_len;
+		}
+		if (!in || !relocs_valid)
+			break;
+		dyn_persist.stored_code += host_len;
+		dyn_persist.store.emplace(key, std::move(entry));
+		++dyn_persist.stats.loaded;
+	}
+	LOG_MSG("DYNREC: Loaded %u blocks from the translation cache",
+	        dyn_persist.stats.loaded);
+}
+
+static void dyn_persist_save()
+{
+	if (dyn_persist.stats.captured == 0)
+		return;
+
+	const auto path = dyn_persist_path();
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		LOG_WARNING("DYNREC: Can't write translation cache '%s'",
+		            path.string().c_str());
+		return;
+	}
+	out.write(dyn_persist_magic, sizeof(dyn_persist_magic));
+	dyn_persist_put(out, dyn_persist_version);
+	const std::string build = VERSION;
+	dyn_persist_put(out, static_cast<uint32_t>(build.size()));
+	out.write(build.data(), static_cast<std::streamsize>(build.size()));
+	for (const auto anchor : dyn_persist_anchors())
+		dyn_persist_put(out, anchor);
+
+	dyn_persist_put(out, static_cast<uint32_t>(dyn_persist.store.size()));
+	for (const auto& [key, entry] : dyn_persist.store) {
+		dyn_persist_put(out, key);
+		dyn_persist_put(out, entry.mode);
+		dyn_persist_put(out, entry.page_start);
+		dyn_persist_put(out, entry.page_end);
+		dyn_persist_put(out, static_cast<uint16_t>(entry.guest_code.size()));
+		dyn_persist_put(out, static_cast<uint16_t>(entry.host_code.size()));
+		dyn_persist_put(out, static_cast<uint16_t>(entry.relocs.size()));
+		out.write(reinterpret_cast<const char*>(entry.guest_code.data()),
+		          static_cast<std::streamsize>(entry.guest_code.size()));
+		out.write(reinterpret_cast<const char*>(entry.host_code.data()),
+		          static_cast<std::streamsize>(entry.host_code.size()));
+		for (const auto& reloc : entry.relocs) {
+			dyn_persist_put(out, reloc.offset);
+			dyn_persist_put(out, reloc.type);
+			dyn_persist_put(out, reloc.tail);
+			dyn_persist_put(out, reloc.target);
+		}
+	}
+}
+
+static void dyn_persist_report()
+{
+	const auto& stats   = dyn_persist.stats;
+	const auto lookups  = stats.hits + stats.misses;
+	const auto hit_rate = lookups ? 100.0 * stats.hits / lookups : 0.0;
+	LOG_MSG("DYNREC: Translation cache: %u hits, %u misses (%.1f%% hit rate), "
+	        "%u mismatches, %u blocks captured",
+	        stats.hits, stats.misses, hit_rate, stats.mismatches, stats.captured);
+}
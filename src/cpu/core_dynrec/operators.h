@@ -17,6 +17,7 @@
  */
 
 #include "include/math_utils.h"
+#include "../string_bulk.h"
 
 static uint8_t DRC_CALL_CONV dynrec_add_byte(uint8_t op1,uint8_t op2) DRC_FC;
 static uint8_t DRC_CALL_CONV dynrec_add_byte(uint8_t op1,uint8_t op2) {
@@ -666,11 +667,11 @@ static uint32_t DRC_CALL_CONV dynrec_neg_dword_simple(uint32_t op) {
 static void dyn_sop_byte_gencall(SingleOps op) {
 	switch (op) {
 		case SOP_INC:
-			InvalidateFlagsPartially((void*)&dynrec_inc_byte_simple,t_INCb);
+			InvalidateFlagsMasked((void*)&dynrec_inc_byte_simple,t_INCb,FMASK_TEST & ~FLAG_CF);
 			gen_call_function_raw((void*)&dynrec_inc_byte);
 			break;
 		case SOP_DEC:
-			InvalidateFlagsPartially((void*)&dynrec_dec_byte_simple,t_DECb);
+			InvalidateFlagsMasked((void*)&dynrec_dec_byte_simple,t_DECb,FMASK_TEST & ~FLAG_CF);
 			gen_call_function_raw((void*)&dynrec_dec_byte);
 			break;
 		case SOP_NOT:
@@ -688,11 +689,11 @@ static void dyn_sop_word_gencall(SingleOps op,bool dword) {
 	if (dword) {
 		switch (op) {
 			case SOP_INC:
-				InvalidateFlagsPartially((void*)&dynrec_inc_dword_simple,t_INCd);
+				InvalidateFlagsMasked((void*)&dynrec_inc_dword_simple,t_INCd,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_inc_dword);
 				break;
 			case SOP_DEC:
-				InvalidateFlagsPartially((void*)&dynrec_dec_dword_simple,t_DECd);
+				InvalidateFlagsMasked((void*)&dynrec_dec_dword_simple,t_DECd,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_dec_dword);
 				break;
 			case SOP_NOT:
@@ -707,11 +708,11 @@ static void dyn_sop_word_gencall(SingleOps op,bool dword) {
 	} else {
 		switch (op) {
 			case SOP_INC:
-				InvalidateFlagsPartially((void*)&dynrec_inc_word_simple,t_INCw);
+				InvalidateFlagsMasked((void*)&dynrec_inc_word_simple,t_INCw,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_inc_word);
 				break;
 			case SOP_DEC:
-				InvalidateFlagsPartially((void*)&dynrec_dec_word_simple,t_DECw);
+				InvalidateFlagsMasked((void*)&dynrec_dec_word_simple,t_DECw,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_dec_word);
 				break;
 			case SOP_NOT:
@@ -1355,6 +1356,16 @@ static uint32_t DRC_CALL_CONV dynrec_get_nzf_and_sf_eq_of(void)	{ return TFLG_NL
 
 
 static void dyn_branchflag_to_reg(BranchTypes btype) {
+	switch (btype) {
+		case BR_O:case BR_NO:AcquireFlags(FLAG_OF);break;
+		case BR_B:case BR_NB:AcquireFlags(FLAG_CF);break;
+		case BR_Z:case BR_NZ:AcquireFlags(FLAG_ZF);break;
+		case BR_BE:case BR_NBE:AcquireFlags(FLAG_CF|FLAG_ZF);break;
+		case BR_S:case BR_NS:AcquireFlags(FLAG_SF);break;
+		case BR_P:case BR_NP:AcquireFlags(FLAG_PF);break;
+		case BR_L:case BR_NL:AcquireFlags(FLAG_SF|FLAG_OF);break;
+		case BR_LE:case BR_NLE:AcquireFlags(FLAG_ZF|FLAG_SF|FLAG_OF);break;
+	}
 	switch (btype) {
 		case BR_O:gen_call_function_raw((void*)&dynrec_get_of);break;
 		case BR_NO:gen_call_function_raw((void*)&dynrec_get_nof);break;
@@ -1641,6 +1652,28 @@ static void DRC_CALL_CONV dynrec_std(void) {
 }
 
 
+// Do the leading elements of a REP MOVS/STOS on host memory in bulk, the
+// rest goes the regular way
+template <typename T>
+static inline uint32_t dynrec_bulk_movs(uint32_t count,PhysPt si_base,PhysPt di_base,bool big_addr) {
+	const uint32_t add_mask=big_addr ? 0xffffffff : 0xffff;
+	uint32_t si_index=reg_esi & add_mask;
+	uint32_t di_index=reg_edi & add_mask;
+	const auto done=STRING_BulkMovs<T>(si_base,si_index,di_base,di_index,add_mask,count);
+	reg_esi=(reg_esi & ~add_mask) | si_index;
+	reg_edi=(reg_edi & ~add_mask) | di_index;
+	return done;
+}
+
+template <typename T>
+static inline uint32_t dynrec_bulk_stos(uint32_t count,PhysPt di_base,bool big_addr,T val) {
+	const uint32_t add_mask=big_addr ? 0xffffffff : 0xffff;
+	uint32_t di_index=reg_edi & add_mask;
+	const auto done=STRING_BulkStos<T>(di_base,di_index,add_mask,count,val);
+	reg_edi=(reg_edi & ~add_mask) | di_index;
+	return done;
+}
+
 static uint16_t DRC_CALL_CONV dynrec_movsb_word(uint16_t count,int16_t add_index,PhysPt si_base,PhysPt di_base) DRC_FC;
 static uint16_t DRC_CALL_CONV dynrec_movsb_word(uint16_t count,int16_t add_index,PhysPt si_base,PhysPt di_base) {
 	uint16_t count_left;
@@ -1651,6 +1684,7 @@ static uint16_t DRC_CALL_CONV dynrec_movsb_word(uint16_t count,int16_t add_index
 		count=(uint16_t)CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	count-=(uint16_t)dynrec_bulk_movs<uint8_t>(count,si_base,di_base,false);
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_di,mem_readb(si_base+reg_si));
 		reg_si+=add_index;
@@ -1669,6 +1703,7 @@ static uint32_t DRC_CALL_CONV dynrec_movsb_dword(uint32_t count,int32_t add_inde
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	count-=dynrec_bulk_movs<uint8_t>(count,si_base,di_base,true);
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_edi,mem_readb(si_base+reg_esi));
 		reg_esi+=add_index;
@@ -1688,6 +1723,7 @@ static uint16_t DRC_CALL_CONV dynrec_movsw_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
+	count-=(uint16_t)dynrec_bulk_movs<uint16_t>(count,si_base,di_base,false);
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_di,mem_readw(si_base+reg_si));
 		reg_si+=add_index;
@@ -1707,6 +1743,7 @@ static uint32_t DRC_CALL_CONV dynrec_movsw_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 1);
+	count-=dynrec_bulk_movs<uint16_t>(count,si_base,di_base,true);
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_edi,mem_readw(si_base+reg_esi));
 		reg_esi+=add_index;
@@ -1726,6 +1763,7 @@ static uint16_t DRC_CALL_CONV dynrec_movsd_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
+	count-=(uint16_t)dynrec_bulk_movs<uint32_t>(count,si_base,di_base,false);
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_di,mem_readd(si_base+reg_si));
 		reg_si+=add_index;
@@ -1745,6 +1783,7 @@ static uint32_t DRC_CALL_CONV dynrec_movsd_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
+	count-=dynrec_bulk_movs<uint32_t>(count,si_base,di_base,true);
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_edi,mem_readd(si_base+reg_esi));
 		reg_esi+=add_index;
@@ -1871,6 +1910,7 @@ static uint16_t DRC_CALL_CONV dynrec_stosb_word(uint16_t count,int16_t add_index
 		count=(uint16_t)CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	count-=(uint16_t)dynrec_bulk_stos<uint8_t>(count,di_base,false,reg_al);
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_di,reg_al);
 		reg_di+=add_index;
@@ -1888,6 +1928,7 @@ static uint32_t DRC_CALL_CONV dynrec_stosb_dword(uint32_t count,int32_t add_inde
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	count-=dynrec_bulk_stos<uint8_t>(count,di_base,true,reg_al);
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_edi,reg_al);
 		reg_edi+=add_index;
@@ -1906,6 +1947,7 @@ static uint16_t DRC_CALL_CONV dynrec_stosw_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 1);
+	count-=(uint16_t)dynrec_bulk_stos<uint16_t>(count,di_base,false,reg_ax);
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_di,reg_ax);
 		reg_di+=add_index;
@@ -1924,6 +1966,7 @@ static uint32_t DRC_CALL_CONV dynrec_stosw_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 1);
+	count-=dynrec_bulk_stos<uint16_t>(count,di_base,true,reg_ax);
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_edi,reg_ax);
 		reg_edi+=add_index;
@@ -1942,6 +1985,7 @@ static uint16_t DRC_CALL_CONV dynrec_stosd_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
+	count-=(uint16_t)dynrec_bulk_stos<uint32_t>(count,di_base,false,reg_eax);
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_di,reg_eax);
 		reg_di+=add_index;
@@ -1960,6 +2004,7 @@ static uint32_t DRC_CALL_CONV dynrec_stosd_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index = left_shift_signed(add_index, 2);
+	count-=dynrec_bulk_stos<uint32_t>(count,di_base,true,reg_eax);
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_edi,reg_eax);
 		reg_edi+=add_index;
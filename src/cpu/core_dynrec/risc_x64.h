@@ -29,6 +29,9 @@
 // try to replace _simple functions by code
 #define DRC_FLAGS_INVALIDATION_DCODE
 
+// address-dependent fields are reported, translations can be persisted
+#define DRC_PERSISTENT_CACHE
+
 // calling convention modifier
 #define DRC_CALL_CONV	/* nothing */
 #define DRC_FC			/* nothing */
@@ -97,12 +100,14 @@ static inline void gen_reg_memaddr(HostReg reg,void* data,uint8_t op,uint8_t pre
 		cache_addb(op);
 		cache_addb(0x05+(reg<<3));
 		// RIP-relative addressing is offset after the instruction 
+		dyn_persist_note_reloc(DynRelocType::RipRel32,cache.pos,data);
 		cache_addd((uint32_t)(((uint64_t)diff)&0xffffffffLL)); 
 	} else if ((uint64_t)data<0x100000000LL) {
 		// mov reg,[data] (or similar, depending on the op) when absolute address of data is <4GB
 		if(prefix) cache_addb(prefix);
 		cache_addb(op);
 		cache_addw(0x2504+(reg<<3));
+		dyn_persist_note_reloc(DynRelocType::Abs32,cache.pos,data);
 		cache_addd((uint32_t)(((uint64_t)data)&0xffffffffLL));
 	} else {
 		// load 64-bit data into tmp_reg and do mov reg,[tmp_reg] (or similar, depending on the op)
@@ -128,6 +133,7 @@ static inline void gen_memaddr(Bitu modreg,void* data,Bitu off,Bitu imm,uint8_t
 		// RIP-relative addressing is offset after the instruction 
 		if(prefix) cache_addb(prefix);
 		cache_addw(op+((modreg+1)<<8));
+		dyn_persist_note_reloc(DynRelocType::RipRel32,cache.pos,data,(uint8_t)off);
 		cache_addd((uint32_t)(((uint64_t)diff)&0xffffffffLL));
 
 		switch(off) {
@@ -140,6 +146,7 @@ static inline void gen_memaddr(Bitu modreg,void* data,Bitu off,Bitu imm,uint8_t
 		if(prefix) cache_addb(prefix);
 		cache_addw(op+(modreg<<8));
 		cache_addb(0x25);
+		dyn_persist_note_reloc(DynRelocType::Abs32,cache.pos,data);
 		cache_addd((uint32_t)(((uint64_t)data)&0xffffffffLL));
 
 		switch(off) {
@@ -190,11 +197,13 @@ static void gen_mov_dword_to_reg_imm(HostReg dest_reg,uint32_t imm) {
 // move a 64bit constant value into a full register
 static void gen_mov_reg_qword(HostReg dest_reg,uint64_t imm) {
 	if (imm==(uint32_t)imm) {
+		dyn_persist_note_reloc(DynRelocType::Abs32,cache.pos+1,(void*)imm);
 		gen_mov_dword_to_reg_imm(dest_reg, (uint32_t)imm);
 		return;
 	}
 	cache_addb(0x48);
 	cache_addb(0xb8+dest_reg);			// mov dest_reg,imm
+	dyn_persist_note_reloc(DynRelocType::Abs64,cache.pos,(void*)imm);
 	cache_addq(imm);
 }
 
@@ -373,6 +382,7 @@ static inline void gen_lea(HostReg dest_reg,Bitu scale,Bits imm) {
 // generate a call to a parameterless function
 static void inline gen_call_function_raw(void * func) {
 	cache_addw(0xb848);
+	dyn_persist_note_reloc(DynRelocType::Abs64,cache.pos,func);
 	cache_addq((uint64_t)func);
 	cache_addw(0xd0ff);
 }
@@ -433,10 +443,12 @@ static void inline gen_load_param_addr(Bitu addr,Bitu param) {
 #if defined (_WIN64)
 		case 2:			// mov r8,addr64
 			cache_addw(0xb849);
+			dyn_persist_note_reloc(DynRelocType::Abs64,cache.pos,(void*)addr);
 			cache_addq(addr);
 			break;
 		case 3:			// mov r9,addr64
 			cache_addw(0xb949);
+			dyn_persist_note_reloc(DynRelocType::Abs64,cache.pos,(void*)addr);
 			cache_addq(addr);
 			break;
 #else
@@ -522,6 +534,7 @@ static void inline gen_load_param_mem(Bitu mem,Bitu param) {
 // jump to an address pointed at by ptr, offset is in imm
 static void gen_jmp_ptr(void * ptr,Bits imm=0) {
 	cache_addw(0xa148);		// mov rax,[data]
+	dyn_persist_note_reloc(DynRelocType::Abs64,cache.pos,ptr);
 	cache_addq((uint64_t)ptr);
 
 	cache_addb(0xff);		// jmp [rax+imm]
@@ -620,6 +633,7 @@ static void gen_return_function(void) {
 // check gen_call_function_raw and gen_call_function_setup
 // for the targeted code
 static void gen_fill_function_ptr(const uint8_t * pos,void* fct_ptr,Bitu flags_type) {
+	dyn_persist_drop_reloc(pos+2);
 #ifdef DRC_FLAGS_INVALIDATION_DCODE
 	// try to avoid function calls but rather directly fill in code
 	switch (flags_type) {
@@ -689,6 +703,7 @@ static void gen_fill_function_ptr(const uint8_t * pos,void* fct_ptr,Bitu flags_t
 			return;
 	}
 #endif
+	dyn_persist_note_reloc(DynRelocType::Abs64,pos+2,fct_ptr);
 	cache_addq((uint64_t)fct_ptr,pos+2);      // fill function pointer
 }
 #endif
@@ -18,8 +18,8 @@
 
 {
 	EAPoint si_base,di_base;
-	Bitu	si_index,di_index;
-	Bitu	add_mask;
+	uint32_t	si_index,di_index;
+	uint32_t	add_mask;
 	Bitu count, count_left = 0;
 	Bits	add_index;
 	
@@ -96,46 +96,64 @@
 		}
 		break;
 	case R_STOSB:
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkStos<uint8_t>(di_base,di_index,add_mask,count,reg_al);
+			if (!count) break;
 			SaveMb(di_base+di_index,reg_al);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_STOSW:
 		add_index *= 2;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkStos<uint16_t>(di_base,di_index,add_mask,count,reg_ax);
+			if (!count) break;
 			SaveMw(di_base+di_index,reg_ax);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_STOSD:
 		add_index *= 4;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkStos<uint32_t>(di_base,di_index,add_mask,count,reg_eax);
+			if (!count) break;
 			SaveMd(di_base+di_index,reg_eax);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSB:
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkMovs<uint8_t>(si_base,si_index,di_base,di_index,add_mask,count);
+			if (!count) break;
 			SaveMb(di_base+di_index,LoadMb(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSW:
 		add_index *= 2;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkMovs<uint16_t>(si_base,si_index,di_base,di_index,add_mask,count);
+			if (!count) break;
 			SaveMw(di_base+di_index,LoadMw(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSD:
 		add_index *= 4;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkMovs<uint32_t>(si_base,si_index,di_base,di_index,add_mask,count);
+			if (!count) break;
 			SaveMd(di_base+di_index,LoadMd(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_LODSB:
@@ -133,14 +133,51 @@ static inline uint32_t Fetchd() {
 #include "instructions.h"
 #include "core_normal/support.h"
 #include "core_normal/string.h"
+#include "core_normal/timing.h"
 
 
 #define EALookupTable (core.ea_table)
 
-Bits CPU_Core_Normal_Run() noexcept
+static CycleTiming core_timing = CycleTiming::Flat;
+
+static constexpr CycleTimingTable timing_tables[] = {
+        {},
+        intel8086_timing(),
+        intel286_timing(),
+        intel386_timing(),
+        intel486_timing(),
+};
+
+// Looks at the ModRM byte ahead, if the opcode has one, to tell the register
+// form from the memory form
+template <CycleTiming timing>
+static inline int32_t opcode_clocks(const Bitu opcode_index)
 {
-	ZoneScoped;
-	while (CPU_Cycles-->0) {
+	constexpr auto& table = timing_tables[static_cast<size_t>(timing)];
+
+	const auto opcode  = opcode_index & 0x1ff;
+	const auto& clocks = table.opcodes[opcode];
+	if (!clocks.mem) {
+		return clocks.reg;
+	}
+	const auto modrm = LoadMb(core.cseip);
+	if (opcode == 0xf6 || opcode == 0xf7) {
+		const auto& op_clocks = table.group3[opcode & 1][(modrm >> 3) & 7];
+		return modrm >= 0xc0 ? op_clocks.reg : op_clocks.mem;
+	}
+	return modrm >= 0xc0 ? clocks.reg : clocks.mem;
+}
+
+// Each timing gets its own copy of the core, so the flat one is as lean as
+// it's always been
+template <CycleTiming timing>
+static Bits core_normal_run()
+{
+	constexpr bool is_flat = (timing == CycleTiming::Flat);
+
+	// The flat timing charges its single cycle up front, the others charge
+	// each opcode and prefix as it's decoded
+	while (is_flat ? CPU_Cycles-- > 0 : CPU_Cycles > 0) {
 		LOADIP;
 		core.opcode_index=cpu.code.big*0x200;
 		core.prefixes=cpu.code.big;
@@ -158,7 +195,11 @@ Bits CPU_Core_Normal_Run() noexcept
 		cycle_count++;
 #endif
 restart_opcode:
-		switch (core.opcode_index+Fetchb()) {
+		const auto opcode_index = core.opcode_index + Fetchb();
+		if constexpr (!is_flat) {
+			CPU_Cycles -= opcode_clocks<timing>(opcode_index);
+		}
+		switch (opcode_index) {
 		#include "core_normal/prefix_none.h"
 		#include "core_normal/prefix_0f.h"
 		#include "core_normal/prefix_66.h"
@@ -191,6 +232,23 @@ decode_end:
 	return CBRET_NONE;
 }
 
+Bits CPU_Core_Normal_Run() noexcept
+{
+	ZoneScoped;
+	switch (core_timing) {
+	case CycleTiming::Flat: return core_normal_run<CycleTiming::Flat>();
+	case CycleTiming::Intel8086:
+		return core_normal_run<CycleTiming::Intel8086>();
+	case CycleTiming::Intel286:
+		return core_normal_run<CycleTiming::Intel286>();
+	case CycleTiming::Intel386:
+		return core_normal_run<CycleTiming::Intel386>();
+	case CycleTiming::Intel486:
+		return core_normal_run<CycleTiming::Intel486>();
+	}
+	return core_normal_run<CycleTiming::Flat>();
+}
+
 Bits CPU_Core_Normal_Trap_Run() noexcept
 {
 	Bits oldCycles = CPU_Cycles;
@@ -205,6 +263,11 @@ Bits CPU_Core_Normal_Trap_Run() noexcept
 	return ret;
 }
 
+void CPU_Core_Normal_SetTiming(const CycleTiming timing)
+{
+	core_timing = timing;
+}
+
 void CPU_Core_Normal_Init(void) {
 
 }
@@ -16,6 +16,7 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../string_bulk.h"
 #include "../string_ops.h"
 
 #define LoadD(_BLAH) _BLAH
@@ -92,46 +93,64 @@ static void DoString(STRING_OP type) {
 		}
 		break;
 	case R_STOSB:
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkStos<uint8_t>(di_base,di_index,add_mask,count,reg_al);
+			if (!count) break;
 			SaveMb(di_base+di_index,reg_al);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_STOSW:
 		add_index *= 2;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkStos<uint16_t>(di_base,di_index,add_mask,count,reg_ax);
+			if (!count) break;
 			SaveMw(di_base+di_index,reg_ax);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_STOSD:
 		add_index *= 4;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkStos<uint32_t>(di_base,di_index,add_mask,count,reg_eax);
+			if (!count) break;
 			SaveMd(di_base+di_index,reg_eax);
 			di_index=(di_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSB:
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkMovs<uint8_t>(si_base,si_index,di_base,di_index,add_mask,count);
+			if (!count) break;
 			SaveMb(di_base+di_index,LoadMb(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSW:
 		add_index *= 2;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkMovs<uint16_t>(si_base,si_index,di_base,di_index,add_mask,count);
+			if (!count) break;
 			SaveMw(di_base+di_index,LoadMw(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_MOVSD:
 		add_index *= 4;
-		for (;count>0;count--) {
+		while (count>0) {
+			count-=STRING_BulkMovs<uint32_t>(si_base,si_index,di_base,di_index,add_mask,count);
+			if (!count) break;
 			SaveMd(di_base+di_index,LoadMd(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
 			si_index=(si_index+add_index) & add_mask;
+			count--;
 		}
 		break;
 	case R_LODSB:
@@ -0,0 +1,516 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*  Instruction Timing
+ *  ------------------
+ *  Clock counts of the one-byte and the 0Fh two-byte opcodes, taken from
+ *  the Intel programmer's reference manuals. Each opcode has a count for
+ *  its register form and one for its memory form; opcodes without a ModRM
+ *  byte only have the former. Where a count depends on the operands, the
+ *  branch being taken or the number of iterations, a typical value is
+ *  used. The memory forms of the 8086 include a typical effective address
+ *  calculation of eight clocks, which the later processors don't charge.
+ *
+ *  The 32-bit operand size forms share the counts of the 16-bit ones. The
+ *  timing of the MUL and DIV group (F6h and F7h) varies too much to share a
+ *  single count, so it's looked up by the reg field of its ModRM byte.
+ *
+ *  Prefixes are charged as opcodes of their own, and the string
+ *  instructions with a REP prefix are charged once and then a cycle per
+ *  iteration, like the flat timing does.
+ */
+
+#include <array>
+#include <cstdint>
+
+#include "cpu.h"
+
+struct OpcodeClocks {
+	uint8_t reg = 1;
+	// Zero if the opcode doesn't have a ModRM byte
+	uint8_t mem = 0;
+};
+
+struct CycleTimingTable {
+	// The one-byte opcodes followed by the 0Fh ones
+	std::array<OpcodeClocks, 0x200> opcodes = {};
+
+	// The MUL and DIV group by the reg field, for byte and word operands
+	std::array<std::array<OpcodeClocks, 8>, 2> group3 = {};
+
+	constexpr void Set(const uint16_t first, const uint16_t last,
+	                   const uint8_t reg, const uint8_t mem = 0)
+	{
+		for (auto opcode = first; opcode <= last; ++opcode) {
+			opcodes[opcode] = {reg, mem};
+		}
+	}
+
+	// The eight arithmetic and logic instructions from 00h to 3Dh, which
+	// come as r/m,reg then reg,r/m then accumulator,immediate
+	constexpr void SetAlu(const uint8_t reg, const uint8_t mem_to_rm,
+	                      const uint8_t mem_to_reg, const uint8_t acc_imm)
+	{
+		for (uint16_t base = 0x00; base < 0x40; base += 0x08) {
+			Set(base + 0, base + 1, reg, mem_to_rm);
+			Set(base + 2, base + 3, reg, mem_to_reg);
+			Set(base + 4, base + 5, acc_imm);
+		}
+	}
+
+	constexpr void SetGroup3(const int size, const OpcodeClocks test,
+	                         const OpcodeClocks not_neg,
+	                         const OpcodeClocks mul, const OpcodeClocks imul,
+	                         const OpcodeClocks div, const OpcodeClocks idiv)
+	{
+		group3[size] = {test, test, not_neg, not_neg, mul, imul, div, idiv};
+	}
+};
+
+// The 0Fh opcodes of the 386, which the 8086 and 286 tables share so the
+// instructions they lack still cost a sensible amount
+constexpr void set_386_two_byte_clocks(CycleTimingTable& t)
+{
+	// Most 0Fh opcodes have no ModRM byte, so only the ones listed with a
+	// memory form read the byte after the opcode
+	t.Set(0x100, 0x1ff, 10);
+	t.Set(0x100, 0x103, 10, 12);   // groups 6 and 7, LAR, LSL
+	t.Set(0x106, 0x106, 5);        // CLTS
+	t.Set(0x108, 0x109, 4);        // INVD, WBINVD
+	t.Set(0x120, 0x123, 6, 6);     // MOV CRx/DRx
+	t.Set(0x180, 0x18f, 5);        // Jcc near
+	t.Set(0x190, 0x19f, 4, 5);     // SETcc
+	t.Set(0x1a0, 0x1a0, 2);        // PUSH FS
+	t.Set(0x1a1, 0x1a1, 7);        // POP FS
+	t.Set(0x1a2, 0x1a2, 14);       // CPUID
+	t.Set(0x1a3, 0x1a3, 3, 12);    // BT
+	t.Set(0x1a4, 0x1a5, 3, 7);     // SHLD
+	t.Set(0x1a8, 0x1a8, 2);        // PUSH GS
+	t.Set(0x1a9, 0x1a9, 7);        // POP GS
+	t.Set(0x1ab, 0x1ab, 6, 13);    // BTS
+	t.Set(0x1ac, 0x1ad, 3, 7);     // SHRD
+	t.Set(0x1af, 0x1af, 20, 22);   // IMUL reg,r/m
+	t.Set(0x1b0, 0x1b1, 6, 8);     // CMPXCHG
+	t.Set(0x1b2, 0x1b2, 7, 7);     // LSS
+	t.Set(0x1b3, 0x1b3, 6, 13);    // BTR
+	t.Set(0x1b4, 0x1b5, 7, 7);     // LFS, LGS
+	t.Set(0x1b6, 0x1b7, 3, 6);     // MOVZX
+	t.Set(0x1ba, 0x1ba, 3, 8);     // BT group
+	t.Set(0x1bb, 0x1bb, 6, 13);    // BTC
+	t.Set(0x1bc, 0x1bd, 11, 11);   // BSF, BSR
+	t.Set(0x1be, 0x1bf, 3, 6);     // MOVSX
+	t.Set(0x1c0, 0x1c1, 3, 4);     // XADD
+	t.Set(0x1c8, 0x1cf, 1);        // BSWAP
+}
+
+constexpr CycleTimingTable intel8086_timing()
+{
+	CycleTimingTable t = {};
+	t.Set(0x00, 0xff, 2);
+	t.SetAlu(3, 24, 17, 4);
+	t.Set(0x38, 0x39, 3, 17);      // CMP r/m,reg only reads
+	t.Set(0x06, 0x06, 10);         // PUSH ES
+	t.Set(0x07, 0x07, 8);          // POP ES
+	t.Set(0x0e, 0x0e, 10);         // PUSH CS
+	t.Set(0x0f, 0x0f, 0);          // two-byte opcodes
+	t.Set(0x16, 0x16, 10);         // PUSH SS
+	t.Set(0x17, 0x17, 8);          // POP SS
+	t.Set(0x1e, 0x1e, 10);         // PUSH DS
+	t.Set(0x1f, 0x1f, 8);          // POP DS
+	t.Set(0x27, 0x27, 4);          // DAA
+	t.Set(0x2f, 0x2f, 4);          // DAS
+	t.Set(0x37, 0x37, 8);          // AAA
+	t.Set(0x3f, 0x3f, 8);          // AAS
+	t.Set(0x40, 0x4f, 2);          // INC, DEC
+	t.Set(0x50, 0x57, 11);         // PUSH
+	t.Set(0x58, 0x5f, 8);          // POP
+	t.Set(0x60, 0x60, 36);         // PUSHA
+	t.Set(0x61, 0x61, 51);         // POPA
+	t.Set(0x62, 0x62, 35, 35);     // BOUND
+	t.Set(0x63, 0x63, 10, 11);     // ARPL
+	t.Set(0x68, 0x68, 10);         // PUSH imm
+	t.Set(0x69, 0x69, 22, 29);     // IMUL reg,r/m,imm
+	t.Set(0x6a, 0x6a, 10);         // PUSH imm
+	t.Set(0x6b, 0x6b, 22, 29);     // IMUL reg,r/m,imm
+	t.Set(0x6c, 0x6f, 14);         // INS, OUTS
+	t.Set(0x70, 0x7f, 12);         // Jcc
+	t.Set(0x80, 0x83, 4, 25);      // ALU r/m,imm
+	t.Set(0x84, 0x85, 3, 17);      // TEST
+	t.Set(0x86, 0x87, 4, 25);      // XCHG
+	t.Set(0x88, 0x89, 2, 17);      // MOV r/m,reg
+	t.Set(0x8a, 0x8b, 2, 16);      // MOV reg,r/m
+	t.Set(0x8c, 0x8c, 2, 17);      // MOV r/m,sreg
+	t.Set(0x8d, 0x8d, 2, 10);      // LEA
+	t.Set(0x8e, 0x8e, 2, 16);      // MOV sreg,r/m
+	t.Set(0x8f, 0x8f, 8, 25);      // POP r/m
+	t.Set(0x90, 0x97, 3);          // XCHG AX,reg
+	t.Set(0x99, 0x99, 5);          // CWD
+	t.Set(0x9a, 0x9a, 28);         // CALL far
+	t.Set(0x9b, 0x9b, 4);          // WAIT
+	t.Set(0x9c, 0x9c, 10);         // PUSHF
+	t.Set(0x9d, 0x9d, 8);          // POPF
+	t.Set(0x9e, 0x9f, 4);          // SAHF, LAHF
+	t.Set(0xa0, 0xa3, 10);         // MOV acc,moffs
+	t.Set(0xa4, 0xa5, 18);         // MOVS
+	t.Set(0xa6, 0xa7, 22);         // CMPS
+	t.Set(0xa8, 0xa9, 4);          // TEST acc,imm
+	t.Set(0xaa, 0xab, 11);         // STOS
+	t.Set(0xac, 0xad, 12);         // LODS
+	t.Set(0xae, 0xaf, 15);         // SCAS
+	t.Set(0xb0, 0xbf, 4);          // MOV reg,imm
+	t.Set(0xc0, 0xc1, 9, 25);      // shift r/m,imm
+	t.Set(0xc2, 0xc2, 20);         // RET imm
+	t.Set(0xc3, 0xc3, 16);         // RET
+	t.Set(0xc4, 0xc5, 24, 24);     // LES, LDS
+	t.Set(0xc6, 0xc7, 4, 18);      // MOV r/m,imm
+	t.Set(0xc8, 0xc8, 15);         // ENTER
+	t.Set(0xc9, 0xc9, 8);          // LEAVE
+	t.Set(0xca, 0xca, 25);         // RETF imm
+	t.Set(0xcb, 0xcb, 26);         // RETF
+	t.Set(0xcc, 0xcc, 52);         // INT 3
+	t.Set(0xcd, 0xcd, 51);         // INT
+	t.Set(0xce, 0xce, 4);          // INTO
+	t.Set(0xcf, 0xcf, 24);         // IRET
+	t.Set(0xd0, 0xd1, 2, 23);      // shift r/m,1
+	t.Set(0xd2, 0xd3, 12, 28);     // shift r/m,CL
+	t.Set(0xd4, 0xd4, 83);         // AAM
+	t.Set(0xd5, 0xd5, 60);         // AAD
+	t.Set(0xd6, 0xd6, 4);          // SALC
+	t.Set(0xd7, 0xd7, 11);         // XLAT
+	t.Set(0xd8, 0xdf, 80, 90);     // 8087 instructions
+	t.Set(0xe0, 0xe1, 18);         // LOOPNZ, LOOPZ
+	t.Set(0xe2, 0xe2, 17);         // LOOP
+	t.Set(0xe3, 0xe3, 18);         // JCXZ
+	t.Set(0xe4, 0xe7, 10);         // IN, OUT imm
+	t.Set(0xe8, 0xe8, 19);         // CALL near
+	t.Set(0xe9, 0xeb, 15);         // JMP
+	t.Set(0xec, 0xef, 8);          // IN, OUT DX
+	t.Set(0xf6, 0xf7, 3, 24);      // MUL and DIV group
+	t.Set(0xfe, 0xff, 3, 23);      // INC, DEC, CALL, JMP, PUSH r/m
+	t.SetGroup3(0, {5, 19}, {3, 24}, {74, 82}, {85, 94}, {85, 94}, {106, 115});
+	t.SetGroup3(1, {5, 19}, {3, 24}, {124, 132}, {134, 144}, {153, 162}, {174, 183});
+	set_386_two_byte_clocks(t);
+	return t;
+}
+
+constexpr CycleTimingTable intel286_timing()
+{
+	CycleTimingTable t = {};
+	t.Set(0x00, 0xff, 2);
+	t.SetAlu(2, 7, 7, 3);
+	t.Set(0x06, 0x06, 3);          // PUSH ES
+	t.Set(0x07, 0x07, 5);          // POP ES
+	t.Set(0x0e, 0x0e, 3);          // PUSH CS
+	t.Set(0x0f, 0x0f, 0);          // two-byte opcodes
+	t.Set(0x16, 0x16, 3);          // PUSH SS
+	t.Set(0x17, 0x17, 5);          // POP SS
+	t.Set(0x1e, 0x1e, 3);          // PUSH DS
+	t.Set(0x1f, 0x1f, 5);          // POP DS
+	t.Set(0x26, 0x26, 0);          // segment prefixes
+	t.Set(0x2e, 0x2e, 0);
+	t.Set(0x36, 0x36, 0);
+	t.Set(0x3e, 0x3e, 0);
+	t.Set(0x27, 0x27, 3);          // DAA
+	t.Set(0x2f, 0x2f, 3);          // DAS
+	t.Set(0x37, 0x37, 3);          // AAA
+	t.Set(0x3f, 0x3f, 3);          // AAS
+	t.Set(0x40, 0x4f, 2);          // INC, DEC
+	t.Set(0x50, 0x57, 3);          // PUSH
+	t.Set(0x58, 0x5f, 5);          // POP
+	t.Set(0x60, 0x60, 17);         // PUSHA
+	t.Set(0x61, 0x61, 19);         // POPA
+	t.Set(0x62, 0x62, 13, 13);     // BOUND
+	t.Set(0x63, 0x63, 10, 11);     // ARPL
+	t.Set(0x64, 0x67, 0);          // FS, GS and size prefixes
+	t.Set(0x68, 0x68, 3);          // PUSH imm
+	t.Set(0x69, 0x69, 21, 24);     // IMUL reg,r/m,imm
+	t.Set(0x6a, 0x6a, 3);          // PUSH imm
+	t.Set(0x6b, 0x6b, 21, 24);     // IMUL reg,r/m,imm
+	t.Set(0x6c, 0x6f, 5);          // INS, OUTS
+	t.Set(0x70, 0x7f, 5);          // Jcc
+	t.Set(0x80, 0x83, 3, 7);       // ALU r/m,imm
+	t.Set(0x84, 0x85, 2, 6);       // TEST
+	t.Set(0x86, 0x87, 3, 5);       // XCHG
+	t.Set(0x88, 0x89, 2, 3);       // MOV r/m,reg
+	t.Set(0x8a, 0x8b, 2, 5);       // MOV reg,r/m
+	t.Set(0x8c, 0x8c, 2, 3);       // MOV r/m,sreg
+	t.Set(0x8d, 0x8d, 3, 3);       // LEA
+	t.Set(0x8e, 0x8e, 2, 5);       // MOV sreg,r/m
+	t.Set(0x8f, 0x8f, 5, 5);       // POP r/m
+	t.Set(0x90, 0x97, 3);          // XCHG AX,reg
+	t.Set(0x9a, 0x9a, 13);         // CALL far
+	t.Set(0x9b, 0x9b, 3);          // WAIT
+	t.Set(0x9c, 0x9c, 3);          // PUSHF
+	t.Set(0x9d, 0x9d, 5);          // POPF
+	t.Set(0xa0, 0xa1, 5);          // MOV acc,moffs
+	t.Set(0xa2, 0xa3, 3);          // MOV moffs,acc
+	t.Set(0xa4, 0xa5, 5);          // MOVS
+	t.Set(0xa6, 0xa7, 8);          // CMPS
+	t.Set(0xa8, 0xa9, 3);          // TEST acc,imm
+	t.Set(0xaa, 0xab, 3);          // STOS
+	t.Set(0xac, 0xad, 5);          // LODS
+	t.Set(0xae, 0xaf, 7);          // SCAS
+	t.Set(0xb0, 0xbf, 2);          // MOV reg,imm
+	t.Set(0xc0, 0xc1, 5, 8);       // shift r/m,imm
+	t.Set(0xc2, 0xc3, 11);         // RET
+	t.Set(0xc4, 0xc5, 7, 7);       // LES, LDS
+	t.Set(0xc6, 0xc7, 2, 3);       // MOV r/m,imm
+	t.Set(0xc8, 0xc8, 11);         // ENTER
+	t.Set(0xc9, 0xc9, 5);          // LEAVE
+	t.Set(0xca, 0xcb, 15);         // RETF
+	t.Set(0xcc, 0xcd, 23);         // INT 3, INT
+	t.Set(0xce, 0xce, 3);          // INTO
+	t.Set(0xcf, 0xcf, 17);         // IRET
+	t.Set(0xd0, 0xd1, 2, 7);       // shift r/m,1
+	t.Set(0xd2, 0xd3, 5, 8);       // shift r/m,CL
+	t.Set(0xd4, 0xd4, 16);         // AAM
+	t.Set(0xd5, 0xd5, 14);         // AAD
+	t.Set(0xd6, 0xd6, 3);          // SALC
+	t.Set(0xd7, 0xd7, 5);          // XLAT
+	t.Set(0xd8, 0xdf, 80, 90);     // 80287 instructions
+	t.Set(0xe0, 0xe2, 8);          // LOOPNZ, LOOPZ, LOOP
+	t.Set(0xe3, 0xe3, 8);          // JCXZ
+	t.Set(0xe4, 0xe5, 5);          // IN imm
+	t.Set(0xe6, 0xe7, 3);          // OUT imm
+	t.Set(0xe8, 0xe9, 7);          // CALL, JMP near
+	t.Set(0xea, 0xea, 11);         // JMP far
+	t.Set(0xeb, 0xeb, 7);          // JMP short
+	t.Set(0xec, 0xed, 5);          // IN DX
+	t.Set(0xee, 0xef, 3);          // OUT DX
+	t.Set(0xf0, 0xf0, 0);          // LOCK
+	t.Set(0xf2, 0xf3, 0);          // REP
+	t.Set(0xf6, 0xf7, 2, 7);       // MUL and DIV group
+	t.Set(0xfe, 0xff, 2, 7);       // INC, DEC, CALL, JMP, PUSH r/m
+	t.SetGroup3(0, {2, 6}, {2, 7}, {13, 16}, {13, 16}, {14, 17}, {17, 20});
+	t.SetGroup3(1, {2, 6}, {2, 7}, {21, 24}, {21, 24}, {22, 25}, {25, 28});
+	set_386_two_byte_clocks(t);
+	return t;
+}
+
+constexpr CycleTimingTable intel386_timing()
+{
+	CycleTimingTable t = {};
+	t.Set(0x00, 0xff, 2);
+	t.SetAlu(2, 7, 6, 2);
+	t.Set(0x38, 0x39, 2, 5);       // CMP r/m,reg only reads
+	t.Set(0x06, 0x06, 2);          // PUSH ES
+	t.Set(0x07, 0x07, 7);          // POP ES
+	t.Set(0x0e, 0x0e, 2);          // PUSH CS
+	t.Set(0x0f, 0x0f, 0);          // two-byte opcodes
+	t.Set(0x16, 0x16, 2);          // PUSH SS
+	t.Set(0x17, 0x17, 7);          // POP SS
+	t.Set(0x1e, 0x1e, 2);          // PUSH DS
+	t.Set(0x1f, 0x1f, 7);          // POP DS
+	t.Set(0x26, 0x26, 0);          // segment prefixes
+	t.Set(0x2e, 0x2e, 0);
+	t.Set(0x36, 0x36, 0);
+	t.Set(0x3e, 0x3e, 0);
+	t.Set(0x27, 0x27, 4);          // DAA
+	t.Set(0x2f, 0x2f, 4);          // DAS
+	t.Set(0x37, 0x37, 4);          // AAA
+	t.Set(0x3f, 0x3f, 4);          // AAS
+	t.Set(0x40, 0x4f, 2);          // INC, DEC
+	t.Set(0x50, 0x57, 2);          // PUSH
+	t.Set(0x58, 0x5f, 4);          // POP
+	t.Set(0x60, 0x60, 18);         // PUSHA
+	t.Set(0x61, 0x61, 24);         // POPA
+	t.Set(0x62, 0x62, 10, 10);     // BOUND
+	t.Set(0x63, 0x63, 20, 21);     // ARPL
+	t.Set(0x64, 0x67, 0);          // FS, GS and size prefixes
+	t.Set(0x68, 0x68, 2);          // PUSH imm
+	t.Set(0x69, 0x69, 20, 22);     // IMUL reg,r/m,imm
+	t.Set(0x6a, 0x6a, 2);          // PUSH imm
+	t.Set(0x6b, 0x6b, 20, 22);     // IMUL reg,r/m,imm
+	t.Set(0x6c, 0x6d, 15);         // INS
+	t.Set(0x6e, 0x6f, 14);         // OUTS
+	t.Set(0x70, 0x7f, 5);          // Jcc
+	t.Set(0x80, 0x83, 2, 7);       // ALU r/m,imm
+	t.Set(0x84, 0x85, 2, 5);       // TEST
+	t.Set(0x86, 0x87, 3, 5);       // XCHG
+	t.Set(0x88, 0x89, 2, 2);       // MOV r/m,reg
+	t.Set(0x8a, 0x8b, 2, 4);       // MOV reg,r/m
+	t.Set(0x8c, 0x8c, 2, 2);       // MOV r/m,sreg
+	t.Set(0x8d, 0x8d, 2, 2);       // LEA
+	t.Set(0x8e, 0x8e, 2, 5);       // MOV sreg,r/m
+	t.Set(0x8f, 0x8f, 5, 5);       // POP r/m
+	t.Set(0x90, 0x97, 3);          // XCHG AX,reg
+	t.Set(0x98, 0x98, 3);          // CBW
+	t.Set(0x9a, 0x9a, 17);         // CALL far
+	t.Set(0x9b, 0x9b, 6);          // WAIT
+	t.Set(0x9c, 0x9c, 4);          // PUSHF
+	t.Set(0x9d, 0x9d, 5);          // POPF
+	t.Set(0x9e, 0x9e, 3);          // SAHF
+	t.Set(0xa0, 0xa1, 4);          // MOV acc,moffs
+	t.Set(0xa2, 0xa3, 2);          // MOV moffs,acc
+	t.Set(0xa4, 0xa5, 7);          // MOVS
+	t.Set(0xa6, 0xa7, 10);         // CMPS
+	t.Set(0xa8, 0xa9, 2);          // TEST acc,imm
+	t.Set(0xaa, 0xab, 4);          // STOS
+	t.Set(0xac, 0xad, 5);          // LODS
+	t.Set(0xae, 0xaf, 7);          // SCAS
+	t.Set(0xb0, 0xbf, 2);          // MOV reg,imm
+	t.Set(0xc0, 0xc1, 3, 7);       // shift r/m,imm
+	t.Set(0xc2, 0xc3, 10);         // RET
+	t.Set(0xc4, 0xc5, 7, 7);       // LES, LDS
+	t.Set(0xc6, 0xc7, 2, 2);       // MOV r/m,imm
+	t.Set(0xc8, 0xc8, 10);         // ENTER
+	t.Set(0xc9, 0xc9, 4);          // LEAVE
+	t.Set(0xca, 0xcb, 18);         // RETF
+	t.Set(0xcc, 0xcc, 33);         // INT 3
+	t.Set(0xcd, 0xcd, 37);         // INT
+	t.Set(0xce, 0xce, 3);          // INTO
+	t.Set(0xcf, 0xcf, 22);         // IRET
+	t.Set(0xd0, 0xd3, 3, 7);       // shift r/m,1 and r/m,CL
+	t.Set(0xd4, 0xd4, 17);         // AAM
+	t.Set(0xd5, 0xd5, 19);         // AAD
+	t.Set(0xd6, 0xd6, 3);          // SALC
+	t.Set(0xd7, 0xd7, 5);          // XLAT
+	t.Set(0xd8, 0xdf, 30, 35);     // 80387 instructions
+	t.Set(0xe0, 0xe2, 11);         // LOOPNZ, LOOPZ, LOOP
+	t.Set(0xe3, 0xe3, 9);          // JCXZ
+	t.Set(0xe4, 0xe5, 12);         // IN imm
+	t.Set(0xe6, 0xe7, 10);         // OUT imm
+	t.Set(0xe8, 0xe9, 7);          // CALL, JMP near
+	t.Set(0xea, 0xea, 12);         // JMP far
+	t.Set(0xeb, 0xeb, 7);          // JMP short
+	t.Set(0xec, 0xed, 13);         // IN DX
+	t.Set(0xee, 0xef, 11);         // OUT DX
+	t.Set(0xf0, 0xf0, 0);          // LOCK
+	t.Set(0xf2, 0xf3, 0);          // REP
+	t.Set(0xf4, 0xf4, 5);          // HLT
+	t.Set(0xf6, 0xf7, 2, 6);       // MUL and DIV group
+	t.Set(0xfa, 0xfb, 3);          // CLI, STI
+	t.Set(0xfe, 0xff, 2, 6);       // INC, DEC, CALL, JMP, PUSH r/m
+	t.SetGroup3(0, {2, 5}, {2, 6}, {12, 15}, {12, 15}, {14, 17}, {19, 22});
+	t.SetGroup3(1, {2, 5}, {2, 6}, {17, 20}, {17, 20}, {22, 25}, {27, 30});
+	set_386_two_byte_clocks(t);
+	return t;
+}
+
+constexpr CycleTimingTable intel486_timing()
+{
+	CycleTimingTable t = {};
+	t.Set(0x00, 0xff, 1);
+	t.SetAlu(1, 3, 2, 1);
+	t.Set(0x38, 0x39, 1, 2);       // CMP r/m,reg only reads
+	t.Set(0x06, 0x07, 3);          // PUSH, POP ES
+	t.Set(0x0e, 0x0e, 3);          // PUSH CS
+	t.Set(0x0f, 0x0f, 0);          // two-byte opcodes
+	t.Set(0x16, 0x17, 3);          // PUSH, POP SS
+	t.Set(0x1e, 0x1f, 3);          // PUSH, POP DS
+	t.Set(0x27, 0x27, 2);          // DAA
+	t.Set(0x2f, 0x2f, 2);          // DAS
+	t.Set(0x37, 0x37, 3);          // AAA
+	t.Set(0x3f, 0x3f, 3);          // AAS
+	t.Set(0x60, 0x60, 11);         // PUSHA
+	t.Set(0x61, 0x61, 9);          // POPA
+	t.Set(0x62, 0x62, 7, 7);       // BOUND
+	t.Set(0x63, 0x63, 9, 9);       // ARPL
+	t.Set(0x69, 0x69, 18, 18);     // IMUL reg,r/m,imm
+	t.Set(0x6b, 0x6b, 18, 18);     // IMUL reg,r/m,imm
+	t.Set(0x6c, 0x6f, 17);         // INS, OUTS
+	t.Set(0x70, 0x7f, 2);          // Jcc
+	t.Set(0x80, 0x83, 1, 3);       // ALU r/m,imm
+	t.Set(0x84, 0x85, 1, 2);       // TEST
+	t.Set(0x86, 0x87, 3, 5);       // XCHG
+	t.Set(0x88, 0x8b, 1, 1);       // MOV
+	t.Set(0x8c, 0x8c, 3, 3);       // MOV r/m,sreg
+	t.Set(0x8d, 0x8d, 1, 1);       // LEA
+	t.Set(0x8e, 0x8e, 3, 9);       // MOV sreg,r/m
+	t.Set(0x8f, 0x8f, 4, 6);       // POP r/m
+	t.Set(0x91, 0x97, 3);          // XCHG AX,reg
+	t.Set(0x98, 0x99, 3);          // CBW, CWD
+	t.Set(0x9a, 0x9a, 18);         // CALL far
+	t.Set(0x9c, 0x9c, 4);          // PUSHF
+	t.Set(0x9d, 0x9d, 9);          // POPF
+	t.Set(0x9e, 0x9e, 2);          // SAHF
+	t.Set(0x9f, 0x9f, 3);          // LAHF
+	t.Set(0xa4, 0xa5, 7);          // MOVS
+	t.Set(0xa6, 0xa7, 8);          // CMPS
+	t.Set(0xaa, 0xab, 5);          // STOS
+	t.Set(0xac, 0xad, 5);          // LODS
+	t.Set(0xae, 0xaf, 6);          // SCAS
+	t.Set(0xc0, 0xc1, 2, 4);       // shift r/m,imm
+	t.Set(0xc2, 0xc3, 5);          // RET
+	t.Set(0xc4, 0xc5, 6, 6);       // LES, LDS
+	t.Set(0xc6, 0xc7, 1, 1);       // MOV r/m,imm
+	t.Set(0xc8, 0xc8, 14);         // ENTER
+	t.Set(0xc9, 0xc9, 5);          // LEAVE
+	t.Set(0xca, 0xcb, 13);         // RETF
+	t.Set(0xcc, 0xcc, 26);         // INT 3
+	t.Set(0xcd, 0xcd, 30);         // INT
+	t.Set(0xce, 0xce, 3);          // INTO
+	t.Set(0xcf, 0xcf, 15);         // IRET
+	t.Set(0xd0, 0xd3, 3, 4);       // shift r/m,1 and r/m,CL
+	t.Set(0xd4, 0xd4, 15);         // AAM
+	t.Set(0xd5, 0xd5, 14);         // AAD
+	t.Set(0xd6, 0xd6, 2);          // SALC
+	t.Set(0xd7, 0xd7, 4);          // XLAT
+	t.Set(0xd8, 0xdf, 10, 12);     // FPU instructions
+	t.Set(0xe0, 0xe2, 7);          // LOOPNZ, LOOPZ, LOOP
+	t.Set(0xe3, 0xe3, 8);          // JCXZ
+	t.Set(0xe4, 0xe5, 14);         // IN imm
+	t.Set(0xe6, 0xe7, 16);         // OUT imm
+	t.Set(0xe8, 0xe9, 3);          // CALL, JMP near
+	t.Set(0xea, 0xea, 17);         // JMP far
+	t.Set(0xeb, 0xeb, 3);          // JMP short
+	t.Set(0xec, 0xed, 14);         // IN DX
+	t.Set(0xee, 0xef, 16);         // OUT DX
+	t.Set(0xf2, 0xf3, 0);          // REP
+	t.Set(0xf4, 0xf4, 4);          // HLT
+	t.Set(0xf5, 0xf5, 2);          // CMC
+	t.Set(0xf6, 0xf7, 1, 3);       // MUL and DIV group
+	t.Set(0xf8, 0xf9, 2);          // CLC, STC
+	t.Set(0xfa, 0xfb, 5);          // CLI, STI
+	t.Set(0xfc, 0xfd, 2);          // CLD, STD
+	t.Set(0xfe, 0xff, 1, 3);       // INC, DEC, CALL, JMP, PUSH r/m
+	t.SetGroup3(0, {1, 2}, {1, 3}, {13, 18}, {13, 18}, {16, 16}, {19, 20});
+	t.SetGroup3(1, {1, 2}, {1, 3}, {20, 22}, {20, 22}, {24, 24}, {27, 28});
+
+	t.Set(0x100, 0x1ff, 10);
+	t.Set(0x100, 0x103, 10, 12);   // groups 6 and 7, LAR, LSL
+	t.Set(0x106, 0x106, 7);        // CLTS
+	t.Set(0x108, 0x109, 4);        // INVD, WBINVD
+	t.Set(0x120, 0x123, 4, 4);     // MOV CRx/DRx
+	t.Set(0x180, 0x18f, 2);        // Jcc near
+	t.Set(0x190, 0x19f, 4, 3);     // SETcc
+	t.Set(0x1a0, 0x1a1, 3);        // PUSH, POP FS
+	t.Set(0x1a2, 0x1a2, 14);       // CPUID
+	t.Set(0x1a3, 0x1a3, 3, 8);     // BT
+	t.Set(0x1a4, 0x1a4, 2, 3);     // SHLD imm
+	t.Set(0x1a5, 0x1a5, 3, 4);     // SHLD CL
+	t.Set(0x1a8, 0x1a9, 3);        // PUSH, POP GS
+	t.Set(0x1ab, 0x1ab, 6, 13);    // BTS
+	t.Set(0x1ac, 0x1ac, 2, 3);     // SHRD imm
+	t.Set(0x1ad, 0x1ad, 3, 4);     // SHRD CL
+	t.Set(0x1af, 0x1af, 18, 18);   // IMUL reg,r/m
+	t.Set(0x1b0, 0x1b1, 6, 8);     // CMPXCHG
+	t.Set(0x1b2, 0x1b2, 6, 6);     // LSS
+	t.Set(0x1b3, 0x1b3, 6, 13);    // BTR
+	t.Set(0x1b4, 0x1b5, 6, 6);     // LFS, LGS
+	t.Set(0x1b6, 0x1b7, 3, 3);     // MOVZX
+	t.Set(0x1ba, 0x1ba, 3, 8);     // BT group
+	t.Set(0x1bb, 0x1bb, 6, 13);    // BTC
+	t.Set(0x1bc, 0x1bd, 10, 10);   // BSF, BSR
+	t.Set(0x1be, 0x1bf, 3, 3);     // MOVSX
+	t.Set(0x1c0, 0x1c1, 3, 4);     // XADD
+	t.Set(0x1c8, 0x1cf, 1);        // BSWAP
+	return t;
+}
@@ -24,12 +24,15 @@
 #include <stddef.h>
 
 #include "memory.h"
+#include "cycle_governor.h"
 #include "debug.h"
 #include "mapper.h"
 #include "setup.h"
 #include "programs.h"
+#include "fpu.h"
 #include "paging.h"
 #include "lazyflags.h"
+#include "savestate.h"
 #include "support.h"
 
 extern void GFX_RefreshTitle();
@@ -74,13 +77,23 @@ void CPU_Core_Normal_Init(void);
 void CPU_Core_Simple_Init(void);
 #if (C_DYNAMIC_X86)
 void CPU_Core_Dyn_X86_Init(void);
+void CPU_Core_Dyn_X86_Cache_SetSize(int megabytes);
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_Cache_Close(void);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
+void CPU_Core_Dyn_X86_SetProfiling(bool enable);
+void CPU_Core_Dyn_X86_ProfileReport(void);
+void CPU_Core_Dyn_X86_Cache_Flush();
+void CPU_Core_Dyn_X86_SyncFPU() noexcept;
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
+void CPU_Core_Dynrec_Cache_SetSize(int megabytes);
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 void CPU_Core_Dynrec_Cache_Close(void);
+void CPU_Core_Dynrec_SetPersistentCache(bool enable);
+void CPU_Core_Dynrec_SetProfiling(bool enable);
+void CPU_Core_Dynrec_ProfileReport(void);
+void CPU_Core_Dynrec_Cache_Flush();
 #endif
 
 /* In debug mode exceptions are tested and dosbox exits when 
@@ -1615,6 +1628,9 @@ void CPU_SET_CRX(Bitu cr,Bitu value) {
 	case 3:
 		PAGING_SetDirBase(value);
 		break;
+	case 4:
+		PAGING_SetCR4(value);
+		break;
 	default:
 		LOG(LOG_CPU,LOG_ERROR)("Unhandled MOV CR%d,%X",cr,value);
 		break;
@@ -1642,6 +1658,8 @@ Bitu CPU_GET_CRX(Bitu cr) {
 		return paging.cr2;
 	case 3:
 		return PAGING_GetDirBase() & 0xfffff000;
+	case 4:
+		return PAGING_GetCR4();
 	default:
 		LOG(LOG_CPU,LOG_ERROR)("Unhandled MOV XXX, CR%d",cr);
 		break;
@@ -2032,13 +2050,13 @@ bool CPU_CPUID(void) {
 		} else if (CPU_ArchitectureType == ArchitectureType::PentiumSlow) {
 #if (C_FPU)
 			reg_eax = 0x517; // Intel Pentium P5 60/66 MHz D1-step
-			reg_edx = 0x11;  // FPU + Time Stamp Counter (RDTSC)
+			reg_edx = 0x19;  // FPU + Page Size Extension + Time Stamp Counter (RDTSC)
 #else
 			// All Pentiums had FPU built-in, so when FPU is
 			// disabled, we pretend to have early Pentium model with
 			// FDIV bug present.
 			reg_eax = 0x513; // Intel Pentium P5 60/66 MHz B1-step
-			reg_edx = 0x10;  // Time Stamp Counter (RDTSC)
+			reg_edx = 0x18;  // Page Size Extension + Time Stamp Counter (RDTSC)
 #endif
 			reg_ebx = 0;     // Not supported
 			reg_ecx = 0;     // No features
@@ -2163,6 +2181,17 @@ static void CPU_CycleDecrease(bool pressed) {
 	}
 }
 
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+static void CPU_DynProfileReport(bool pressed) {
+	if (!pressed) return;
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_ProfileReport();
+#elif (C_DYNREC)
+	CPU_Core_Dynrec_ProfileReport();
+#endif
+}
+#endif
+
 void CPU_Enable_SkipAutoAdjust(void) {
 	if (CPU_CycleAutoAdjust) {
 		CPU_CycleMax /= 2;
@@ -2177,13 +2206,51 @@ void CPU_Disable_SkipAutoAdjust(void) {
 }
 
 
-extern int64_t ticksDone;
-extern int64_t ticksScheduled;
-
 void CPU_Reset_AutoAdjust(void) {
 	CPU_IODelayRemoved = 0;
-	ticksDone = 0;
-	ticksScheduled = 0;
+	CYCLE_GOVERNOR_Reset();
+}
+
+static void cpu_save_state(SaveStateWriter& writer)
+{
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_SyncFPU();
+#endif
+	writer.Write(cpu_regs);
+	writer.Write(Segs);
+	writer.Write(lflags);
+	writer.Write(cpu);
+	writer.WriteFunction(cpu.hlt.old_decoder);
+	writer.Write(cpu_tss);
+	writer.WriteFunction(cpudecoder);
+#if C_FPU
+	writer.Write(fpu);
+#endif
+}
+
+static void cpu_load_state(SaveStateReader& reader)
+{
+#if (C_DYNAMIC_X86)
+	// so the dynamic core's FPU doesn't overwrite the loaded one
+	CPU_Core_Dyn_X86_SyncFPU();
+#endif
+	reader.Read(cpu_regs);
+	reader.Read(Segs);
+	reader.Read(lflags);
+	reader.Read(cpu);
+	reader.ReadFunction(cpu.hlt.old_decoder);
+	reader.Read(cpu_tss);
+	reader.ReadFunction(cpudecoder);
+#if C_FPU
+	reader.Read(fpu);
+#endif
+
+	// The translated code was made from the memory before loading
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_Cache_Flush();
+#elif (C_DYNREC)
+	CPU_Core_Dynrec_Cache_Flush();
+#endif
 }
 
 class CPU final : public Module_base {
@@ -2248,6 +2315,11 @@ public:
 		                  PRIMARY_MOD, "cycledown", "Dec Cycles");
 		MAPPER_AddHandler(CPU_CycleIncrease, SDL_SCANCODE_F12,
 		                  PRIMARY_MOD, "cycleup", "Inc Cycles");
+		SAVESTATE_AddComponent("cpu", 1, cpu_save_state, cpu_load_state);
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+		MAPPER_AddHandler(CPU_DynProfileReport, SDL_SCANCODE_UNKNOWN,
+		                  0, "hotblocks", "Hot Blocks");
+#endif
 		Change_Config(configuration);
 		CPU_JMP(false,0,0,0);					//Setup the first cpu core
 	}
@@ -2333,6 +2405,8 @@ public:
 			CPU_CycleAutoAdjust = false;
 		}
 
+		CYCLE_GOVERNOR_SetPolicy(section->Get_string("cycle_governor"));
+
 		CPU_CycleUp=section->Get_int("cycleup");
 		CPU_CycleDown=section->Get_int("cycledown");
 		std::string core(section->Get_string("core"));
@@ -2365,13 +2439,19 @@ public:
 		}
 
 #if (C_DYNAMIC_X86)
+		CPU_Core_Dyn_X86_Cache_SetSize(section->Get_int("dynamic_core_cache_size"));
 		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
+		CPU_Core_Dyn_X86_SetProfiling(section->Get_bool("dynamic_core_profile"));
 #elif (C_DYNREC)
+		CPU_Core_Dynrec_Cache_SetSize(section->Get_int("dynamic_core_cache_size"));
 		CPU_Core_Dynrec_Cache_Init( core == "dynamic" );
+		CPU_Core_Dynrec_SetPersistentCache(section->Get_bool("dynamic_core_cache"));
+		CPU_Core_Dynrec_SetProfiling(section->Get_bool("dynamic_core_profile"));
 #endif
 
 		CPU_ArchitectureType = ArchitectureType::Mixed;
 		std::string cputype(section->Get_string("cputype"));
+		auto timing = CycleTiming::Flat;
 		if (cputype == "auto") {
 			CPU_ArchitectureType = ArchitectureType::Mixed;
 		} else if (cputype == "386") {
@@ -2406,7 +2486,31 @@ public:
 			}
 		} else if (cputype == "pentium_slow") {
 			CPU_ArchitectureType = ArchitectureType::PentiumSlow;
+		} else if (cputype == "8086_timed") {
+			CPU_ArchitectureType = ArchitectureType::Intel386Slow;
+			timing = CycleTiming::Intel8086;
+		} else if (cputype == "286_timed") {
+			CPU_ArchitectureType = ArchitectureType::Intel386Slow;
+			timing = CycleTiming::Intel286;
+		} else if (cputype == "386_timed") {
+			CPU_ArchitectureType = ArchitectureType::Intel386Slow;
+			timing = CycleTiming::Intel386;
+		} else if (cputype == "486_timed") {
+			CPU_ArchitectureType = ArchitectureType::Intel486OldSlow;
+			timing = CycleTiming::Intel486;
+		}
+
+		// Only the normal core charges the clock counts of the
+		// instructions
+		if (timing != CycleTiming::Flat) {
+			if (core == "auto") {
+				cpudecoder = &CPU_Core_Normal_Run;
+				CPU_AutoDetermineMode &= (~CPU_AUTODETERMINE_CORE);
+			} else if (core != "normal") {
+				E_Exit("instruction timing requires the normal core setting.");
+			}
 		}
+		CPU_Core_Normal_SetTiming(timing);
 
 		if (CPU_ArchitectureType>=ArchitectureType::Intel486NewSlow) CPU_extflags_toggle=(FLAG_ID|FLAG_AC);
 		else if (CPU_ArchitectureType>=ArchitectureType::Intel486OldSlow) CPU_extflags_toggle=(FLAG_AC);
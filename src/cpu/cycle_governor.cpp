@@ -0,0 +1,306 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cycle_governor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cpu.h"
+#include "logging.h"
+#include "tracy.h"
+
+// Upper limit of the auto-adjusted cycles if no 'limit' was specified
+constexpr int32_t max_auto_cycles = 2000000;
+
+// The PID policy updates the cycles after this many milliseconds of host
+// time or emulated time, whichever comes first
+constexpr int64_t pid_update_interval_ms = 50;
+
+// The main loop schedules at most 20 ms at once. Scheduling more than 15 ms
+// means the emulation fell behind the host's clock; the 5 ms below the cap
+// leave room for a late wakeup from sleeping, and match the threshold the
+// legacy policy divides the cycles at.
+constexpr int64_t deadline_ms = 15;
+
+// Gains of the PID controller. It runs in velocity form on the logarithm of
+// the cycles: every update changes log(cycles) by
+//   kp * (e - e_prev) + ki * e + kd * (e - 2 * e_prev + e_prev2)
+// where e = log(target / measured). The cycles themselves act as the
+// integrator, so there's nothing that can wind up; ki = 1 would correct the
+// whole error in one step, less than that damps the response to noise.
+constexpr double pid_kp = 0.3;
+constexpr double pid_ki = 0.6;
+constexpr double pid_kd = 0.05;
+
+// Largest change of the cycles in one update: a third down or double up
+const double pid_max_decrease = std::log(1.0 / 3.0);
+const double pid_max_increase = std::log(2.0);
+
+static CycleGovernorPolicy policy = CycleGovernorPolicy::Legacy;
+
+static struct {
+	int64_t scheduled = 0; // emulated milliseconds since the last update
+	int64_t done_us   = 0; // host microseconds spent not sleeping
+	int64_t added     = 0; // milliseconds scheduled by the last call
+} ticks = {};
+
+static struct {
+	double prev_error  = 0.0;
+	double prev_error2 = 0.0;
+} pid = {};
+
+static CycleGovernorStats stats = {};
+
+void CYCLE_GOVERNOR_SetPolicy(const std::string& policy_name)
+{
+	const auto new_policy = (policy_name == "pid") ? CycleGovernorPolicy::Pid
+	                                               : CycleGovernorPolicy::Legacy;
+	if (new_policy != policy) {
+		policy = new_policy;
+		CYCLE_GOVERNOR_Reset();
+	}
+}
+
+CycleGovernorPolicy CYCLE_GOVERNOR_GetPolicy()
+{
+	return policy;
+}
+
+void CYCLE_GOVERNOR_Reset()
+{
+	ticks = {};
+	pid   = {};
+}
+
+CycleGovernorStats CYCLE_GOVERNOR_GetStats()
+{
+	return stats;
+}
+
+static void clamp_cycle_max(int32_t new_cmax)
+{
+	if (new_cmax < CPU_CYCLES_LOWER_LIMIT)
+		new_cmax = CPU_CYCLES_LOWER_LIMIT;
+	if (CPU_CycleLimit > 0) {
+		if (new_cmax > CPU_CycleLimit)
+			new_cmax = CPU_CycleLimit;
+	} else if (new_cmax > max_auto_cycles) {
+		new_cmax = max_auto_cycles;
+	}
+	CPU_CycleMax = new_cmax;
+}
+
+static void update_stats(const double target, const double measured, const double error)
+{
+	stats.target   = target;
+	stats.measured = measured;
+	stats.error    = error;
+	stats.cycles   = CPU_CycleMax;
+	stats.updates++;
+
+	TracyPlot("Cycle governor target", target);
+	TracyPlot("Cycle governor measured", measured);
+	TracyPlot("Cycle governor error", error);
+	TracyPlot("Cycle governor cycles", static_cast<int64_t>(CPU_CycleMax));
+}
+
+static void adjust_legacy()
+{
+	// the heuristic was tuned for millisecond timestamps
+	auto done_ms = ticks.done_us / 1000;
+
+	if (ticks.scheduled >= 250 || done_ms >= 250 ||
+	    (ticks.added > 15 && ticks.scheduled >= 5)) {
+		if (done_ms < 1)
+			done_ms = 1; // Protect against div by zero
+		/* ratio we are aiming for is around 90% usage*/
+		int32_t ratio = static_cast<int32_t>(
+		        (ticks.scheduled * (CPU_CyclePercUsed * 90 * 1024 / 100 / 100)) /
+		        done_ms);
+
+		int32_t new_cmax = CPU_CycleMax;
+		int64_t cproc = (int64_t)CPU_CycleMax * (int64_t)ticks.scheduled;
+		double ratioremoved = 0.0; //increase scope for logging
+		if (cproc > 0) {
+			/* ignore the cycles added due to the IO delay code in order
+			   to have smoother auto cycle adjustments */
+			ratioremoved = (double) CPU_IODelayRemoved / (double) cproc;
+			if (ratioremoved < 1.0) {
+				double ratio_not_removed = 1 - ratioremoved;
+				ratio = (int32_t)((double)ratio * ratio_not_removed);
+
+				/* Don't allow very high ratio which can cause us to lock as we don't scale down
+				 * for very low ratios. High ratio might result because of timing resolution */
+				if (ticks.scheduled >= 250 && done_ms < 10 && ratio > 16384)
+					ratio = 16384;
+
+				// Limit the ratio even more when the cycles are already way above the realmode default.
+				if (ticks.scheduled >= 250 && done_ms < 10 && ratio > 5120 && CPU_CycleMax > 50000)
+					ratio = 5120;
+
+				// When downscaling multiple times in a row, ensure a minimum amount of downscaling
+				if (ticks.added > 15 && ticks.scheduled >= 5 && ticks.scheduled <= 20 && ratio > 800)
+					ratio = 800;
+
+				if (ratio <= 1024) {
+					// ratio_not_removed = 1.0; //enabling this restores the old formula
+					double r = (1.0 + ratio_not_removed) /(ratio_not_removed + 1024.0/(static_cast<double>(ratio)));
+					new_cmax = 1 + static_cast<int32_t>(CPU_CycleMax * r);
+				} else {
+					int64_t ratio_with_removed = (int64_t) ((((double)ratio - 1024.0) * ratio_not_removed) + 1024.0);
+					int64_t cmax_scaled = (int64_t)CPU_CycleMax * ratio_with_removed;
+					new_cmax = (int32_t)(1 + (CPU_CycleMax >> 1) + cmax_scaled / (int64_t)2048);
+				}
+			}
+		}
+
+		if (new_cmax < CPU_CYCLES_LOWER_LIMIT)
+			new_cmax = CPU_CYCLES_LOWER_LIMIT;
+
+		/* ratios below 1% are considered to be dropouts due to
+		   temporary load imbalance, the cycles adjusting is skipped */
+		if (ratio > 10) {
+			/* ratios below 12% along with a large time since the last update
+			   has taken place are most likely caused by heavy load through a
+			   different application, the cycles adjusting is skipped as well */
+			if ((ratio > 120) || (done_ms < 700)) {
+				clamp_cycle_max(new_cmax);
+			}
+		}
+
+		const auto target   = CPU_CyclePercUsed * 0.9 / 100.0;
+		const auto measured = static_cast<double>(done_ms) /
+		                      static_cast<double>(std::max(ticks.scheduled, int64_t{1}));
+		update_stats(target, measured, target / measured - 1.0);
+
+		//Reset cycleguessing parameters.
+		CPU_IODelayRemoved = 0;
+		ticks.done_us = 0;
+		ticks.scheduled = 0;
+	} else if (ticks.added > 15) {
+		/* ticks.added > 15 but ticks.scheduled < 5, lower the cycles
+		   but do not reset the scheduled/done ticks to take them into
+		   account during the next auto cycle adjustment */
+		CPU_CycleMax /= 3;
+		if (CPU_CycleMax < CPU_CYCLES_LOWER_LIMIT)
+			CPU_CycleMax = CPU_CYCLES_LOWER_LIMIT;
+	}
+}
+
+static void adjust_pid()
+{
+	const bool missed_deadline = ticks.added > deadline_ms;
+	// Unlike the legacy policy, a missed deadline isn't acted upon blindly;
+	// after a few milliseconds there's a measurement to base the cut on
+	if (ticks.scheduled < pid_update_interval_ms &&
+	    ticks.done_us < pid_update_interval_ms * 1000 &&
+	    !(missed_deadline && ticks.scheduled >= 5)) {
+		return;
+	}
+
+	const auto target = CPU_CyclePercUsed * 0.9 / 100.0;
+	const auto done = static_cast<double>(std::max(ticks.done_us, int64_t{1})) / 1000.0;
+	const auto scheduled = static_cast<double>(ticks.scheduled);
+
+	const auto reset_window = []() {
+		CPU_IODelayRemoved = 0;
+		ticks.done_us      = 0;
+		ticks.scheduled    = 0;
+	};
+
+	if (ticks.scheduled <= 0 || target <= 0.0) {
+		reset_window();
+		return;
+	}
+
+	// Share of host time spent emulating, 1.0 means the host was busy the
+	// whole time and > 1.0 that it couldn't keep up
+	auto measured = done / scheduled;
+
+	// The cycles burnt by the IO delay code cost next to no host time, so
+	// only the remaining cycles are taken as the load of the emulation
+	const auto cproc = static_cast<double>(CPU_CycleMax) * scheduled;
+	const auto removed = static_cast<double>(CPU_IODelayRemoved) / cproc;
+	if (removed > 0.0 && removed < 1.0) {
+		measured /= (1.0 - removed);
+	}
+
+	// Same dropout rules as the legacy policy: a very high load is caused by
+	// a stall of the host rather than by the emulation, so the measurement
+	// is thrown away
+	const auto load = measured / target;
+	if (load > 100.0 || (load > 8.5 && ticks.done_us >= 700 * 1000)) {
+		reset_window();
+		return;
+	}
+
+	auto error = std::log(target / measured);
+	if (missed_deadline) {
+		// falling behind never means there's headroom
+		error = std::min(error, 0.0);
+	}
+
+	auto step = pid_kp * (error - pid.prev_error) + pid_ki * error +
+	            pid_kd * (error - 2.0 * pid.prev_error + pid.prev_error2);
+	step = std::clamp(step, pid_max_decrease, pid_max_increase);
+
+	pid.prev_error2 = pid.prev_error;
+	pid.prev_error  = error;
+
+	// clamp_cycle_max applies the cycle limit, only keep the conversion
+	// from overflowing here
+	constexpr auto int32_max = std::numeric_limits<int32_t>::max();
+	const auto new_cmax = static_cast<double>(CPU_CycleMax) * std::exp(step);
+	clamp_cycle_max(static_cast<int32_t>(
+	        std::min(new_cmax, static_cast<double>(int32_max))));
+
+	update_stats(target, measured, std::exp(error) - 1.0);
+	reset_window();
+}
+
+void CYCLE_GOVERNOR_AddSleep(const int64_t slept_us)
+{
+	ticks.scheduled += ticks.added;
+	ticks.added = 0;
+
+	ticks.done_us -= slept_us;
+	if (ticks.done_us < 0)
+		ticks.done_us = 0;
+}
+
+void CYCLE_GOVERNOR_AddTicks(const int64_t elapsed_us, const int64_t scheduled_ms)
+{
+	ticks.scheduled += ticks.added;
+	ticks.done_us += elapsed_us;
+	ticks.added = scheduled_ms;
+
+	// Is the system in auto cycle mode guessing ? If not just exit. (It can
+	// be temporary disabled)
+	if (!CPU_CycleAutoAdjust || CPU_SkipCycleAutoAdjust)
+		return;
+
+	if (policy == CycleGovernorPolicy::Pid)
+		adjust_pid();
+	else
+		adjust_legacy();
+}
@@ -19,10 +19,13 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <memory>
 #include <new>
+#include <unordered_map>
+#include <vector>
 
 #include "mem_unaligned.h"
 #include "paging.h"
@@ -47,6 +50,37 @@
 
 class CodePageHandler;
 
+// default size of the code cache in megabytes
+#define CACHE_DEFAULT_MB	(8)
+
+// blocks that were entered at least this often since they were translated
+// are spared when the cache wraps around
+#define CACHE_HOT_COUNT		(256)
+// limit the number of hot blocks spared while opening a new block
+#define CACHE_MAX_SPARES	(64)
+
+// Self-modifying code is tracked per region of 64 bytes of a code page.
+// Writes to regions without code don't count, so the data next to the code
+// doesn't take the rest of the page down with it. A region whose code was
+// overwritten this often isn't translated anymore but run by the normal
+// core, in slices of DYN_SMC_SLICE cycles; the counters of the page are
+// halved every DYN_SMC_AGE slices, so code that settled down is translated
+// again.
+#define DYN_SMC_REGION_SHIFT	(6)
+#define DYN_SMC_REGIONS		(4096>>DYN_SMC_REGION_SHIFT)
+#define DYN_SMC_DEMOTE_COUNT	(32)
+#define DYN_SMC_SLICE		(64)
+#define DYN_SMC_AGE		(1024)
+
+static struct {
+	uint64_t invalidations = 0; // writes that hit translated code
+	uint64_t demotions     = 0; // regions handed to the normal core
+	uint64_t slices        = 0; // slices the normal core ran for them
+
+	// invalidations of the pages released so far, by physical page
+	std::unordered_map<Bitu, uint64_t> pages = {};
+} dyn_smc = {};
+
 // basic cache block representation
 class CacheBlock {
 public:
@@ -102,6 +136,13 @@ public:
 	} link[2] = {};                // maximum two links (conditional jumps)
 
 	CacheBlock* crossblock = {};
+
+	// number of times the block was entered, maintained by the generated
+	// code of cores that support hotness-driven eviction
+	uint32_t exec_count = 0;
+
+	// the block was translated as a superblock spanning several blocks
+	bool superblock = false;
 };
 
 static struct {
@@ -131,7 +172,14 @@ static uint8_t* cache_code_start_ptr   = {};
 static uint8_t* cache_code             = {};
 static uint8_t* cache_code_link_blocks = {};
 
-static std::vector<CacheBlock> cache_blocks(CACHE_BLOCKS);
+// dimensions of the code cache, fixed once the cache is initialized
+static struct {
+	size_t total  = CACHE_DEFAULT_MB * 1024 * 1024; // bytes of code
+	size_t blocks = CACHE_DEFAULT_MB * CACHE_BLOCKS_PER_MB;
+	size_t pages  = CACHE_DEFAULT_MB * CACHE_PAGES_PER_MB;
+} cache_dims = {};
+
+static std::vector<CacheBlock> cache_blocks = {};
 static CacheBlock link_blocks[2] = {}; // default linking (specially marked)
 
 // the CodePageHandler class provides access to the contained
@@ -161,6 +209,9 @@ public:
 		// code present)
 		memset(&hash_map,0,sizeof(hash_map));
 		memset(&write_map,0,sizeof(write_map));
+		memset(&smc_count,0,sizeof(smc_count));
+		smc_age = 0;
+		invalidations = 0;
 		if (invalidation_map) {
 			delete [] invalidation_map;
 			invalidation_map = nullptr;
@@ -213,6 +264,46 @@ public:
 		return map;
 	}
 
+	// a write hit the code of some cache blocks
+	void CountInvalidation(Bitu addr)
+	{
+		uint8_t &count = smc_count[addr >> DYN_SMC_REGION_SHIFT];
+		if (count < UINT8_MAX && ++count == DYN_SMC_DEMOTE_COUNT)
+			dyn_smc.demotions++;
+		invalidations++;
+		dyn_smc.invalidations++;
+	}
+
+	// see if code in the given range of the page has been modified
+	bool IsModified(Bitu start, Bitu end) const
+	{
+		for (Bitu region = start >> DYN_SMC_REGION_SHIFT;
+		     region <= (end >> DYN_SMC_REGION_SHIFT); region++) {
+			if (smc_count[region])
+				return true;
+		}
+		return false;
+	}
+
+	// the code at addr is modified too often to be worth translating
+	bool IsDemoted(Bitu addr) const
+	{
+		return smc_count[addr >> DYN_SMC_REGION_SHIFT] >= DYN_SMC_DEMOTE_COUNT;
+	}
+
+	// the normal core ran a slice of demoted code of this page
+	void AgeDemoted()
+	{
+		dyn_smc.slices++;
+		if (++smc_age < DYN_SMC_AGE)
+			return;
+		smc_age = 0;
+		for (auto &count : smc_count)
+			count /= 2;
+	}
+
+	uint32_t GetInvalidations() const { return invalidations; }
+
 	// the following functions will clean all cache blocks that are invalid
 	// now due to the write
 
@@ -239,6 +330,7 @@ public:
 			invalidation_map = alloc_invalidation_map();
 		}
 		invalidation_map[addr]++;
+		CountInvalidation(addr);
 		InvalidateRange(addr,addr);
 	}
 
@@ -265,6 +357,7 @@ public:
 			invalidation_map = alloc_invalidation_map();
 		}
 		host_addw(&invalidation_map[addr], 0x0101);
+		CountInvalidation(addr);
 		InvalidateRange(addr,addr+1);
 	}
 
@@ -291,6 +384,7 @@ public:
 			invalidation_map = alloc_invalidation_map();
 		}
 		host_addd(&invalidation_map[addr], 0x01010101);
+		CountInvalidation(addr);
 		InvalidateRange(addr,addr+3);
 	}
 
@@ -316,6 +410,7 @@ public:
 				invalidation_map = alloc_invalidation_map();
 
 			invalidation_map[addr]++;
+			CountInvalidation(addr);
 			if (InvalidateRange(addr,addr)) {
 				cpu.exception.which=SMC_CURRENT_BLOCK;
 				return true;
@@ -347,6 +442,7 @@ public:
 				invalidation_map = alloc_invalidation_map();
 
 			host_addw(&invalidation_map[addr], 0x0101);
+			CountInvalidation(addr);
 			if (InvalidateRange(addr,addr+1)) {
 				cpu.exception.which=SMC_CURRENT_BLOCK;
 				return true;
@@ -378,6 +474,7 @@ public:
 				invalidation_map = alloc_invalidation_map();
 
 			host_addd(&invalidation_map[addr], 0x01010101);
+			CountInvalidation(addr);
 			if (InvalidateRange(addr,addr+3)) {
 				cpu.exception.which=SMC_CURRENT_BLOCK;
 				return true;
@@ -458,7 +555,13 @@ public:
 	{
 		// revert to old handler
 		MEM_SetPageHandler(phys_page,1,old_pagehandler);
-		PAGING_ClearTLB();
+		PAGING_UnlinkPhysPages(phys_page,1);
+
+		// keep the invalidations of the page for the report
+		if (invalidations) {
+			dyn_smc.pages[phys_page] += invalidations;
+			invalidations = 0;
+		}
 
 		// remove page from the lists
 		if (prev) prev->next=next;
@@ -514,10 +617,14 @@ public:
 	// the byte at address i
 	uint8_t write_map[4096] = {};
 	uint8_t *invalidation_map = nullptr;
+	// writes that hit code, per region of the page
+	uint8_t smc_count[DYN_SMC_REGIONS] = {};
 
 	CodePageHandler *prev = nullptr;
 	CodePageHandler *next = nullptr;
 
+	Bitu GetPhysPage() const { return phys_page; }
+
 private:
 	PageHandler *old_pagehandler = nullptr;
 
@@ -529,8 +636,44 @@ private:
 	                        // a page
 	HostPt hostmem = nullptr;
 	Bitu phys_page = 0;
+
+	uint32_t invalidations = 0; // writes that hit code since the setup
+	uint16_t smc_age = 0;       // slices of demoted code run since aging
 };
 
+// Log the self-modifying code counters and the pages that were modified
+// the most
+static void dyn_smc_report(const char* core_name)
+{
+	if (!dyn_smc.invalidations) {
+		LOG_MSG("%s: No translated code has been modified", core_name);
+		return;
+	}
+	auto pages = dyn_smc.pages;
+	for (auto page = cache.used_pages; page; page = page->next) {
+		if (page->GetInvalidations())
+			pages[page->GetPhysPage()] += page->GetInvalidations();
+	}
+	std::vector<std::pair<Bitu, uint64_t>> sorted(pages.begin(), pages.end());
+	std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+		return a.second > b.second;
+	});
+	LOG_MSG("%s: %llu writes hit translated code in %u pages, %llu regions were demoted, "
+	        "the normal core ran %llu slices of them",
+	        core_name,
+	        static_cast<unsigned long long>(dyn_smc.invalidations),
+	        static_cast<unsigned>(sorted.size()),
+	        static_cast<unsigned long long>(dyn_smc.demotions),
+	        static_cast<unsigned long long>(dyn_smc.slices));
+	constexpr size_t max_listed = 8;
+	for (size_t i = 0; i < sorted.size() && i < max_listed; i++) {
+		LOG_MSG("%s:  page %05x  %12llu invalidations",
+		        core_name,
+		        static_cast<unsigned>(sorted[i].first),
+		        static_cast<unsigned long long>(sorted[i].second));
+	}
+}
+
 static inline void cache_add_unused_block(CacheBlock *block)
 {
 	// block has become unused, add it to the freelist
@@ -598,31 +741,59 @@ void CacheBlock::Clear()
 	}
 }
 
+static inline bool cache_block_is_hot(const CacheBlock *block)
+{
+	return block->page.handler && block->exec_count >= CACHE_HOT_COUNT;
+}
+
 static CacheBlock *cache_openblock()
 {
+	// Blocks are handed out in ring order. Hot blocks get a second
+	// chance: they are skipped and their execution count is halved, so
+	// code that stays in use survives while code that went cold ages out
+	// on one of the next passes.
+	Bitu spares_left = CACHE_MAX_SPARES;
 	CacheBlock *block = cache.block.active;
-	// check for enough space in this block
-	Bitu size=block->cache.size;
-	CacheBlock *nextblock = block->cache.next;
-	if (block->page.handler)
-		block->Clear();
-	// block size must be at least CACHE_MAXSIZE
-	while (size<CACHE_MAXSIZE) {
-		if (!nextblock)
-			goto skipresize;
-		// merge blocks
-		size+=nextblock->cache.size;
-		CacheBlock *tempblock = nextblock->cache.next;
-		if (nextblock->page.handler)
-			nextblock->Clear();
-		// block is free now
-		cache_add_unused_block(nextblock);
-		nextblock=tempblock;
-	}
-skipresize:
-	// adjust parameters and open this block
-	block->cache.size=size;
-	block->cache.next=nextblock;
+	for (;;) {
+		if (spares_left && cache_block_is_hot(block)) {
+			spares_left--;
+			block->exec_count /= 2;
+			block = block->cache.next ? block->cache.next
+			                          : cache.block.first;
+			continue;
+		}
+		// check for enough space in this block
+		Bitu size=block->cache.size;
+		CacheBlock *nextblock = block->cache.next;
+		if (block->page.handler)
+			block->Clear();
+		// block size must be at least CACHE_MAXSIZE
+		bool blocked_by_hot_block = false;
+		while (size<CACHE_MAXSIZE && nextblock) {
+			if (spares_left && cache_block_is_hot(nextblock)) {
+				blocked_by_hot_block = true;
+				break;
+			}
+			// merge blocks
+			size+=nextblock->cache.size;
+			CacheBlock *tempblock = nextblock->cache.next;
+			if (nextblock->page.handler)
+				nextblock->Clear();
+			// block is free now
+			cache_add_unused_block(nextblock);
+			nextblock=tempblock;
+		}
+		block->cache.size=size;
+		block->cache.next=nextblock;
+		if (!blocked_by_hot_block)
+			break;
+		// leave the merged space free and continue after the hot block
+		block = nextblock;
+	}
+	// open this block
+	block->exec_count = 0;
+	block->superblock = false;
+	cache.block.active = block;
 	cache.pos=block->cache.start;
 	return block;
 }
@@ -667,7 +838,7 @@ static void cache_closeblock()
 #if (C_DYNAMIC_X86)
 	const bool cache_is_full = !block->cache.next;
 #elif (C_DYNREC)
-	const uint8_t *limit = (cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE);
+	const uint8_t *limit = (cache_code_start_ptr + cache_dims.total - CACHE_MAXSIZE);
 	const bool cache_is_full = (!block->cache.next ||
 	                            (block->cache.next->cache.start > limit));
 #endif
@@ -751,7 +922,7 @@ static void cache_block_before_close();
 static void cache_block_closing(const uint8_t *block_start, Bitu block_size);
 #endif
 
-static constexpr size_t cache_code_size = CACHE_TOTAL + CACHE_MAXSIZE + host_pagesize - 1 + host_pagesize;
+static size_t cache_code_size = 0;
 constexpr bool is_64bit_platform = sizeof(void *) == 8;
 
 static inline void dyn_mem_adjust(void *&ptr, size_t &size)
@@ -842,6 +1013,18 @@ static inline void dyn_cache_invalidate([[maybe_unused]] void *ptr,
 
 static bool cache_initialized = false;
 
+static void cache_set_size(const int megabytes)
+{
+	// the cache memory is allocated only once
+	if (cache_code_start_ptr != nullptr) {
+		return;
+	}
+	const auto mb = static_cast<size_t>(std::max(megabytes, 1));
+	cache_dims.total  = mb * 1024 * 1024;
+	cache_dims.blocks = mb * CACHE_BLOCKS_PER_MB;
+	cache_dims.pages  = mb * CACHE_PAGES_PER_MB;
+}
+
 static void cache_init(bool enable) {
 	if (enable) {
 		// see if cache is already initialized
@@ -849,14 +1032,19 @@ static void cache_init(bool enable) {
 			return;
 		}
 		cache_initialized = true;
+		if (cache_blocks.size() != cache_dims.blocks) {
+			cache_blocks = std::vector<CacheBlock>(cache_dims.blocks);
+		}
 		cache.block.free = &cache_blocks[0];
 		// initialize the cache blocks
-		for (int i=0;i<CACHE_BLOCKS-1;i++) {
+		for (size_t i = 0; i < cache_dims.blocks - 1; i++) {
 			cache_blocks[i].link[0].to = (CacheBlock *)1;
 			cache_blocks[i].link[1].to = (CacheBlock *)1;
 			cache_blocks[i].cache.next = &cache_blocks[i + 1];
 		}
 		if (cache_code_start_ptr == nullptr) {
+			cache_code_size = cache_dims.total + CACHE_MAXSIZE +
+			                  host_pagesize - 1 + host_pagesize;
 			// allocate the code cache memory
 #if defined (WIN32)
 			LPVOID lp_vmem = nullptr;
@@ -898,7 +1086,7 @@ static void cache_init(bool enable) {
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_dims.total;
 			block->cache.next = nullptr; // last block in the list
 		}
 
@@ -948,7 +1136,7 @@ static void cache_init(bool enable) {
 		cache.last_page=nullptr;
 		cache.used_pages=nullptr;
 		// setup the code pages
-		for (int i=0;i<CACHE_PAGES;i++) {
+		for (size_t i = 0; i < cache_dims.pages; i++) {
 			auto newpage = new (std::nothrow) CodePageHandler();
 			if (GCC_UNLIKELY(!newpage)) {
 				E_Exit("DYN_CACHE: Failed to allocate code-page handler");
@@ -959,6 +1147,15 @@ static void cache_init(bool enable) {
 	}
 }
 
+// Releases all code pages and the code translated from them, for when the
+// memory changed without going through the page handlers
+static void cache_flush()
+{
+	while (cache.used_pages) {
+		cache.used_pages->ClearRelease();
+	}
+}
+
 static void cache_close(void) {
 /*	for (;;) {
 		if (cache.used_pages) {
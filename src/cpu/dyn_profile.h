@@ -0,0 +1,192 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+	Block profiler for the dynamic cores.
+
+	All accounting is done by the run loop of the core, the generated code
+	is the same whether profiling is enabled or not. While profiling, the
+	run loop doesn't link blocks, so every block returns to it and each
+	block entry and the cycles it consumed can be attributed to the guest
+	code it was translated from.
+
+	Blocks come and go as the code cache wraps around or guest code gets
+	modified, so the counters are kept per guest location (physical
+	address and CS:EIP) rather than per CacheBlock.
+*/
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "tracy.h"
+
+// number of blocks listed in the hot-block report
+#define DYN_PROFILE_REPORT_BLOCKS	(24)
+// number of block entries between two updates of the Tracy plots
+#define DYN_PROFILE_PLOT_INTERVAL	(16*1024)
+
+struct DynProfileKey {
+	uint32_t phys_addr = 0; // physical address of the first guest byte
+	uint32_t eip       = 0;
+	uint16_t cs        = 0;
+
+	bool operator==(const DynProfileKey& other) const
+	{
+		return phys_addr == other.phys_addr && eip == other.eip &&
+		       cs == other.cs;
+	}
+};
+
+struct DynProfileKeyHash {
+	size_t operator()(const DynProfileKey& key) const
+	{
+		const uint64_t val = (static_cast<uint64_t>(key.phys_addr) << 32) ^
+		                     (static_cast<uint64_t>(key.cs) << 16) ^ key.eip;
+		return std::hash<uint64_t>()(val);
+	}
+};
+
+struct DynProfileCounters {
+	uint64_t entries = 0;
+	int64_t cycles   = 0;
+};
+
+static struct {
+	bool enabled = false;
+
+	std::unordered_map<DynProfileKey, DynProfileCounters, DynProfileKeyHash> blocks = {};
+
+	// counters of the block that is currently being run
+	DynProfileCounters* running = nullptr;
+	int32_t cycles_at_entry     = 0;
+
+	uint64_t total_entries = 0;
+	int64_t total_cycles   = 0;
+
+	// block entries and cycles since the last plot update
+	uint32_t plot_entries = 0;
+	int64_t plot_cycles   = 0;
+} dyn_profile = {};
+
+// called by the run loop right before the block is entered
+static void dyn_profile_enter(const CacheBlock* block)
+{
+	DynProfileKey key = {};
+	key.phys_addr = check_cast<uint32_t>(
+	        (block->page.handler->GetPhysPage() << 12) + block->page.start);
+	key.eip = reg_eip;
+	key.cs  = SegValue(cs);
+
+	dyn_profile.running         = &dyn_profile.blocks[key];
+	dyn_profile.cycles_at_entry = CPU_Cycles;
+}
+
+// called by the run loop when control came back from the block
+static void dyn_profile_leave()
+{
+	if (!dyn_profile.running) {
+		return;
+	}
+	// the generated code subtracts the cycles of the whole block when it
+	// is entered, so this also covers blocks that were left early
+	const int64_t cycles = dyn_profile.cycles_at_entry - CPU_Cycles;
+
+	dyn_profile.running->entries++;
+	dyn_profile.running->cycles += cycles;
+	dyn_profile.running = nullptr;
+
+	dyn_profile.total_entries++;
+	dyn_profile.total_cycles += cycles;
+
+	dyn_profile.plot_cycles += cycles;
+	if (++dyn_profile.plot_entries < DYN_PROFILE_PLOT_INTERVAL) {
+		return;
+	}
+	TracyPlot("Dynamic core cycles per block",
+	          static_cast<double>(dyn_profile.plot_cycles) /
+	                  dyn_profile.plot_entries);
+	TracyPlot("Dynamic core profiled blocks",
+	          static_cast<int64_t>(dyn_profile.blocks.size()));
+	dyn_profile.plot_entries = 0;
+	dyn_profile.plot_cycles  = 0;
+}
+
+// log the blocks that consumed the most cycles, hottest first
+static void dyn_profile_report(const char* core_name)
+{
+	if (!dyn_profile.enabled) {
+		LOG_MSG("%s: Block profiling is disabled, set 'dynamic_core_profile' to enable it",
+		        core_name);
+		return;
+	}
+	if (dyn_profile.blocks.empty() || dyn_profile.total_cycles <= 0) {
+		LOG_MSG("%s: No blocks have been profiled yet", core_name);
+		return;
+	}
+
+	using profile_entry_t = decltype(dyn_profile.blocks)::value_type;
+	std::vector<const profile_entry_t*> sorted = {};
+	sorted.reserve(dyn_profile.blocks.size());
+	for (const auto& entry : dyn_profile.blocks) {
+		sorted.push_back(&entry);
+	}
+	const auto num_listed = std::min(sorted.size(),
+	                                 static_cast<size_t>(DYN_PROFILE_REPORT_BLOCKS));
+	std::partial_sort(sorted.begin(),
+	                  sorted.begin() + static_cast<ptrdiff_t>(num_listed),
+	                  sorted.end(),
+	                  [](const profile_entry_t* a, const profile_entry_t* b) {
+		                  return a->second.cycles > b->second.cycles;
+	                  });
+
+	const auto total_cycles = static_cast<double>(dyn_profile.total_cycles);
+	LOG_MSG("%s: Profiled %llu block entries and %lld cycles in %u blocks",
+	        core_name,
+	        static_cast<unsigned long long>(dyn_profile.total_entries),
+	        static_cast<long long>(dyn_profile.total_cycles),
+	        static_cast<unsigned>(dyn_profile.blocks.size()));
+	LOG_MSG("%s:  rank   CS:EIP         physical       entries          cycles   share",
+	        core_name);
+
+	double cumulative_share = 0.0;
+	for (size_t i = 0; i < num_listed; i++) {
+		const auto& key      = sorted[i]->first;
+		const auto& counters = sorted[i]->second;
+		const double share = 100.0 * static_cast<double>(counters.cycles) /
+		                     total_cycles;
+		cumulative_share += share;
+		LOG_MSG("%s:  %4u   %04x:%08x  %08x  %12llu  %14lld  %5.1f%%",
+		        core_name,
+		        static_cast<unsigned>(i + 1),
+		        key.cs,
+		        key.eip,
+		        key.phys_addr,
+		        static_cast<unsigned long long>(counters.entries),
+		        static_cast<long long>(counters.cycles),
+		        share);
+	}
+	LOG_MSG("%s: The listed blocks account for %.1f%% of the cycles",
+	        core_name,
+	        cumulative_share);
+	TracyPlot("Dynamic core hottest block share",
+	          100.0 * static_cast<double>(sorted[0]->second.cycles) /
+	                  total_cycles);
+}
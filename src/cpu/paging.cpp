@@ -29,6 +29,7 @@
 #include "lazyflags.h"
 #include "cpu.h"
 #include "debug.h"
+#include "savestate.h"
 #include "setup.h"
 
 #define LINK_TOTAL		(64*1024)
@@ -174,55 +175,120 @@ void PAGING_PageFault(PhysPt lin_addr,uint32_t page_addr,uint32_t faultcode) {
 
 static inline void InitPageUpdateLink(uint32_t relink,PhysPt addr) {
 	if (relink==0) return;
+	const auto flags=paging.tlb.flags[addr>>12];
 	if (paging.links.used) {
 		if (paging.links.entries[paging.links.used-1]==(addr>>12)) {
 			paging.links.used--;
 			PAGING_UnlinkPages(addr>>12,1);
 		}
 	}
-	if (relink>1) PAGING_LinkPage_ReadOnly(addr>>12,relink);
+	if (relink>1) {
+		PAGING_LinkPage_ReadOnly(addr>>12,relink);
+		paging.tlb.flags[addr>>12]=flags;
+	}
+}
+
+// The page directory and page table entry a linear address was translated
+// with. A 4 MB page has no page table entry, so one is made up from the
+// directory entry, and both addresses point at the directory entry.
+struct PageWalk {
+	X86PageEntry table = {};
+	X86PageEntry entry = {};
+	PhysPt table_addr  = 0;
+	PhysPt entry_addr  = 0;
+	bool large         = false;
+};
+
+// With PSE enabled, the bit of a directory entry at the position of the PAT
+// bit of a page table entry selects a 4 MB page
+static inline bool IsLargePage(const X86PageEntry& table) {
+	return (paging.cr4 & CR4_PSE) && table.block.pat;
+}
+
+static inline void MakeLargePageEntry(PageWalk& walk,uint32_t lin_page) {
+	walk.large=true;
+	walk.entry=walk.table;
+	walk.entry.block.pat=0;
+	walk.entry.block.base=(walk.table.block.base & ~0x3ffu) | (lin_page & 0x3ff);
+	walk.entry_addr=walk.table_addr;
+	paging.stats.large_page_walks++;
+}
+
+static inline void PageWalkWriteTable(const PageWalk& walk) {
+	phys_writed(walk.table_addr,walk.table.load);
+}
+
+static inline void PageWalkWriteEntry(PageWalk& walk) {
+	if (walk.large) {
+		// the accessed and dirty bits of a 4 MB page are in the directory
+		walk.table.block.a=walk.entry.block.a;
+		walk.table.block.d=walk.entry.block.d;
+		phys_writed(walk.table_addr,walk.table.load);
+	} else {
+		phys_writed(walk.entry_addr,walk.entry.load);
+	}
+}
+
+// remember how the page was mapped once it has been linked into the TLB
+static inline void PageWalkMarkTLB(const PageWalk& walk,uint32_t lin_page) {
+	uint8_t flags=0;
+	if (walk.large) flags|=TLB_LARGE;
+	if ((paging.cr4 & CR4_PGE) && walk.entry.block.g) flags|=TLB_GLOBAL;
+	paging.tlb.flags[lin_page]=flags;
 }
 
-static inline void InitPageCheckPresence(PhysPt lin_addr,bool writing,X86PageEntry& table,X86PageEntry& entry) {
+static inline void InitPageCheckPresence(PhysPt lin_addr,bool writing,PageWalk& walk) {
 	const auto lin_page=lin_addr >> 12;
 	const auto d_index=lin_page >> 10;
 	const auto t_index=lin_page & 0x3ff;
-	const auto table_addr=(paging.base.page<<12)+d_index*4;
-	table.load=phys_readd(table_addr);
+	auto& table=walk.table;
+	auto& entry=walk.entry;
+	walk.table_addr=(paging.base.page<<12)+d_index*4;
+	table.load=phys_readd(walk.table_addr);
 	if (!table.block.p) {
 		LOG(LOG_PAGING,LOG_NORMAL)("NP Table");
-		PAGING_PageFault(lin_addr,table_addr,
+		PAGING_PageFault(lin_addr,walk.table_addr,
 			(writing?0x02:0x00) | (((cpu.cpl&cpu.mpl)==0)?0x00:0x04));
-		table.load=phys_readd(table_addr);
+		table.load=phys_readd(walk.table_addr);
 		if (GCC_UNLIKELY(!table.block.p))
 			E_Exit("Pagefault didn't correct table");
 	}
-	const auto entry_addr=(table.block.base<<12)+t_index*4;
-	entry.load=phys_readd(entry_addr);
+	if (IsLargePage(table)) {
+		MakeLargePageEntry(walk,lin_page);
+		return;
+	}
+	walk.entry_addr=(table.block.base<<12)+t_index*4;
+	entry.load=phys_readd(walk.entry_addr);
 	if (!entry.block.p) {
 //		LOG(LOG_PAGING,LOG_NORMAL)("NP Page");
-		PAGING_PageFault(lin_addr,entry_addr,
+		PAGING_PageFault(lin_addr,walk.entry_addr,
 			(writing?0x02:0x00) | (((cpu.cpl&cpu.mpl)==0)?0x00:0x04));
-		entry.load=phys_readd(entry_addr);
+		entry.load=phys_readd(walk.entry_addr);
 		if (GCC_UNLIKELY(!entry.block.p))
 			E_Exit("Pagefault didn't correct page");
 	}
 }
 			
-static inline bool InitPageCheckPresence_CheckOnly(PhysPt lin_addr,bool writing,X86PageEntry& table,X86PageEntry& entry) {
+static inline bool InitPageCheckPresence_CheckOnly(PhysPt lin_addr,bool writing,PageWalk& walk) {
 	const auto lin_page=lin_addr >> 12;
 	const auto d_index=lin_page >> 10;
 	const auto t_index=lin_page & 0x3ff;
-	const auto table_addr=(paging.base.page<<12)+d_index*4;
-	table.load=phys_readd(table_addr);
+	auto& table=walk.table;
+	auto& entry=walk.entry;
+	walk.table_addr=(paging.base.page<<12)+d_index*4;
+	table.load=phys_readd(walk.table_addr);
 	if (!table.block.p) {
 		paging.cr2=lin_addr;
 		cpu.exception.which=EXCEPTION_PF;
 		cpu.exception.error=(writing?0x02:0x00) | (((cpu.cpl&cpu.mpl)==0)?0x00:0x04);
 		return false;
 	}
-	const auto entry_addr=(table.block.base<<12)+t_index*4;
-	entry.load=phys_readd(entry_addr);
+	if (IsLargePage(table)) {
+		MakeLargePageEntry(walk,lin_page);
+		return true;
+	}
+	walk.entry_addr=(table.block.base<<12)+t_index*4;
+	entry.load=phys_readd(walk.entry_addr);
 	if (!entry.block.p) {
 		paging.cr2=lin_addr;
 		cpu.exception.which=EXCEPTION_PF;
@@ -337,10 +403,12 @@ public:
 	uint32_t InitPage(uint32_t lin_addr,bool writing) {
 		const auto lin_page=lin_addr >> 12;
 		uint32_t phys_page;
+		paging.stats.misses++;
 		if (paging.enabled) {
-			X86PageEntry table;
-			X86PageEntry entry;
-			InitPageCheckPresence(lin_addr,writing,table,entry);
+			PageWalk walk;
+			InitPageCheckPresence(lin_addr,writing,walk);
+			auto& table=walk.table;
+			auto& entry=walk.entry;
 
 			// 0: no action
 			// 1: can (but currently does not) fail a user-level access privilege check
@@ -388,13 +456,13 @@ public:
 			if (priv_check==3) {
 				LOG(LOG_PAGING, LOG_NORMAL)("Page access denied: cpl=%i, %x:%x:%x:%x",
 				    static_cast<int>(cpu.cpl), entry.block.us, table.block.us, entry.block.wr, table.block.wr);
-				PAGING_PageFault(lin_addr,(table.block.base<<12)+(lin_page & 0x3ff)*4,0x05 | (writing?0x02:0x00));
+				PAGING_PageFault(lin_addr,walk.entry_addr,0x05 | (writing?0x02:0x00));
 				priv_check=0;
 			}
 
 			if (!table.block.a) {
 				table.block.a=1;		// set page table accessed
-				phys_writed((paging.base.page<<12)+(lin_page >> 10)*4,table.load);
+				PageWalkWriteTable(walk);
 			}
 			if ((!entry.block.a) || (!entry.block.d)) {
 				entry.block.a=1;		// set page accessed
@@ -403,7 +471,7 @@ public:
 				// page will be fully linked so we can't track later writes
 				if (writing || (priv_check==0)) entry.block.d=1;		// mark page as dirty
 
-				phys_writed((table.block.base<<12)+(lin_page & 0x3ff)*4,entry.load);
+				PageWalkWriteEntry(walk);
 			}
 
 			phys_page=entry.block.base;
@@ -414,13 +482,16 @@ public:
 				// if reading we could link the page as read-only to later cacth writes,
 				// will slow down pretty much but allows catching all dirty events
 				PAGING_LinkPage(lin_page,phys_page);
+				PageWalkMarkTLB(walk,lin_page);
 			} else {
 				if (priv_check==1) {
 					PAGING_LinkPage(lin_page,phys_page);
+					PageWalkMarkTLB(walk,lin_page);
 					return 1;
 				} else if (writing) {
 					PageHandler * handler=MEM_GetPageHandler(phys_page);
 					PAGING_LinkPage(lin_page,phys_page);
+					PageWalkMarkTLB(walk,lin_page);
 					if (!(handler->flags & PFLAG_READABLE)) return 1;
 					if (!(handler->flags & PFLAG_WRITEABLE)) return 1;
 					if (get_tlb_read(lin_addr)!=get_tlb_write(lin_addr)) return 1;
@@ -428,6 +499,7 @@ public:
 					else return 1;
 				} else {
 					PAGING_LinkPage_ReadOnly(lin_page,phys_page);
+					PageWalkMarkTLB(walk,lin_page);
 				}
 			}
 		} else {
@@ -439,10 +511,12 @@ public:
 	}
 	bool InitPageCheckOnly(uint32_t lin_addr,bool writing) {
 		const auto lin_page=lin_addr >> 12;
+		paging.stats.misses++;
 		if (paging.enabled) {
-			X86PageEntry table;
-			X86PageEntry entry;
-			if (!InitPageCheckPresence_CheckOnly(lin_addr,writing,table,entry)) return false;
+			PageWalk walk;
+			if (!InitPageCheckPresence_CheckOnly(lin_addr,writing,walk)) return false;
+			const auto& table=walk.table;
+			const auto& entry=walk.entry;
 
 			if (!USERWRITE_PROHIBITED) return true;
 
@@ -466,26 +540,30 @@ public:
 	void InitPageForced(uint32_t lin_addr) {
 		const auto lin_page=lin_addr >> 12;
 		uint32_t phys_page;
+		paging.stats.misses++;
 		if (paging.enabled) {
-			X86PageEntry table;
-			X86PageEntry entry;
-			InitPageCheckPresence(lin_addr,false,table,entry);
+			PageWalk walk;
+			InitPageCheckPresence(lin_addr,false,walk);
+			auto& table=walk.table;
+			auto& entry=walk.entry;
 
 			if (!table.block.a) {
 				table.block.a=1;		//Set access
-				phys_writed((paging.base.page<<12)+(lin_page >> 10)*4,table.load);
+				PageWalkWriteTable(walk);
 			}
 			if (!entry.block.a) {
 				entry.block.a=1;					//Set access
-				phys_writed((table.block.base<<12)+(lin_page & 0x3ff)*4,entry.load);
+				PageWalkWriteEntry(walk);
 			}
 			phys_page=entry.block.base;
 			// maybe use read-only page here if possible
+			PAGING_LinkPage(lin_page,phys_page);
+			PageWalkMarkTLB(walk,lin_page);
 		} else {
 			if (lin_page<LINK_START) phys_page=paging.firstmb[lin_page];
 			else phys_page=lin_page;
+			PAGING_LinkPage(lin_page,phys_page);
 		}
-		PAGING_LinkPage(lin_page,phys_page);
 	}
 };
 
@@ -548,28 +626,31 @@ public:
 	void InitPage(uint32_t lin_addr, [[maybe_unused]] uint32_t val) {
 		const auto lin_page=lin_addr >> 12;
 		uint32_t phys_page;
+		paging.stats.misses++;
 		if (paging.enabled) {
 			if (!USERWRITE_PROHIBITED) return;
 
-			X86PageEntry table;
-			X86PageEntry entry;
-			InitPageCheckPresence(lin_addr,true,table,entry);
+			PageWalk walk;
+			InitPageCheckPresence(lin_addr,true,walk);
+			auto& table=walk.table;
+			auto& entry=walk.entry;
 
 			LOG(LOG_PAGING, LOG_NORMAL)("Page access denied: cpl=%i, %x:%x:%x:%x",
 			    static_cast<int>(cpu.cpl), entry.block.us, table.block.us, entry.block.wr, table.block.wr);
-			PAGING_PageFault(lin_addr,(table.block.base<<12)+(lin_page & 0x3ff)*4,0x07);
+			PAGING_PageFault(lin_addr,walk.entry_addr,0x07);
 
 			if (!table.block.a) {
 				table.block.a=1;		//Set access
-				phys_writed((paging.base.page<<12)+(lin_page >> 10)*4,table.load);
+				PageWalkWriteTable(walk);
 			}
 			if ((!entry.block.a) || (!entry.block.d)) {
 				entry.block.a=1;	//Set access
 				entry.block.d=1;	//Set dirty
-				phys_writed((table.block.base<<12)+(lin_page & 0x3ff)*4,entry.load);
+				PageWalkWriteEntry(walk);
 			}
 			phys_page=entry.block.base;
 			PAGING_LinkPage(lin_page,phys_page);
+			PageWalkMarkTLB(walk,lin_page);
 		} else {
 			if (lin_page<LINK_START) phys_page=paging.firstmb[lin_page];
 			else phys_page=lin_page;
@@ -578,12 +659,14 @@ public:
 	}
 	uint32_t InitPageCheckOnly(uint32_t lin_addr, [[maybe_unused]] uint32_t val) {
 		const auto lin_page=lin_addr >> 12;
+		paging.stats.misses++;
 		if (paging.enabled) {
 			if (!USERWRITE_PROHIBITED) return 2;
 
-			X86PageEntry table;
-			X86PageEntry entry;
-			if (!InitPageCheckPresence_CheckOnly(lin_addr,true,table,entry)) return 0;
+			PageWalk walk;
+			if (!InitPageCheckPresence_CheckOnly(lin_addr,true,walk)) return 0;
+			const auto& table=walk.table;
+			const auto& entry=walk.entry;
 
 			if (InitPage_CheckUseraccess(entry.block.us,table.block.us) || (((entry.block.wr==0) || (table.block.wr==0)))) {
 				LOG(LOG_PAGING, LOG_NORMAL)("Page access denied: cpl=%i, %x:%x:%x:%x",
@@ -594,6 +677,7 @@ public:
 				return 0;
 			}
 			PAGING_LinkPage(lin_page,entry.block.base);
+			PageWalkMarkTLB(walk,lin_page);
 		} else {
 			uint32_t phys_page;
 			if (lin_page<LINK_START) phys_page=paging.firstmb[lin_page];
@@ -605,25 +689,29 @@ public:
 	void InitPageForced(uint32_t lin_addr) {
 		const auto lin_page=lin_addr >> 12;
 		uint32_t phys_page;
+		paging.stats.misses++;
 		if (paging.enabled) {
-			X86PageEntry table;
-			X86PageEntry entry;
-			InitPageCheckPresence(lin_addr,true,table,entry);
+			PageWalk walk;
+			InitPageCheckPresence(lin_addr,true,walk);
+			auto& table=walk.table;
+			auto& entry=walk.entry;
 
 			if (!table.block.a) {
 				table.block.a=1;		//Set access
-				phys_writed((paging.base.page<<12)+(lin_page >> 10)*4,table.load);
+				PageWalkWriteTable(walk);
 			}
 			if (!entry.block.a) {
 				entry.block.a=1;	//Set access
-				phys_writed((table.block.base<<12)+(lin_page & 0x3ff)*4,entry.load);
+				PageWalkWriteEntry(walk);
 			}
 			phys_page=entry.block.base;
+			PAGING_LinkPage(lin_page,phys_page);
+			PageWalkMarkTLB(walk,lin_page);
 		} else {
 			if (lin_page<LINK_START) phys_page=paging.firstmb[lin_page];
 			else phys_page=lin_page;
+			PAGING_LinkPage(lin_page,phys_page);
 		}
-		PAGING_LinkPage(lin_page,phys_page);
 	}
 };
 
@@ -636,6 +724,10 @@ bool PAGING_MakePhysPage(Bitu & page) {
 		X86PageEntry table;
 		table.load=phys_readd((paging.base.page<<12)+d_index*4);
 		if (!table.block.p) return false;
+		if (IsLargePage(table)) {
+			page=(table.block.base & ~0x3ffu) | t_index;
+			return true;
+		}
 		X86PageEntry entry;
 		entry.load=phys_readd((table.block.base<<12)+t_index*4);
 		if (!entry.block.p) return false;
@@ -668,48 +760,89 @@ bool PAGING_ForcePageInit(Bitu lin_addr) {
 	return false;
 }
 
-#if defined(USE_FULL_TLB)
+static inline void UnlinkPage(uint32_t lin_page) {
+	paging.tlb.read[lin_page]=nullptr;
+	paging.tlb.write[lin_page]=nullptr;
+	paging.tlb.readhandler[lin_page]=&init_page_handler;
+	paging.tlb.writehandler[lin_page]=&init_page_handler;
+	paging.tlb.flags[lin_page]=0;
+}
+
+static inline bool IsPageLinked(uint32_t lin_page) {
+	return paging.tlb.readhandler[lin_page]!=&init_page_handler;
+}
+
 void PAGING_InitTLB()
 {
-	for (auto i=0;i<TLB_SIZE;i++) {
-		paging.tlb.read[i]=nullptr;
-		paging.tlb.write[i]=nullptr;
-		paging.tlb.readhandler[i]=&init_page_handler;
-		paging.tlb.writehandler[i]=&init_page_handler;
+	for (uint32_t i=0;i<TLB_SIZE;i++) {
+		UnlinkPage(i);
 	}
 	paging.links.used=0;
 }
 
 void PAGING_ClearTLB()
 {
+	paging.stats.full_flushes++;
+	paging.stats.flushed_entries+=paging.links.used;
 	uint32_t * entries=&paging.links.entries[0];
 	for (;paging.links.used>0;paging.links.used--) {
-		const auto page=*entries++;
-		paging.tlb.read[page]=nullptr;
-		paging.tlb.write[page]=nullptr;
-		paging.tlb.readhandler[page]=&init_page_handler;
-		paging.tlb.writehandler[page]=&init_page_handler;
+		UnlinkPage(*entries++);
 	}
 	paging.links.used=0;
 }
 
+// Drop all pages that aren't marked global from the TLB; the global ones are
+// moved to the front of the links list
+static void ClearNonGlobalTLB()
+{
+	uint32_t kept=0;
+	for (uint32_t i=0;i<paging.links.used;i++) {
+		const auto page=paging.links.entries[i];
+		if ((paging.tlb.flags[page] & TLB_GLOBAL) && IsPageLinked(page)) {
+			paging.links.entries[kept++]=page;
+		} else {
+			UnlinkPage(page);
+		}
+	}
+	paging.stats.flushed_entries+=paging.links.used-kept;
+	paging.stats.global_kept+=kept;
+	paging.links.used=kept;
+}
+
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
 	for (;pages>0;pages--) {
-		paging.tlb.read[lin_page]=nullptr;
-		paging.tlb.write[lin_page]=nullptr;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
+		UnlinkPage(static_cast<uint32_t>(lin_page));
 		lin_page++;
 	}
 }
 
+void PAGING_InvalidatePage(PhysPt lin_addr) {
+	paging.stats.page_invalidates++;
+	const auto lin_page=lin_addr >> 12;
+	UnlinkPage(lin_page);
+	// a 4 MB page is translated by a single directory entry, so the other
+	// pages of the region may come from it even if the named page wasn't
+	// linked through it
+	const auto first_page=lin_page & ~0x3ffu;
+	for (auto page=first_page;page<first_page+1024;page++) {
+		if (paging.tlb.flags[page] & TLB_LARGE) UnlinkPage(page);
+	}
+}
+
+void PAGING_UnlinkPhysPages(Bitu phys_page,Bitu pages) {
+	paging.stats.phys_invalidates++;
+	for (uint32_t i=0;i<paging.links.used;i++) {
+		const auto page=paging.links.entries[i];
+		if (paging.tlb.phys_page[page]-phys_page<pages && IsPageLinked(page)) {
+			UnlinkPage(page);
+		}
+	}
+}
+
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 	if (lin_page<LINK_START) {
 		paging.firstmb[lin_page]=phys_page;
-		paging.tlb.read[lin_page]=nullptr;
-		paging.tlb.write[lin_page]=nullptr;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
+		UnlinkPage(static_cast<uint32_t>(lin_page));
 	} else {
 		PAGING_LinkPage(lin_page,phys_page);
 	}
@@ -736,6 +869,7 @@ void PAGING_LinkPage(uint32_t lin_page,uint32_t phys_page) {
 	paging.links.entries[paging.links.used++]=lin_page;
 	paging.tlb.readhandler[lin_page]=handler;
 	paging.tlb.writehandler[lin_page]=handler;
+	paging.tlb.flags[lin_page]=0;
 }
 
 void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page) {
@@ -758,128 +892,67 @@ void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page) {
 	paging.links.entries[paging.links.used++]=lin_page;
 	paging.tlb.readhandler[lin_page]=handler;
 	paging.tlb.writehandler[lin_page]=&init_page_handler_userro;
+	paging.tlb.flags[lin_page]=0;
 }
 
-#else
-
-static inline void InitTLBInt(tlb_entry *bank) {
- 	for (Bitu i=0;i<TLB_SIZE;i++) {
-		bank[i].read=0;
-		bank[i].write=0;
-		bank[i].readhandler=&init_page_handler;
-		bank[i].writehandler=&init_page_handler;
- 	}
-}
-
-void PAGING_InitTLBBank(tlb_entry **bank) {
-	*bank = (tlb_entry *)malloc(sizeof(tlb_entry)*TLB_SIZE);
-	if(!*bank) E_Exit("Out of Memory");
-	InitTLBInt(*bank);
-}
-
-void PAGING_InitTLB()
-{
-	InitTLBInt(paging.tlbh);
-	paging.links.used=0;
-}
-
-void PAGING_ClearTLB()
-{
-	uint32_t* entries = &paging.links.entries[0];
-	for (;paging.links.used>0;paging.links.used--) {
-		Bitu page=*entries++;
-		tlb_entry *entry = get_tlb_entry(page<<12);
-		entry->read=0;
-		entry->write=0;
-		entry->readhandler=&init_page_handler;
-		entry->writehandler=&init_page_handler;
+void PAGING_SetDirBase(Bitu cr3) {
+	assert(cr3 <= UINT32_MAX);
+	paging.cr3=static_cast<uint32_t>(cr3);
+	
+	paging.base.page=static_cast<uint32_t>(cr3 >> 12);
+	paging.base.addr=static_cast<PhysPt>(cr3 & ~4095);
+//	LOG(LOG_PAGING,LOG_NORMAL)("CR3:%X Base %X",cr3,paging.base.page);
+	if (paging.enabled) {
+		paging.stats.cr3_reloads++;
+		// loading CR3 keeps the pages marked global, which is what
+		// operating systems use to keep the kernel mapped across tasks
+		if (paging.cr4 & CR4_PGE) ClearNonGlobalTLB();
+		else PAGING_ClearTLB();
 	}
-	paging.links.used=0;
 }
 
-void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
-	for (;pages>0;pages--) {
-		tlb_entry *entry = get_tlb_entry(lin_page<<12);
-		entry->read=0;
-		entry->write=0;
-		entry->readhandler=&init_page_handler;
-		entry->writehandler=&init_page_handler;
-		lin_page++;
-	}
+Bitu PAGING_GetCR4()
+{
+	return paging.cr4;
 }
 
-void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
-	if (lin_page<LINK_START) {
-		paging.firstmb[lin_page]=phys_page;
-		paging.tlbh[lin_page].read=0;
-		paging.tlbh[lin_page].write=0;
-		paging.tlbh[lin_page].readhandler=&init_page_handler;
-		paging.tlbh[lin_page].writehandler=&init_page_handler;
-	} else {
-		PAGING_LinkPage(lin_page,phys_page);
+void PAGING_SetCR4(Bitu cr4) {
+	// only large pages and global pages are supported, and only when
+	// emulating a Pentium as that's the only CPU type reporting them
+	uint32_t new_cr4=0;
+	if (CPU_ArchitectureType==ArchitectureType::PentiumSlow) {
+		new_cr4=static_cast<uint32_t>(cr4) & (CR4_PSE | CR4_PGE);
 	}
+	if (new_cr4==paging.cr4) return;
+	paging.cr4=new_cr4;
+	// changing the page size or the global bit invalidates all translations
+	PAGING_ClearTLB();
 }
 
-void PAGING_LinkPage(uint32_t lin_page, uint32_t phys_page)
+void PAGING_ResetTLBStats()
 {
-	PageHandler* handler = MEM_GetPageHandler(phys_page);
-	Bitu lin_base=lin_page << 12;
-	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
-		E_Exit("Illegal page");
-
-	if (paging.links.used>=PAGING_LINKS) {
-		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
-		PAGING_ClearTLB();
-	}
-
-	tlb_entry *entry = get_tlb_entry(lin_base);
-	entry->phys_page=phys_page;
-	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
-	else entry->read=0;
-	if (handler->flags & PFLAG_WRITEABLE) entry->write=handler->GetHostWritePt(phys_page)-lin_base;
-	else entry->write=0;
-
- 	paging.links.entries[paging.links.used++]=lin_page;
-	entry->readhandler=handler;
-	entry->writehandler=handler;
+	paging.stats={};
 }
 
-void PAGING_LinkPage_ReadOnly(uint32_t lin_page, uint32_t phys_page)
+void PAGING_LogTLBStats()
 {
-	PageHandler* handler = MEM_GetPageHandler(phys_page);
-	Bitu lin_base=lin_page << 12;
-	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
-		E_Exit("Illegal page");
-
-	if (paging.links.used>=PAGING_LINKS) {
-		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
-		PAGING_ClearTLB();
-	}
-
-	tlb_entry *entry = get_tlb_entry(lin_base);
-	entry->phys_page=phys_page;
-	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
-	else entry->read=0;
-	entry->write=0;
-
- 	paging.links.entries[paging.links.used++]=lin_page;
-	entry->readhandler=handler;
-	entry->writehandler=&init_page_handler_userro;
-}
-
-#endif
-
-
-void PAGING_SetDirBase(Bitu cr3) {
-	assert(cr3 <= UINT32_MAX);
-	paging.cr3=static_cast<uint32_t>(cr3);
-	
-	paging.base.page=static_cast<uint32_t>(cr3 >> 12);
-	paging.base.addr=static_cast<PhysPt>(cr3 & ~4095);
-//	LOG(LOG_PAGING,LOG_NORMAL)("CR3:%X Base %X",cr3,paging.base.page);
-	if (paging.enabled) {
-		PAGING_ClearTLB();
-	}
+	const auto& stats=paging.stats;
+	LOG_MSG("PAGING: CR3=%08x CR4=%08x (PSE %s, PGE %s), %u of %u links in use",
+	        paging.cr3,paging.cr4,
+	        (paging.cr4 & CR4_PSE) ? "on" : "off",
+	        (paging.cr4 & CR4_PGE) ? "on" : "off",
+	        paging.links.used,PAGING_LINKS);
+	LOG_MSG("PAGING: %llu misses, %llu of them through 4 MB pages",
+	        static_cast<unsigned long long>(stats.misses),
+	        static_cast<unsigned long long>(stats.large_page_walks));
+	LOG_MSG("PAGING: %llu full flushes, %llu CR3 reloads, %llu entries flushed, %llu global entries kept",
+	        static_cast<unsigned long long>(stats.full_flushes),
+	        static_cast<unsigned long long>(stats.cr3_reloads),
+	        static_cast<unsigned long long>(stats.flushed_entries),
+	        static_cast<unsigned long long>(stats.global_kept));
+	LOG_MSG("PAGING: %llu single page invalidations, %llu physical range invalidations",
+	        static_cast<unsigned long long>(stats.page_invalidates),
+	        static_cast<unsigned long long>(stats.phys_invalidates));
 }
 
 void PAGING_Enable(bool enabled) {
@@ -904,16 +977,43 @@ bool PAGING_Enabled()
 	return paging.enabled;
 }
 
+static void paging_save_state(SaveStateWriter& writer)
+{
+	writer.Write(paging.cr3);
+	writer.Write(paging.cr2);
+	writer.Write(paging.cr4);
+	writer.Write(paging.enabled);
+	writer.WriteBytes(paging.firstmb.data(),
+	                  paging.firstmb.size() * sizeof(paging.firstmb[0]));
+}
+
+static void paging_load_state(SaveStateReader& reader)
+{
+	uint32_t cr3 = 0;
+	reader.Read(cr3);
+	reader.Read(paging.cr2);
+	reader.Read(paging.cr4);
+	reader.Read(paging.enabled);
+	reader.ReadBytes(paging.firstmb.data(),
+	                 paging.firstmb.size() * sizeof(paging.firstmb[0]));
+
+	// Nothing in the TLB is valid for the loaded page tables
+	PAGING_InitTLB();
+	PAGING_SetDirBase(cr3);
+}
+
 class PAGING final : public Module_base{
 public:
 	PAGING(Section* configuration):Module_base(configuration){
 		/* Setup default Page Directory, force it to update */
 		paging.enabled=false;
+		paging.cr4=0;
 		PAGING_InitTLB();
 		for (auto i=0;i<LINK_START;i++) {
 			paging.firstmb[i]=i;
 		}
 		pf_queue.used=0;
+		SAVESTATE_AddComponent("paging", 1, paging_save_state, paging_load_state);
 	}
 };
 
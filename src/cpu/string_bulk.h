@@ -0,0 +1,154 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#ifndef DOSBOX_STRING_BULK_H
+#define DOSBOX_STRING_BULK_H
+
+/*  Bulk REP MOVS/STOS
+ *  ------------------
+ *  Runs of REP MOVS and REP STOS elements that lie on pages mapped to host
+ *  memory are done with memmove or a fill loop instead of one element at a
+ *  time, a page at most per step. The caller still decides how many
+ *  elements may be done, so the cycle accounting and interruption of the
+ *  string instruction stay the same.
+ *
+ *  The bulk functions stop at the first element that isn't on a host
+ *  memory page (pages with a handler, such as VGA memory or code pages of
+ *  the dynamic cores, or pages that aren't in the TLB yet), or that crosses
+ *  a page boundary or the wrap-around of the index register. The caller
+ *  does that element the regular way and then tries again.
+ */
+
+#include "cpu.h"
+#include "mem_host.h"
+#include "paging.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Number of elements, starting with the one at base + index, that lie on
+// the same page and don't wrap around the index, in the string direction
+template <typename T>
+static inline uint32_t STRING_RunLength(const PhysPt base, const uint32_t index,
+                                        const uint32_t add_mask, const bool backwards)
+{
+	constexpr uint32_t size = sizeof(T);
+
+	const uint32_t offset = (base + index) & (MEM_PAGE_SIZE - 1);
+	if (offset > MEM_PAGE_SIZE - size || index > add_mask - (size - 1)) {
+		return 0;
+	}
+	if (backwards) {
+		return std::min(offset / size, index / size) + 1;
+	}
+	return std::min((MEM_PAGE_SIZE - size - offset) / size,
+	                (add_mask - (size - 1) - index) / size) + 1;
+}
+
+template <typename T>
+static inline uint32_t STRING_BulkMovs(const PhysPt si_base, uint32_t& si_index,
+                                       const PhysPt di_base, uint32_t& di_index,
+                                       const uint32_t add_mask, const uint32_t count)
+{
+	const bool backwards = cpu.direction < 0;
+	uint32_t done        = 0;
+	while (done < count) {
+		// bail out early on pages that are backed by a handler
+		if (!get_tlb_write(di_base + di_index) || !get_tlb_read(si_base + si_index)) {
+			break;
+		}
+		const auto num = std::min({count - done,
+		                           STRING_RunLength<T>(si_base, si_index, add_mask, backwards),
+		                           STRING_RunLength<T>(di_base, di_index, add_mask, backwards)});
+		if (!num) {
+			break;
+		}
+		const uint32_t bytes = num * sizeof(T);
+		const uint32_t span  = backwards ? bytes - sizeof(T) : 0;
+
+		// the lowest addresses of both ranges
+		const auto src = reinterpret_cast<uintptr_t>(
+		        mem_host_read_pt<T>(si_base + si_index - span));
+		const auto dst = reinterpret_cast<uintptr_t>(
+		        mem_host_write_pt<T>(di_base + di_index - span));
+		if (!src || !dst) {
+			break;
+		}
+		// Moving element by element replicates the data when the
+		// destination overlaps the part of the source that's yet to be
+		// read, something memmove doesn't do
+		const bool replicates = backwards ? (dst < src && dst + bytes > src)
+		                                  : (dst > src && dst < src + bytes);
+		if (replicates) {
+			break;
+		}
+		memmove(reinterpret_cast<void*>(dst), reinterpret_cast<const void*>(src), bytes);
+
+		const uint32_t step = backwards ? 0u - bytes : bytes;
+		si_index            = (si_index + step) & add_mask;
+		di_index            = (di_index + step) & add_mask;
+		done += num;
+	}
+	return done;
+}
+
+template <typename T>
+static inline uint32_t STRING_BulkStos(const PhysPt di_base, uint32_t& di_index,
+                                       const uint32_t add_mask, const uint32_t count,
+                                       const T val)
+{
+	const bool backwards = cpu.direction < 0;
+	uint32_t done        = 0;
+	while (done < count) {
+		if (!get_tlb_write(di_base + di_index)) {
+			break;
+		}
+		const auto num = std::min(count - done,
+		                          STRING_RunLength<T>(di_base, di_index, add_mask, backwards));
+		if (!num) {
+			break;
+		}
+		const uint32_t bytes = num * sizeof(T);
+		const uint32_t span  = backwards ? bytes - sizeof(T) : 0;
+
+		const auto dst = mem_host_write_pt<T>(di_base + di_index - span);
+		if (!dst) {
+			break;
+		}
+		if (sizeof(T) == 1) {
+			memset(dst, static_cast<uint8_t>(val), bytes);
+		} else {
+			for (uint32_t i = 0; i < bytes; i += sizeof(T)) {
+				if (sizeof(T) == 2) {
+					host_writew(dst + i, static_cast<uint16_t>(val));
+				} else {
+					host_writed(dst + i, static_cast<uint32_t>(val));
+				}
+			}
+		}
+
+		const uint32_t step = backwards ? 0u - bytes : bytes;
+		di_index            = (di_index + step) & add_mask;
+		done += num;
+	}
+	return done;
+}
+
+#endif
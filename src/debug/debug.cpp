@@ -1290,6 +1290,17 @@ bool ParseCommand(char* str) {
 
 	if (command == "PAGING") {LogPages(found); return true;}
 
+	if (command == "TLB") {
+		stream >> command;
+		if (command == "CLEAR") {
+			PAGING_ResetTLBStats();
+			DEBUG_ShowMsg("DEBUG: TLB counters cleared.\n");
+		} else {
+			PAGING_LogTLBStats();
+		}
+		return true;
+	}
+
 	if (command == "CPU") {LogCPUInfo(); return true;}
 
 	if (command == "INTVEC") {
@@ -1380,6 +1391,7 @@ bool ParseCommand(char* str) {
 		DEBUG_ShowMsg("LDT                       - Lists descriptors of the LDT.\n");
 		DEBUG_ShowMsg("IDT                       - Lists descriptors of the IDT.\n");
 		DEBUG_ShowMsg("PAGING [page]             - Display content of page table.\n");
+		DEBUG_ShowMsg("TLB [CLEAR]               - Display or clear the TLB counters.\n");
 		DEBUG_ShowMsg("EXTEND                    - Toggle additional info.\n");
 		DEBUG_ShowMsg("TIMERIRQ                  - Run the system timer.\n");
 
@@ -2052,8 +2064,14 @@ void LogPages(char* selname) {
 				table.load=phys_readd(table_addr);
 				if (table.block.p) {
 					X86PageEntry entry;
-					Bitu entry_addr=(table.block.base<<12)+(i & 0x3ff)*4;
-					entry.load=phys_readd(entry_addr);
+					if ((paging.cr4 & CR4_PSE) && table.block.pat) {
+						// 4 MB page, there's no page table to read
+						entry=table;
+						entry.block.base=(table.block.base & ~0x3ffu)|(i & 0x3ff);
+					} else {
+						Bitu entry_addr=(table.block.base<<12)+(i & 0x3ff)*4;
+						entry.load=phys_readd(entry_addr);
+					}
 					if (entry.block.p) {
 						sprintf(out1,"page %05Xxxx -> %04Xxxx  flags [uw] %x:%x::%x:%x [d=%x|a=%x]",
 							i,entry.block.base,entry.block.us,table.block.us,
@@ -2068,8 +2086,14 @@ void LogPages(char* selname) {
 			table.load=phys_readd(table_addr);
 			if (table.block.p) {
 				X86PageEntry entry;
-				Bitu entry_addr=(table.block.base<<12)+(sel & 0x3ff)*4;
-				entry.load=phys_readd(entry_addr);
+				if ((paging.cr4 & CR4_PSE) && table.block.pat) {
+					// 4 MB page, there's no page table to read
+					entry=table;
+					entry.block.base=(table.block.base & ~0x3ffu)|(sel & 0x3ff);
+				} else {
+					Bitu entry_addr=(table.block.base<<12)+(sel & 0x3ff)*4;
+					entry.load=phys_readd(entry_addr);
+				}
 				sprintf(out1,"page %05" sBitfs(X) "xxx -> %04Xxxx  flags [puw] %x:%x::%x:%x::%x:%x",sel,entry.block.base,entry.block.p,table.block.p,entry.block.us,table.block.us,entry.block.wr,table.block.wr);
 				LOG(LOG_MISC,LOG_ERROR)("%s",out1);
 			} else {
@@ -2082,7 +2106,7 @@ void LogPages(char* selname) {
 
 static void LogCPUInfo(void) {
 	char out1[512];
-	sprintf(out1,"cr0:%08" sBitfs(X) " cr2:%08u cr3:%08u  cpl=%" sBitfs(x),cpu.cr0,paging.cr2,paging.cr3,cpu.cpl);
+	sprintf(out1,"cr0:%08" sBitfs(X) " cr2:%08u cr3:%08u cr4:%08x  cpl=%" sBitfs(x),cpu.cr0,paging.cr2,paging.cr3,paging.cr4,cpu.cpl);
 	LOG(LOG_MISC,LOG_ERROR)("%s",out1);
 	sprintf(out1, "eflags:%08x [vm=%x iopl=%x nt=%x]", reg_flags,
 	        GETFLAG(VM) >> 17, GETFLAG(IOPL) >> 12, GETFLAG(NT) >> 14);
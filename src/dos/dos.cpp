@@ -31,6 +31,7 @@
 #include "mem.h"
 #include "program_mount_common.h"
 #include "regs.h"
+#include "savestate.h"
 #include "serialport.h"
 #include "setup.h"
 #include "string_utils.h"
@@ -1556,6 +1557,141 @@ DOS_Version DOS_ParseVersion(const char *word, const char *args)
 	return new_version;
 }
 
+// The DOS tables live in the guest's memory; what's kept on the host side
+// are the open files, which are opened again by name, and the current
+// directories of the drives, which have to be mounted the same way
+static void dos_save_state(SaveStateWriter& writer)
+{
+	writer.Write(dos.date);
+	writer.Write(dos.version);
+	writer.Write(dos.firstMCB);
+	writer.Write(dos.errorcode);
+	writer.Write(dos.env);
+	writer.Write(dos.cpmentry);
+	writer.Write(dos.return_code);
+	writer.Write(dos.return_mode);
+	writer.Write(dos.current_drive);
+	writer.Write(dos.verify);
+	writer.Write(dos.breakcheck);
+	writer.Write(dos.echo);
+	writer.Write(dos.direct_output);
+	writer.Write(dos.internal_output);
+	writer.Write(dos.loaded_codepage);
+	writer.Write(dos.dcp);
+
+	for (const auto drive : Drives) {
+		writer.Write(drive != nullptr);
+		if (drive) {
+			writer.WriteString(drive->curdir);
+		}
+	}
+
+	for (const auto file : Files) {
+		writer.Write(file && file->IsOpen());
+		if (!file || !file->IsOpen()) {
+			continue;
+		}
+		uint32_t pos = 0;
+		file->Seek(&pos, DOS_SEEK_CUR);
+		writer.WriteString(file->name);
+		writer.Write(file->GetDrive());
+		writer.Write(file->flags);
+		writer.Write(file->time);
+		writer.Write(file->date);
+		writer.Write(file->attr);
+		writer.Write(file->refCtr);
+		writer.Write(pos);
+	}
+}
+
+static void dos_load_state(SaveStateReader& reader)
+{
+	reader.Read(dos.date);
+	reader.Read(dos.version);
+	reader.Read(dos.firstMCB);
+	reader.Read(dos.errorcode);
+	reader.Read(dos.env);
+	reader.Read(dos.cpmentry);
+	reader.Read(dos.return_code);
+	reader.Read(dos.return_mode);
+	reader.Read(dos.current_drive);
+	reader.Read(dos.verify);
+	reader.Read(dos.breakcheck);
+	reader.Read(dos.echo);
+	reader.Read(dos.direct_output);
+	reader.Read(dos.internal_output);
+	reader.Read(dos.loaded_codepage);
+	reader.Read(dos.dcp);
+
+	for (size_t i = 0; i < Drives.size(); ++i) {
+		bool is_mounted = false;
+		reader.Read(is_mounted);
+		if (!is_mounted) {
+			continue;
+		}
+		const auto curdir = reader.ReadString();
+		if (Drives[i]) {
+			safe_strcpy(Drives[i]->curdir, curdir.c_str());
+		} else {
+			LOG_WARNING("DOS: Drive %c: is no longer mounted",
+			            static_cast<char>('A' + i));
+		}
+	}
+
+	for (auto& file : Files) {
+		if (file) {
+			if (file->IsOpen()) {
+				file->Close();
+			}
+			delete file;
+			file = nullptr;
+		}
+
+		bool is_open = false;
+		reader.Read(is_open);
+		if (!is_open) {
+			continue;
+		}
+		const auto name = reader.ReadString();
+		uint8_t drive   = 0;
+		uint32_t flags  = 0;
+		uint16_t time   = 0;
+		uint16_t date   = 0;
+		uint16_t attr   = 0;
+		Bits ref_count  = 0;
+		uint32_t pos    = 0;
+		reader.Read(drive);
+		reader.Read(flags);
+		reader.Read(time);
+		reader.Read(date);
+		reader.Read(attr);
+		reader.Read(ref_count);
+		reader.Read(pos);
+
+		char fullname[DOS_PATHLENGTH];
+		safe_strcpy(fullname, name.c_str());
+		if (drive == 0xff) {
+			const auto devnum = DOS_FindDevice(fullname);
+			if (devnum != DOS_DEVICES) {
+				file = new DOS_Device(*Devices[devnum]);
+			}
+		} else if (drive < Drives.size() && Drives[drive] &&
+		           Drives[drive]->FileOpen(&file, fullname, flags)) {
+			file->SetDrive(drive);
+		}
+		if (!file) {
+			LOG_WARNING("DOS: Couldn't open '%s' again", name.c_str());
+			continue;
+		}
+		file->flags  = flags;
+		file->time   = time;
+		file->date   = date;
+		file->attr   = attr;
+		file->refCtr = ref_count;
+		file->Seek(&pos, DOS_SEEK_SET);
+	}
+}
+
 class DOS:public Module_base{
 private:
 	CALLBACK_HandlerObject callback[7];
@@ -1603,6 +1739,8 @@ public:
 		DOS_SDA(DOS_SDA_SEG,DOS_SDA_OFS).SetDrive(25); /* Else the next call gives a warning. */
 		DOS_SetDefaultDrive(25);
 
+		SAVESTATE_AddComponent("dos", 1, dos_save_state, dos_load_state);
+
 		dos.version.major=5;
 		dos.version.minor=0;
 		dos.direct_output=false;
@@ -21,6 +21,7 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdarg>
 #include <cstdio>
@@ -30,11 +31,13 @@
 #include <thread>
 #include <unistd.h>
 
+#include "benchmark.h"
 #include "callback.h"
 #include "capture/capture.h"
 #include "control.h"
 #include "cpu.h"
 #include "cross.h"
+#include "cycle_governor.h"
 #include "debug.h"
 #include "dos_inc.h"
 #include "hardware.h"
@@ -51,6 +54,8 @@
 #include "programs.h"
 #include "reelmagic.h"
 #include "render.h"
+#include "replay.h"
+#include "savestate.h"
 #include "setup.h"
 #include "shell.h"
 #include "support.h"
@@ -133,10 +138,13 @@ static LoopHandler * loop;
 
 static int64_t ticksRemain;
 static int64_t ticksLast;
-static int64_t ticksAdded;
-int64_t ticksDone;
-int64_t ticksScheduled;
+static int64_t ticksLastUs;
 bool ticksLocked;
+
+// Schedule emulated milliseconds against microsecond timestamps and wait for
+// them with a hybrid sleep and spin, see the 'precise_timing' setting
+static bool precise_timing = false;
+static int64_t precise_timing_slack_us = 250;
 void increaseticks();
 
 bool mono_cga=false;
@@ -145,11 +153,20 @@ void Null_Init([[maybe_unused]] Section *sec) {
 	// do nothing
 }
 
+static bool run_pic_queue()
+{
+	BenchmarkScope scope(BenchmarkSection::PicQueue);
+	return PIC_RunQueue();
+}
+
 static Bitu Normal_Loop() {
 	Bits ret;
 	while (1) {
-		if (PIC_RunQueue()) {
-			ret = (*cpudecoder)();
+		if (run_pic_queue()) {
+			{
+				BenchmarkScope scope(BenchmarkSection::Cpu);
+				ret = (*cpudecoder)();
+			}
 			if (GCC_UNLIKELY(ret<0)) return 1;
 			if (ret>0) {
 				if (GCC_UNLIKELY(ret >= CB_MAX)) return 0;
@@ -160,148 +177,88 @@ static Bitu Normal_Loop() {
 			if (DEBUG_ExitLoop()) return 0;
 #endif
 		} else {
+			if (GCC_UNLIKELY(benchmark_running))
+				BENCHMARK_EndTick();
 			if (!GFX_Events())
 				return 0;
+			if (GCC_UNLIKELY(savestate_pending))
+				SAVESTATE_RunPending();
 			if (ticksRemain > 0) {
+				if (GCC_UNLIKELY(replay_active))
+					REPLAY_Tick();
 				TIMER_AddTick();
 				ticksRemain--;
+				if (GCC_UNLIKELY(benchmark_running))
+					BENCHMARK_Tick();
 			} else {increaseticks();return 0;}
 		}
 	}
 }
 
+// Sleep until the given point in time, in microseconds since startup. Sleeping
+// can overshoot by the scheduling granularity of the host, so the last part of
+// the wait, the slack, is spent yielding instead.
+static void precise_wait_until(const int64_t deadline_us)
+{
+	const auto remaining_us = deadline_us - GetTicksUs();
+	if (remaining_us > precise_timing_slack_us) {
+		std::this_thread::sleep_for(
+		        std::chrono::microseconds(remaining_us - precise_timing_slack_us));
+	}
+	while (GetTicksUs() < deadline_us) {
+		std::this_thread::yield();
+	}
+}
+
 void increaseticks() { //Make it return ticksRemain and set it in the function above to remove the global variable.
 	ZoneScoped;
 	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
 		ticksLast = GetTicks();
-		ticksAdded = 0;
-		ticksDone = 0;
-		ticksScheduled = 0;
+		ticksLastUs = GetTicksUs();
+		CYCLE_GOVERNOR_Reset();
+		return;
+	}
+
+	if (precise_timing) {
+		const auto ticksNewUs = GetTicksUs();
+		const auto elapsedUs  = ticksNewUs - ticksLastUs;
+		if (elapsedUs < 1000) {
+			// Ahead of the host, wait for the start of the next
+			// millisecond rather than a whole millisecond from now
+			precise_wait_until(ticksLastUs + 1000);
+			CYCLE_GOVERNOR_AddSleep(GetTicksUs() - ticksNewUs);
+			return;
+		}
+		// Only whole milliseconds are emulated, the rest carries over
+		// to the next call instead of being lost
+		const auto elapsedMs = elapsedUs / 1000;
+		ticksLastUs += elapsedMs * 1000;
+		ticksRemain = std::min(elapsedMs, static_cast<int64_t>(20));
+
+		CYCLE_GOVERNOR_AddTicks(elapsedMs * 1000, ticksRemain);
 		return;
 	}
 
 	const auto ticksNew = GetTicks();
-	ticksScheduled += ticksAdded;
 	if (ticksNew <= ticksLast) { //lower should not be possible, only equal.
-		ticksAdded = 0;
+		const auto sleepStartUs = GetTicksUs();
 
 		constexpr auto duration = std::chrono::milliseconds(1);
 		std::this_thread::sleep_for(duration);
 
-		const auto timeslept = GetTicksSince(ticksNew);
-
-		// Update ticksDone with the time spent sleeping
-		ticksDone -= timeslept;
-		if (ticksDone < 0)
-			ticksDone = 0;
-		return; //0
-
-		// If we do work this tick and sleep till the next tick, then ticksDone is decreased,
-		// despite the fact that work was done as well in this tick. Maybe make it depend on an extra parameter.
-		// What do we know: ticksRemain = 0 (condition to enter this function)
-		// ticksNew = time before sleeping
-
-		// maybe keep track of sleeped time in this frame, and use sleeped and done as indicators. (and take care of the fact there
-		// are frames that have both.
+		// Let the cycle governor know about the time spent sleeping
+		CYCLE_GOVERNOR_AddSleep(GetTicksUs() - sleepStartUs);
+		return;
 	}
 
 	//TicksNew > ticksLast
-	ticksRemain = GetTicksDiff(ticksNew, ticksLast);
+	const auto ticksElapsed = GetTicksDiff(ticksNew, ticksLast);
 	ticksLast = ticksNew;
-	ticksDone += ticksRemain;
-	if ( ticksRemain > 20 ) {
-//		LOG(LOG_MISC,LOG_ERROR)("large remain %d",ticksRemain);
-		ticksRemain = 20;
-	}
-	ticksAdded = ticksRemain;
-
-	// Is the system in auto cycle mode guessing ? If not just exit. (It can be temporary disabled)
-	if (!CPU_CycleAutoAdjust || CPU_SkipCycleAutoAdjust) return;
-
-	if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) ) {
-		if(ticksDone < 1) ticksDone = 1; // Protect against div by zero
-		/* ratio we are aiming for is around 90% usage*/
-		int32_t ratio = static_cast<int32_t>(
-		        (ticksScheduled * (CPU_CyclePercUsed * 90 * 1024 / 100 / 100)) /
-		        ticksDone);
-
-		int32_t new_cmax = CPU_CycleMax;
-		int64_t cproc = (int64_t)CPU_CycleMax * (int64_t)ticksScheduled;
-		double ratioremoved = 0.0; //increase scope for logging
-		if (cproc > 0) {
-			/* ignore the cycles added due to the IO delay code in order
-			   to have smoother auto cycle adjustments */
-			ratioremoved = (double) CPU_IODelayRemoved / (double) cproc;
-			if (ratioremoved < 1.0) {
-				double ratio_not_removed = 1 - ratioremoved;
-				ratio = (int32_t)((double)ratio * ratio_not_removed);
-
-				/* Don't allow very high ratio which can cause us to lock as we don't scale down
-				 * for very low ratios. High ratio might result because of timing resolution */
-				if (ticksScheduled >= 250 && ticksDone < 10 && ratio > 16384)
-					ratio = 16384;
-
-				// Limit the ratio even more when the cycles are already way above the realmode default.
-				if (ticksScheduled >= 250 && ticksDone < 10 && ratio > 5120 && CPU_CycleMax > 50000)
-					ratio = 5120;
-
-				// When downscaling multiple times in a row, ensure a minimum amount of downscaling
-				if (ticksAdded > 15 && ticksScheduled >= 5 && ticksScheduled <= 20 && ratio > 800)
-					ratio = 800;
-
-				if (ratio <= 1024) {
-					// ratio_not_removed = 1.0; //enabling this restores the old formula
-					double r = (1.0 + ratio_not_removed) /(ratio_not_removed + 1024.0/(static_cast<double>(ratio)));
-					new_cmax = 1 + static_cast<int32_t>(CPU_CycleMax * r);
-				} else {
-					int64_t ratio_with_removed = (int64_t) ((((double)ratio - 1024.0) * ratio_not_removed) + 1024.0);
-					int64_t cmax_scaled = (int64_t)CPU_CycleMax * ratio_with_removed;
-					new_cmax = (int32_t)(1 + (CPU_CycleMax >> 1) + cmax_scaled / (int64_t)2048);
-				}
-			}
-		}
-
-		if (new_cmax < CPU_CYCLES_LOWER_LIMIT)
-			new_cmax = CPU_CYCLES_LOWER_LIMIT;
-		/*
-		LOG(LOG_MISC,LOG_ERROR)("cyclelog: current %06d   cmax %06d   ratio  %05d  done %03d   sched %03d Add %d rr %4.2f",
-			CPU_CycleMax,
-			new_cmax,
-			ratio,
-			ticksDone,
-			ticksScheduled,
-			ticksAdded,
-			ratioremoved);
-		*/
-
-		/* ratios below 1% are considered to be dropouts due to
-		   temporary load imbalance, the cycles adjusting is skipped */
-		if (ratio > 10) {
-			/* ratios below 12% along with a large time since the last update
-			   has taken place are most likely caused by heavy load through a
-			   different application, the cycles adjusting is skipped as well */
-			if ((ratio > 120) || (ticksDone < 700)) {
-				CPU_CycleMax = new_cmax;
-				if (CPU_CycleLimit > 0) {
-					if (CPU_CycleMax > CPU_CycleLimit) CPU_CycleMax = CPU_CycleLimit;
-				} else if (CPU_CycleMax > 2000000) CPU_CycleMax = 2000000; //Hardcoded limit, if no limit was specified.
-			}
-		}
+	ticksRemain = std::min(ticksElapsed, static_cast<int64_t>(20));
 
-		//Reset cycleguessing parameters.
-		CPU_IODelayRemoved = 0;
-		ticksDone = 0;
-		ticksScheduled = 0;
-	} else if (ticksAdded > 15) {
-		/* ticksAdded > 15 but ticksScheduled < 5, lower the cycles
-		   but do not reset the scheduled/done ticks to take them into
-		   account during the next auto cycle adjustment */
-		CPU_CycleMax /= 3;
-		if (CPU_CycleMax < CPU_CYCLES_LOWER_LIMIT)
-			CPU_CycleMax = CPU_CYCLES_LOWER_LIMIT;
-	} //if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) )
+	CYCLE_GOVERNOR_AddTicks(ticksElapsed * 1000, ticksRemain);
 }
 
 void DOSBOX_SetLoop(LoopHandler * handler) {
@@ -312,10 +269,19 @@ void DOSBOX_SetNormalLoop() {
 	loop=Normal_Loop;
 }
 
+static int run_depth = 0;
+
 void DOSBOX_RunMachine()
 {
+	++run_depth;
 	while ((*loop)() == 0 && !shutdown_requested)
 		;
+	--run_depth;
+}
+
+int DOSBOX_GetRunDepth()
+{
+	return run_depth;
 }
 
 static void DOSBOX_UnlockSpeed( bool pressed ) {
@@ -344,11 +310,15 @@ static void DOSBOX_RealInit(Section * sec) {
 	/* Initialize some dosbox internals */
 	ticksRemain=0;
 	ticksLast=GetTicks();
+	ticksLastUs = GetTicksUs();
 	ticksLocked = false;
+	precise_timing = section->Get_bool("precise_timing");
+	precise_timing_slack_us = section->Get_int("precise_timing_slack");
 	DOSBOX_SetLoop(&Normal_Loop);
 
 	MAPPER_AddHandler(DOSBOX_UnlockSpeed, SDL_SCANCODE_F12, MMOD2,
 	                  "speedlock", "Speedlock");
+	SAVESTATE_Init();
 
 	std::string cmd_machine;
 	if (control->cmdline->FindString("-machine",cmd_machine,true)){
@@ -512,6 +482,15 @@ void DOSBOX_Init()
 	        "though a few games might require a higher value.\n"
 	        "There is generally no speed advantage when raising this value.");
 
+	pstring = secprop->Add_path("memimage", only_at_start, "");
+	pstring->Set_help(
+	        "Map the memory of the emulated machine copy-on-write from this RAM image\n"
+	        "file (unset by default). Sessions that map the same image share the pages\n"
+	        "the guest hasn't written to, which makes starting many sessions from the\n"
+	        "same state quick and light on memory. If the file doesn't exist or doesn't\n"
+	        "match 'memsize', the memory is allocated as usual and the image is written\n"
+	        "after the state given with '--loadstate' has been loaded.");
+
 	const char *mcb_fault_strategies[] = {"repair", "report", "allow", "deny", nullptr};
 	pstring = secprop->Add_string("mcb_fault_strategy",
 	                              only_at_start,
@@ -575,6 +554,20 @@ void DOSBOX_Init()
 	pbool = secprop->Add_bool("vga_8dot_font", only_at_start, false);
 	pbool->Set_help("Use 8-pixel-wide fonts on VGA adapters (disabled by default).");
 
+	pbool = secprop->Add_bool("vga_dirty_tracking", only_at_start, false);
+	pbool->Set_help(
+	        "Track the video memory writes in VGA and VESA graphics modes, and only draw\n"
+	        "the scanlines that show changed memory (disabled by default). In text modes,\n"
+	        "only the character rows whose text changed are drawn. Saves time on mostly\n"
+	        "static screens, but writes to the VESA framebuffer get slower.");
+
+	pbool = secprop->Add_bool("vga_frame_batching", only_at_start, false);
+	pbool->Set_help(
+	        "Draw each VGA frame in one go at the end of its display period, instead of\n"
+	        "in parts as the emulated beam moves down (disabled by default). Frames are\n"
+	        "drawn in parts again as soon as a program changes the palette or the line\n"
+	        "length (the CRTC offset register) mid-frame, so raster effects keep working.");
+
 	pbool = secprop->Add_bool("speed_mods", only_at_start, true);
 	pbool->Set_help(
 	        "Permit changes known to improve performance (enabled by default).\n"
@@ -582,6 +575,21 @@ void DOSBOX_Init()
 	        "Please file a bug with the project if you find a game that fails\n"
 	        "when this is enabled so we will list them here.");
 
+	pbool = secprop->Add_bool("precise_timing", only_at_start, false);
+	pbool->Set_help(
+	        "Pace the emulation with microsecond instead of millisecond timestamps\n"
+	        "(disabled by default). Emulated time then follows the host's clock more\n"
+	        "closely, which evens out frame times and lowers audio and input latency.\n"
+	        "Waiting for the next millisecond briefly spins on the host CPU, see\n"
+	        "'precise_timing_slack'.");
+
+	pint = secprop->Add_int("precise_timing_slack", only_at_start, 250);
+	pint->SetMinMax(0, 1000);
+	pint->Set_help(
+	        "Microseconds of each wait that are spent yielding the host CPU instead of\n"
+	        "sleeping when 'precise_timing' is enabled (250 by default). Raise it if the\n"
+	        "host oversleeps, lower it to use less CPU time.");
+
 	secprop->AddInitFunction(&CALLBACK_Init);
 	secprop->AddInitFunction(&PIC_Init);
 	secprop->AddInitFunction(&PROGRAMS_Init);
@@ -672,6 +680,13 @@ void DOSBOX_Init()
 	const char* mono_pal[] = {"white", "paperwhite", "green", "amber", 0};
 	pstring->Set_values(mono_pal);
 
+	pbool = secprop->Add_bool("threaded_rendering", always, false);
+	pbool->Set_help(
+	        "Detect the changed lines and scale the image on a separate thread, while the\n"
+	        "emulation carries on with the frame (disabled by default). This takes load off\n"
+	        "the emulation in high-resolution modes. Works with the 'texture' and 'surface'\n"
+	        "outputs; with 'opengl' only if the driver lacks pixel buffer objects.");
+
 	pstring = secprop->Add_string("cga_colors", only_at_start, "default");
 	pstring->Set_help(
 	        "Set the interpretation of CGA RGBI colours. Affects all machine types capable\n"
@@ -743,11 +758,16 @@ void DOSBOX_Init()
 	pstring->Set_help("CPU core used in emulation ('auto' by default). 'auto' will switch to dynamic\n"
 	                  "if available and appropriate.");
 
-	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch", 0};
+	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch",
+	                                 "8086_timed", "286_timed", "386_timed", "486_timed", 0};
 	pstring = secprop->Add_string("cputype", always, "auto");
 	pstring->Set_values(cputype_values);
 	pstring->Set_help(
-	        "CPU type used in emulation ('auto' by default). 'auto' is the fastest choice.");
+	        "CPU type used in emulation ('auto' by default). 'auto' is the fastest choice.\n"
+	        "The '_timed' types charge each instruction its clock count on that processor\n"
+	        "instead of a single cycle, so 'cycles' sets the clock rate in kHz\n"
+	        "(e.g. 'fixed 4770' for a 4.77 MHz 8086). They require the normal core and\n"
+	        "keep the instruction set of a 386, or of a 486 with '486_timed'.");
 
 	pmulti_remain = secprop->AddMultiValRemain("cycles", always, " ");
 	pmulti_remain->Set_help(
@@ -776,6 +796,40 @@ void DOSBOX_Init()
 	pint->SetMinMax(1, 1000000);
 	pint->Set_help("Setting it lower than 100 will be a percentage (20 by default).");
 
+	const char* cycle_governors[] = {"legacy", "pid", 0};
+	pstring = secprop->Add_string("cycle_governor", always, "legacy");
+	pstring->Set_values(cycle_governors);
+	pstring->Set_help(
+	        "How the cycles are adjusted with 'cycles = auto' and 'cycles = max'\n"
+	        "('legacy' by default).\n"
+	        "  legacy:  Adjust the cycles about every 250 ms, as DOSBox always did.\n"
+	        "  pid:     Use a PID controller that adjusts the cycles every 50 ms. It\n"
+	        "           settles faster and oscillates less under changing host load.");
+
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+	pint = secprop->Add_int("dynamic_core_cache_size", only_at_start, 8);
+	pint->SetMinMax(4, 512);
+	pint->Set_help(
+	        "Size of the dynamic core's code cache in megabytes (8 by default).\n"
+	        "Large protected mode programs like Windows 3.x/9x run smoother with\n"
+	        "a bigger cache, as less translated code has to be thrown away.");
+
+	pbool = secprop->Add_bool("dynamic_core_profile", only_at_start, false);
+	pbool->Set_help(
+	        "Count how often each block of translated code is run and how many cycles\n"
+	        "it takes (disabled by default). The hottest blocks are logged on exit or\n"
+	        "with the 'Hot Blocks' mapper event, which has no default binding.\n"
+	        "Profiling slows down the dynamic core considerably.");
+#endif
+
+#if (C_DYNREC)
+	pbool = secprop->Add_bool("dynamic_core_cache", only_at_start, false);
+	pbool->Set_help(
+	        "Keep the code translated by the dynamic core in a cache file in the\n"
+	        "configuration directory, and reuse it on the next run if the guest code\n"
+	        "is identical (disabled by default). Only supported on x86_64 hosts.");
+#endif
+
 #if C_FPU
 	secprop->AddInitFunction(&FPU_Init);
 #endif
@@ -66,9 +66,9 @@ static void FPU_PREP_PUSH(void){
 	fpu.tags[TOP] = TAG_Valid;
 }
 
-static void FPU_PUSH(double in){
+static void FPU_PUSH(const FPU_Float in){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = in;
+	fpu.regs[TOP] = in;
 //	LOG(LOG_FPU,LOG_ERROR)("Pushed at %d  %g to the stack",newtop,in);
 	return;
 }
@@ -99,70 +99,37 @@ static void FPU_FPOP(void){
 	return;
 }
 
-static double FROUND(double in){
+static FPU_Float FROUND(const FPU_Float in){
 	switch(fpu.round){
-	case ROUND_Nearest: return std::nearbyint(in);
-	case ROUND_Down: return (floor(in));
-	case ROUND_Up: return (ceil(in));
-	case ROUND_Chop: [[fallthrough]]; // cast by the caller chops
+	case ROUND_Nearest: return fpu_round_nearest(in);
+	case ROUND_Down: return fpu_floor(in);
+	case ROUND_Up: return fpu_ceil(in);
+	case ROUND_Chop: return fpu_trunc(in);
 	default: return in;
 	}
 }
 
-#define BIAS80 16383
-#define BIAS64 1023
-
-static Real64 FPU_FLD80(PhysPt addr) {
-	struct {
-		int16_t begin = 0;
-		FPU_Reg eind  = {};
-	} test = {};
-
-	test.eind.l.lower = mem_readd(addr);
-	test.eind.l.upper = mem_readd(addr+4);
-	test.begin = mem_readw(addr+8);
-   
-	int64_t exp64 = (((test.begin&0x7fff) - BIAS80));
-	int64_t blah = ((exp64 >0)?exp64:-exp64)&0x3ff;
-	int64_t exp64final = ((exp64 >0)?blah:-blah) +BIAS64;
-
-	int64_t mant64 = (test.eind.ll >> 11) & LONGTYPE(0xfffffffffffff);
-	int64_t sign = (test.begin&0x8000)?1:0;
-	FPU_Reg result;
-	result.ll = (sign <<63)|(exp64final << 52)| mant64;
-
-	if (test.eind.l.lower == 0 && test.eind.l.upper == INT32_MIN &&
-	    (test.begin & INT16_MAX) == INT16_MAX) {
-		//Detect INF and -INF (score 3.11 when drawing a slur.)
-		result.d = sign?-HUGE_VAL:HUGE_VAL;
-	}
-	return result.d;
-
-	//mant64= test.mant80/2***64    * 2 **53 
+static FPU_Float FPU_FLD80(PhysPt addr) {
+	FPU_Float80 val = {};
+	val.mantissa = mem_readd(addr) | (static_cast<uint64_t>(mem_readd(addr + 4)) << 32);
+	val.sign_exponent = mem_readw(addr+8);
+	return fpu_from_float80<FPU_Float>(val);
 }
 
 static void FPU_ST80(PhysPt addr,Bitu reg) {
-	struct {
-		int16_t begin = 0;
-		FPU_Reg eind  = {};
-	} test = {};
-
-	int64_t sign80 = (fpu.regs[reg].ll & LONGTYPE(0x8000000000000000)) ? 1 : 0;
-	int64_t exp80       = fpu.regs[reg].ll & LONGTYPE(0x7ff0000000000000);
-	int64_t exp80final  = (exp80 >> 52);
-	int64_t mant80 = fpu.regs[reg].ll&LONGTYPE(0x000fffffffffffff);
-	int64_t mant80final = (mant80 << 11);
-	if(fpu.regs[reg].d != 0){ //Zero is a special case
-		// Elvira wants the 8 and tcalc doesn't
-		mant80final |= LONGTYPE(0x8000000000000000);
-		//Ca-cyber doesn't like this when result is zero.
-		exp80final += (BIAS80 - BIAS64);
-	}
-	test.begin = (static_cast<int16_t>(sign80)<<15)| static_cast<int16_t>(exp80final);
-	test.eind.ll = mant80final;
-	mem_writed(addr,test.eind.l.lower);
-	mem_writed(addr+4,test.eind.l.upper);
-	mem_writew(addr+8,test.begin);
+	const auto val = fpu_to_float80(fpu.regs[reg]);
+	mem_writed(addr,static_cast<uint32_t>(val.mantissa));
+	mem_writed(addr+4,static_cast<uint32_t>(val.mantissa >> 32));
+	mem_writew(addr+8,val.sign_exponent);
+}
+
+// FSIN, FCOS, FSINCOS and FPTAN leave operands of 2^63 and up alone and
+// report them with C2
+static bool FPU_TRIG_OUT_OF_RANGE(const FPU_Float in){
+	constexpr double limit = 9223372036854775808.0;
+	const bool out_of_range = !(fpu_fabs(in) < limit);
+	FPU_SET_C2(out_of_range);
+	return out_of_range;
 }
 
 
@@ -172,33 +139,35 @@ static void FPU_FLD_F32(PhysPt addr,Bitu store_to) {
 		uint32_t l;
 	}	blah;
 	blah.l = mem_readd(addr);
-	fpu.regs[store_to].d = static_cast<Real64>(blah.f);
+	fpu.regs[store_to] = static_cast<double>(blah.f);
 }
 
 static void FPU_FLD_F64(PhysPt addr,Bitu store_to) {
-	fpu.regs[store_to].l.lower = mem_readd(addr);
-	fpu.regs[store_to].l.upper = mem_readd(addr+4);
+	FPU_Reg blah;
+	blah.l.lower = mem_readd(addr);
+	blah.l.upper = mem_readd(addr+4);
+	fpu.regs[store_to] = blah.d;
 }
 
 static void FPU_FLD_F80(PhysPt addr) {
-	fpu.regs[TOP].d = FPU_FLD80(addr);
+	fpu.regs[TOP] = FPU_FLD80(addr);
 }
 
 static void FPU_FLD_I16(PhysPt addr,Bitu store_to) {
 	int16_t blah = mem_readw(addr);
-	fpu.regs[store_to].d = static_cast<Real64>(blah);
+	fpu.regs[store_to] = fpu_from_int64<FPU_Float>(blah);
 }
 
 static void FPU_FLD_I32(PhysPt addr,Bitu store_to) {
 	int32_t blah = mem_readd(addr);
-	fpu.regs[store_to].d = static_cast<Real64>(blah);
+	fpu.regs[store_to] = fpu_from_int64<FPU_Float>(blah);
 }
 
 static void FPU_FLD_I64(PhysPt addr,Bitu store_to) {
 	FPU_Reg blah;
 	blah.l.lower = mem_readd(addr);
 	blah.l.upper = mem_readd(addr+4);
-	fpu.regs[store_to].d = static_cast<Real64>(blah.ll);
+	fpu.regs[store_to] = fpu_from_int64<FPU_Float>(blah.ll);
 }
 
 static void FPU_FBLD(PhysPt addr,Bitu store_to) {
@@ -215,11 +184,12 @@ static void FPU_FBLD(PhysPt addr,Bitu store_to) {
 
 	//last number, only now convert to float in order to get
 	//the best signification
-	Real64 temp = static_cast<Real64>(val);
+	FPU_Float temp = fpu_from_int64<FPU_Float>(static_cast<int64_t>(val));
 	in = mem_readb(addr + 9);
-	temp += ( (in&0xf) * base );
-	if(in&0x80) temp *= -1.0;
-	fpu.regs[store_to].d = temp;
+	temp += fpu_from_int64<FPU_Float>(static_cast<int64_t>(in & 0xf)) *
+	        fpu_from_int64<FPU_Float>(static_cast<int64_t>(base));
+	if(in&0x80) temp = -temp;
+	fpu.regs[store_to] = temp;
 }
 
 
@@ -243,13 +213,15 @@ static void FPU_FST_F32(PhysPt addr) {
 		uint32_t l;
 	}	blah;
 	//should depend on rounding method
-	blah.f = static_cast<float>(fpu.regs[TOP].d);
+	blah.f = static_cast<float>(fpu_to_double(fpu.regs[TOP]));
 	mem_writed(addr,blah.l);
 }
 
 static void FPU_FST_F64(PhysPt addr) {
-	mem_writed(addr,fpu.regs[TOP].l.lower);
-	mem_writed(addr+4,fpu.regs[TOP].l.upper);
+	FPU_Reg blah;
+	blah.d = fpu_to_double(fpu.regs[TOP]);
+	mem_writed(addr,blah.l.lower);
+	mem_writed(addr+4,blah.l.upper);
 }
 
 static void FPU_FST_F80(PhysPt addr) {
@@ -257,34 +229,34 @@ static void FPU_FST_F80(PhysPt addr) {
 }
 
 static void FPU_FST_I16(PhysPt addr) {
-	double val = FROUND(fpu.regs[TOP].d);
-	mem_writew(addr,(val < 32768.0 && val >= -32768.0)?static_cast<int16_t>(val):0x8000);
+	const FPU_Float val = FROUND(fpu.regs[TOP]);
+	mem_writew(addr,(val < 32768.0 && val >= -32768.0)?static_cast<int16_t>(fpu_to_int64(val)):0x8000);
 }
 
 static void FPU_FST_I32(PhysPt addr) {
-	double val = FROUND(fpu.regs[TOP].d);
-	mem_writed(addr,(val < 2147483648.0 && val >= -2147483648.0)?static_cast<int32_t>(val):0x80000000);
+	const FPU_Float val = FROUND(fpu.regs[TOP]);
+	mem_writed(addr,(val < 2147483648.0 && val >= -2147483648.0)?static_cast<int32_t>(fpu_to_int64(val)):0x80000000);
 }
 
 static void FPU_FST_I64(PhysPt addr) {
-	double val = FROUND(fpu.regs[TOP].d);
+	const FPU_Float val = FROUND(fpu.regs[TOP]);
 	FPU_Reg blah;
-	blah.ll = (val < 9223372036854775808.0 && val >= -9223372036854775808.0)?static_cast<int64_t>(val):LONGTYPE(0x8000000000000000);
+	blah.ll = (val < 9223372036854775808.0 && val >= -9223372036854775808.0)?fpu_to_int64(val):LONGTYPE(0x8000000000000000);
 
 	mem_writed(addr,blah.l.lower);
 	mem_writed(addr+4,blah.l.upper);
 }
 
 static void FPU_FBST(PhysPt addr) {
-	FPU_Reg val = fpu.regs[TOP];
-	if(val.ll & LONGTYPE(0x8000000000000000)) { // MSB = sign
+	FPU_Float val = fpu.regs[TOP];
+	if (fpu_signbit(val)) {
 		mem_writeb(addr+9,0x80);
-		val.d = -val.d;
+		val = -val;
 	} else mem_writeb(addr+9,0);
 
-	uint64_t rndint = static_cast<uint64_t>(FROUND(val.d));
+	val = FROUND(val);
 	// BCD (18 decimal digits) overflow? (0x0DE0B6B3A763FFFF max)
-	if (rndint > LONGTYPE(999999999999999999)) {
+	if (!(val < 1e18)) {
 		// write BCD integer indefinite value
 		mem_writed(addr+0,0);
 		mem_writed(addr+4,0xC0000000);
@@ -292,6 +264,7 @@ static void FPU_FBST(PhysPt addr) {
 		return;
 	}
 
+	uint64_t rndint = static_cast<uint64_t>(fpu_to_int64(val));
 	static_assert(sizeof(rndint) == sizeof(long long int),
 	              "passing rndint to lldiv function");
 	// numbers from back to front
@@ -307,85 +280,85 @@ static void FPU_FBST(PhysPt addr) {
 }
 
 static void FPU_FADD(Bitu op1, Bitu op2){
-	fpu.regs[op1].d+=fpu.regs[op2].d;
+	fpu.regs[op1] += fpu.regs[op2];
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSIN(void){
-	fpu.regs[TOP].d = sin(fpu.regs[TOP].d);
-	FPU_SET_C2(0);
+	if (FPU_TRIG_OUT_OF_RANGE(fpu.regs[TOP])) return;
+	fpu.regs[TOP] = fpu_sin(fpu.regs[TOP]);
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSINCOS(void){
-	Real64 temp = fpu.regs[TOP].d;
-	fpu.regs[TOP].d = sin(temp);
-	FPU_PUSH(cos(temp));
-	FPU_SET_C2(0);
+	if (FPU_TRIG_OUT_OF_RANGE(fpu.regs[TOP])) return;
+	const FPU_Float temp = fpu.regs[TOP];
+	fpu.regs[TOP] = fpu_sin(temp);
+	FPU_PUSH(fpu_cos(temp));
 	//flags and such :)
 	return;
 }
 
 static void FPU_FCOS(void){
-	fpu.regs[TOP].d = cos(fpu.regs[TOP].d);
-	FPU_SET_C2(0);
+	if (FPU_TRIG_OUT_OF_RANGE(fpu.regs[TOP])) return;
+	fpu.regs[TOP] = fpu_cos(fpu.regs[TOP]);
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSQRT(void){
-	fpu.regs[TOP].d = sqrt(fpu.regs[TOP].d);
+	fpu.regs[TOP] = fpu_sqrt(fpu.regs[TOP]);
 	//flags and such :)
 	return;
 }
 static void FPU_FPATAN(void){
-	fpu.regs[STV(1)].d = atan2(fpu.regs[STV(1)].d,fpu.regs[TOP].d);
+	fpu.regs[STV(1)] = fpu_atan2(fpu.regs[STV(1)],fpu.regs[TOP]);
 	FPU_FPOP();
 	//flags and such :)
 	return;
 }
 static void FPU_FPTAN(void){
-	fpu.regs[TOP].d = tan(fpu.regs[TOP].d);
+	if (FPU_TRIG_OUT_OF_RANGE(fpu.regs[TOP])) return;
+	fpu.regs[TOP] = fpu_tan(fpu.regs[TOP]);
 	FPU_PUSH(1.0);
-	FPU_SET_C2(0);
 	//flags and such :)
 	return;
 }
 static void FPU_FDIV(Bitu st, Bitu other){
-	fpu.regs[st].d= fpu.regs[st].d/fpu.regs[other].d;
+	fpu.regs[st] = fpu.regs[st] / fpu.regs[other];
 	//flags and such :)
 	return;
 }
 
 static void FPU_FDIVR(Bitu st, Bitu other){
-	fpu.regs[st].d= fpu.regs[other].d/fpu.regs[st].d;
+	fpu.regs[st] = fpu.regs[other] / fpu.regs[st];
 	// flags and such :)
 	return;
 }
 
 static void FPU_FMUL(Bitu st, Bitu other){
-	fpu.regs[st].d*=fpu.regs[other].d;
+	fpu.regs[st] *= fpu.regs[other];
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSUB(Bitu st, Bitu other){
-	fpu.regs[st].d = fpu.regs[st].d - fpu.regs[other].d;
+	fpu.regs[st] = fpu.regs[st] - fpu.regs[other];
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSUBR(Bitu st, Bitu other){
-	fpu.regs[st].d= fpu.regs[other].d - fpu.regs[st].d;
+	fpu.regs[st] = fpu.regs[other] - fpu.regs[st];
 	//flags and such :)
 	return;
 }
 
 static void FPU_FXCH(Bitu st, Bitu other){
 	FPU_Tag tag = fpu.tags[other];
-	FPU_Reg reg = fpu.regs[other];
+	FPU_Float reg = fpu.regs[other];
 	fpu.tags[other] = fpu.tags[st];
 	fpu.regs[other] = fpu.regs[st];
 	fpu.tags[st] = tag;
@@ -403,10 +376,13 @@ static void FPU_FCOM(Bitu st, Bitu other){
 		((fpu.tags[other] != TAG_Valid) && (fpu.tags[other] != TAG_Zero))){
 		FPU_SET_C3(1);FPU_SET_C2(1);FPU_SET_C0(1);return;
 	}
-	if(fpu.regs[st].d == fpu.regs[other].d){
+	if (fpu_isnan(fpu.regs[st]) || fpu_isnan(fpu.regs[other])) { // unordered
+		FPU_SET_C3(1);FPU_SET_C2(1);FPU_SET_C0(1);return;
+	}
+	if(fpu.regs[st] == fpu.regs[other]){
 		FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(0);return;
 	}
-	if(fpu.regs[st].d < fpu.regs[other].d){
+	if(fpu.regs[st] < fpu.regs[other]){
 		FPU_SET_C3(0);FPU_SET_C2(0);FPU_SET_C0(1);return;
 	}
 	// st > other
@@ -419,89 +395,85 @@ static void FPU_FUCOM(Bitu st, Bitu other){
 }
 
 static void FPU_FRNDINT(void){
-	int64_t temp  = static_cast<int64_t>(FROUND(fpu.regs[TOP].d));
-	double tempd = static_cast<double>(temp);
+	const FPU_Float temp = FROUND(fpu.regs[TOP]);
 	if (fpu.cw&0x20) { //As we don't generate exceptions; only do it when masked
-		if (tempd != fpu.regs[TOP].d)
+		if (temp != fpu.regs[TOP])
 			fpu.sw |= 0x20; //Set Precision Exception
 	}
-	fpu.regs[TOP].d = tempd;
+	fpu.regs[TOP] = temp;
 }
 
-static void FPU_FPREM(void){
-	Real64 valtop = fpu.regs[TOP].d;
-	Real64 valdiv = fpu.regs[STV(1)].d;
-	int64_t ressaved = static_cast<int64_t>( (valtop/valdiv) );
-// Some backups
-//	Real64 res=valtop - ressaved*valdiv; 
-//      res= fmod(valtop,valdiv);
-	fpu.regs[TOP].d = valtop - ressaved*valdiv;
+// Sets the partial remainder in ST(0) and the three lowest bits of the
+// quotient in C0, C3 and C1
+static void FPU_SET_REMAINDER(const FPU_Float valtop, const FPU_Float valdiv,
+                              const FPU_Float quot){
+	const FPU_Float limit = 9223372036854775808.0;
+	const int64_t ressaved = (fpu_fabs(quot) < limit) ? fpu_to_int64(quot) : 0;
+	fpu.regs[TOP] = valtop - quot * valdiv;
 	FPU_SET_C0(static_cast<Bitu>(ressaved&4));
 	FPU_SET_C3(static_cast<Bitu>(ressaved&2));
 	FPU_SET_C1(static_cast<Bitu>(ressaved&1));
 	FPU_SET_C2(0);
 }
 
+static void FPU_FPREM(void){
+	const FPU_Float valtop = fpu.regs[TOP];
+	const FPU_Float valdiv = fpu.regs[STV(1)];
+	FPU_SET_REMAINDER(valtop, valdiv, fpu_trunc(valtop / valdiv));
+}
+
 static void FPU_FPREM1(void){
-	Real64 valtop = fpu.regs[TOP].d;
-	Real64 valdiv = fpu.regs[STV(1)].d;
-	double quot = valtop/valdiv;
-	double quotf = floor(quot);
-	int64_t ressaved;
-	if (quot-quotf>0.5) ressaved = static_cast<int64_t>(quotf+1);
-	else if (quot-quotf<0.5) ressaved = static_cast<int64_t>(quotf);
-	else ressaved = static_cast<int64_t>((((static_cast<int64_t>(quotf))&1)!=0)?(quotf+1):(quotf));
-	fpu.regs[TOP].d = valtop - ressaved*valdiv;
-	FPU_SET_C0(static_cast<Bitu>(ressaved&4));
-	FPU_SET_C3(static_cast<Bitu>(ressaved&2));
-	FPU_SET_C1(static_cast<Bitu>(ressaved&1));
-	FPU_SET_C2(0);
+	const FPU_Float valtop = fpu.regs[TOP];
+	const FPU_Float valdiv = fpu.regs[STV(1)];
+	FPU_SET_REMAINDER(valtop, valdiv, fpu_round_nearest(valtop / valdiv));
 }
 
 static void FPU_FXAM(void){
-	if(fpu.regs[TOP].ll & LONGTYPE(0x8000000000000000))	//sign
-	{ 
-		FPU_SET_C1(1);
-	} 
-	else 
-	{
-		FPU_SET_C1(0);
-	}
+	FPU_SET_C1(fpu_signbit(fpu.regs[TOP]));
 	if(fpu.tags[TOP] == TAG_Empty)
 	{
 		FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(1);
 		return;
 	}
-	if(fpu.regs[TOP].d == 0.0)		//zero or normalized number.
-	{ 
-		FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(0);
-	}
-	else
-	{
-		FPU_SET_C3(0);FPU_SET_C2(1);FPU_SET_C0(0);
+	switch (fpu_fpclassify(fpu.regs[TOP])) {
+	case FP_NAN: FPU_SET_C3(0);FPU_SET_C2(0);FPU_SET_C0(1); break;
+	case FP_INFINITE: FPU_SET_C3(0);FPU_SET_C2(1);FPU_SET_C0(1); break;
+	case FP_ZERO: FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(0); break;
+	case FP_SUBNORMAL: FPU_SET_C3(1);FPU_SET_C2(1);FPU_SET_C0(0); break;
+	default: FPU_SET_C3(0);FPU_SET_C2(1);FPU_SET_C0(0); break;
 	}
 }
 
 
 static void FPU_F2XM1(void){
-	fpu.regs[TOP].d = pow(2.0,fpu.regs[TOP].d) - 1;
+	fpu.regs[TOP] = fpu_exp2_m1(fpu.regs[TOP]);
 	return;
 }
 
 static void FPU_FYL2X(void){
-	fpu.regs[STV(1)].d*=log(fpu.regs[TOP].d)/log(static_cast<Real64>(2.0));
+	fpu.regs[STV(1)] *= fpu_log2(fpu.regs[TOP]);
 	FPU_FPOP();
 	return;
 }
 
 static void FPU_FYL2XP1(void){
-	fpu.regs[STV(1)].d*=log(fpu.regs[TOP].d+1.0)/log(static_cast<Real64>(2.0));
+	fpu.regs[STV(1)] *= fpu_log2_1p(fpu.regs[TOP]);
 	FPU_FPOP();
 	return;
 }
 
 static void FPU_FSCALE(void){
-	fpu.regs[TOP].d *= pow(2.0,static_cast<Real64>(static_cast<int64_t>(fpu.regs[STV(1)].d)));
+	// the exponent range of any result fits easily in an int
+	const FPU_Float scale = fpu_trunc(fpu.regs[STV(1)]);
+	const FPU_Float limit = 65536.0;
+	if (fpu_isnan(scale)) {
+		fpu.regs[TOP] = scale;
+		return;
+	}
+	const int exponent = (scale < -limit) ? -65536
+	                   : (scale > limit)  ? 65536
+	                                      : static_cast<int>(fpu_to_int64(scale));
+	fpu.regs[TOP] = fpu_ldexp(fpu.regs[TOP], exponent);
 	//FPU_SET_C1(0);
 	return; //2^x where x is chopped.
 }
@@ -552,7 +524,7 @@ static void FPU_FRSTOR(PhysPt addr){
 	FPU_FLDENV(addr);
 	Bitu start = (cpu.code.big?28:14);
 	for(Bitu i = 0;i < 8;i++){
-		fpu.regs[STV(i)].d = FPU_FLD80(addr+start);
+		fpu.regs[STV(i)] = FPU_FLD80(addr+start);
 		start += 10;
 	}
 }
@@ -560,64 +532,68 @@ static void FPU_FRSTOR(PhysPt addr){
 static void FPU_FXTRACT(void) {
 	// function stores real bias in st and 
 	// pushes the significant number onto the stack
-	// if double ever uses a different base please correct this function
 
-	FPU_Reg test = fpu.regs[TOP];
-	int64_t exp80 =  test.ll&LONGTYPE(0x7ff0000000000000);
-	int64_t exp80final = (exp80>>52) - BIAS64;
-	Real64 mant = test.d / (pow(2.0,static_cast<Real64>(exp80final)));
-	fpu.regs[TOP].d = static_cast<Real64>(exp80final);
+	const FPU_Float test = fpu.regs[TOP];
+	if (fpu_fpclassify(test) == FP_ZERO) {
+		// exponent of minus infinity, the significand keeps the sign
+		fpu.sw |= 0x4; // Zero Divide
+		fpu.regs[TOP] = -HUGE_VAL;
+		FPU_PUSH(test);
+		return;
+	}
+	int exponent = 0;
+	// frexp returns a significand in [0.5,1) and the x87 one in [1,2)
+	const FPU_Float mant = fpu_ldexp(fpu_frexp(test, &exponent), 1);
+	fpu.regs[TOP] = fpu_from_int64<FPU_Float>(exponent - 1);
 	FPU_PUSH(mant);
 }
 
 static void FPU_FCHS(void){
-	fpu.regs[TOP].d = -1.0*(fpu.regs[TOP].d);
+	fpu.regs[TOP] = -fpu.regs[TOP];
 }
 
 static void FPU_FABS(void){
-	fpu.regs[TOP].d = fabs(fpu.regs[TOP].d);
+	fpu.regs[TOP] = fpu_fabs(fpu.regs[TOP]);
 }
 
 static void FPU_FTST(void){
-	fpu.regs[8].d = 0.0;
+	fpu.regs[8] = 0.0;
 	FPU_FCOM(TOP,8);
 }
 
 static void FPU_FLD1(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = 1.0;
+	fpu.regs[TOP] = 1.0;
 }
 
 static void FPU_FLDL2T(void){
-	constexpr auto L2T = M_LN10 / M_LN2;
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = L2T;
+	fpu.regs[TOP] = fpu_from_float80<FPU_Float>(fpu_const_l2t);
 }
 
 static void FPU_FLDL2E(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = M_LOG2E;
+	fpu.regs[TOP] = fpu_from_float80<FPU_Float>(fpu_const_l2e);
 }
 
 static void FPU_FLDPI(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = M_PI;
+	fpu.regs[TOP] = fpu_from_float80<FPU_Float>(fpu_const_pi);
 }
 
 static void FPU_FLDLG2(void){
-	constexpr auto LG2 = M_LOG10E / M_LOG2E;
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = LG2;
+	fpu.regs[TOP] = fpu_from_float80<FPU_Float>(fpu_const_lg2);
 }
 
 static void FPU_FLDLN2(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = M_LN2;
+	fpu.regs[TOP] = fpu_from_float80<FPU_Float>(fpu_const_ln2);
 }
 
 static void FPU_FLDZ(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = 0.0;
+	fpu.regs[TOP] = 0.0;
 	fpu.tags[TOP] = TAG_Zero;
 }
 
@@ -73,6 +73,18 @@ List of common options:
 
   -exit                Exit after the DOS program specified by FILE has ended.
 
+  --benchmark <secs>   Run headless for <secs> emulated seconds, then print a
+                       performance report in JSON format and exit.
+
+  --record <file>      Record the keyboard and mouse input and the timing of
+                       the session to <file>.
+
+  --replay <file>      Replay a session recorded with --record as fast as
+                       possible, then exit.
+
+  --loadstate <file>   Load the save state <file> once the autoexec has
+                       started the programs it was saved in.
+
   -h, --help           Print this help message and exit.
 
   -v, --version        Print version information and exit.
@@ -20,6 +20,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
@@ -28,11 +29,14 @@
 #include <mutex>
 #include <regex>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <sys/types.h>
 
 #include "../capture/capture.h"
+#include "benchmark.h"
 #include "control.h"
 #include "cross.h"
 #include "mapper.h"
@@ -45,10 +49,175 @@
 #include "video.h"
 
 #include "render_scalers.h"
+#include "render_simd.h"
 
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
 
+// The handler that processes the next line. It's RENDER_DrawLine itself,
+// unless the frame is queued for the render thread.
+static ScalerLineHandler_t draw_line = nullptr;
+
+// The render thread runs the change detection and the scalers while the
+// emulation carries on with the frame. The emulation copies each source line
+// into the queue, as the video memory and the registers it came from may
+// change before the thread gets to it, and waits for the thread to catch up
+// at the end of the frame. Only used when the frame buffer is plain memory.
+static struct RenderThread {
+	std::thread thread                   = {};
+	std::mutex mutex                     = {};
+	std::condition_variable lines_queued = {};
+	std::condition_variable lines_done   = {};
+
+	// The source lines of the frame and whether each one was given
+	std::vector<uint8_t> lines    = {};
+	std::vector<uint8_t> has_line = {};
+	size_t line_size              = 0;
+
+	size_t num_queued = 0;
+	size_t num_done   = 0;
+	bool is_idle      = false;
+	bool quit         = false;
+
+	bool is_enabled      = false;
+	bool is_frame_queued = false;
+
+	// The frame buffer, taken on the emulation thread when the frame is
+	// queued, as GFX_StartUpdate isn't safe to call from the render thread.
+	// Also used for the rest of the frame if the queue is flushed early.
+	uint8_t* pixels = nullptr;
+	int pitch       = 0;
+	bool has_pixels = false;
+
+	void Stop()
+	{
+		if (!thread.joinable()) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		lines_queued.notify_one();
+		thread.join();
+	}
+
+	~RenderThread()
+	{
+		Stop();
+	}
+} render_thread;
+
+static void set_line_handler(const ScalerLineHandler_t handler)
+{
+	draw_line = handler;
+	if (!render_thread.is_frame_queued) {
+		RENDER_DrawLine = handler;
+	}
+}
+
+static void render_thread_loop()
+{
+	auto& t = render_thread;
+	std::unique_lock<std::mutex> lock(t.mutex);
+	while (true) {
+		t.is_idle = true;
+		t.lines_queued.wait(lock, [&t] {
+			return t.quit || t.num_done < t.num_queued;
+		});
+		t.is_idle = false;
+		if (t.quit) {
+			return;
+		}
+		const auto first = t.num_done;
+		const auto last  = t.num_queued;
+		lock.unlock();
+		for (auto i = first; i < last; ++i) {
+			draw_line(t.has_line[i] ? &t.lines[i * t.line_size] : nullptr);
+		}
+		lock.lock();
+		t.num_done = last;
+		if (t.num_done == t.num_queued) {
+			t.lines_done.notify_one();
+		}
+	}
+}
+
+static void queue_line(const void* src)
+{
+	auto& t = render_thread;
+
+	// Only this thread changes the number of queued lines
+	const auto index = t.num_queued;
+	if (index >= t.has_line.size()) {
+		return;
+	}
+	t.has_line[index] = (src != nullptr);
+	if (src) {
+		memcpy(&t.lines[index * t.line_size], src, t.line_size);
+	}
+	bool is_idle = false;
+	{
+		std::lock_guard<std::mutex> lock(t.mutex);
+		t.num_queued = index + 1;
+		is_idle      = t.is_idle;
+	}
+	if (is_idle) {
+		t.lines_queued.notify_one();
+	}
+}
+
+static void RENDER_StartLineHandler(const void *s);
+
+// Hands the lines of the frame that's starting to the render thread
+static void queue_frame()
+{
+	auto& t      = render_thread;
+	t.has_pixels = false;
+	if (!t.is_enabled || !GFX_HasMemoryFrameBuffer()) {
+		return;
+	}
+	if (!t.thread.joinable()) {
+		t.quit   = false;
+		t.thread = std::thread(render_thread_loop);
+		set_thread_name(t.thread, "dosbox:render");
+	}
+	// The scalers may read a block of pixels past the end of the line
+	constexpr size_t line_padding = 64;
+
+	t.line_size = render.scale.cachePitch;
+	t.lines.resize(render.src.height * t.line_size + line_padding);
+	t.has_line.resize(render.src.height);
+	{
+		std::lock_guard<std::mutex> lock(t.mutex);
+		t.num_queued = 0;
+		t.num_done   = 0;
+	}
+	// The start handler only takes the frame buffer once it finds a
+	// changed line; that's done on this thread up front instead
+	t.has_pixels = (draw_line == RENDER_StartLineHandler) &&
+	               GFX_StartUpdate(t.pixels, t.pitch);
+
+	t.is_frame_queued = true;
+	RENDER_DrawLine   = queue_line;
+}
+
+// Waits for the render thread to process the lines queued so far; the rest
+// of the frame, if any, is processed right away
+void RENDER_FlushQueuedFrame()
+{
+	auto& t = render_thread;
+	if (!t.is_frame_queued) {
+		return;
+	}
+	{
+		std::unique_lock<std::mutex> lock(t.mutex);
+		t.lines_done.wait(lock, [&t] { return t.num_done == t.num_queued; });
+	}
+	t.is_frame_queued = false;
+	RENDER_DrawLine   = draw_line;
+}
+
 static void RENDER_CallBack(GFX_CallBackFunctions_t function);
 
 static void Check_Palette(void)
@@ -112,29 +281,34 @@ void RENDER_SetPal(uint8_t entry, uint8_t red, uint8_t green, uint8_t blue)
 
 static void RENDER_EmptyLineHandler(const void *) {}
 
+// Takes the frame buffer for the first changed line of the frame
+static bool start_output_update()
+{
+	auto& t = render_thread;
+	if (!t.has_pixels) {
+		return !t.is_frame_queued &&
+		       GFX_StartUpdate(render.scale.outWrite, render.scale.outPitch);
+	}
+	render.scale.outWrite = t.pixels;
+	render.scale.outPitch = t.pitch;
+	return true;
+}
+
 static void RENDER_StartLineHandler(const void *s)
 {
 	if (s) {
-		const Bitu *src = (Bitu *)s;
-		Bitu *cache     = (Bitu *)(render.scale.cacheRead);
-		for (Bits x = render.src.start; x > 0;) {
-			const auto src_ptr = reinterpret_cast<const uint8_t *>(src);
-			const auto src_val = read_unaligned_size_t(src_ptr);
-			if (GCC_UNLIKELY(src_val != cache[0])) {
-				if (!GFX_StartUpdate(render.scale.outWrite,
-				                     render.scale.outPitch)) {
-					RENDER_DrawLine = RENDER_EmptyLineHandler;
-					return;
-				}
-				render.scale.outWrite += render.scale.outPitch *
-				                         Scaler_ChangedLines[0];
-				RENDER_DrawLine = render.scale.lineHandler;
-				RENDER_DrawLine(s);
+		const auto num_bytes = render.src.start * sizeof(Bitu);
+		if (GCC_UNLIKELY(RENDER_CountEqualBytes(s, render.scale.cacheRead,
+		                                        num_bytes) < num_bytes)) {
+			if (!start_output_update()) {
+				set_line_handler(RENDER_EmptyLineHandler);
 				return;
 			}
-			x--;
-			src++;
-			cache++;
+			render.scale.outWrite += render.scale.outPitch *
+			                         Scaler_ChangedLines[0];
+			set_line_handler(render.scale.lineHandler);
+			draw_line(s);
+			return;
 		}
 	}
 	render.scale.cacheRead += render.scale.cachePitch;
@@ -146,14 +320,7 @@ static void RENDER_StartLineHandler(const void *s)
 static void RENDER_FinishLineHandler(const void *s)
 {
 	if (s) {
-		const Bitu *src = (Bitu *)s;
-		Bitu *cache     = (Bitu *)(render.scale.cacheRead);
-		for (Bits x = render.src.start; x > 0;) {
-			cache[0] = src[0];
-			x--;
-			src++;
-			cache++;
-		}
+		memcpy(render.scale.cacheRead, s, render.src.start * sizeof(Bitu));
 	}
 	render.scale.cacheRead += render.scale.cachePitch;
 }
@@ -197,7 +364,7 @@ bool RENDER_StartUpdate(void)
 			return false;
 		render.fullFrame        = true;
 		render.scale.clearCache = false;
-		RENDER_DrawLine         = RENDER_ClearCacheHandler;
+		set_line_handler(RENDER_ClearCacheHandler);
 	} else {
 		if (render.pal.changed) {
 			/* Assume pal changes always do a full screen update
@@ -205,10 +372,10 @@ bool RENDER_StartUpdate(void)
 			if (GCC_UNLIKELY(!GFX_StartUpdate(render.scale.outWrite,
 			                                  render.scale.outPitch)))
 				return false;
-			RENDER_DrawLine  = render.scale.linePalHandler;
+			set_line_handler(render.scale.linePalHandler);
 			render.fullFrame = true;
 		} else {
-			RENDER_DrawLine = RENDER_StartLineHandler;
+			set_line_handler(RENDER_StartLineHandler);
 			if (GCC_UNLIKELY(CAPTURE_IsCapturingImage() ||
 			                 CAPTURE_IsCapturingVideo())) {
 				render.fullFrame = true;
@@ -218,12 +385,14 @@ bool RENDER_StartUpdate(void)
 		}
 	}
 	render.updating = true;
+	queue_frame();
 	return true;
 }
 
 static void RENDER_Halt(void)
 {
-	RENDER_DrawLine = RENDER_EmptyLineHandler;
+	RENDER_FlushQueuedFrame();
+	set_line_handler(RENDER_EmptyLineHandler);
 	GFX_EndUpdate(0);
 	render.updating = false;
 	render.active   = false;
@@ -236,7 +405,8 @@ void RENDER_EndUpdate(bool abort)
 		return;
 	}
 
-	RENDER_DrawLine = RENDER_EmptyLineHandler;
+	RENDER_FlushQueuedFrame();
+	set_line_handler(RENDER_EmptyLineHandler);
 
 	if (GCC_UNLIKELY((CAPTURE_IsCapturingImage() || CAPTURE_IsCapturingVideo()))) {
 		uint8_t flags = 0;
@@ -267,6 +437,9 @@ void RENDER_EndUpdate(bool abort)
 		// If we made it here, then there's nothing new to render.
 		GFX_EndUpdate(nullptr);
 	}
+	if (!abort) {
+		BENCHMARK_AddFrame();
+	}
 	render.updating = false;
 }
 
@@ -297,6 +470,7 @@ static void RENDER_Reset(void)
 	// be called from the rendering callback, which might come from a video
 	// driver operating in a different thread or process.
 	std::lock_guard<std::mutex> guard(render_reset_mutex);
+	RENDER_FlushQueuedFrame();
 
 	Bitu width  = render.src.width;
 	bool dblw   = render.src.dblw;
@@ -442,7 +616,7 @@ static void RENDER_Reset(void)
 	render.pal.changed = false;
 	memset(render.pal.modified, 0, sizeof(render.pal.modified));
 	// Finish this frame using a copy only handler
-	RENDER_DrawLine       = RENDER_FinishLineHandler;
+	set_line_handler(RENDER_FinishLineHandler);
 	render.scale.outWrite = 0;
 	/* Signal the next frame to first reinit the cache */
 	render.scale.clearCache = true;
@@ -458,6 +632,7 @@ static void RENDER_CallBack(GFX_CallBackFunctions_t function)
 		render.scale.clearCache = true;
 		return;
 	} else if (function == GFX_CallBackReset) {
+		RENDER_FlushQueuedFrame();
 		GFX_EndUpdate(0);
 		RENDER_Reset();
 	} else {
@@ -774,6 +949,12 @@ void RENDER_Init(Section *sec)
 	render.pal.last  = 0;
 	render.aspect    = section->Get_bool("aspect");
 
+	RENDER_FlushQueuedFrame();
+	render_thread.is_enabled = section->Get_bool("threaded_rendering");
+	if (!render_thread.is_enabled) {
+		render_thread.Stop();
+	}
+
 	VGA_SetMonoPalette(section->Get_string("monochrome_palette"));
 
 	// Only use the default 1x rendering scaler
@@ -36,6 +36,10 @@ constexpr uint16_t SCALER_MAXWIDTH  = 1600 + 30;
 
 #define SCALER_BLOCKSIZE	16
 
+// The line handlers take a null line as unchanged, for the scanlines the VGA
+// knows to be the same as in the previous frame
+#define RENDER_NULL_INPUT
+
 enum ScalerMode : uint8_t {
 	scalerMode8,
 	scalerMode15,
@@ -0,0 +1,319 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "render_simd.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RENDER_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RENDER_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only allow the intrinsics in functions built for SSE2, which
+// 32-bit builds aren't by default
+#if defined(RENDER_SIMD_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define SSE2_TARGET __attribute__((target("sse2")))
+#else
+#define SSE2_TARGET
+#endif
+
+// Plain kernels
+// ~~~~~~~~~~~~~
+
+static size_t count_equal_bytes_plain(const uint8_t* a, const uint8_t* b,
+                                      const size_t num_bytes)
+{
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= num_bytes; i += sizeof(uint64_t)) {
+		uint64_t a_val = 0;
+		uint64_t b_val = 0;
+		memcpy(&a_val, a + i, sizeof(a_val));
+		memcpy(&b_val, b + i, sizeof(b_val));
+		if (a_val != b_val) {
+			break;
+		}
+	}
+	while (i < num_bytes && a[i] == b[i]) {
+		++i;
+	}
+	return i;
+}
+
+static inline uint32_t convert_15_to_32(const uint16_t p)
+{
+	const uint32_t r = (p >> 10) & 0x1f;
+	const uint32_t g = (p >> 5) & 0x1f;
+	const uint32_t b = p & 0x1f;
+	return (((r << 3) | (r >> 2)) << 16) | (((g << 3) | (g >> 2)) << 8) |
+	       ((b << 3) | (b >> 2));
+}
+
+static inline uint32_t convert_16_to_32(const uint16_t p)
+{
+	const uint32_t r = (p >> 11) & 0x1f;
+	const uint32_t g = (p >> 5) & 0x3f;
+	const uint32_t b = p & 0x1f;
+	return (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) |
+	       ((b << 3) | (b >> 2));
+}
+
+static void convert_15_to_32_plain(const uint16_t* src, uint32_t* dst,
+                                   const size_t num_pixels)
+{
+	for (size_t i = 0; i < num_pixels; ++i) {
+		dst[i] = convert_15_to_32(src[i]);
+	}
+}
+
+static void convert_16_to_32_plain(const uint16_t* src, uint32_t* dst,
+                                   const size_t num_pixels)
+{
+	for (size_t i = 0; i < num_pixels; ++i) {
+		dst[i] = convert_16_to_32(src[i]);
+	}
+}
+
+// SSE2 kernels
+// ~~~~~~~~~~~~
+#if defined(RENDER_SIMD_SSE2)
+
+SSE2_TARGET static size_t count_equal_bytes_sse2(const uint8_t* a, const uint8_t* b,
+                                                 const size_t num_bytes)
+{
+	size_t i = 0;
+	for (; i + 16 <= num_bytes; i += 16) {
+		const auto a_val = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		const auto b_val = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		const auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a_val, b_val));
+		if (mask != 0xffff) {
+			break;
+		}
+	}
+	return i + count_equal_bytes_plain(a + i, b + i, num_bytes - i);
+}
+
+// Widens the 8-bit components in the 16-bit lanes to xRGB8888 pixels
+SSE2_TARGET static inline void store_xrgb_sse2(uint32_t* dst, const __m128i r,
+                                               const __m128i g, const __m128i b)
+{
+	const auto gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(gb, r));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4), _mm_unpackhi_epi16(gb, r));
+}
+
+SSE2_TARGET static void convert_15_to_32_sse2(const uint16_t* src, uint32_t* dst,
+                                              const size_t num_pixels)
+{
+	const auto mask5 = _mm_set1_epi16(0x1f);
+	size_t i         = 0;
+	for (; i + 8 <= num_pixels; i += 8) {
+		const auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		auto r = _mm_and_si128(_mm_srli_epi16(p, 10), mask5);
+		auto g = _mm_and_si128(_mm_srli_epi16(p, 5), mask5);
+		auto b = _mm_and_si128(p, mask5);
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+		store_xrgb_sse2(dst + i, r, g, b);
+	}
+	convert_15_to_32_plain(src + i, dst + i, num_pixels - i);
+}
+
+SSE2_TARGET static void convert_16_to_32_sse2(const uint16_t* src, uint32_t* dst,
+                                              const size_t num_pixels)
+{
+	const auto mask5 = _mm_set1_epi16(0x1f);
+	const auto mask6 = _mm_set1_epi16(0x3f);
+	size_t i         = 0;
+	for (; i + 8 <= num_pixels; i += 8) {
+		const auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		auto r = _mm_srli_epi16(p, 11);
+		auto g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+		auto b = _mm_and_si128(p, mask5);
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+		store_xrgb_sse2(dst + i, r, g, b);
+	}
+	convert_16_to_32_plain(src + i, dst + i, num_pixels - i);
+}
+
+static bool host_has_sse2()
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_IX86_FP)
+	return true;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+// NEON kernels
+// ~~~~~~~~~~~~
+#if defined(RENDER_SIMD_NEON)
+
+static size_t count_equal_bytes_neon(const uint8_t* a, const uint8_t* b,
+                                     const size_t num_bytes)
+{
+	size_t i = 0;
+	for (; i + 16 <= num_bytes; i += 16) {
+		const auto equal = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+		if (vminvq_u8(equal) != 0xff) {
+			break;
+		}
+	}
+	return i + count_equal_bytes_plain(a + i, b + i, num_bytes - i);
+}
+
+static inline void store_xrgb_neon(uint32_t* dst, const uint16x8_t r,
+                                   const uint16x8_t g, const uint16x8_t b)
+{
+	const auto gb     = vorrq_u16(vshlq_n_u16(g, 8), b);
+	const auto pixels = vzipq_u16(gb, r);
+	vst1q_u32(dst, vreinterpretq_u32_u16(pixels.val[0]));
+	vst1q_u32(dst + 4, vreinterpretq_u32_u16(pixels.val[1]));
+}
+
+static void convert_15_to_32_neon(const uint16_t* src, uint32_t* dst,
+                                  const size_t num_pixels)
+{
+	const auto mask5 = vdupq_n_u16(0x1f);
+	size_t i         = 0;
+	for (; i + 8 <= num_pixels; i += 8) {
+		const auto p = vld1q_u16(src + i);
+		auto r = vandq_u16(vshrq_n_u16(p, 10), mask5);
+		auto g = vandq_u16(vshrq_n_u16(p, 5), mask5);
+		auto b = vandq_u16(p, mask5);
+		r = vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2));
+		g = vorrq_u16(vshlq_n_u16(g, 3), vshrq_n_u16(g, 2));
+		b = vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2));
+		store_xrgb_neon(dst + i, r, g, b);
+	}
+	convert_15_to_32_plain(src + i, dst + i, num_pixels - i);
+}
+
+static void convert_16_to_32_neon(const uint16_t* src, uint32_t* dst,
+                                  const size_t num_pixels)
+{
+	const auto mask5 = vdupq_n_u16(0x1f);
+	const auto mask6 = vdupq_n_u16(0x3f);
+	size_t i         = 0;
+	for (; i + 8 <= num_pixels; i += 8) {
+		const auto p = vld1q_u16(src + i);
+		auto r = vshrq_n_u16(p, 11);
+		auto g = vandq_u16(vshrq_n_u16(p, 5), mask6);
+		auto b = vandq_u16(p, mask5);
+		r = vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2));
+		g = vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4));
+		b = vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2));
+		store_xrgb_neon(dst + i, r, g, b);
+	}
+	convert_16_to_32_plain(src + i, dst + i, num_pixels - i);
+}
+
+#endif
+
+// Dispatch
+// ~~~~~~~~
+
+struct RenderKernels {
+	const char* name = "plain";
+	size_t (*count_equal_bytes)(const uint8_t*, const uint8_t*, size_t) = count_equal_bytes_plain;
+	void (*convert_15_to_32)(const uint16_t*, uint32_t*, size_t) = convert_15_to_32_plain;
+	void (*convert_16_to_32)(const uint16_t*, uint32_t*, size_t) = convert_16_to_32_plain;
+};
+
+static RenderKernels select_kernels(const bool use_simd)
+{
+	RenderKernels kernels = {};
+	if (!use_simd) {
+		return kernels;
+	}
+#if defined(RENDER_SIMD_SSE2)
+	if (host_has_sse2()) {
+		kernels.name              = "sse2";
+		kernels.count_equal_bytes = count_equal_bytes_sse2;
+		kernels.convert_15_to_32  = convert_15_to_32_sse2;
+		kernels.convert_16_to_32  = convert_16_to_32_sse2;
+	}
+#elif defined(RENDER_SIMD_NEON)
+	kernels.name              = "neon";
+	kernels.count_equal_bytes = count_equal_bytes_neon;
+	kernels.convert_15_to_32  = convert_15_to_32_neon;
+	kernels.convert_16_to_32  = convert_16_to_32_neon;
+#endif
+	return kernels;
+}
+
+static RenderKernels kernels = select_kernels(true);
+
+size_t RENDER_CountEqualBytes(const void* a, const void* b, const size_t num_bytes)
+{
+	return kernels.count_equal_bytes(static_cast<const uint8_t*>(a),
+	                                 static_cast<const uint8_t*>(b),
+	                                 num_bytes);
+}
+
+// Neither SSE2 nor NEON can gather, so the lookups stay scalar; unrolling
+// them lets the loads overlap
+void RENDER_Expand8To32(const uint8_t* src, uint32_t* dst,
+                        const size_t num_pixels, const uint32_t* palette)
+{
+	size_t i = 0;
+	for (; i + 4 <= num_pixels; i += 4) {
+		const auto p0 = palette[src[i + 0]];
+		const auto p1 = palette[src[i + 1]];
+		const auto p2 = palette[src[i + 2]];
+		const auto p3 = palette[src[i + 3]];
+		dst[i + 0]    = p0;
+		dst[i + 1]    = p1;
+		dst[i + 2]    = p2;
+		dst[i + 3]    = p3;
+	}
+	for (; i < num_pixels; ++i) {
+		dst[i] = palette[src[i]];
+	}
+}
+
+void RENDER_Convert15To32(const uint16_t* src, uint32_t* dst, const size_t num_pixels)
+{
+	kernels.convert_15_to_32(src, dst, num_pixels);
+}
+
+void RENDER_Convert16To32(const uint16_t* src, uint32_t* dst, const size_t num_pixels)
+{
+	kernels.convert_16_to_32(src, dst, num_pixels);
+}
+
+const char* RENDER_GetSimdName()
+{
+	return kernels.name;
+}
+
+void RENDER_EnableSimd(const bool enabled)
+{
+	kernels = select_kernels(enabled);
+}
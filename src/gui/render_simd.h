@@ -0,0 +1,49 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_RENDER_SIMD_H
+#define DOSBOX_RENDER_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Line kernels of the renderer. They use SSE2 or NEON where the host has it,
+// which is checked once at startup, and plain loops otherwise.
+
+// Returns the number of leading bytes that are the same in both buffers
+size_t RENDER_CountEqualBytes(const void* a, const void* b, size_t num_bytes);
+
+// Looks the 8-bit pixels up in the 32-bit palette
+void RENDER_Expand8To32(const uint8_t* src, uint32_t* dst, size_t num_pixels,
+                        const uint32_t* palette);
+
+// Converts xRGB1555 and RGB565 pixels to xRGB8888, filling the low bits of
+// each component with its high bits
+void RENDER_Convert15To32(const uint16_t* src, uint32_t* dst, size_t num_pixels);
+void RENDER_Convert16To32(const uint16_t* src, uint32_t* dst, size_t num_pixels);
+
+// Name of the instruction set the kernels use
+const char* RENDER_GetSimdName();
+
+// Selects the plain kernels, or the SIMD ones if the host has them; for
+// comparing the two
+void RENDER_EnableSimd(bool enabled);
+
+#endif
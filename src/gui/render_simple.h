@@ -16,7 +16,9 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
-#include "mem_unaligned.h"
+#include <cstring>
+
+#include "render_simd.h"
 
 #if SCALER_MAX_MUL_HEIGHT < SCALERHEIGHT
 #error "Scaler goes too high"
@@ -59,20 +61,15 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 			cache+=4;
 			line0+=4*SCALERWIDTH;
 #else
-	constexpr uint8_t address_step = sizeof(Bitu) / sizeof(SRCTYPE);
-
 	for (Bits x = render.src.width; x > 0;) {
-		const auto src_ptr = reinterpret_cast<const uint8_t *>(src);
-		const auto src_val = read_unaligned_size_t(src_ptr);
-
-		const auto cache_ptr = reinterpret_cast<uint8_t *>(cache);
-		const auto cache_val = read_unaligned_size_t(cache_ptr);
-
-		if (src_val == cache_val) {
-			x -= address_step;
-			src += address_step;
-			cache += address_step;
-			line0 += address_step * SCALERWIDTH;
+		const auto unchanged = static_cast<Bits>(
+		        RENDER_CountEqualBytes(src, cache, x * sizeof(SRCTYPE)) /
+		        sizeof(SRCTYPE));
+		if (unchanged > 0) {
+			x -= unchanged;
+			src += unchanged;
+			cache += unchanged;
+			line0 += unchanged * SCALERWIDTH;
 #endif
 		} else {
 #if defined(SCALERLINEAR)
@@ -85,11 +82,23 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 #endif
 #endif //defined(SCALERLINEAR)
 			hadChange = 1;
-			for (Bitu i = x > 32 ? 32 : x;i>0;i--,x--) {
+			const Bitu run = x > 32 ? 32 : x;
+#if defined(PCONVERT)
+			PTYPE converted[32];
+			PCONVERT(src, converted, run);
+			std::memcpy(cache, src, run * sizeof(SRCTYPE));
+			src += run;
+			cache += run;
+#endif
+			for (Bitu i = 0; i < run; i++, x--) {
+#if defined(PCONVERT)
+				const PTYPE P = converted[i];
+#else
 				const SRCTYPE S = *src;
 				*cache = S;
 				src++;cache++;
 				const PTYPE P = PMAKE(S);
+#endif
 				SCALERFUNC;
 				line0 += SCALERWIDTH;
 #if (SCALERHEIGHT > 1) 
@@ -203,6 +203,19 @@
 #	define SRCTYPE uint32_t
 #endif
 
+// Changed runs are converted to the 32-bit output format in one go with the
+// line kernels
+#if DBPP == 32 && !defined(WORDS_BIGENDIAN)
+#	if SBPP == 8 || SBPP == 9
+#		define PCONVERT(_SRC, _DST, _NUM) \
+			RENDER_Expand8To32(_SRC, _DST, _NUM, render.pal.lut.b32)
+#	elif SBPP == 15
+#		define PCONVERT(_SRC, _DST, _NUM) RENDER_Convert15To32(_SRC, _DST, _NUM)
+#	elif SBPP == 16
+#		define PCONVERT(_SRC, _DST, _NUM) RENDER_Convert16To32(_SRC, _DST, _NUM)
+#	endif
+#endif
+
 //  C0 C1 C2 D3
 //  C3 C4 C5 D4
 //  C6 C7 C8 D5
@@ -270,6 +283,7 @@
 #undef PSIZE
 #undef PTYPE
 #undef PMAKE
+#undef PCONVERT
 #undef WC
 #undef LC
 #undef FC
@@ -48,6 +48,7 @@
 #endif
 
 #include "../ints/int10.h"
+#include "benchmark.h"
 #include "control.h"
 #include "cpu.h"
 #include "cross.h"
@@ -64,6 +65,8 @@
 #include "pacer.h"
 #include "pic.h"
 #include "render.h"
+#include "replay.h"
+#include "savestate.h"
 #include "sdlmain.h"
 #include "setup.h"
 #include "string_utils.h"
@@ -233,7 +236,7 @@ static SDL_Rect calc_viewport(const int width, const int height);
 static void CleanupSDLResources();
 static void HandleVideoResize(int width, int height);
 
-static void update_frame_texture([[maybe_unused]] const uint16_t *changedLines);
+static void update_frame_texture(const uint16_t *changedLines);
 static void update_frame_surface(const uint16_t *changedLines);
 static bool present_frame_texture();
 #if C_OPENGL
@@ -2515,6 +2518,18 @@ bool GFX_StartUpdate(uint8_t * &pixels, int &pitch)
 	return false;
 }
 
+bool GFX_HasMemoryFrameBuffer()
+{
+	switch (sdl.desktop.type) {
+	case SCREEN_TEXTURE:
+	case SCREEN_SURFACE: return true;
+#if C_OPENGL
+	case SCREEN_OPENGL: return !sdl.opengl.pixel_buffer_object;
+#endif
+	}
+	return false;
+}
+
 void GFX_EndUpdate(const uint16_t *changedLines)
 {
 	sdl.frame.update(changedLines);
@@ -2540,13 +2555,26 @@ void GFX_EndUpdate(const uint16_t *changedLines)
 
 // Texture update and presentation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-static void update_frame_texture([[maybe_unused]] const uint16_t *changedLines)
+static void update_frame_texture(const uint16_t *changedLines)
 {
-	if (sdl.update_display_contents) {
-		SDL_UpdateTexture(sdl.texture.texture,
-		                  nullptr, // update entire texture
-		                  sdl.texture.input_surface->pixels,
-		                  sdl.texture.input_surface->pitch);
+	if (!sdl.update_display_contents || !changedLines) {
+		return;
+	}
+	// Only upload the runs of changed lines
+	const auto pixels = static_cast<uint8_t *>(sdl.texture.input_surface->pixels);
+	const auto pitch = sdl.texture.input_surface->pitch;
+	int y = 0;
+	size_t index = 0;
+	while (y < sdl.draw.height) {
+		if (!(index & 1)) {
+			y += changedLines[index];
+		} else {
+			const int height = changedLines[index];
+			const SDL_Rect rect = {0, y, sdl.draw.width, height};
+			SDL_UpdateTexture(sdl.texture.texture, &rect, pixels + y * pitch, pitch);
+			y += height;
+		}
+		index++;
 	}
 }
 
@@ -2672,6 +2700,8 @@ Bitu GFX_GetRGB(uint8_t red,uint8_t green,uint8_t blue) {
 }
 
 void GFX_Stop() {
+	// the render thread might still be writing to the frame buffer
+	RENDER_FlushQueuedFrame();
 	if (sdl.updating)
 		GFX_EndUpdate(nullptr);
 	sdl.active=false;
@@ -4813,6 +4843,40 @@ int sdl_main(int argc, char *argv[])
 			return 0;
 		}
 
+		// Run headless for the given number of emulated seconds, then
+		// print the performance report and exit
+		int benchmark_seconds = 0;
+		if (control->cmdline->FindInt("--benchmark", benchmark_seconds, remove_arg) ||
+		    control->cmdline->FindInt("-benchmark", benchmark_seconds, remove_arg)) {
+			if (benchmark_seconds <= 0) {
+				LOG_ERR("BENCHMARK: The duration must be a positive number of seconds");
+				return 1;
+			}
+			SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+			SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+		}
+
+		// Record the input and timing of the session, or replay a
+		// recorded one
+		std::string record_path = {};
+		std::string replay_path = {};
+		if (!control->cmdline->FindString("--record", record_path, remove_arg)) {
+			control->cmdline->FindString("-record", record_path, remove_arg);
+		}
+		if (!control->cmdline->FindString("--replay", replay_path, remove_arg)) {
+			control->cmdline->FindString("-replay", replay_path, remove_arg);
+		}
+		if (!record_path.empty() && !replay_path.empty()) {
+			LOG_ERR("REPLAY: Can't record and replay at the same time");
+			return 1;
+		}
+
+		// Load a save state once the machine has started
+		std::string loadstate_path = {};
+		if (!control->cmdline->FindString("--loadstate", loadstate_path, remove_arg)) {
+			control->cmdline->FindString("-loadstate", loadstate_path, remove_arg);
+		}
+
 #if defined(WIN32)
 	SetConsoleCtrlHandler((PHANDLER_ROUTINE) ConsoleEventHandler,TRUE);
 
@@ -4876,6 +4940,28 @@ int sdl_main(int argc, char *argv[])
 		}
 	}
 
+	if (benchmark_seconds > 0) {
+		// the dummy video driver only has a window surface
+		control->GetSection("sdl")->HandleInputline("output=surface");
+		control->GetSection("mixer")->HandleInputline("nosound=true");
+		BENCHMARK_Start(benchmark_seconds);
+	}
+
+	if (!record_path.empty() || !replay_path.empty()) {
+		const auto started = record_path.empty()
+		                           ? REPLAY_StartReplay(replay_path)
+		                           : REPLAY_StartRecording(record_path);
+		if (!started) {
+			return 1;
+		}
+		// the pace of the audio device would steer the sound cards
+		control->GetSection("mixer")->HandleInputline("nosound=true");
+	}
+
+	if (!loadstate_path.empty()) {
+		SAVESTATE_LoadAtStart(loadstate_path);
+	}
+
 #if C_OPENGL
 	const auto glshaders_dir = config_path / "glshaders";
 	if (create_dir(glshaders_dir, 0700, OK_IF_EXISTS) != 0)
@@ -4920,6 +5006,7 @@ int sdl_main(int argc, char *argv[])
 			MAPPER_DisplayUI();
 
 		control->StartUp(); // Run the machine until shutdown
+		REPLAY_Stop();
 		control.reset();  // Shutdown and release
 
 	} catch (char *error) {
@@ -22,10 +22,11 @@
 #include <ctime>
 
 #include "bios_disk.h"
-#include "cross.h"
 #include "inout.h"
 #include "mem.h"
 #include "pic.h"
+#include "replay.h"
+#include "savestate.h"
 #include "setup.h"
 #include "timer.h"
 
@@ -137,9 +138,9 @@ static uint8_t cmos_readreg(io_port_t, io_width_t)
 	Bitu drive_a, drive_b;
 	uint8_t hdparm;
 
-	const time_t curtime = time(nullptr);
-	struct tm datetime;
-	cross::localtime_r(&curtime, &datetime);
+	struct tm datetime    = {};
+	uint32_t milliseconds = 0;
+	REPLAY_GetLocalTime(datetime, milliseconds);
 
 	switch (cmos.reg) {
 	case 0x00:		/* Seconds */
@@ -337,6 +338,15 @@ void CMOS_SetRegister(Bitu regNr, uint8_t val) {
 	cmos.regs[regNr] = val;
 }
 
+static void cmos_save_state(SaveStateWriter& writer)
+{
+	writer.Write(cmos);
+}
+
+static void cmos_load_state(SaveStateReader& reader)
+{
+	reader.Read(cmos);
+}
 
 class CMOS final : public Module_base{
 private:
@@ -372,6 +382,8 @@ public:
 		cmos.regs[0x18]=(uint8_t)(exsize >> 8);
 		cmos.regs[0x30]=(uint8_t)exsize;
 		cmos.regs[0x31]=(uint8_t)(exsize >> 8);
+
+		SAVESTATE_AddComponent("cmos", 1, cmos_save_state, cmos_load_state);
 	}
 };
 
@@ -27,6 +27,7 @@
 #include "inout.h"
 #include "pic.h"
 #include "paging.h"
+#include "savestate.h"
 #include "setup.h"
 
 DmaController *DmaControllers[2];
@@ -362,6 +363,87 @@ again:
 	return done;
 }
 
+using DMA_CallBackFunction = void(DmaChannel* chan, DMAEvent event);
+
+void DmaController::SaveState(SaveStateWriter& writer) const
+{
+	writer.Write(flipflop);
+	for (const auto* channel : dma_channels) {
+		writer.Write(channel->pagebase);
+		writer.Write(channel->baseaddr);
+		writer.Write(channel->curraddr);
+		writer.Write(channel->basecnt);
+		writer.Write(channel->currcnt);
+		writer.Write(channel->pagenum);
+		writer.Write(channel->increment);
+		writer.Write(channel->autoinit);
+		writer.Write(channel->masked);
+		writer.Write(channel->tcount);
+		writer.Write(channel->request);
+
+		// Only callbacks that are plain functions can be saved, the
+		// devices that bind theirs to an object leave them as they are
+		const auto function = channel->callback
+		                            ? channel->callback.target<DMA_CallBackFunction*>()
+		                            : nullptr;
+		writer.Write(static_cast<bool>(!channel->callback || function));
+		if (function) {
+			writer.WriteFunction(*function);
+		} else {
+			writer.WriteFunction<DMA_CallBackFunction>(nullptr);
+		}
+	}
+}
+
+void DmaController::LoadState(SaveStateReader& reader)
+{
+	reader.Read(flipflop);
+	for (auto* channel : dma_channels) {
+		reader.Read(channel->pagebase);
+		reader.Read(channel->baseaddr);
+		reader.Read(channel->curraddr);
+		reader.Read(channel->basecnt);
+		reader.Read(channel->currcnt);
+		reader.Read(channel->pagenum);
+		reader.Read(channel->increment);
+		reader.Read(channel->autoinit);
+		reader.Read(channel->masked);
+		reader.Read(channel->tcount);
+		reader.Read(channel->request);
+
+		bool has_function = false;
+		reader.Read(has_function);
+		DMA_CallBackFunction* function = nullptr;
+		reader.ReadFunction(function);
+		if (has_function) {
+			// set directly, registering would signal the device
+			channel->callback = function;
+		}
+	}
+}
+
+static void dma_save_state(SaveStateWriter& writer)
+{
+	for (const auto* controller : DmaControllers) {
+		if (controller) {
+			controller->SaveState(writer);
+		}
+	}
+	writer.Write(dma_wrapping);
+	writer.Write(ems_board_mapping);
+}
+
+static void dma_load_state(SaveStateReader& reader)
+{
+	for (auto* controller : DmaControllers) {
+		if (controller) {
+			controller->LoadState(reader);
+		}
+	}
+	reader.Read(dma_wrapping);
+	reader.Read(ems_board_mapping);
+}
+
 class DMA final : public Module_base {
 public:
 	DMA(Section *configuration) : Module_base(configuration)
@@ -399,6 +481,8 @@ public:
 			DmaControllers[1]->DMA_WriteHandler[0x11].Install(0x8f, DMA_Write_Port, io_width_t::byte, 1);
 			DmaControllers[1]->DMA_ReadHandler[0x11].Install(0x8f, DMA_Read_Port, io_width_t::byte, 1);
 		}
+
+		SAVESTATE_AddComponent("dma", 1, dma_save_state, dma_load_state);
 	}
 	~DMA(){
 		if (DmaControllers[0]) {
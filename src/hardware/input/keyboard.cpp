@@ -30,6 +30,7 @@
 #include "intel8042.h"
 #include "intel8255.h"
 #include "pic.h"
+#include "replay.h"
 #include "support.h"
 #include "timer.h"
 
@@ -644,6 +645,17 @@ void KEYBOARD_NotifyReadyForFrame()
 
 void KEYBOARD_AddKey(const KBD_KEYS key_type, const bool is_pressed)
 {
+	static_assert(KBD_LAST <= UINT8_MAX, "Key codes are recorded as bytes");
+	if (GCC_UNLIKELY(replay_active)) {
+		ReplayEvent event = {};
+		event.type        = ReplayEventType::Key;
+		event.code        = static_cast<uint8_t>(key_type);
+		event.pressed     = is_pressed;
+		if (REPLAY_InterceptEvent(event)) {
+			return;
+		}
+	}
+
 	if (!is_scanning) {
 		return;
 	}
@@ -695,6 +707,14 @@ void KEYBOARD_ClrBuffer()
 	// keyboard IRQs - so once we fired an IRQ for the scancode package,
 	// it's too late to withdraw it!
 
+	if (GCC_UNLIKELY(replay_active)) {
+		ReplayEvent event = {};
+		event.type        = ReplayEventType::ClearKeyboard;
+		if (REPLAY_InterceptEvent(event)) {
+			return;
+		}
+	}
+
 	// We have to limit clearing to keyboard internal buffer, this is safe
 	clear_buffer();
 }
@@ -32,6 +32,7 @@
 #include "checks.h"
 #include "cpu.h"
 #include "pic.h"
+#include "replay.h"
 #include "video.h"
 
 CHECK_NARROWING();
@@ -496,6 +497,109 @@ void MOUSE_NotifyBooting()
 		interface->NotifyBooting();
 }
 
+// Delivery of the events which passed the checks of the host state; while
+// recording or replaying they go through the replay module (see replay.h)
+
+template <typename Fill>
+static bool intercept_event(const ReplayEventType type,
+                            const MouseInterfaceId interface_id, const Fill& fill)
+{
+	if (GCC_UNLIKELY(replay_active)) {
+		ReplayEvent event     = {};
+		event.type            = type;
+		event.mouse_interface = static_cast<uint8_t>(interface_id);
+		fill(event);
+		return REPLAY_InterceptEvent(event);
+	}
+	return false;
+}
+
+static void notify_moved(const float x_rel, const float y_rel, const uint32_t x_abs,
+                         const uint32_t y_abs, const MouseInterfaceId interface_id)
+{
+	const auto fill = [&](ReplayEvent& event) {
+		event.x_rel = x_rel;
+		event.y_rel = y_rel;
+		event.x_abs = x_abs;
+		event.y_abs = y_abs;
+	};
+	if (intercept_event(ReplayEventType::MouseMoved, interface_id, fill)) {
+		return;
+	}
+
+	if (interface_id == MouseInterfaceId::None) {
+		for (auto &interface : mouse_interfaces)
+			if (interface->IsUsingHostPointer())
+				interface->NotifyMoved(x_rel, y_rel, x_abs, y_abs);
+		return;
+	}
+	auto interface = MouseInterface::Get(interface_id);
+	if (interface && interface->IsUsingEvents()) {
+		interface->NotifyMoved(x_rel, y_rel, 0, 0);
+	}
+}
+
+static void notify_button(const uint8_t idx, const bool pressed,
+                          const MouseInterfaceId interface_id)
+{
+	const auto fill = [&](ReplayEvent& event) {
+		event.code    = idx;
+		event.pressed = pressed;
+	};
+	if (intercept_event(ReplayEventType::MouseButton, interface_id, fill)) {
+		return;
+	}
+
+	if (interface_id == MouseInterfaceId::None) {
+		for (auto &interface : mouse_interfaces)
+			if (interface->IsUsingHostPointer())
+				interface->NotifyButton(idx, pressed);
+		return;
+	}
+	auto interface = MouseInterface::Get(interface_id);
+	if (interface && interface->IsUsingEvents()) {
+		interface->NotifyButton(idx, pressed);
+	}
+}
+
+static void notify_wheel(const int16_t w_rel, const MouseInterfaceId interface_id)
+{
+	const auto fill = [&](ReplayEvent& event) {
+		event.wheel = w_rel;
+	};
+	if (intercept_event(ReplayEventType::MouseWheel, interface_id, fill)) {
+		return;
+	}
+
+	if (interface_id == MouseInterfaceId::None) {
+		for (auto &interface : mouse_interfaces)
+			if (interface->IsUsingHostPointer())
+				interface->NotifyWheel(w_rel);
+		return;
+	}
+	auto interface = MouseInterface::Get(interface_id);
+	if (interface && interface->IsUsingEvents()) {
+		interface->NotifyWheel(w_rel);
+	}
+}
+
+void MOUSE_ReplayEvent(const ReplayEvent& event)
+{
+	const auto interface_id = static_cast<MouseInterfaceId>(event.mouse_interface);
+	switch (event.type) {
+	case ReplayEventType::MouseMoved:
+		notify_moved(event.x_rel, event.y_rel, event.x_abs, event.y_abs, interface_id);
+		break;
+	case ReplayEventType::MouseButton:
+		notify_button(event.code, event.pressed, interface_id);
+		break;
+	case ReplayEventType::MouseWheel:
+		notify_wheel(event.wheel, interface_id);
+		break;
+	default: assert(false); break;
+	}
+}
+
 void MOUSE_EventMoved(const float x_rel, const float y_rel,
                       const int32_t x_abs, const int32_t y_abs)
 {
@@ -527,11 +631,8 @@ void MOUSE_EventMoved(const float x_rel, const float y_rel,
 	// so it needs data in both formats.
 
 	// Notify mouse interfaces
-	for (auto &interface : mouse_interfaces)
-		if (interface->IsUsingHostPointer())
-			interface->NotifyMoved(x_rel, y_rel,
-			                       state.cursor_x_abs,
-			                       state.cursor_y_abs);
+	notify_moved(x_rel, y_rel, state.cursor_x_abs, state.cursor_y_abs,
+	             MouseInterfaceId::None);
 }
 
 void MOUSE_EventMoved(const float x_rel, const float y_rel,
@@ -545,10 +646,7 @@ void MOUSE_EventMoved(const float x_rel, const float y_rel,
 	}
 
 	// Notify mouse interface
-	auto interface = MouseInterface::Get(interface_id);
-	if (interface && interface->IsUsingEvents()) {
-		interface->NotifyMoved(x_rel, y_rel, 0, 0);
-	}
+	notify_moved(x_rel, y_rel, 0, 0, interface_id);
 }
 
 void MOUSE_EventButton(const uint8_t idx, const bool pressed)
@@ -586,9 +684,7 @@ void MOUSE_EventButton(const uint8_t idx, const bool pressed)
 	}
 
 	// Notify mouse interfaces
-	for (auto &interface : mouse_interfaces)
-		if (interface->IsUsingHostPointer())
-			interface->NotifyButton(idx, pressed);
+	notify_button(idx, pressed, MouseInterfaceId::None);
 }
 
 void MOUSE_EventButton(const uint8_t idx, const bool pressed,
@@ -604,10 +700,7 @@ void MOUSE_EventButton(const uint8_t idx, const bool pressed,
 	}
 
 	// Notify mouse interface
-	auto interface = MouseInterface::Get(interface_id);
-	if (interface && interface->IsUsingEvents()) {
-		interface->NotifyButton(idx, pressed);
-	}
+	notify_button(idx, pressed, interface_id);
 }
 
 void MOUSE_EventWheel(const int16_t w_rel)
@@ -620,9 +713,7 @@ void MOUSE_EventWheel(const int16_t w_rel)
 	}
 
 	// Notify mouse interfaces
-	for (auto &interface : mouse_interfaces)
-		if (interface->IsUsingHostPointer())
-			interface->NotifyWheel(w_rel);
+	notify_wheel(w_rel, MouseInterfaceId::None);
 }
 
 void MOUSE_EventWheel(const int16_t w_rel, const MouseInterfaceId interface_id)
@@ -635,10 +726,7 @@ void MOUSE_EventWheel(const int16_t w_rel, const MouseInterfaceId interface_id)
 	}
 
 	// Notify mouse interface
-	auto interface = MouseInterface::Get(interface_id);
-	if (interface && interface->IsUsingEvents()) {
-		interface->NotifyWheel(w_rel);
-	}
+	notify_wheel(w_rel, interface_id);
 }
 
 // ***************************************************************************
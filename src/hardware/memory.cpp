@@ -20,12 +20,24 @@
 
 #include "mem.h"
 
+#include <cstdio>
+#include <random>
 #include <string.h>
 
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "inout.h"
 #include "setup.h"
 #include "paging.h"
 #include "regs.h"
+#include "savestate.h"
+#include "std_filesystem.h"
 #include "support.h"
 
 // Allow up to 3072 MB, at this address emulated S3 card framebuffer starts
@@ -40,7 +52,26 @@ static struct MemoryBlock {
 	struct page_t {
 		uint8_t bytes[dos_pagesize] = {};
 	};
-	std::vector<page_t> pages           = {};
+	// Points at either the allocated pages or the mapped RAM image
+	struct {
+		page_t* data = nullptr;
+		size_t count = 0;
+
+		size_t size() const
+		{
+			return count;
+		}
+		page_t& operator[](const size_t index) const
+		{
+			return data[index];
+		}
+	} pages = {};
+	std::vector<page_t> allocated_pages = {};
+	struct {
+		std::string path = {};
+		bool is_mapped   = false;
+	} image = {};
+
 	std::vector<PageHandler*> phandlers = {};
 	std::vector<MemHandle> mhandles     = {};
 	struct {
@@ -563,6 +594,74 @@ bool mem_unalignedwrited_checked(PhysPt address, uint32_t val) {
 	return false;
 }
 
+/* Slow paths of the inlined accessors, taken when the page isn't mapped to
+   host memory or the access crosses a page boundary */
+uint8_t mem_readb_slow(PhysPt address) {
+	return get_tlb_readhandler(address)->readb(address);
+}
+
+uint16_t mem_readw_slow(PhysPt address) {
+	if (mem_access_in_page<uint16_t>(address))
+		return get_tlb_readhandler(address)->readw(address);
+	return mem_unalignedreadw(address);
+}
+
+uint32_t mem_readd_slow(PhysPt address) {
+	if (mem_access_in_page<uint32_t>(address))
+		return get_tlb_readhandler(address)->readd(address);
+	return mem_unalignedreadd(address);
+}
+
+void mem_writeb_slow(PhysPt address,uint8_t val) {
+	get_tlb_writehandler(address)->writeb(address,val);
+}
+
+void mem_writew_slow(PhysPt address,uint16_t val) {
+	if (mem_access_in_page<uint16_t>(address))
+		get_tlb_writehandler(address)->writew(address,val);
+	else
+		mem_unalignedwritew(address,val);
+}
+
+void mem_writed_slow(PhysPt address,uint32_t val) {
+	if (mem_access_in_page<uint32_t>(address))
+		get_tlb_writehandler(address)->writed(address,val);
+	else
+		mem_unalignedwrited(address,val);
+}
+
+bool mem_readb_checked_slow(PhysPt address, uint8_t * val) {
+	return get_tlb_readhandler(address)->readb_checked(address,val);
+}
+
+bool mem_readw_checked_slow(PhysPt address, uint16_t * val) {
+	if (mem_access_in_page<uint16_t>(address))
+		return get_tlb_readhandler(address)->readw_checked(address,val);
+	return mem_unalignedreadw_checked(address,val);
+}
+
+bool mem_readd_checked_slow(PhysPt address, uint32_t * val) {
+	if (mem_access_in_page<uint32_t>(address))
+		return get_tlb_readhandler(address)->readd_checked(address,val);
+	return mem_unalignedreadd_checked(address,val);
+}
+
+bool mem_writeb_checked_slow(PhysPt address,uint8_t val) {
+	return get_tlb_writehandler(address)->writeb_checked(address,val);
+}
+
+bool mem_writew_checked_slow(PhysPt address,uint16_t val) {
+	if (mem_access_in_page<uint16_t>(address))
+		return get_tlb_writehandler(address)->writew_checked(address,val);
+	return mem_unalignedwritew_checked(address,val);
+}
+
+bool mem_writed_checked_slow(PhysPt address,uint32_t val) {
+	if (mem_access_in_page<uint32_t>(address))
+		return get_tlb_writehandler(address)->writed_checked(address,val);
+	return mem_unalignedwrited_checked(address,val);
+}
+
 uint8_t mem_readb(PhysPt address) {
 	return mem_readb_inline(address);
 }
@@ -639,6 +738,109 @@ HostPt GetMemBase(void)
 	return MemBase;
 }
 
+// Maps the RAM image copy-on-write: its pages are shared with the other
+// processes that map the same file until the guest writes to them
+static MemoryBlock::page_t* map_ram_image(const std::string& path,
+                                          const size_t num_bytes)
+{
+	std::error_code ec = {};
+	if (std_fs::file_size(path, ec) != num_bytes || ec) {
+		return nullptr;
+	}
+	void* data = nullptr;
+#if defined(WIN32)
+	const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+	                              nullptr, OPEN_EXISTING,
+	                              FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+	const auto mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY,
+	                                        0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) {
+		return nullptr;
+	}
+	// the view keeps the mapping open
+	data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, num_bytes);
+	CloseHandle(mapping);
+#elif defined(HAVE_MMAP)
+	const auto fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+	data = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		data = nullptr;
+	}
+#endif
+	return static_cast<MemoryBlock::page_t*>(data);
+}
+
+static void unmap_ram_image(MemoryBlock::page_t* data, const size_t num_bytes)
+{
+#if defined(WIN32)
+	(void)num_bytes;
+	UnmapViewOfFile(data);
+#elif defined(HAVE_MMAP)
+	munmap(data, num_bytes);
+#else
+	(void)data;
+	(void)num_bytes;
+#endif
+}
+
+bool MEM_WriteImage()
+{
+	auto& image = memory.image;
+	std::error_code ec = {};
+	if (image.path.empty() || image.is_mapped || std_fs::exists(image.path, ec)) {
+		return false;
+	}
+	// Write to a file of our own and move it in place, so the sessions
+	// that start meanwhile never map a partial image
+	const auto temp_path = image.path + "." +
+	                       std::to_string(std::random_device{}()) + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (!file) {
+		LOG_ERR("MEMORY: Can't write the RAM image '%s'", temp_path.c_str());
+		return false;
+	}
+	const auto num_bytes  = memory.pages.size() * dos_pagesize;
+	const bool is_written = fwrite(MemBase, 1, num_bytes, file) == num_bytes;
+	if (fclose(file) != 0 || !is_written) {
+		LOG_ERR("MEMORY: Failed writing the RAM image '%s'", temp_path.c_str());
+		std_fs::remove(temp_path, ec);
+		return false;
+	}
+	std_fs::rename(temp_path, image.path, ec);
+	if (ec) {
+		std_fs::remove(temp_path, ec);
+		return false;
+	}
+	LOG_MSG("MEMORY: Wrote the RAM image '%s'", image.path.c_str());
+	return true;
+}
+
+// The RAM itself is saved as a memory region; the mapping of the first
+// megabyte that follows the A20 gate is part of the paging state
+static void memory_save_state(SaveStateWriter& writer)
+{
+	writer.WriteBytes(memory.mhandles.data(),
+	                  memory.mhandles.size() * sizeof(memory.mhandles[0]));
+	writer.Write(memory.a20.enabled);
+	writer.Write(memory.a20.controlport);
+}
+
+static void memory_load_state(SaveStateReader& reader)
+{
+	reader.ReadBytes(memory.mhandles.data(),
+	                 memory.mhandles.size() * sizeof(memory.mhandles[0]));
+	reader.Read(memory.a20.enabled);
+	reader.Read(memory.a20.controlport);
+}
+
 class MEMORY final : public Module_base {
 private:
 	IO_ReadHandleObject ReadHandler   = {};
@@ -653,8 +855,22 @@ public:
 		check_num_megabytes(num_megabytes);
 		const auto num_pages = (num_megabytes * 1024 * 1024) / dos_pagesize;
 
-		// Size the actual memory pages
-		memory.pages.resize(num_pages);
+		// Map the memory pages from the RAM image if there's one,
+		// otherwise allocate them
+		auto& image     = memory.image;
+		image.path      = section->Get_path("memimage")->realpath;
+		image.is_mapped = false;
+		if (!image.path.empty()) {
+			const auto num_bytes = static_cast<size_t>(num_pages) *
+			                       dos_pagesize;
+			memory.pages.data = map_ram_image(image.path, num_bytes);
+			image.is_mapped   = (memory.pages.data != nullptr);
+		}
+		if (!image.is_mapped) {
+			memory.allocated_pages.resize(num_pages);
+			memory.pages.data = memory.allocated_pages.data();
+		}
+		memory.pages.count = num_pages;
 
 		// The MemBase is address of the the first page's first byte
 		MemBase = &(memory.pages[0].bytes[0]);
@@ -663,6 +879,14 @@ public:
 		        static_cast<int>(memory.pages.size()),
 		        num_megabytes,
 		        static_cast<void*>(MemBase));
+		if (image.is_mapped) {
+			LOG_MSG("MEMORY: Mapped the RAM copy-on-write from '%s'",
+			        image.path.c_str());
+		} else if (!image.path.empty()) {
+			LOG_MSG("MEMORY: The RAM image '%s' doesn't exist or has "
+			        "another size, it's written after loading a state",
+			        image.path.c_str());
+		}
 
 		// Setup the page handlers, defaulting to the RAM handler
 		memory.phandlers.clear();
@@ -698,6 +922,21 @@ public:
 		WriteHandler.Install(0x92, write_p92, io_width_t::byte);
 		ReadHandler.Install(0x92, read_p92, io_width_t::byte);
 		InitA20();
+
+		SAVESTATE_AddRegion("ram", MemBase, memory.pages.size() * dos_pagesize);
+		SAVESTATE_AddComponent("memory", 1, memory_save_state, memory_load_state);
+	}
+
+	~MEMORY() override
+	{
+		if (memory.image.is_mapped) {
+			SAVESTATE_RemoveRegion("ram");
+			unmap_ram_image(memory.pages.data,
+			                memory.pages.size() * dos_pagesize);
+			memory.pages           = {};
+			memory.image.is_mapped = false;
+			MemBase                = nullptr;
+		}
 	}
 };
 
@@ -48,6 +48,7 @@
 
 #include "../capture/capture.h"
 #include "ansi_code_markup.h"
+#include "benchmark.h"
 #include "control.h"
 #include "cross.h"
 #include "hardware.h"
@@ -58,6 +59,7 @@
 #include "mixer.h"
 #include "pic.h"
 #include "programs.h"
+#include "replay.h"
 #include "setup.h"
 #include "string_utils.h"
 #include "timer.h"
@@ -1472,12 +1474,21 @@ void MixerChannel::Sleeper::Listen(const AudioFrame &frame)
 	            fabsf(frame.right) > silent_threshold;
 }
 
+// While recording or replaying, the time is counted in emulated milliseconds
+// so channels fall asleep at the same points in both runs. The mixer is in
+// nosound mode then and mixes on the emulation thread, which owns PIC_Ticks.
+// Otherwise it's the host time, as the audio thread does the mixing.
+static int64_t sleeper_now_ms()
+{
+	return replay_active ? static_cast<int64_t>(PIC_Ticks) : GetTicks();
+}
+
 void MixerChannel::Sleeper::MaybeSleep()
 {
 	constexpr auto consider_sleeping_after_ms = 250;
 
 	// Not enough time has passed.. try again later
-	if (GetTicksSince(woken_at_ms) < consider_sleeping_after_ms)
+	if (sleeper_now_ms() - woken_at_ms < consider_sleeping_after_ms)
 		return;
 
 	// Stay awake if it's been noisy, otherwise we can sleep
@@ -1493,7 +1504,7 @@ void MixerChannel::Sleeper::MaybeSleep()
 bool MixerChannel::Sleeper::WakeUp()
 {
 	// Always reset for another round of awakeness
-	woken_at_ms = GetTicks();
+	woken_at_ms = sleeper_now_ms();
 	had_noise   = false;
 
 	const auto was_sleeping = !channel.is_enabled;
@@ -1975,11 +1986,14 @@ static void MIXER_MixData(const int frames_requested)
 	if (Mixer_irq_important())
 		mixer.tick_add = calc_tickadd(mixer.sample_rate);
 
+	BENCHMARK_AddAudioFrames(frames_requested - mixer.frames_done);
 	mixer.frames_done = frames_requested;
 }
 
 static void MIXER_Mix()
 {
+	BenchmarkScope scope(BenchmarkSection::Mixer);
+
 	MIXER_LockAudioDevice();
 	MIXER_MixData(mixer.frames_needed);
 	mixer.tick_counter += mixer.tick_add;
@@ -1997,6 +2011,8 @@ static void MIXER_ReduceChannelsDoneCounts(const int at_most)
 
 static void MIXER_Mix_NoSound()
 {
+	BenchmarkScope scope(BenchmarkSection::Mixer);
+
 	MIXER_LockAudioDevice();
 	MIXER_MixData(mixer.frames_needed);
 
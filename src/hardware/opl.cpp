@@ -28,6 +28,7 @@
 #include "cpu.h"
 #include "mapper.h"
 #include "mem.h"
+#include "savestate.h"
 #include "setup.h"
 #include "support.h"
 
@@ -836,6 +837,61 @@ static void SaveRad()
 }
 #endif
 
+void OPL::SaveState(SaveStateWriter& writer) const
+{
+	writer.Write(cache);
+	writer.Write(chip);
+	writer.Write(newm);
+	writer.Write(reg);
+	writer.Write(ctrl.index);
+	writer.Write(ctrl.lvol);
+	writer.Write(ctrl.rvol);
+	writer.Write(ctrl.active);
+}
+
+// The emulated chip points into itself, so rather than saving it the chip
+// is reset and the registers are written again from the cache. Notes that
+// were sounding restart from their attack phase.
+void OPL::LoadState(SaveStateReader& reader)
+{
+	RegisterCache saved_cache = {};
+	reader.Read(saved_cache);
+	reader.Read(chip);
+	reader.Read(newm);
+	reader.Read(reg);
+	reader.Read(ctrl.index);
+	reader.Read(ctrl.lvol);
+	reader.Read(ctrl.rvol);
+	reader.Read(ctrl.active);
+
+	const auto saved_newm = newm;
+	OPL3_Reset(&oplchip, check_cast<uint32_t>(channel->GetSampleRate()));
+
+	// The OPL3 mode bit decides how the second register set is handled
+	constexpr io_port_t opl3_mode_reg = 0x105;
+	WriteReg(opl3_mode_reg, saved_cache[opl3_mode_reg]);
+	for (io_port_t port = 0; port < ARRAY_LEN(saved_cache); ++port) {
+		if (port != opl3_mode_reg) {
+			WriteReg(port, saved_cache[port]);
+		}
+	}
+	memcpy(cache, saved_cache, sizeof(cache));
+	newm = saved_newm;
+
+	fifo             = {};
+	last_rendered_ms = PIC_FullIndex();
+}
+
+static void opl_save_state(SaveStateWriter& writer)
+{
+	opl->SaveState(writer);
+}
+
+static void opl_load_state(SaveStateReader& reader)
+{
+	opl->LoadState(reader);
+}
+
 static void OPL_SaveRawEvent(const bool pressed)
 {
 	if (!pressed)
@@ -969,6 +1025,7 @@ OPL::~OPL()
 
 void OPL_ShutDown([[maybe_unused]] Section* sec)
 {
+	SAVESTATE_RemoveComponent("opl");
 	opl = {};
 }
 
@@ -976,6 +1033,7 @@ void OPL_Init(Section* sec, const OplMode oplmode)
 {
 	assert(sec);
 	opl = std::make_unique<OPL>(sec, oplmode);
+	SAVESTATE_AddComponent("opl", 1, opl_save_state, opl_load_state);
 
 	constexpr auto changeable_at_runtime = true;
 	sec->AddDestroyFunction(&OPL_ShutDown, changeable_at_runtime);
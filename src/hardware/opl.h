@@ -78,6 +78,9 @@ typedef uint8_t RegisterCache[512];
 // Internal class used for dro capturing
 class Capture;
 
+class SaveStateReader;
+class SaveStateWriter;
+
 enum class Mode { Opl2, DualOpl2, Opl3, Opl3Gold };
 
 class OPL {
@@ -97,6 +100,9 @@ public:
 	// prevent assignment
 	OPL &operator=(const OPL &) = delete;
 
+	void SaveState(SaveStateWriter &writer) const;
+	void LoadState(SaveStateReader &reader);
+
 private:
 	IO_ReadHandleObject ReadHandler[3];
 	IO_WriteHandleObject WriteHandler[3];
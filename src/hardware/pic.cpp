@@ -21,6 +21,8 @@
 #include "cpu.h"
 #include "callback.h"
 #include "pic.h"
+#include "pic_event_queue.h"
+#include "savestate.h"
 #include "timer.h"
 #include "setup.h"
 
@@ -38,8 +40,6 @@
 // "master-slave" relationship, which is misleading given that fact that the
 // primary has no control over the secondary.
 
-#define PIC_QUEUESIZE 512
-
 struct PIC_Controller {
 	Bitu icw_words;
 	Bitu icw_index;
@@ -190,18 +190,7 @@ void PIC_Controller::start_irq(uint8_t val) {
 }
 
 
-struct PICEntry {
-	double index;
-	Bitu value;
-	PIC_EventHandler pic_event;
-	PICEntry * next;
-};
-
-static struct {
-	PICEntry entries[PIC_QUEUESIZE];
-	PICEntry * free_entry;
-	PICEntry * next_entry;
-} pic_queue;
+static PIC_EventQueue pic_queue;
 
 static void write_command(io_port_t port, io_val_t value, io_width_t)
 {
@@ -416,104 +405,45 @@ void PIC_SetIRQMask(uint32_t irq, bool masked)
 	pic->set_imr(newmask);
 }
 
-static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
-	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
-	if (cycles<CPU_Cycles) {
-		CPU_CycleLeft+=CPU_Cycles;
-		CPU_Cycles=0;
-	}
-}
 static bool InEventService = false;
 static double srv_lag = 0.0;
 
-void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val)
+PIC_EventHandle PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val)
 {
-	if (GCC_UNLIKELY(!pic_queue.free_entry)) {
-		LOG(LOG_PIC,LOG_ERROR)("Event queue full");
-		return;
+	PIC_EventQueue::Event event = {};
+	if (InEventService) event.index = delay + srv_lag;
+	else event.index = delay + PIC_TickIndex();
+	event.handler = handler;
+	event.value   = val;
+
+	const auto handle = pic_queue.Add(event);
+
+	/* End the current cycle run early if the first event is now due sooner */
+	const auto cycles = PIC_MakeCycles(pic_queue.Top().index - PIC_TickIndex());
+	if (cycles < CPU_Cycles) {
+		CPU_CycleLeft += CPU_Cycles;
+		CPU_Cycles = 0;
 	}
-	PICEntry * entry=pic_queue.free_entry;
-	if(InEventService) entry->index = delay + srv_lag;
-	else entry->index = delay + PIC_TickIndex();
-
-	entry->pic_event=handler;
-	entry->value=val;
-	pic_queue.free_entry=pic_queue.free_entry->next;
-	AddEntry(entry);
+	return handle;
+}
+
+bool PIC_RemoveEvent(PIC_EventHandle handle)
+{
+	return pic_queue.Remove(handle);
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val)
 {
-	PICEntry *entry = pic_queue.next_entry;
-	PICEntry *prev_entry;
-	prev_entry = 0;
-	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+	pic_queue.RemoveIf([=](const PIC_EventQueue::Event& event) {
+		return event.handler == handler && event.value == val;
+	});
 }
 
-void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
-	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+void PIC_RemoveEvents(PIC_EventHandler handler)
+{
+	pic_queue.RemoveIf([=](const PIC_EventQueue::Event& event) {
+		return event.handler == handler;
+	});
 }
 
 
@@ -529,24 +459,21 @@ bool PIC_RunQueue(void) {
 
 	/* Check the queue for an entry */
 	InEventService = true;
-	while (pic_queue.next_entry &&
-	       (pic_queue.next_entry->index * static_cast<double>(CPU_CycleMax) <= index_nd_f)) {
-		PICEntry *entry = pic_queue.next_entry;
-		pic_queue.next_entry = entry->next;
-
-		srv_lag = entry->index;
-		(entry->pic_event)(entry->value); // call the event handler
-
-		/* Put the entry in the free list */
-		entry->next=pic_queue.free_entry;
-		pic_queue.free_entry=entry;
+	while (!pic_queue.IsEmpty() &&
+	       (pic_queue.Top().index * static_cast<double>(CPU_CycleMax) <= index_nd_f)) {
+		/* Take the event off the queue first, the handler may add or
+		 * remove events */
+		const auto event = pic_queue.Pop();
+
+		srv_lag = event.index;
+		(event.handler)(event.value); // call the event handler
 	}
 	InEventService = false;
 
 	/* Check when to set the new cycle end */
-	if (pic_queue.next_entry) {
+	if (!pic_queue.IsEmpty()) {
 		auto cycles = static_cast<int32_t>(
-		        pic_queue.next_entry->index * static_cast<double>(CPU_CycleMax) -
+		        pic_queue.Top().index * static_cast<double>(CPU_CycleMax) -
 		        index_nd_f);
 		if (GCC_UNLIKELY(!cycles))
 			cycles = 1;
@@ -597,11 +524,7 @@ void TIMER_AddTick(void) {
 	CPU_Cycles=0;
 	PIC_Ticks++;
 	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0f;
-		entry=entry->next;
-	}
+	pic_queue.ShiftIndexes(1.0);
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
 	while (ticker) {
@@ -611,6 +534,39 @@ void TIMER_AddTick(void) {
 	}
 }
 
+static void pic_save_state(SaveStateWriter& writer)
+{
+	writer.Write(pics);
+	writer.Write(PIC_Ticks);
+	writer.Write(PIC_IRQCheck);
+
+	const auto events = pic_queue.GetEvents();
+	writer.Write(static_cast<uint32_t>(events.size()));
+	for (const auto& event : events) {
+		writer.Write(event.index);
+		writer.WriteFunction(event.handler);
+		writer.Write(event.value);
+	}
+}
+
+static void pic_load_state(SaveStateReader& reader)
+{
+	reader.Read(pics);
+	reader.Read(PIC_Ticks);
+	reader.Read(PIC_IRQCheck);
+
+	pic_queue.Clear();
+	uint32_t num_events = 0;
+	reader.Read(num_events);
+	for (uint32_t i = 0; i < num_events && reader.IsOk(); ++i) {
+		PIC_EventQueue::Event event = {};
+		reader.Read(event.index);
+		reader.ReadFunction(event.handler);
+		reader.Read(event.value);
+		pic_queue.Add(event);
+	}
+}
+
 /* Use full name to avoid name clash with compile option for position-independent code */
 class PIC_8259A final : public Module_base {
 private:
@@ -664,12 +620,9 @@ public:
 		WriteHandler[2].Install(0xa0, write_command, io_width_t::byte);
 		WriteHandler[3].Install(0xa1, write_data, io_width_t::byte);
 		/* Initialize the pic queue */
-		for (i=0;i<PIC_QUEUESIZE-1;i++) {
-			pic_queue.entries[i].next=&pic_queue.entries[i+1];
-		}
-		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-		pic_queue.free_entry=&pic_queue.entries[0];
-		pic_queue.next_entry=0;
+		pic_queue.Clear();
+
+		SAVESTATE_AddComponent("pic", 1, pic_save_state, pic_load_state);
 	}
 
 	~PIC_8259A(){
@@ -35,6 +35,7 @@
 #include "midi.h"
 #include "mixer.h"
 #include "pic.h"
+#include "savestate.h"
 #include "setup.h"
 #include "shell.h"
 #include "string_utils.h"
@@ -2112,6 +2113,68 @@ OplMode find_oplmode()
 	return opl_mode;
 }
 
+// The card type, its resources and its filters come from the configuration
+static void sblaster_save_state(SaveStateWriter& writer)
+{
+	writer.Write(sb.freq);
+	writer.Write(sb.dma);
+	const uint8_t dma_channel = sb.dma.chan ? sb.dma.chan->channum : UINT8_MAX;
+	writer.Write(dma_channel);
+	writer.Write(sb.speaker);
+	writer.Write(sb.midi);
+	writer.Write(sb.time_constant);
+	writer.Write(sb.mode);
+	writer.Write(sb.irq);
+	writer.Write(sb.dsp);
+	writer.Write(sb.dac);
+	writer.Write(sb.mixer);
+	writer.Write(sb.adpcm);
+	writer.Write(sb.e2);
+	writer.Write(ASP_regs);
+	writer.Write(ASP_init_in_progress);
+	writer.Write(last_dma_callback);
+	writer.WriteFunction(ProcessDMATransfer);
+
+	writer.Write(sb.chan ? sb.chan->GetSampleRate() : 0);
+	writer.Write(sb.chan && sb.chan->is_enabled);
+}
+
+static void sblaster_load_state(SaveStateReader& reader)
+{
+	reader.Read(sb.freq);
+	reader.Read(sb.dma);
+	uint8_t dma_channel = UINT8_MAX;
+	reader.Read(dma_channel);
+	sb.dma.chan = (dma_channel == UINT8_MAX) ? nullptr
+	                                         : GetDMAChannel(dma_channel);
+	reader.Read(sb.speaker);
+	reader.Read(sb.midi);
+	reader.Read(sb.time_constant);
+	reader.Read(sb.mode);
+	reader.Read(sb.irq);
+	reader.Read(sb.dsp);
+	reader.Read(sb.dac);
+	reader.Read(sb.mixer);
+	reader.Read(sb.adpcm);
+	reader.Read(sb.e2);
+	reader.Read(ASP_regs);
+	reader.Read(ASP_init_in_progress);
+	reader.Read(last_dma_callback);
+	reader.ReadFunction(ProcessDMATransfer);
+
+	int sample_rate_hz = 0;
+	bool is_enabled    = false;
+	reader.Read(sample_rate_hz);
+	reader.Read(is_enabled);
+	if (sb.chan) {
+		if (sample_rate_hz > 0) {
+			sb.chan->SetSampleRate(sample_rate_hz);
+		}
+		sb.chan->Enable(is_enabled);
+	}
+	CTMIXER_UpdateVolumes();
+}
+
 class SBLASTER final {
 private:
 	/* Data */
@@ -2340,6 +2403,7 @@ public:
 static std::unique_ptr<SBLASTER> sblaster = {};
 
 void SBLASTER_ShutDown(Section* /*sec*/) {
+	SAVESTATE_RemoveComponent("sblaster");
 	sblaster = {};
 }
 
@@ -2348,6 +2412,7 @@ void SBLASTER_Init(Section* sec)
 	assert(sec);
 
 	sblaster = std::make_unique<SBLASTER>(sec);
+	SAVESTATE_AddComponent("sblaster", 1, sblaster_save_state, sblaster_load_state);
 
 	constexpr auto changeable_at_runtime = true;
 	sec->AddDestroyFunction(&SBLASTER_ShutDown, changeable_at_runtime);
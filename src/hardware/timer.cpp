@@ -27,6 +27,7 @@
 #include "mem.h"
 #include "math_utils.h"
 #include "mixer.h"
+#include "savestate.h"
 #include "setup.h"
 
 const std::chrono::steady_clock::time_point system_start_time = std::chrono::steady_clock::now();
@@ -630,6 +631,22 @@ bool TIMER_GetOutput2()
 	return counter_output(channel_2);
 }
 
+static void pit_save_state(SaveStateWriter& writer)
+{
+	writer.Write(pit);
+	writer.Write(gate2);
+	writer.Write(latched_timerstatus);
+	writer.Write(latched_timerstatus_locked);
+}
+
+static void pit_load_state(SaveStateReader& reader)
+{
+	reader.Read(pit);
+	reader.Read(gate2);
+	reader.Read(latched_timerstatus);
+	reader.Read(latched_timerstatus_locked);
+}
+
 class TIMER final : public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[4];
@@ -683,6 +700,8 @@ public:
 		latched_timerstatus_locked=false;
 		gate2 = false;
 		PIC_AddEvent(PIT0_Event, channel_0.delay);
+
+		SAVESTATE_AddComponent("pit", 1, pit_save_state, pit_load_state);
 	}
 	~TIMER(){
 		PIC_RemoveEvents(PIT0_Event);
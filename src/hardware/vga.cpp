@@ -18,6 +18,7 @@
 
 #include "vga.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <utility>
@@ -26,6 +27,8 @@
 #include "logging.h"
 #include "math_utils.h"
 #include "pic.h"
+#include "render.h"
+#include "savestate.h"
 #include "video.h"
 
 VGA_Type vga;
@@ -39,7 +42,6 @@ uint32_t TXT_Font_Table[16];
 uint32_t TXT_FG_Table[16];
 uint32_t TXT_BG_Table[16];
 uint32_t ExpandTable[256];
-uint32_t Expand16Table[4][16];
 uint32_t FillTable[16];
 
 // Get the current video mode's type and numeric ID
@@ -399,6 +401,172 @@ static void set_vga_single_scanning_pref()
 	}
 }
 
+// The draw and Tandy state points into the RAM, the video memory or the
+// font; these pointers are saved as an area and an offset within it
+enum class VgaPointerArea : uint8_t { None, Ram, Linear, Fastmem, Font };
+
+static void write_vga_pointer(SaveStateWriter& writer, const uint8_t* pointer)
+{
+	const auto in_area = [&](const uint8_t* base, const size_t size) {
+		return base && pointer >= base && pointer < base + size;
+	};
+	// see VGA_SetupMemory for the sizes of the buffers
+	const auto linear_size = std::max(512u * 1024, vga.vmemsize) + 2048;
+
+	auto area           = VgaPointerArea::None;
+	const uint8_t* base = nullptr;
+	if (in_area(vga.mem.linear, linear_size)) {
+		area = VgaPointerArea::Linear;
+		base = vga.mem.linear;
+	} else if (in_area(vga.fastmem, linear_size * 2)) {
+		area = VgaPointerArea::Fastmem;
+		base = vga.fastmem;
+	} else if (in_area(vga.draw.font, sizeof(vga.draw.font))) {
+		area = VgaPointerArea::Font;
+		base = vga.draw.font;
+	} else if (in_area(MemBase, MEM_TotalPages() * 4096u)) {
+		area = VgaPointerArea::Ram;
+		base = MemBase;
+	}
+	writer.Write(area);
+	writer.Write(static_cast<uint64_t>(base ? pointer - base : 0));
+}
+
+static uint8_t* read_vga_pointer(SaveStateReader& reader)
+{
+	auto area       = VgaPointerArea::None;
+	uint64_t offset = 0;
+	reader.Read(area);
+	reader.Read(offset);
+	switch (area) {
+	case VgaPointerArea::Ram: return MemBase + offset;
+	case VgaPointerArea::Linear: return vga.mem.linear + offset;
+	case VgaPointerArea::Fastmem: return vga.fastmem + offset;
+	case VgaPointerArea::Font: return vga.draw.font + offset;
+	case VgaPointerArea::None: break;
+	}
+	return nullptr;
+}
+
+static void vga_save_state(SaveStateWriter& writer)
+{
+	writer.Write(vga.mode);
+	writer.Write(vga.misc_output);
+	writer.Write(vga.config);
+	writer.Write(vga.internal);
+	writer.Write(vga.seq.index);
+	writer.Write(vga.seq.reset);
+	writer.Write(vga.seq.clocking_mode.data);
+	writer.Write(vga.seq.map_mask);
+	writer.Write(vga.seq.character_map_select);
+	writer.Write(vga.seq.memory_mode);
+	writer.Write(vga.attr);
+	writer.Write(vga.crtc);
+	writer.Write(vga.gfx);
+	writer.Write(vga.dac);
+	writer.Write(vga.latch);
+	writer.Write(vga.s3);
+	writer.Write(vga.svga);
+	writer.Write(vga.herc);
+	writer.Write(vga.other);
+	writer.Write(vga.vmemwrap);
+	writer.Write(vga.lfb.page);
+	writer.Write(vga.lfb.addr);
+	writer.Write(vga.lfb.mask);
+
+	writer.Write(vga.tandy);
+	write_vga_pointer(writer, vga.tandy.draw_base);
+	write_vga_pointer(writer, vga.tandy.mem_base);
+
+	writer.Write(vga.draw);
+	write_vga_pointer(writer, vga.draw.linear_base);
+	write_vga_pointer(writer, vga.draw.font_tables[0]);
+	write_vga_pointer(writer, vga.draw.font_tables[1]);
+
+	writer.Write(CGA_2_Table);
+	writer.Write(CGA_4_Table);
+	writer.Write(CGA_4_HiRes_Table);
+	writer.Write(CGA_Composite_Table);
+	writer.Write(TXT_FG_Table);
+	writer.Write(TXT_BG_Table);
+}
+
+static void vga_load_state(SaveStateReader& reader)
+{
+	reader.Read(vga.mode);
+	reader.Read(vga.misc_output);
+	reader.Read(vga.config);
+	reader.Read(vga.internal);
+	reader.Read(vga.seq.index);
+	reader.Read(vga.seq.reset);
+	reader.Read(vga.seq.clocking_mode.data);
+	reader.Read(vga.seq.map_mask);
+	reader.Read(vga.seq.character_map_select);
+	reader.Read(vga.seq.memory_mode);
+	reader.Read(vga.attr);
+	reader.Read(vga.crtc);
+	reader.Read(vga.gfx);
+	reader.Read(vga.dac);
+	reader.Read(vga.latch);
+	reader.Read(vga.s3);
+	reader.Read(vga.svga);
+	reader.Read(vga.herc);
+	reader.Read(vga.other);
+	reader.Read(vga.vmemwrap);
+	reader.Read(vga.lfb.page);
+	reader.Read(vga.lfb.addr);
+	reader.Read(vga.lfb.mask);
+
+	reader.Read(vga.tandy);
+	vga.tandy.draw_base = read_vga_pointer(reader);
+	vga.tandy.mem_base  = read_vga_pointer(reader);
+
+	// The refresh rate settings and the override belong to the host
+	const auto host_refresh_hz       = vga.draw.host_refresh_hz;
+	const auto custom_refresh_hz     = vga.draw.custom_refresh_hz;
+	const auto dos_rate_mode         = vga.draw.dos_rate_mode;
+	const auto vga_override          = vga.draw.vga_override;
+	const auto sub_350_line_handling = vga.draw.vga_sub_350_line_handling;
+
+	reader.Read(vga.draw);
+	vga.draw.linear_base    = read_vga_pointer(reader);
+	vga.draw.font_tables[0] = read_vga_pointer(reader);
+	vga.draw.font_tables[1] = read_vga_pointer(reader);
+
+	vga.draw.host_refresh_hz           = host_refresh_hz;
+	vga.draw.custom_refresh_hz         = custom_refresh_hz;
+	vga.draw.dos_rate_mode             = dos_rate_mode;
+	vga.draw.vga_override              = vga_override;
+	vga.draw.vga_sub_350_line_handling = sub_350_line_handling;
+
+	reader.Read(CGA_2_Table);
+	reader.Read(CGA_4_Table);
+	reader.Read(CGA_4_HiRes_Table);
+	reader.Read(CGA_Composite_Table);
+	reader.Read(TXT_FG_Table);
+	reader.Read(TXT_BG_Table);
+
+	if (svgaCard == SVGA_S3Trio) {
+		VGA_StartUpdateLFB();
+	}
+	VGA_SetupHandlers();
+	VGA_RedrawFrame();
+
+	for (uint16_t i = 0; i < 256; ++i) {
+		const auto rgb = vga.dac.palette_map[i];
+		RENDER_SetPal(static_cast<uint8_t>(i),
+		              static_cast<uint8_t>(rgb >> 16),
+		              static_cast<uint8_t>(rgb >> 8),
+		              static_cast<uint8_t>(rgb));
+	}
+
+	// Drop the frame in progress and resize the output, the next vertical
+	// timer event starts drawing again
+	vga.draw.resizing = false;
+	vga.draw.width    = 0;
+	VGA_SetupDrawing(0);
+}
+
 void VGA_Init(Section* sec)
 {
 	set_vga_single_scanning_pref();
@@ -407,6 +575,8 @@ void VGA_Init(Section* sec)
 	vga.mode          = M_ERROR; // For first init
 	SVGA_Setup_Driver();
 	VGA_SetupMemory(sec);
+	VGA_SetFrameBatching(
+	        static_cast<Section_prop*>(sec)->Get_bool("vga_frame_batching"));
 	VGA_SetupMisc();
 	VGA_SetupDAC();
 	VGA_SetupGFX();
@@ -416,10 +586,11 @@ void VGA_Init(Section* sec)
 	VGA_SetupXGA();
 	VGA_SetClock(0,CLK_25);
 	VGA_SetClock(1,CLK_28);
+	SAVESTATE_AddComponent("vga", 1, vga_save_state, vga_load_state);
 /* Generate tables */
 	VGA_SetCGA2Table(0,1);
 	VGA_SetCGA4Table(0,1,2,3);
-	Bitu i,j;
+	Bitu i;
 	for (i=0;i<256;i++) {
 		ExpandTable[i]=i | (i << 8)| (i <<16) | (i << 24);
 	}
@@ -450,23 +621,6 @@ void VGA_Init(Section* sec)
 			((i & 8) ? 0x000000ff : 0) ;
 #endif
 	}
-	for (j=0;j<4;j++) {
-		for (i=0;i<16;i++) {
-#ifdef WORDS_BIGENDIAN
-			Expand16Table[j][i] =
-				((i & 1) ? 1 << j : 0) |
-				((i & 2) ? 1 << (8 + j) : 0) |
-				((i & 4) ? 1 << (16 + j) : 0) |
-				((i & 8) ? 1 << (24 + j) : 0);
-#else
-			Expand16Table[j][i] =
-				((i & 1) ? 1 << (24 + j) : 0) |
-				((i & 2) ? 1 << (16 + j) : 0) |
-				((i & 4) ? 1 << (8 + j) : 0) |
-				((i & 8) ? 1 << j : 0);
-#endif
-		}
-	}
 }
 
 void SVGA_Setup_Driver(void) {
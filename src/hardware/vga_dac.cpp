@@ -83,6 +83,8 @@ static void VGA_DAC_SendColor(uint8_t index, uint8_t src)
 	                                                   (g8 << 8) | b8);
 
 	RENDER_SetPal(index, r8, g8, b8);
+	VGA_RedrawFrame();
+	VGA_ChangedRasterRegister();
 }
 
 static void VGA_DAC_UpdateColor(uint16_t index)
@@ -22,9 +22,11 @@
 #include <array>
 #include <cmath>
 #include <cstring>
+#include <tuple>
 
 #include "../gui/render_scalers.h"
 #include "../ints/int10.h"
+#include "benchmark.h"
 #include "bitops.h"
 #include "math_utils.h"
 #include "mem_unaligned.h"
@@ -262,64 +264,59 @@ static uint8_t *VGA_Draw_CGA4_Composite_Line(Bitu vidstart, Bitu line)
 	return Composite_Process(vga.tandy.color_select & 0x0f, vga.draw.blocks, true);
 }
 
+// The pixels of each byte of the 4-bit modes, built from the attribute
+// palette whenever it's changed, to draw a byte with a single lookup
+static struct {
+	std::array<uint8_t, 16> palette = {};
+	std::array<uint16_t, 256> pairs = {};
+	std::array<uint32_t, 256> doubled_pairs = {};
+	bool is_valid = false;
+} packed_4bpp = {};
+
+static void update_packed_4bpp_pixels()
+{
+	auto& lut = packed_4bpp;
+	if (lut.is_valid &&
+	    memcmp(lut.palette.data(), vga.attr.palette, lut.palette.size()) == 0) {
+		return;
+	}
+	memcpy(lut.palette.data(), vga.attr.palette, lut.palette.size());
+	for (size_t byte = 0; byte < lut.pairs.size(); ++byte) {
+		const auto left  = lut.palette[byte >> 4];
+		const auto right = lut.palette[byte & 0x0f];
+
+		const uint8_t pair[]         = {left, right};
+		const uint8_t doubled_pair[] = {left, left, right, right};
+		memcpy(&lut.pairs[byte], pair, sizeof(pair));
+		memcpy(&lut.doubled_pairs[byte], doubled_pair, sizeof(doubled_pair));
+	}
+	lut.is_valid = true;
+}
+
 static uint8_t * VGA_Draw_4BPP_Line(Bitu vidstart, Bitu line) {
 	const uint8_t *base = vga.tandy.draw_base + ((line & vga.tandy.line_mask) << vga.tandy.line_shift);
-	uint8_t* draw=TempLine;
-	Bitu end = vga.draw.blocks*2;
-	while(end) {
-		uint8_t byte = base[vidstart & vga.tandy.addr_mask];
-		*draw++=vga.attr.palette[byte >> 4];
-		*draw++=vga.attr.palette[byte & 0x0f];
-		++vidstart;
-		--end;
+	update_packed_4bpp_pixels();
+
+	uint16_t i = 0;
+	for (Bitu x = vga.draw.blocks * 2; x > 0; --x, ++vidstart) {
+		const uint8_t byte = base[vidstart & vga.tandy.addr_mask];
+		write_unaligned_uint16_at(TempLine, i++, packed_4bpp.pairs[byte]);
 	}
 	return TempLine;
 }
 
 static uint8_t * VGA_Draw_4BPP_Line_Double(Bitu vidstart, Bitu line) {
 	const uint8_t *base = vga.tandy.draw_base + ((line & vga.tandy.line_mask) << vga.tandy.line_shift);
-	uint8_t* draw=TempLine;
-	Bitu end = vga.draw.blocks;
-	while(end) {
-		uint8_t byte = base[vidstart & vga.tandy.addr_mask];
-		uint8_t data = vga.attr.palette[byte >> 4];
-		*draw++ = data; *draw++ = data;
-		data = vga.attr.palette[byte & 0x0f];
-		*draw++ = data; *draw++ = data;
-		++vidstart;
-		--end;
-	}
-	return TempLine;
-}
+	update_packed_4bpp_pixels();
 
-#ifdef VGA_KEEP_CHANGES
-static uint8_t * VGA_Draw_Changes_Line(Bitu vidstart, Bitu line) {
-	Bitu checkMask = vga.changes.checkMask;
-	uint8_t *map = vga.changes.map;
-	Bitu start = (vidstart >> VGA_CHANGE_SHIFT);
-	Bitu end = ((vidstart + vga.draw.line_length ) >> VGA_CHANGE_SHIFT);
-	for (; start <= end; ++start) {
-		if ( map[start] & checkMask ) {
-			Bitu offset = vidstart & vga.draw.linear_mask;
-			if (vga.draw.linear_mask-offset < vga.draw.line_length)
-				memcpy(vga.draw.linear_base+vga.draw.linear_mask+1, vga.draw.linear_base, vga.draw.line_length);
-			uint8_t *ret = &vga.draw.linear_base[ offset ];
-#if !defined(C_UNALIGNED_MEMORY)
-			if (GCC_UNLIKELY( ((Bitu)ret) & (sizeof(Bitu)-1)) ) {
-				memcpy( TempLine, ret, vga.draw.line_length );
-				return TempLine;
-			}
-#endif
-			return ret;
-		}
+	uint16_t i = 0;
+	for (Bitu x = vga.draw.blocks; x > 0; --x, ++vidstart) {
+		const uint8_t byte = base[vidstart & vga.tandy.addr_mask];
+		write_unaligned_uint32_at(TempLine, i++, packed_4bpp.doubled_pairs[byte]);
 	}
-//	memset( TempLine, 0x30, vga.changes.lineWidth );
-//	return TempLine;
-	return 0;
+	return TempLine;
 }
 
-#endif
-
 static uint8_t * VGA_Draw_Linear_Line(Bitu vidstart, Bitu /*line*/) {
 	Bitu offset = vidstart & vga.draw.linear_mask;
 	uint8_t* ret = &vga.draw.linear_base[offset];
@@ -760,9 +757,126 @@ static uint8_t *VGA_TEXT_Herc_Draw_Line(Bitu vidstart, Bitu line)
 	}
 	return TempLine;
 }
+// What the text mode cells are drawn with, besides the font and the palette
+struct TextDrawState {
+	const uint8_t* font_tables[2] = {nullptr, nullptr};
+	uint8_t underline_line = 0;
+	uint8_t mode_control   = 0;
+	bool blinking          = false;
+	bool blink             = false;
+	bool is_eight_dot_mode = false;
+
+	static TextDrawState Current()
+	{
+		return {{vga.draw.font_tables[0], vga.draw.font_tables[1]},
+		        static_cast<uint8_t>(vga.crtc.underline_location & 0x1f),
+		        vga.attr.mode_control,
+		        vga.draw.blinking != 0,
+		        vga.draw.blink,
+		        vga.seq.clocking_mode.is_eight_dot_mode > 0};
+	}
+
+	bool operator==(const TextDrawState& other) const
+	{
+		return std::tie(font_tables[0], font_tables[1], underline_line,
+		                mode_control, blinking, blink, is_eight_dot_mode) ==
+		       std::tie(other.font_tables[0], other.font_tables[1],
+		                other.underline_line, other.mode_control,
+		                other.blinking, other.blink, other.is_eight_dot_mode);
+	}
+};
+
+// The pixels of a line of a character cell
+struct GlyphRow {
+	uint32_t generation = 0;
+	uint32_t cell       = 0;
+	std::array<uint32_t, PixelsPerChar::Nine> pixels = {};
+};
+
+// Holds the drawn glyph rows, keyed by the line, the attribute, which also
+// selects the font page, and the character. Text screens repeat a few cells
+// all over, so most rows are copied from here. A new generation of rows
+// starts when the font, the palette or the drawing state changes.
+constexpr int glyph_cache_bits = 12;
+
+static struct {
+	std::vector<GlyphRow> rows = std::vector<GlyphRow>(1 << glyph_cache_bits);
+	TextDrawState state = {};
+	uint32_t generation = 1;
+} glyph_cache;
+
+static void invalidate_glyph_cache()
+{
+	if (++glyph_cache.generation == 0) {
+		// Rows from the previous wrap-around could match again
+		std::fill(glyph_cache.rows.begin(), glyph_cache.rows.end(), GlyphRow{});
+		glyph_cache.generation = 1;
+	}
+}
+
+static void draw_glyph_row(const uint8_t chr, const uint8_t attr,
+                           const Bitu line, GlyphRow& row)
+{
+	// the font pattern
+	uint16_t font = vga.draw.font_tables[(attr >> 3) & 1][(chr << 5) + line];
+
+	uint8_t bg_palette_idx = attr >> 4;
+	// if blinking is enabled bit7 is not mapped to attributes
+	if (vga.draw.blinking) {
+		bg_palette_idx &= ~0x8;
+	}
+	// choose foreground color if blinking not set for this cell or
+	// blink on
+	const uint8_t fg_palette_idx = (vga.draw.blink || (attr & 0x80) == 0)
+	                                     ? (attr & 0xf)
+	                                     : bg_palette_idx;
+
+	// underline: all foreground [freevga: 0x77, previous 0x7]
+	if (GCC_UNLIKELY(((attr&0x77) == 0x01) &&
+		(vga.crtc.underline_location&0x1f)==line))
+		bg_palette_idx = fg_palette_idx;
+
+	// The font's bits will indicate which color is used per pixel
+	const auto fg_colour = vga.dac.palette_map[fg_palette_idx];
+	const auto bg_colour = vga.dac.palette_map[bg_palette_idx];
+
+	if (vga.seq.clocking_mode.is_eight_dot_mode) {
+		for (auto n = 0; n < 8; ++n) {
+			row.pixels[n] = (font & 0x80) ? fg_colour : bg_colour;
+			font <<= 1;
+		}
+	} else {
+		font <<= 1; // 9 pixels
+		// extend to the 9th pixel if needed
+		if ((font&0x2) && (vga.attr.mode_control&0x04) &&
+			(chr>=0xc0) && (chr<=0xdf)) font |= 1;
+		for (auto n = 0; n < 9; ++n) {
+			row.pixels[n] = (font & 0x100) ? fg_colour : bg_colour;
+			font <<= 1;
+		}
+	}
+}
+
+static const GlyphRow& get_glyph_row(const uint8_t chr, const uint8_t attr,
+                                     const Bitu line)
+{
+	const auto cell = static_cast<uint32_t>((line << 16) | (attr << 8) | chr);
+	auto& row = glyph_cache.rows[(cell * 2654435761u) >> (32 - glyph_cache_bits)];
+	if (row.generation != glyph_cache.generation || row.cell != cell) {
+		draw_glyph_row(chr, attr, line, row);
+		row.generation = glyph_cache.generation;
+		row.cell       = cell;
+	}
+	return row;
+}
+
 // combined 8/9-dot wide text mode line drawing function
 static uint8_t* draw_text_line_from_dac_palette(Bitu vidstart, Bitu line)
 {
+	if (const auto state = TextDrawState::Current(); !(state == glyph_cache.state)) {
+		glyph_cache.state = state;
+		invalidate_glyph_cache();
+	}
 	// pointer to chars+attribs
 	const uint8_t* vidmem  = VGA_Text_Memwrap(vidstart);
 	const auto palette_map = vga.dac.palette_map;
@@ -781,51 +895,19 @@ static uint8_t* draw_text_line_from_dac_palette(Bitu vidstart, Bitu line)
 	// pixel and also per character block.
 	auto draw_idx = draw_idx_start;
 
+	const auto pixels_per_char = vga.seq.clocking_mode.is_eight_dot_mode
+	                                   ? PixelsPerChar::Eight
+	                                   : PixelsPerChar::Nine;
+
 	while (blocks--) { // for each character in the line
 		const auto chr  = *vidmem++;
 		const auto attr = *vidmem++;
-		// the font pattern
-		uint16_t font = vga.draw.font_tables[(attr >> 3) & 1][(chr << 5) + line];
 
-		uint8_t bg_palette_idx = attr >> 4;
-		// if blinking is enabled bit7 is not mapped to attributes
-		if (vga.draw.blinking) {
-			bg_palette_idx &= ~0x8;
-		}
-		// choose foreground color if blinking not set for this cell or
-		// blink on
-		const uint8_t fg_palette_idx = (vga.draw.blink || (attr & 0x80) == 0)
-		                                     ? (attr & 0xf)
-		                                     : bg_palette_idx;
-
-		// underline: all foreground [freevga: 0x77, previous 0x7]
-		if (GCC_UNLIKELY(((attr&0x77) == 0x01) &&
-			(vga.crtc.underline_location&0x1f)==line))
-			bg_palette_idx = fg_palette_idx;
-
-		// The font's bits will indicate which color is used per pixel
-		const auto fg_colour = palette_map[fg_palette_idx];
-		const auto bg_colour = palette_map[bg_palette_idx];
-
-		if (vga.seq.clocking_mode.is_eight_dot_mode) {
-			for (auto n = 0; n < 8; ++n) {
-				const auto color = (font & 0x80) ? fg_colour
-				                                 : bg_colour;
-				write_unaligned_uint32_at(TempLine, draw_idx++, color);
-				font <<= 1;
-			}
-		} else {
-			font <<= 1; // 9 pixels
-			// extend to the 9th pixel if needed
-			if ((font&0x2) && (vga.attr.mode_control&0x04) &&
-				(chr>=0xc0) && (chr<=0xdf)) font |= 1;
-			for (auto n = 0; n < 9; ++n) {
-				const auto color = (font & 0x100) ? fg_colour
-				                                  : bg_colour;
-				write_unaligned_uint32_at(TempLine, draw_idx++, color);
-				font <<= 1;
-			}
-		}
+		const auto& row = get_glyph_row(chr, attr, line);
+		memcpy(&TempLine[draw_idx * sizeof(row.pixels[0])],
+		       row.pixels.data(),
+		       pixels_per_char * sizeof(row.pixels[0]));
+		draw_idx += pixels_per_char;
 	}
 	// draw the text mode cursor if needed
 	if (!SkipCursor(vidstart, line)) {
@@ -854,22 +936,105 @@ static uint8_t* draw_text_line_from_dac_palette(Bitu vidstart, Bitu line)
 	return TempLine + 32;
 }
 
-#ifdef VGA_KEEP_CHANGES
-static inline void VGA_ChangesEnd(void ) {
-	if ( vga.changes.active ) {
-//		vga.changes.active = false;
-		Bitu end = vga.draw.address >> VGA_CHANGE_SHIFT;
-		Bitu total = 4 + end - vga.changes.start;
-		uint32_t clearMask = vga.changes.clearMask;
-		total >>= 2;
-		uint32_t *clear = (uint32_t *)&vga.changes.map[  vga.changes.start & ~3 ];
-		while ( total-- ) {
-			clear[0] &= clearMask;
-			++clear;
+// The text of the character rows the last frame drew, to skip drawing the
+// rows that stay the same. The rows are told apart by their address, and
+// counted from the top of the frame.
+static struct {
+	std::vector<uint8_t> cells = {};
+	Bitu address               = 0;
+	Bitu cursor_address        = 0;
+	Bitu last_cursor_address   = 0;
+	size_t num_rows            = 0;
+	bool is_active             = false;
+	bool is_full_frame         = true;
+	bool is_row_unchanged      = false;
+} text_rows;
+
+void VGA_RedrawFrame()
+{
+	vga.changes.check_mask       = 0;
+	vga.changes.needs_full_frame = true;
+	text_rows.is_full_frame      = true;
+	text_rows.is_row_unchanged   = false;
+	invalidate_glyph_cache();
+}
+
+static bool is_text_row_unchanged(const Bitu vidstart)
+{
+	auto& rows = text_rows;
+	if (vidstart == rows.address && rows.num_rows > 0) {
+		return rows.is_row_unchanged;
+	}
+	// A new character row
+	rows.address = vidstart;
+
+	const auto row_bytes = static_cast<size_t>(vga.draw.blocks * 2);
+	const auto offset    = rows.num_rows++ * row_bytes;
+	if (rows.cells.size() < offset + row_bytes) {
+		rows.cells.resize(offset + row_bytes);
+		rows.is_full_frame = true;
+	}
+	const auto saved = &rows.cells[offset];
+	const auto cells = VGA_Text_Memwrap(vidstart);
+
+	// The rows with the cursor, or with where it was, are always drawn
+	const auto has_cursor = [&](const Bitu cursor_address) {
+		return cursor_address - vidstart < row_bytes;
+	};
+	rows.is_row_unchanged = !rows.is_full_frame &&
+	                        !has_cursor(vga.draw.cursor.address) &&
+	                        !has_cursor(rows.last_cursor_address) &&
+	                        memcmp(saved, cells, row_bytes) == 0;
+	memcpy(saved, cells, row_bytes);
+	return rows.is_row_unchanged;
+}
+
+// Checks if the line starting at the given address only shows video memory
+// that wasn't written since it was last drawn
+static bool is_line_unchanged(const Bitu vidstart)
+{
+	if (text_rows.is_active) {
+		return is_text_row_unchanged(vidstart);
+	}
+	auto& changes = vga.changes;
+	if (!changes.is_active) {
+		return false;
+	}
+	const auto offset = vidstart & vga.draw.linear_mask;
+	const auto end    = offset + changes.line_bytes;
+	if (end > vga.draw.linear_mask) {
+		// The wrapped lines are always drawn
+		return false;
+	}
+	const auto first_span = static_cast<uint32_t>(offset >> VGA_CHANGE_SHIFT);
+	const auto last_span = static_cast<uint32_t>((end - 1) >> VGA_CHANGE_SHIFT);
+	changes.first_span   = std::min(changes.first_span, first_span);
+	changes.last_span    = std::max(changes.last_span, last_span);
+
+	if (!changes.check_mask) {
+		return false;
+	}
+	for (auto span = first_span; span <= last_span; ++span) {
+		if (changes.map[span] & changes.check_mask) {
+			return false;
 		}
 	}
+	return true;
+}
+
+// Forgets the changes the frame has drawn, except the ones written while it
+// was drawn
+static void VGA_ChangesEnd()
+{
+	auto& changes = vga.changes;
+	if (!changes.is_active) {
+		return;
+	}
+	for (auto span = changes.first_span; span <= changes.last_span; ++span) {
+		changes.map[span] &= changes.clear_mask;
+	}
+	changes.is_active = false;
 }
-#endif
 
 
 static void VGA_ProcessSplit() {
@@ -899,6 +1064,8 @@ static uint16_t from_rgb_888_to_565(const uint32_t rgb888)
 static uint8_t bg_color_index = 0; // screen-off black index
 static void VGA_DrawSingleLine(uint32_t /*blah*/)
 {
+	BenchmarkScope scope(BenchmarkSection::VgaDraw);
+
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
 		switch(machine) {
 		case MCH_PCJR:
@@ -989,6 +1156,8 @@ static void VGA_DrawSingleLine(uint32_t /*blah*/)
 
 static void VGA_DrawEGASingleLine(uint32_t /*blah*/)
 {
+	BenchmarkScope scope(BenchmarkSection::VgaDraw);
+
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
 		std::fill(templine_buffer.begin(), templine_buffer.end(), 0);
 		RENDER_DrawLine(TempLine);
@@ -1013,9 +1182,17 @@ static void VGA_DrawEGASingleLine(uint32_t /*blah*/)
 
 static void VGA_DrawPart(uint32_t lines)
 {
+	BenchmarkScope scope(BenchmarkSection::VgaDraw);
+
 	while (lines--) {
-		uint8_t * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
-		RENDER_DrawLine(data);
+		if (is_line_unchanged(vga.draw.address)) {
+			// The renderer keeps the line it has
+			RENDER_DrawLine(nullptr);
+		} else {
+			uint8_t* data = VGA_DrawLine(vga.draw.address,
+			                             vga.draw.address_line);
+			RENDER_DrawLine(data);
+		}
 		++vga.draw.address_line;
 		if (vga.draw.address_line>=vga.draw.address_line_total) {
 			vga.draw.address_line=0;
@@ -1023,13 +1200,7 @@ static void VGA_DrawPart(uint32_t lines)
 		}
 		++vga.draw.lines_done;
 		if (vga.draw.split_line==vga.draw.lines_done) {
-#ifdef VGA_KEEP_CHANGES
-			VGA_ChangesEnd( );
-#endif
 			VGA_ProcessSplit();
-#ifdef VGA_KEEP_CHANGES
-			vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-#endif
 		}
 	}
 	if (--vga.draw.parts_left) {
@@ -1038,9 +1209,7 @@ static void VGA_DrawPart(uint32_t lines)
 		                     ? vga.draw.parts_lines
 		                     : (vga.draw.lines_total - vga.draw.lines_done));
 	} else {
-#ifdef VGA_KEEP_CHANGES
 		VGA_ChangesEnd();
-#endif
 		RENDER_EndUpdate(false);
 	}
 }
@@ -1063,28 +1232,137 @@ void VGA_SetBlinking(const uint8_t enabled)
 		                      ((b + i) << 16) | ((b + i) << 24);
 }
 
-#ifdef VGA_KEEP_CHANGES
-static void inline VGA_ChangesStart( void ) {
-	vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-	vga.changes.last = vga.changes.start;
-	if ( vga.changes.lastAddress != vga.draw.address ) {
-//		LOG_MSG("Address");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-		vga.changes.lastAddress = vga.draw.address;
-	} else if ( render.fullFrame ) {
-//		LOG_MSG("Full Frame");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-	} else {
-//		LOG_MSG("Changes");
-		VGA_DrawLine = VGA_Draw_Changes_Line;
-	}
-	vga.changes.active = true;
-	vga.changes.checkMask = vga.changes.writeMask;
-	vga.changes.clearMask = ~( 0x01010101 << (vga.changes.frame & 7));
-	++vga.changes.frame;
-	vga.changes.writeMask = 1 << (vga.changes.frame & 7);
+// What decides which video memory each line of a frame shows, and how
+struct FrameLayout {
+	VGA_Line_Handler draw_line = nullptr;
+	const uint8_t* linear_base = nullptr;
+	Bitu linear_mask           = 0;
+	Bitu address               = 0;
+	Bitu address_add           = 0;
+	Bitu address_line          = 0;
+	uint32_t address_line_total = 0;
+	uint32_t line_length       = 0;
+	uint32_t lines_total       = 0;
+	Bitu split_line            = 0;
+	uint16_t panning           = 0;
+	uint8_t mode_control       = 0;
+
+	static FrameLayout Current()
+	{
+		return {VGA_DrawLine,
+		        vga.draw.linear_base,
+		        vga.draw.linear_mask,
+		        vga.draw.address,
+		        vga.draw.address_add,
+		        vga.draw.address_line,
+		        vga.draw.address_line_total,
+		        vga.draw.line_length,
+		        vga.draw.lines_total,
+		        vga.draw.split_line,
+		        vga.draw.panning,
+		        vga.attr.mode_control};
+	}
+
+	bool operator==(const FrameLayout& other) const
+	{
+		return std::tie(draw_line, linear_base, linear_mask, address,
+		                address_add, address_line, address_line_total,
+		                line_length, lines_total, split_line, panning,
+		                mode_control) ==
+		       std::tie(other.draw_line, other.linear_base,
+		                other.linear_mask, other.address, other.address_add,
+		                other.address_line, other.address_line_total,
+		                other.line_length, other.lines_total,
+		                other.split_line, other.panning, other.mode_control);
+	}
+};
+
+// Returns the number of video memory bytes a line reads, if the line only
+// depends on the tracked memory and the palette
+static uint32_t get_tracked_line_bytes()
+{
+	switch (vga.mode) {
+	case M_VGA:
+		// The chained handler tracks the CPU addresses, which only
+		// match the fast memory
+		if (vga.config.chained && vga.config.compatible_chain4) {
+			if (vga.draw.linear_base != vga.fastmem) {
+				return 0;
+			}
+		} else if (vga.draw.linear_base != vga.mem.linear) {
+			return 0;
+		}
+		break;
+	case M_LIN8:
+	case M_LIN15:
+	case M_LIN16:
+	case M_LIN24:
+	case M_LIN32:
+		if (vga.draw.linear_base != vga.mem.linear) {
+			return 0;
+		}
+		break;
+	default: return 0;
+	}
+	// The palette drawers write four bytes per byte of memory, and the
+	// hardware cursor drawers aren't tracked at all
+	if (VGA_DrawLine == VGA_Draw_Linear_Line) {
+		return vga.draw.line_length;
+	}
+	if (VGA_DrawLine == draw_linear_line_from_dac_palette ||
+	    VGA_DrawLine == draw_unwrapped_line_from_dac_palette) {
+		return vga.draw.line_length / sizeof(vga.dac.palette_map[0]);
+	}
+	return 0;
+}
+
+// Checks if the text mode lines only depend on the text, the font and the
+// palette. The panned lines also show a character past the row.
+static bool are_text_rows_tracked()
+{
+	return IS_EGAVGA_ARCH && vga.mode == M_TEXT && !vga.draw.panning &&
+	       (VGA_DrawLine == VGA_TEXT_Draw_Line ||
+	        VGA_DrawLine == draw_text_line_from_dac_palette);
+}
+
+static void VGA_ChangesStart()
+{
+	static FrameLayout last_layout      = {};
+	static TextDrawState last_text_state = {};
+
+	auto& changes      = vga.changes;
+	changes.line_bytes = get_tracked_line_bytes();
+	changes.is_active  = changes.is_enabled && vga.draw.mode == PART &&
+	                    changes.line_bytes > 0;
+	text_rows.is_active = changes.is_enabled && vga.draw.mode == PART &&
+	                      are_text_rows_tracked();
+	if (!changes.is_active && !text_rows.is_active) {
+		changes.needs_full_frame = true;
+		return;
+	}
+
+	const auto layout     = FrameLayout::Current();
+	const auto text_state = TextDrawState::Current();
+	const auto is_full_frame = changes.needs_full_frame || render.fullFrame ||
+	                           !(layout == last_layout) ||
+	                           !(text_state == last_text_state);
+	last_layout              = layout;
+	last_text_state          = text_state;
+	changes.needs_full_frame = false;
+
+	if (text_rows.is_active) {
+		text_rows.is_full_frame       = is_full_frame;
+		text_rows.num_rows            = 0;
+		text_rows.last_cursor_address = text_rows.cursor_address;
+		text_rows.cursor_address      = vga.draw.cursor.address;
+		return;
+	}
+	changes.clear_mask = static_cast<uint8_t>(~changes.write_mask);
+	changes.write_mask ^= 0b11;
+	changes.check_mask = is_full_frame ? 0 : 0b11;
+	changes.first_span = UINT32_MAX;
+	changes.last_span  = 0;
 }
-#endif
 
 static void VGA_VertInterrupt(uint32_t /*val*/)
 {
@@ -1113,8 +1391,57 @@ static void VGA_PanningLatch(uint32_t /*val*/)
 	vga.draw.panning = vga.config.pel_panning;
 }
 
+// Draws each frame in one go at the end of the display period, while the
+// program doesn't change the registers the lines are drawn with mid-frame.
+// The frames are drawn in parts again as soon as it does.
+static struct {
+	bool is_enabled           = false;
+	bool has_mid_frame_change = false;
+	int clean_frames          = 0;
+	double display_start_ms   = 0.0;
+} frame_batching = {};
+
+// The number of frames without mid-frame changes before batching resumes
+constexpr int clean_frames_before_batching = 30;
+
+void VGA_SetFrameBatching(const bool enabled)
+{
+	frame_batching = {};
+	frame_batching.is_enabled = enabled;
+}
+
+void VGA_ChangedRasterRegister()
+{
+	// Only changes during the display period of a frame being drawn count
+	if (!frame_batching.is_enabled || !vga.draw.parts_left) {
+		return;
+	}
+	const auto frame_ms = PIC_FullIndex() - vga.draw.delay.framestart;
+	if (frame_ms > frame_batching.display_start_ms &&
+	    frame_ms < vga.draw.delay.vdend) {
+		frame_batching.has_mid_frame_change = true;
+	}
+}
+
+static bool should_batch_frame(const double display_start_ms)
+{
+	auto& batching = frame_batching;
+	if (batching.has_mid_frame_change) {
+		batching.clean_frames = 0;
+	} else if (batching.clean_frames < clean_frames_before_batching) {
+		++batching.clean_frames;
+	}
+	batching.has_mid_frame_change = false;
+	batching.display_start_ms     = display_start_ms;
+
+	return batching.is_enabled &&
+	       batching.clean_frames >= clean_frames_before_batching;
+}
+
 static void VGA_VerticalTimer(uint32_t /*val*/)
 {
+	BenchmarkScope scope(BenchmarkSection::VgaDraw);
+
 	vga.draw.delay.framestart = PIC_FullIndex();
 	PIC_AddEvent(VGA_VerticalTimer, vga.draw.delay.vtotal);
 
@@ -1174,9 +1501,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		++vga.draw.split_line; // EGA adds one buggy scanline
 	}
 //	if (machine==MCH_EGA) vga.draw.split_line = ((((vga.config.line_compare&0x5ff)+1)*2-1)/vga.draw.lines_scaled);
-#ifdef VGA_KEEP_CHANGES
-	bool startaddr_changed=false;
-#endif
 	switch (vga.mode) {
 	case M_EGA:
 		if (!(vga.crtc.mode_control&0x1)) vga.draw.linear_mask &= ~0x10000;
@@ -1187,9 +1511,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		vga.draw.address += vga.draw.bytes_skip;
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		if (machine!=MCH_EGA) vga.draw.address += vga.draw.panning;
-#ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
-#endif
 		break;
 	case M_VGA:
 		if (vga.config.compatible_chain4 && (vga.crtc.underline_location & 0x40)) {
@@ -1209,9 +1530,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		vga.draw.address += vga.draw.bytes_skip;
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		vga.draw.address += vga.draw.panning;
-#ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
-#endif
 		break;
 	case M_TEXT:
 		vga.draw.byte_panning_shift = 2;
@@ -1247,9 +1565,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		break;
 	}
 	if (GCC_UNLIKELY(vga.draw.split_line==0)) VGA_ProcessSplit();
-#ifdef VGA_KEEP_CHANGES
-	if (startaddr_changed) VGA_ChangesStart();
-#endif
 
 	// check if some lines at the top off the screen are blanked
 	double draw_skip = 0.0;
@@ -1257,6 +1572,7 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		draw_skip = vga.draw.delay.htotal * static_cast<double>(vga.draw.vblank_skip);
 		vga.draw.address += vga.draw.address_add * vga.draw.vblank_skip / vga.draw.address_line_total;
 	}
+	VGA_ChangesStart();
 
 	// add the draw event
 	switch (vga.draw.mode) {
@@ -1267,8 +1583,20 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 			RENDER_EndUpdate(true);
 		}
 		vga.draw.lines_done = 0;
-		vga.draw.parts_left = vga.draw.parts_total;
-		PIC_AddEvent(VGA_DrawPart, vga.draw.delay.parts + draw_skip, vga.draw.parts_lines);
+		if (should_batch_frame(draw_skip)) {
+			// Draw all lines when the last part would have been drawn
+			vga.draw.parts_left = 1;
+			PIC_AddEvent(VGA_DrawPart,
+			             vga.draw.delay.parts * vga.draw.parts_total + draw_skip,
+			             vga.draw.lines_total);
+			BENCHMARK_AddVgaFrame(true);
+		} else {
+			vga.draw.parts_left = vga.draw.parts_total;
+			PIC_AddEvent(VGA_DrawPart,
+			             vga.draw.delay.parts + draw_skip,
+			             vga.draw.parts_lines);
+			BENCHMARK_AddVgaFrame(false);
+		}
 		break;
 	case DRAWLINE:
 	case EGALINE:
@@ -1336,6 +1664,8 @@ void VGA_CheckScanLength(void) {
 		vga.draw.address_add=vga.draw.blocks*8;
 		break;
 	}
+	// the new line length applies from the next line drawn
+	VGA_ChangedRasterRegister();
 }
 
 // If the hardware mouse cursor is activated, this function changes the VGA line
@@ -2108,11 +2438,7 @@ void VGA_SetupDrawing(uint32_t /*val*/)
 	vga.draw.vblank_skip = vblank_skip;
 	setup_line_drawing_delays(height);
 	vga.draw.line_length = width * ((bpp + 1) / 8);
-#ifdef VGA_KEEP_CHANGES
-	vga.changes.active = false;
-	vga.changes.frame = 0;
-	vga.changes.writeMask = 1;
-#endif
+	VGA_RedrawFrame();
 	// Use square pixels for all non-tweaked modes with 4:3 storage pixel
 	// aspect ratio (e.g., 320x240, 400x300, 640x480, 1024x768, etc.)
 	// The calculated PARs for these modes are not exactly 1:1, but they are
@@ -18,15 +18,18 @@
 
 #include "dosbox.h"
 
+#include <array>
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
 
+#include "byteorder.h"
 #include "inout.h"
 #include "mem.h"
 #include "mem_host.h"
 #include "paging.h"
 #include "pic.h"
+#include "savestate.h"
 #include "setup.h"
 #include "vga.h"
 
@@ -48,12 +51,7 @@
 #define CHECKED4(v) ((v)&((vga.vmemwrap>>2)-1))
 
 
-#ifdef VGA_KEEP_CHANGES
-#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] |= vga.changes.writeMask;
-//#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] = 1;
-#else
-#define MEM_CHANGED( _MEM ) 
-#endif
+#define MEM_CHANGED( _MEM ) VGA_MemoryChanged(_MEM);
 
 #define TANDY_VIDBASE(_X_)  &MemBase[ 0x80000 + (_X_)]
 
@@ -104,6 +102,65 @@ inline static uint32_t ModeOperation(uint8_t val) {
 	return full;
 }
 
+// Writes the bytes of the value to the planes enabled by the map mask. The
+// latches stay the same during the write, so the write mode is applied to all
+// bytes first, leaving a merge over consecutive dwords that gets vectorized.
+template <int num_bytes>
+static inline void write_planes(const PhysPt start, const uint32_t val)
+{
+	uint32_t data[num_bytes];
+	for (int i = 0; i < num_bytes; ++i) {
+		data[i] = ModeOperation(static_cast<uint8_t>(val >> (i * 8)));
+	}
+	const auto not_map_mask = vga.config.full_not_map_mask;
+	const auto map_mask     = vga.config.full_map_mask;
+
+	auto planes = reinterpret_cast<uint32_t*>(vga.mem.linear) + start;
+	for (int i = 0; i < num_bytes; ++i) {
+		planes[i] = (planes[i] & not_map_mask) | (data[i] & map_mask);
+	}
+}
+
+// Spreads the bits of a plane byte over the bytes of the result, with the
+// high bit going to the lowest byte. The shifted copies of the byte are 9
+// bits apart, so the multiplication can't carry between them.
+static constexpr uint64_t spread_plane(const uint64_t plane)
+{
+	return host_to_le64(((plane * 0x8040201008040201) >> 7) & 0x0101010101010101);
+}
+
+static constexpr auto generate_plane_lut()
+{
+	std::array<uint64_t, 256> lut = {};
+	for (size_t i = 0; i < lut.size(); ++i) {
+		lut[i] = spread_plane(i);
+	}
+	return lut;
+}
+
+// The memory handlers convert 1 to 4 groups per write, too few for SSE2 to
+// beat the table lookups
+void VGA_PlanesToPixels(const uint8_t* planes, uint8_t* pixels, const size_t num_groups)
+{
+	static constexpr auto plane_lut = generate_plane_lut();
+
+	for (size_t i = 0; i < num_groups; ++i) {
+		const auto group = planes + i * 4;
+		const auto value = plane_lut[group[0]] | (plane_lut[group[1]] << 1) |
+		                   (plane_lut[group[2]] << 2) |
+		                   (plane_lut[group[3]] << 3);
+		memcpy(pixels + i * 8, &value, sizeof(value));
+	}
+}
+
+// Updates the pixel buffer from the planes of the given bytes
+static inline void update_ega_pixels(const PhysPt start, const int num_bytes)
+{
+	VGA_PlanesToPixels(&vga.mem.linear[start * 4],
+	                   &vga.fastmem[start * 8],
+	                   num_bytes);
+}
+
 /* Gonna assume that whoever maps vga memory, maps it on 32/64kb boundary */
 
 #define VGA_PAGES		(128/4)
@@ -167,28 +224,8 @@ public:
 	void writeHandler(PhysPt start, uint8_t val) {
 		ModeOperation(val);
 		/* Update video memory and the pixel buffer */
-		VGA_Latch pixels;
 		vga.mem.linear[start] = val;
-		start >>= 2;
-		pixels.d=((uint32_t*)vga.mem.linear)[start];
-
-		uint8_t * write_pixels=&vga.fastmem[start<<3];
-
-		uint32_t colors0_3, colors4_7;
-		VGA_Latch temp;temp.d=(pixels.d>>4) & 0x0f0f0f0f;
-		colors0_3 = 
-			Expand16Table[0][temp.b[0]] |
-			Expand16Table[1][temp.b[1]] |
-			Expand16Table[2][temp.b[2]] |
-			Expand16Table[3][temp.b[3]];
-		*(uint32_t *)write_pixels=colors0_3;
-		temp.d=pixels.d & 0x0f0f0f0f;
-		colors4_7 = 
-			Expand16Table[0][temp.b[0]] |
-			Expand16Table[1][temp.b[1]] |
-			Expand16Table[2][temp.b[2]] |
-			Expand16Table[3][temp.b[3]];
-		*(uint32_t *)(write_pixels+4)=colors4_7;
+		update_ega_pixels(start >> 2, 1);
 	}
 public:	
 	VGA_ChainedEGA_Handler()  {
@@ -200,7 +237,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr >> 2) << 3);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 	}
 
@@ -209,7 +246,8 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr >> 2) << 3);
+		MEM_CHANGED( ((addr + 1) >> 2) << 3);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 	}
@@ -219,7 +257,8 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr >> 2) << 3);
+		MEM_CHANGED( ((addr + 3) >> 2) << 3);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 		writeHandler(addr+2,(uint8_t)(val >> 16));
@@ -257,31 +296,12 @@ public:
 
 class VGA_UnchainedEGA_Handler : public VGA_UnchainedRead_Handler {
 public:
-	void writeHandler(PhysPt start, uint8_t val) {
-		uint32_t data=ModeOperation(val);
+	template <int num_bytes>
+	void writeHandler(PhysPt start, uint32_t val)
+	{
 		/* Update video memory and the pixel buffer */
-		VGA_Latch pixels;
-		pixels.d=((uint32_t*)vga.mem.linear)[start];
-		pixels.d&=vga.config.full_not_map_mask;
-		pixels.d|=(data & vga.config.full_map_mask);
-		((uint32_t*)vga.mem.linear)[start]=pixels.d;
-		uint8_t * write_pixels=&vga.fastmem[start<<3];
-
-		uint32_t colors0_3, colors4_7;
-		VGA_Latch temp;temp.d=(pixels.d>>4) & 0x0f0f0f0f;
-			colors0_3 = 
-			Expand16Table[0][temp.b[0]] |
-			Expand16Table[1][temp.b[1]] |
-			Expand16Table[2][temp.b[2]] |
-			Expand16Table[3][temp.b[3]];
-		*(uint32_t *)write_pixels=colors0_3;
-		temp.d=pixels.d & 0x0f0f0f0f;
-		colors4_7 = 
-			Expand16Table[0][temp.b[0]] |
-			Expand16Table[1][temp.b[1]] |
-			Expand16Table[2][temp.b[2]] |
-			Expand16Table[3][temp.b[3]];
-		*(uint32_t *)(write_pixels+4)=colors4_7;
+		write_planes<num_bytes>(start, val);
+		update_ega_pixels(start, num_bytes);
 	}
 public:	
 	VGA_UnchainedEGA_Handler()  {
@@ -294,7 +314,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 3);
-		writeHandler(addr+0,(uint8_t)(val >> 0));
+		writeHandler<1>(addr, val);
 	}
 
 	void writew(PhysPt addr, uint16_t val)
@@ -303,8 +323,8 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 3);
-		writeHandler(addr+0,(uint8_t)(val >> 0));
-		writeHandler(addr+1,(uint8_t)(val >> 8));
+		MEM_CHANGED( (addr + 1) << 3);
+		writeHandler<2>(addr, val);
 	}
 
 	void writed(PhysPt addr, uint32_t val)
@@ -313,10 +333,8 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 3);
-		writeHandler(addr+0,(uint8_t)(val >> 0));
-		writeHandler(addr+1,(uint8_t)(val >> 8));
-		writeHandler(addr+2,(uint8_t)(val >> 16));
-		writeHandler(addr+3,(uint8_t)(val >> 24));
+		MEM_CHANGED( (addr + 3) << 3);
+		writeHandler<4>(addr, val);
 	}
 };
 
@@ -441,7 +459,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED( addr );
-//		MEM_CHANGED( addr + 1);
+		MEM_CHANGED( addr + 1);
 		if (GCC_UNLIKELY(addr & 1)) {
 			writeHandler_byte(addr + 0, val >> 0);
 			writeHandler_byte(addr + 1, val >> 8);
@@ -457,7 +475,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED( addr );
-//		MEM_CHANGED( addr + 3);
+		MEM_CHANGED( addr + 3);
 		if (GCC_UNLIKELY(addr & 3)) {
 			writeHandler_byte(addr + 0, val >> 0);
 			writeHandler_byte(addr + 1, val >> 8);
@@ -472,13 +490,10 @@ public:
 
 class VGA_UnchainedVGA_Handler final : public VGA_UnchainedRead_Handler {
 public:
-	void writeHandler( PhysPt addr, uint8_t val ) {
-		uint32_t data=ModeOperation(val);
-		VGA_Latch pixels;
-		pixels.d=((uint32_t*)vga.mem.linear)[addr];
-		pixels.d&=vga.config.full_not_map_mask;
-		pixels.d|=(data & vga.config.full_map_mask);
-		((uint32_t*)vga.mem.linear)[addr]=pixels.d;
+	template <int num_bytes>
+	void writeHandler(PhysPt addr, uint32_t val)
+	{
+		write_planes<num_bytes>(addr, val);
 //		if(vga.config.compatible_chain4)
 //			((uint32_t*)vga.mem.linear)[CHECKED2(addr+64*1024)]=pixels.d; 
 	}
@@ -493,7 +508,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 2 );
-		writeHandler(addr+0,(uint8_t)(val >> 0));
+		writeHandler<1>(addr, val);
 	}
 
 	void writew(PhysPt addr, uint16_t val)
@@ -502,8 +517,8 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 2);
-		writeHandler(addr+0,(uint8_t)(val >> 0));
-		writeHandler(addr+1,(uint8_t)(val >> 8));
+		MEM_CHANGED( (addr + 1) << 2);
+		writeHandler<2>(addr, val);
 	}
 
 	void writed(PhysPt addr, uint32_t val)
@@ -512,10 +527,8 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 2);
-		writeHandler(addr+0,(uint8_t)(val >> 0));
-		writeHandler(addr+1,(uint8_t)(val >> 8));
-		writeHandler(addr+2,(uint8_t)(val >> 16));
-		writeHandler(addr+3,(uint8_t)(val >> 24));
+		MEM_CHANGED( (addr + 3) << 2);
+		writeHandler<4>(addr, val);
 	}
 };
 
@@ -544,6 +557,10 @@ public:
 	{
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		
+		if (vga.seq.map_mask & 0x4) {
+			// The font is drawn from a cache, and isn't tracked
+			VGA_RedrawFrame();
+		}
 		if (GCC_LIKELY(vga.seq.map_mask == 0x4)) {
 			vga.draw.font[addr] = val;
 		} else {
@@ -617,6 +634,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED(addr);
+		MEM_CHANGED(addr + 1);
 		host_writew_at(vga.mem.linear, addr, val);
 	}
 
@@ -626,6 +644,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED(addr);
+		MEM_CHANGED(addr + 3);
 		host_writed_at(vga.mem.linear, addr, val);
 	}
 };
@@ -640,7 +659,7 @@ public:
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
-		writeHandler(addr+0,(uint8_t)(val >> 0));
+		writeHandler<1>(addr, val);
 	}
 
 	void writew(PhysPt addr, uint16_t val)
@@ -648,8 +667,8 @@ public:
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
-		writeHandler(addr+0,(uint8_t)(val >> 0));
-		writeHandler(addr+1,(uint8_t)(val >> 8));
+		MEM_CHANGED( (addr + 1) << 3 );
+		writeHandler<2>(addr, val);
 	}
 
 	void writed(PhysPt addr, uint32_t val)
@@ -657,10 +676,8 @@ public:
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
-		writeHandler(addr+0,(uint8_t)(val >> 0));
-		writeHandler(addr+1,(uint8_t)(val >> 8));
-		writeHandler(addr+2,(uint8_t)(val >> 16));
-		writeHandler(addr+3,(uint8_t)(val >> 24));
+		MEM_CHANGED( (addr + 3) << 3 );
+		writeHandler<4>(addr, val);
 	}
 
 	uint8_t readb(PhysPt addr)
@@ -731,6 +748,7 @@ public:
 		addr = CHECKED(addr);
 		host_writew_at(vga.mem.linear, addr, val);
 		MEM_CHANGED( addr );
+		MEM_CHANGED( addr + 1 );
 	}
 
 	void writed(PhysPt addr, uint32_t val)
@@ -739,6 +757,7 @@ public:
 		addr = CHECKED(addr);
 		host_writed_at(vga.mem.linear, addr, val);
 		MEM_CHANGED( addr );
+		MEM_CHANGED( addr + 3 );
 	}
 };
 
@@ -890,6 +909,16 @@ static struct vg {
 	VGA_Empty_Handler empty = {};
 } vgaph;
 
+// Mapping the memory directly is faster, but bypasses the tracking of the
+// changed memory
+static PageHandler* get_linear_handler()
+{
+	if (vga.changes.is_enabled) {
+		return &vgaph.changes;
+	}
+	return &vgaph.map;
+}
+
 void VGA_ChangedBank(void) {
 #ifndef VGA_LFB_MAPPED
 	//If the mode is accurate than the correct mapper must have been installed already
@@ -966,7 +995,7 @@ void VGA_SetupHandlers(void) {
 	case M_LIN24:
 	case M_LIN32:
 #ifdef VGA_LFB_MAPPED
-		newHandler = &vgaph.map;
+		newHandler = get_linear_handler();
 #else
 		newHandler = &vgaph.changes;
 #endif
@@ -978,7 +1007,7 @@ void VGA_SetupHandlers(void) {
 				newHandler = &vgaph.cvga;
 			else 
 #ifdef VGA_LFB_MAPPED
-				newHandler = &vgaph.map;
+				newHandler = get_linear_handler();
 #else
 				newHandler = &vgaph.changes;
 #endif
@@ -1041,14 +1070,19 @@ void VGA_SetupHandlers(void) {
 	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10))
 		MEM_SetPageHandler(VGA_PAGE_A0, 16, &vgaph.mmio);
 range_done:
-	PAGING_ClearTLB();
+	// only the handlers of the legacy VGA window were changed
+	PAGING_UnlinkPhysPages(VGA_PAGE_A0,32);
 }
 
 void VGA_StartUpdateLFB(void) {
 	vga.lfb.page = vga.s3.la_window << 4;
 	vga.lfb.addr = vga.s3.la_window << 16;
 #ifdef VGA_LFB_MAPPED
-	vga.lfb.handler = &vgaph.lfb;
+	if (vga.changes.is_enabled) {
+		vga.lfb.handler = &vgaph.lfbchanges;
+	} else {
+		vga.lfb.handler = &vgaph.lfb;
+	}
 #else
 	vga.lfb.handler = &vgaph.lfbchanges;
 #endif
@@ -1056,11 +1090,6 @@ void VGA_StartUpdateLFB(void) {
 }
 
 static void VGA_Memory_ShutDown(Section * /*sec*/) {
-#ifdef VGA_KEEP_CHANGES
-	delete[] vga.changes.map;
-	vga.mem.linear = {};
-	vga.fastmem    = {};
-#endif
 }
 
 void VGA_SetupMemory(Section* sec)
@@ -1097,16 +1126,24 @@ void VGA_SetupMemory(Section* sec)
 	                                                           num_fastmem_bytes);
 	assert(reinterpret_cast<uintptr_t>(vga.fastmem) % vmem_alignment == 0);
 
+	SAVESTATE_AddRegion("vram", vga.mem.linear, num_linear_bytes);
+	SAVESTATE_AddRegion("vga_fastmem", vga.fastmem, num_fastmem_bytes);
+
 	// In most cases these values stay the same. Assumptions: vmemwrap is power of 2,
 	// vmemwrap <= vmemsize, fastmem implicitly has mem wrap twice as big
 	vga.vmemwrap = vga.vmemsize;
 
-#ifdef VGA_KEEP_CHANGES
-	memset( &vga.changes, 0, sizeof( vga.changes ));
-	int changesMapSize = (vga.vmemsize >> VGA_CHANGE_SHIFT) + 32;
-	vga.changes.map = new uint8_t[changesMapSize];
-	memset(vga.changes.map, 0, changesMapSize);
-#endif
+	// The change map covers the fast memory, which is twice the size of
+	// the linear memory; a power of 2 lets the handlers wrap it with a mask
+	size_t num_spans = 1;
+	while (num_spans < (num_fastmem_bytes >> VGA_CHANGE_SHIFT)) {
+		num_spans <<= 1;
+	}
+	vga.changes = {};
+	vga.changes.map.assign(num_spans, 0);
+
+	const auto section = static_cast<Section_prop*>(sec);
+	vga.changes.is_enabled = section->Get_bool("vga_dirty_tracking");
 	vga.svga.bank_read = vga.svga.bank_write = 0;
 	vga.svga.bank_read_full = vga.svga.bank_write_full = 0;
 	vga.svga.bank_size = 0x10000; /* most common bank size is 64K */
@@ -156,18 +156,22 @@ void XGA_DrawPoint(Bitu x, Bitu y, Bitu c) {
 		case M_LIN8:
 			if (GCC_UNLIKELY(memaddr >= vga.vmemsize)) break;
 			vga.mem.linear[memaddr] = c;
+			VGA_MemoryChanged(memaddr);
 			break;
 		case M_LIN15:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.vmemsize)) break;
 			((uint16_t*)(vga.mem.linear))[memaddr] = (uint16_t)(c&0x7fff);
+			VGA_MemoryChanged(memaddr * 2);
 			break;
 		case M_LIN16:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.vmemsize)) break;
 			((uint16_t*)(vga.mem.linear))[memaddr] = (uint16_t)(c&0xffff);
+			VGA_MemoryChanged(memaddr * 2);
 			break;
 		case M_LIN32:
 			if (GCC_UNLIKELY(memaddr*4 >= vga.vmemsize)) break;
 			((uint32_t*)(vga.mem.linear))[memaddr] = c;
+			VGA_MemoryChanged(memaddr * 4);
 			break;
 		default:
 			break;
@@ -33,16 +33,11 @@
 #include "pci_bus.h"
 #include "pic.h"
 #include "regs.h"
+#include "replay.h"
 #include "serialport.h"
 #include "setup.h"
 #include <time.h>
 
-#if defined(HAVE_CLOCK_GETTIME) && !defined(WIN32)
-// time.h is already included
-#else
-#include <sys/timeb.h>
-#endif
-
 // Reference:
 // - Ralf Brown's Interrupt List
 // - https://www.stanislavs.org/helppc/idx_interrupt.html
@@ -508,25 +503,11 @@ static Bitu INT11_Handler(void) {
 #endif
 
 static void BIOS_HostTimeSync() {
-	uint32_t milli = 0;
-	// TODO investigate if clock_gettime and ftime can be replaced
-	// by using C++11 chrono
-#if defined(HAVE_CLOCK_GETTIME) && !defined(WIN32)
-	struct timespec tp;
-	clock_gettime(CLOCK_REALTIME,&tp);
-
-	struct tm *loctime;
-	loctime = localtime(&tp.tv_sec);
-	milli = (uint32_t) (tp.tv_nsec / 1000000);
-#else
-	/* Setup time and date */
-	struct timeb timebuffer;
-	ftime(&timebuffer);
+	struct tm datetime = {};
+	uint32_t milli     = 0;
+	REPLAY_GetLocalTime(datetime, milli);
+	struct tm* loctime = &datetime;
 
-	struct tm *loctime;
-	loctime = localtime (&timebuffer.time);
-	milli = (uint32_t) timebuffer.millitm;
-#endif
 	/*
 	loctime->tm_hour = 23;
 	loctime->tm_min = 59;
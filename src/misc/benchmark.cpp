@@ -0,0 +1,290 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "benchmark.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#if defined(WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "control.h"
+#include "cpu.h"
+#include "cycle_governor.h"
+#include "dosbox.h"
+#include "logging.h"
+#include "video.h"
+
+extern bool ticksLocked;
+
+bool benchmark_running = false;
+
+static struct {
+	int64_t duration_ms = 0;
+	int64_t ticks       = 0;
+	bool started        = false;
+
+	std::chrono::steady_clock::time_point start_time = {};
+
+	// the cycles of the running tick, and the removed cycles when it started
+	int64_t tick_cycles  = 0;
+	int64_t tick_removed = 0;
+	bool in_tick         = false;
+
+	int64_t cycles       = 0;
+	int64_t frames       = 0;
+	int64_t audio_frames = 0;
+
+	int64_t batched_vga_frames  = 0;
+	int64_t vga_frames_in_parts = 0;
+
+	std::array<int64_t, static_cast<size_t>(BenchmarkSection::NumSections)> section_ns = {};
+	BenchmarkScope* current_scope = nullptr;
+} bench = {};
+
+static int64_t now_ns()
+{
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void BenchmarkScope::Enter(const BenchmarkSection _section)
+{
+	section  = _section;
+	parent   = bench.current_scope;
+	start_ns = now_ns();
+	active   = true;
+
+	bench.current_scope = this;
+}
+
+void BenchmarkScope::Leave()
+{
+	const auto elapsed_ns = now_ns() - start_ns;
+	bench.section_ns[static_cast<size_t>(section)] += elapsed_ns - nested_ns;
+	if (parent) {
+		parent->nested_ns += elapsed_ns;
+	}
+	bench.current_scope = parent;
+}
+
+void BENCHMARK_Start(const int emulated_seconds)
+{
+	bench.duration_ms = static_cast<int64_t>(emulated_seconds) * 1000;
+	benchmark_running = true;
+}
+
+void BENCHMARK_AddFrame()
+{
+	if (benchmark_running) {
+		++bench.frames;
+	}
+}
+
+void BENCHMARK_AddVgaFrame(const bool is_batched)
+{
+	if (benchmark_running) {
+		++(is_batched ? bench.batched_vga_frames : bench.vga_frames_in_parts);
+	}
+}
+
+void BENCHMARK_AddAudioFrames(const int num_frames)
+{
+	if (benchmark_running) {
+		bench.audio_frames += num_frames;
+	}
+}
+
+// Peak resident set size of the process in kilobytes
+static int64_t get_peak_rss_kb()
+{
+#if defined(WIN32)
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return -1;
+	}
+	return static_cast<int64_t>(counters.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return -1;
+	}
+#	if defined(MACOSX)
+	// reported in bytes rather than kilobytes
+	return static_cast<int64_t>(usage.ru_maxrss / 1024);
+#	else
+	return static_cast<int64_t>(usage.ru_maxrss);
+#	endif
+#endif
+}
+
+static std::string to_json_string(const std::string& value)
+{
+	std::string escaped = "\"";
+	for (const auto c : value) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		if (static_cast<unsigned char>(c) >= 0x20) {
+			escaped += c;
+		}
+	}
+	return escaped + "\"";
+}
+
+static std::string get_cpu_setting(const char* name)
+{
+	const auto section = control ? control->GetSection("cpu") : nullptr;
+	return section ? section->GetPropValue(name) : std::string();
+}
+
+static void print_report()
+{
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+	                                              bench.start_time;
+	const auto host_seconds     = elapsed.count();
+	const auto emulated_seconds = static_cast<double>(bench.ticks) / 1000.0;
+
+	const auto seconds = [](const BenchmarkSection section) {
+		return static_cast<double>(bench.section_ns[static_cast<size_t>(section)]) / 1e9;
+	};
+	const auto cpu_seconds   = seconds(BenchmarkSection::Cpu);
+	const auto pic_seconds   = seconds(BenchmarkSection::PicQueue);
+	const auto vga_seconds   = seconds(BenchmarkSection::VgaDraw);
+	const auto mixer_seconds = seconds(BenchmarkSection::Mixer);
+	const auto other_seconds = host_seconds - cpu_seconds - pic_seconds -
+	                           vga_seconds - mixer_seconds;
+
+	// The state of the last update; fixed cycles have none
+	const auto governor = CYCLE_GOVERNOR_GetStats();
+	const auto policy   = CYCLE_GOVERNOR_GetPolicy() == CycleGovernorPolicy::Pid
+	                            ? "pid"
+	                            : "legacy";
+
+	printf("{\n"
+	       "  \"version\": %s,\n"
+	       "  \"core\": %s,\n"
+	       "  \"cycles\": %s,\n"
+	       "  \"emulated_seconds\": %.3f,\n"
+	       "  \"host_seconds\": %.3f,\n"
+	       "  \"instructions\": %lld,\n"
+	       "  \"instructions_per_second\": %.0f,\n"
+	       "  \"frames_rendered\": %lld,\n"
+	       "  \"audio_frames_mixed\": %lld,\n"
+	       "  \"vga_frames\": {\n"
+	       "    \"batched\": %lld,\n"
+	       "    \"in_parts\": %lld\n"
+	       "  },\n"
+	       "  \"cycle_governor\": {\n"
+	       "    \"policy\": \"%s\",\n"
+	       "    \"updates\": %u,\n"
+	       "    \"cycles\": %d,\n"
+	       "    \"target\": %.3f,\n"
+	       "    \"measured\": %.3f,\n"
+	       "    \"error\": %.3f\n"
+	       "  },\n"
+	       "  \"time_seconds\": {\n"
+	       "    \"cpu_core\": %.3f,\n"
+	       "    \"pic_queue\": %.3f,\n"
+	       "    \"vga_draw\": %.3f,\n"
+	       "    \"mixer\": %.3f,\n"
+	       "    \"other\": %.3f\n"
+	       "  },\n"
+	       "  \"peak_rss_kb\": %lld\n"
+	       "}\n",
+	       to_json_string(DOSBOX_GetDetailedVersion()).c_str(),
+	       to_json_string(get_cpu_setting("core")).c_str(),
+	       to_json_string(get_cpu_setting("cycles")).c_str(),
+	       emulated_seconds,
+	       host_seconds,
+	       static_cast<long long>(bench.cycles),
+	       host_seconds > 0.0 ? static_cast<double>(bench.cycles) / host_seconds : 0.0,
+	       static_cast<long long>(bench.frames),
+	       static_cast<long long>(bench.audio_frames),
+	       static_cast<long long>(bench.batched_vga_frames),
+	       static_cast<long long>(bench.vga_frames_in_parts),
+	       policy,
+	       governor.updates,
+	       governor.cycles,
+	       governor.target,
+	       governor.measured,
+	       governor.error,
+	       cpu_seconds,
+	       pic_seconds,
+	       vga_seconds,
+	       mixer_seconds,
+	       other_seconds,
+	       static_cast<long long>(get_peak_rss_kb()));
+	fflush(stdout);
+}
+
+void BENCHMARK_Tick()
+{
+	if (!bench.started) {
+		bench.started    = true;
+		bench.start_time = std::chrono::steady_clock::now();
+		// forget what was counted before the first tick
+		bench.frames       = 0;
+		bench.audio_frames = 0;
+		bench.section_ns   = {};
+		// fixed cycles run as fast as the host allows
+		if (!CPU_CycleAutoAdjust) {
+			ticksLocked = true;
+		}
+		LOG_MSG("BENCHMARK: Running for %lld emulated seconds",
+		        static_cast<long long>(bench.duration_ms / 1000));
+	}
+	bench.tick_cycles  = CPU_CycleLeft;
+	bench.tick_removed = CPU_IODelayRemoved;
+	bench.in_tick      = true;
+}
+
+void BENCHMARK_EndTick()
+{
+	if (!bench.in_tick) {
+		return;
+	}
+	bench.in_tick = false;
+
+	// The cycles idled away by HLT and the removed IO delays weren't
+	// executed. A CPU reset clears the removed cycles.
+	auto removed = CPU_IODelayRemoved - bench.tick_removed;
+	if (removed < 0) {
+		removed = CPU_IODelayRemoved;
+	}
+	// What's left of the tick is zero, or the negative overshoot of the
+	// last instruction
+	bench.cycles += bench.tick_cycles - CPU_CycleLeft - removed;
+
+	if (++bench.ticks < bench.duration_ms) {
+		return;
+	}
+	print_report();
+	benchmark_running = false;
+	ticksLocked       = false;
+	GFX_RequestExit(true);
+}
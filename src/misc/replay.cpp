@@ -0,0 +1,552 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "replay.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "cpu.h"
+#include "cross.h"
+#include "keyboard.h"
+#include "logging.h"
+#include "mouse.h"
+#include "video.h"
+
+extern bool ticksLocked;
+
+bool replay_active = false;
+
+constexpr char replay_magic[]      = "DBREPLAY";
+constexpr size_t replay_magic_size = sizeof(replay_magic) - 1;
+constexpr uint8_t replay_version   = 1;
+
+// The recording is written out in chunks of about this size
+constexpr size_t replay_flush_size = 64 * 1024;
+
+enum class ReplayMode : uint8_t { Off, Record, Replay };
+
+static struct {
+	ReplayMode mode = ReplayMode::Off;
+	bool delivering = false;
+	int64_t tick    = 0;
+
+	// Local time at the start, in milliseconds since 1970-01-01
+	int64_t start_local_ms = 0;
+
+	// Recording
+	FILE* file                       = nullptr;
+	std::vector<uint8_t> buffer      = {};
+	std::vector<ReplayEvent> pending = {};
+	int64_t last_tick                = 0;
+	ReplayEvent cycles               = {};
+
+	// Replaying
+	std::vector<uint8_t> data = {};
+	const uint8_t* pos        = nullptr;
+	ReplayEvent next          = {};
+	int64_t next_tick         = 0;
+} replay = {};
+
+bool ReplayEvent::operator==(const ReplayEvent& other) const
+{
+	return type == other.type && cycle_max == other.cycle_max &&
+	       cycle_auto_adjust == other.cycle_auto_adjust &&
+	       code == other.code && pressed == other.pressed &&
+	       mouse_interface == other.mouse_interface &&
+	       x_rel == other.x_rel && y_rel == other.y_rel &&
+	       x_abs == other.x_abs && y_abs == other.y_abs && wheel == other.wheel;
+}
+
+// Variable-length quantities, 7 bits per byte with the lowest bits first,
+// signed values zigzag encoded so small negative numbers stay short
+
+static void put_uint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80) {
+		out.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+static void put_int(std::vector<uint8_t>& out, const int64_t value)
+{
+	put_uint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+static void put_float(std::vector<uint8_t>& out, const float value)
+{
+	uint32_t bits = 0;
+	static_assert(sizeof(bits) == sizeof(value));
+	memcpy(&bits, &value, sizeof(bits));
+	for (int i = 0; i < 4; ++i) {
+		out.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+	}
+}
+
+static bool get_byte(const uint8_t*& pos, const uint8_t* end, uint8_t& value)
+{
+	if (pos >= end) {
+		return false;
+	}
+	value = *pos++;
+	return true;
+}
+
+static bool get_uint(const uint8_t*& pos, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		uint8_t byte = 0;
+		if (!get_byte(pos, end, byte)) {
+			return false;
+		}
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool get_uint32(const uint8_t*& pos, const uint8_t* end, uint32_t& value)
+{
+	uint64_t raw = 0;
+	if (!get_uint(pos, end, raw) || raw > UINT32_MAX) {
+		return false;
+	}
+	value = static_cast<uint32_t>(raw);
+	return true;
+}
+
+static bool get_int(const uint8_t*& pos, const uint8_t* end, int64_t& value)
+{
+	uint64_t raw = 0;
+	if (!get_uint(pos, end, raw)) {
+		return false;
+	}
+	value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+	return true;
+}
+
+template <typename T>
+static bool get_int_as(const uint8_t*& pos, const uint8_t* end, T& value)
+{
+	int64_t raw = 0;
+	if (!get_int(pos, end, raw)) {
+		return false;
+	}
+	value = static_cast<T>(raw);
+	return static_cast<int64_t>(value) == raw;
+}
+
+static bool get_float(const uint8_t*& pos, const uint8_t* end, float& value)
+{
+	if (end - pos < 4) {
+		return false;
+	}
+	uint32_t bits = 0;
+	for (int i = 0; i < 4; ++i) {
+		bits |= static_cast<uint32_t>(*pos++) << (i * 8);
+	}
+	memcpy(&value, &bits, sizeof(value));
+	return true;
+}
+
+void REPLAY_EncodeEvent(std::vector<uint8_t>& out, const int64_t tick_delta,
+                        const ReplayEvent& event)
+{
+	assert(tick_delta >= 0);
+	put_uint(out, static_cast<uint64_t>(tick_delta));
+	out.push_back(static_cast<uint8_t>(event.type));
+
+	switch (event.type) {
+	case ReplayEventType::End:
+	case ReplayEventType::ClearKeyboard: break;
+	case ReplayEventType::Cycles:
+		put_int(out, event.cycle_max);
+		out.push_back(event.cycle_auto_adjust);
+		break;
+	case ReplayEventType::Key:
+		out.push_back(event.code);
+		out.push_back(event.pressed);
+		break;
+	case ReplayEventType::MouseMoved:
+		out.push_back(event.mouse_interface);
+		put_float(out, event.x_rel);
+		put_float(out, event.y_rel);
+		put_uint(out, event.x_abs);
+		put_uint(out, event.y_abs);
+		break;
+	case ReplayEventType::MouseButton:
+		out.push_back(event.mouse_interface);
+		out.push_back(event.code);
+		out.push_back(event.pressed);
+		break;
+	case ReplayEventType::MouseWheel:
+		out.push_back(event.mouse_interface);
+		put_int(out, event.wheel);
+		break;
+	}
+}
+
+bool REPLAY_DecodeEvent(const uint8_t*& pos, const uint8_t* end,
+                        int64_t& tick_delta, ReplayEvent& event)
+{
+	uint64_t delta = 0;
+	uint8_t type   = 0;
+	if (!get_uint(pos, end, delta) || delta > INT64_MAX || !get_byte(pos, end, type)) {
+		return false;
+	}
+	tick_delta = static_cast<int64_t>(delta);
+	event      = {};
+	event.type = static_cast<ReplayEventType>(type);
+
+	uint8_t flag = 0;
+	switch (event.type) {
+	case ReplayEventType::End:
+	case ReplayEventType::ClearKeyboard: return true;
+	case ReplayEventType::Cycles:
+		if (!get_int_as(pos, end, event.cycle_max) || !get_byte(pos, end, flag)) {
+			return false;
+		}
+		event.cycle_auto_adjust = flag;
+		return true;
+	case ReplayEventType::Key:
+		if (!get_byte(pos, end, event.code) || !get_byte(pos, end, flag)) {
+			return false;
+		}
+		event.pressed = flag;
+		return true;
+	case ReplayEventType::MouseMoved:
+		return get_byte(pos, end, event.mouse_interface) &&
+		       get_float(pos, end, event.x_rel) &&
+		       get_float(pos, end, event.y_rel) &&
+		       get_uint32(pos, end, event.x_abs) &&
+		       get_uint32(pos, end, event.y_abs);
+	case ReplayEventType::MouseButton:
+		if (!get_byte(pos, end, event.mouse_interface) ||
+		    !get_byte(pos, end, event.code) || !get_byte(pos, end, flag)) {
+			return false;
+		}
+		event.pressed = flag;
+		return true;
+	case ReplayEventType::MouseWheel:
+		return get_byte(pos, end, event.mouse_interface) &&
+		       get_int_as(pos, end, event.wheel);
+	}
+	return false;
+}
+
+// Conversions between a date and the days since 1970-01-01 in the proleptic
+// Gregorian calendar, so the emulated clock doesn't depend on the time zone
+// or the C library of the host
+
+static int64_t days_from_civil(int64_t year, const int month, const int day)
+{
+	year -= (month <= 2);
+	const auto era         = (year >= 0 ? year : year - 399) / 400;
+	const auto year_of_era = year - era * 400;
+	const auto day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	const auto day_of_era = year_of_era * 365 + year_of_era / 4 -
+	                        year_of_era / 100 + day_of_year;
+	return era * 146097 + day_of_era - 719468;
+}
+
+static void civil_from_days(int64_t days, struct tm& datetime)
+{
+	// 1970-01-01 was a Thursday
+	datetime.tm_wday = static_cast<int>(((days % 7) + 11) % 7);
+
+	days += 719468;
+	const auto era         = (days >= 0 ? days : days - 146096) / 146097;
+	const auto day_of_era  = days - era * 146097;
+	const auto year_of_era = (day_of_era - day_of_era / 1460 +
+	                          day_of_era / 36524 - day_of_era / 146096) /
+	                         365;
+	const auto day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 -
+	                                       year_of_era / 100);
+	const auto mp    = (5 * day_of_year + 2) / 153;
+	const auto day   = day_of_year - (153 * mp + 2) / 5 + 1;
+	const auto month = mp < 10 ? mp + 3 : mp - 9;
+	const auto year  = year_of_era + era * 400 + (month <= 2);
+
+	datetime.tm_mday = static_cast<int>(day);
+	datetime.tm_mon  = static_cast<int>(month - 1);
+	datetime.tm_year = static_cast<int>(year - 1900);
+	datetime.tm_yday = static_cast<int>(
+	        days - 719468 - days_from_civil(year, 1, 1));
+}
+
+static void get_host_local_time(struct tm& datetime, uint32_t& milliseconds)
+{
+	using namespace std::chrono;
+	const auto now = system_clock::now();
+	const auto ms  = duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
+	const auto seconds = system_clock::to_time_t(now);
+
+	cross::localtime_r(&seconds, &datetime);
+	milliseconds = static_cast<uint32_t>(ms.count() % 1000);
+}
+
+void REPLAY_GetLocalTime(struct tm& datetime, uint32_t& milliseconds)
+{
+	if (replay.mode == ReplayMode::Off) {
+		get_host_local_time(datetime, milliseconds);
+		return;
+	}
+	constexpr int64_t ms_per_day = 24 * 60 * 60 * 1000;
+
+	const auto local_ms = replay.start_local_ms + replay.tick;
+	auto days           = local_ms / ms_per_day;
+	auto ms_of_day      = local_ms % ms_per_day;
+	if (ms_of_day < 0) {
+		--days;
+		ms_of_day += ms_per_day;
+	}
+	datetime = {};
+	civil_from_days(days, datetime);
+	datetime.tm_hour = static_cast<int>(ms_of_day / (60 * 60 * 1000));
+	datetime.tm_min  = static_cast<int>(ms_of_day / (60 * 1000) % 60);
+	datetime.tm_sec  = static_cast<int>(ms_of_day / 1000 % 60);
+	milliseconds     = static_cast<uint32_t>(ms_of_day % 1000);
+}
+
+static void write_header(std::vector<uint8_t>& out)
+{
+	out.insert(out.end(), replay_magic, replay_magic + replay_magic_size);
+	out.push_back(replay_version);
+	put_int(out, replay.start_local_ms);
+}
+
+bool REPLAY_StartRecording(const std::string& path)
+{
+	assert(replay.mode == ReplayMode::Off);
+
+	replay.file = fopen(path.c_str(), "wb");
+	if (!replay.file) {
+		LOG_ERR("REPLAY: Can't create '%s'", path.c_str());
+		return false;
+	}
+	struct tm datetime    = {};
+	uint32_t milliseconds = 0;
+	get_host_local_time(datetime, milliseconds);
+
+	replay.start_local_ms = (days_from_civil(datetime.tm_year + 1900,
+	                                         datetime.tm_mon + 1,
+	                                         datetime.tm_mday) * 86400 +
+	                         datetime.tm_hour * 3600 + datetime.tm_min * 60 +
+	                         datetime.tm_sec) * 1000 + milliseconds;
+
+	replay.tick      = 0;
+	replay.last_tick = 0;
+	replay.buffer.clear();
+	write_header(replay.buffer);
+
+	// Never matches, so the first tick records the cycles
+	replay.cycles           = {};
+	replay.cycles.cycle_max = -1;
+
+	replay.mode   = ReplayMode::Record;
+	replay_active = true;
+	LOG_MSG("REPLAY: Recording to '%s'", path.c_str());
+	return true;
+}
+
+static bool read_next_event()
+{
+	const uint8_t* end = replay.data.data() + replay.data.size();
+	int64_t tick_delta = 0;
+	if (!REPLAY_DecodeEvent(replay.pos, end, tick_delta, replay.next)) {
+		// A recording cut short ends where the data does
+		LOG_WARNING("REPLAY: The recording is truncated");
+		replay.next = {};
+		return false;
+	}
+	replay.next_tick += tick_delta;
+	return true;
+}
+
+bool REPLAY_StartReplay(const std::string& path)
+{
+	assert(replay.mode == ReplayMode::Off);
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		LOG_ERR("REPLAY: Can't open '%s'", path.c_str());
+		return false;
+	}
+	replay.data.assign(std::istreambuf_iterator<char>(file),
+	                   std::istreambuf_iterator<char>());
+
+	const uint8_t* pos = replay.data.data();
+	const uint8_t* end = pos + replay.data.size();
+	if (replay.data.size() < replay_magic_size + 1 ||
+	    memcmp(pos, replay_magic, replay_magic_size) != 0) {
+		LOG_ERR("REPLAY: '%s' isn't a recording", path.c_str());
+		return false;
+	}
+	pos += replay_magic_size;
+	if (*pos++ != replay_version) {
+		LOG_ERR("REPLAY: '%s' was recorded in an unsupported format",
+		        path.c_str());
+		return false;
+	}
+	if (!get_int(pos, end, replay.start_local_ms)) {
+		LOG_ERR("REPLAY: '%s' is truncated", path.c_str());
+		return false;
+	}
+	replay.tick      = 0;
+	replay.pos       = pos;
+	replay.next_tick = 0;
+	replay.cycles    = {};
+	read_next_event();
+
+	replay.mode   = ReplayMode::Replay;
+	replay_active = true;
+	LOG_MSG("REPLAY: Replaying '%s'", path.c_str());
+	return true;
+}
+
+static void flush_recording()
+{
+	if (replay.buffer.empty()) {
+		return;
+	}
+	if (fwrite(replay.buffer.data(), 1, replay.buffer.size(), replay.file) !=
+	    replay.buffer.size()) {
+		LOG_ERR("REPLAY: Failed writing the recording");
+	}
+	replay.buffer.clear();
+}
+
+static void record_event(const ReplayEvent& event)
+{
+	REPLAY_EncodeEvent(replay.buffer, replay.tick - replay.last_tick, event);
+	replay.last_tick = replay.tick;
+}
+
+void REPLAY_Stop()
+{
+	if (replay.mode == ReplayMode::Record) {
+		record_event({});
+		flush_recording();
+		fclose(replay.file);
+		replay.file = nullptr;
+		LOG_MSG("REPLAY: Recorded %lld ms", static_cast<long long>(replay.tick));
+	}
+	replay.mode   = ReplayMode::Off;
+	replay_active = false;
+	replay.pending.clear();
+	replay.data.clear();
+}
+
+bool REPLAY_InterceptEvent(const ReplayEvent& event)
+{
+	if (replay.mode == ReplayMode::Off || replay.delivering) {
+		return false;
+	}
+	if (replay.mode == ReplayMode::Record) {
+		replay.pending.push_back(event);
+	}
+	return true;
+}
+
+static void deliver_event(const ReplayEvent& event)
+{
+	replay.delivering = true;
+	switch (event.type) {
+	case ReplayEventType::End: break;
+	case ReplayEventType::Cycles:
+		CPU_CycleMax        = event.cycle_max;
+		CPU_CycleAutoAdjust = event.cycle_auto_adjust;
+		break;
+	case ReplayEventType::Key:
+		KEYBOARD_AddKey(static_cast<KBD_KEYS>(event.code), event.pressed);
+		break;
+	case ReplayEventType::ClearKeyboard: KEYBOARD_ClrBuffer(); break;
+	case ReplayEventType::MouseMoved:
+	case ReplayEventType::MouseButton:
+	case ReplayEventType::MouseWheel: MOUSE_ReplayEvent(event); break;
+	}
+	replay.delivering = false;
+}
+
+static void record_tick()
+{
+	// The cycles are recorded on every change, whether it came from the
+	// host or the guest, so replaying can simply set them every tick
+	if (CPU_CycleMax != replay.cycles.cycle_max ||
+	    CPU_CycleAutoAdjust != replay.cycles.cycle_auto_adjust) {
+		replay.cycles.type              = ReplayEventType::Cycles;
+		replay.cycles.cycle_max         = CPU_CycleMax;
+		replay.cycles.cycle_auto_adjust = CPU_CycleAutoAdjust;
+		record_event(replay.cycles);
+	}
+	for (const auto& event : replay.pending) {
+		record_event(event);
+		deliver_event(event);
+	}
+	replay.pending.clear();
+
+	if (replay.buffer.size() >= replay_flush_size) {
+		flush_recording();
+	}
+}
+
+static void replay_tick()
+{
+	// Take over the pacing, the replay runs as fast as it can
+	ticksLocked = true;
+
+	while (replay.next_tick == replay.tick) {
+		if (replay.next.type == ReplayEventType::End) {
+			LOG_MSG("REPLAY: Replayed %lld ms", static_cast<long long>(replay.tick));
+			REPLAY_Stop();
+			ticksLocked = false;
+			GFX_RequestExit(true);
+			return;
+		}
+		if (replay.next.type == ReplayEventType::Cycles) {
+			replay.cycles = replay.next;
+		} else {
+			deliver_event(replay.next);
+		}
+		read_next_event();
+	}
+	if (replay.cycles.type == ReplayEventType::Cycles) {
+		deliver_event(replay.cycles);
+	}
+}
+
+void REPLAY_Tick()
+{
+	if (replay.mode == ReplayMode::Record) {
+		record_tick();
+	} else if (replay.mode == ReplayMode::Replay) {
+		replay_tick();
+	}
+	++replay.tick;
+}
@@ -0,0 +1,760 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "savestate.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <zlib.h>
+
+#include "cross.h"
+#include "dosbox.h"
+#include "logging.h"
+#include "mapper.h"
+#include "mem.h"
+#include "replay.h"
+#include "support.h"
+
+bool savestate_pending = false;
+
+constexpr char savestate_magic[]      = "DBXSTATE";
+constexpr size_t savestate_magic_size = sizeof(savestate_magic) - 1;
+constexpr uint32_t savestate_version  = 2;
+
+// Memory regions are compared and written in pages of this size
+constexpr size_t savestate_page_size = 4096;
+
+// The state of a component is small next to the memory regions. This bounds
+// it when checking the sizes in a file before anything is allocated.
+constexpr uint64_t max_component_size = 16 * 1024 * 1024;
+
+// After this many records the slot is written anew, which bounds the size of
+// the file and the time it takes to load it
+constexpr uint32_t max_records_per_file = 32;
+
+constexpr int num_slots = 9;
+
+enum class SaveStateAction : uint8_t { None, Save, Load, LoadAtStart };
+
+struct SaveStateComponent {
+	std::string name                   = {};
+	uint32_t version                   = 0;
+	SAVESTATE_SaveHandler save_handler = nullptr;
+	SAVESTATE_LoadHandler load_handler = nullptr;
+};
+
+struct SaveStateRegion {
+	std::string name = {};
+	uint8_t* data    = nullptr;
+	size_t size      = 0;
+
+	// The contents at the last save or load of the slot file below
+	std::vector<uint8_t> shadow = {};
+};
+
+static struct {
+	std::vector<SaveStateComponent> components = {};
+	std::vector<SaveStateRegion> regions       = {};
+
+	// The slot file the shadow copies of the regions belong to
+	std_fs::path last_path   = {};
+	uintmax_t last_file_size = 0;
+	uint32_t num_records     = 0;
+
+	int slot                       = 1;
+	SaveStateAction pending_action = SaveStateAction::None;
+
+	// The state given on the command line, loaded once the machine reaches
+	// the run depth it was saved at
+	std_fs::path start_path  = {};
+	bool is_waiting_at_start = false;
+} savestate = {};
+
+// Function addresses are stored relative to this one
+static uintptr_t get_reference_address()
+{
+	return reinterpret_cast<uintptr_t>(&SAVESTATE_AddComponent);
+}
+
+void SaveStateWriter::WriteBytes(const void* bytes, const size_t num_bytes)
+{
+	const auto first = static_cast<const uint8_t*>(bytes);
+	data.insert(data.end(), first, first + num_bytes);
+}
+
+void SaveStateWriter::WriteString(const std::string& value)
+{
+	Write(static_cast<uint32_t>(value.size()));
+	WriteBytes(value.data(), value.size());
+}
+
+void SaveStateWriter::WriteFunctionAddress(const uintptr_t address)
+{
+	const bool is_set = (address != 0);
+	Write(is_set);
+	if (is_set) {
+		Write(address - get_reference_address());
+	}
+}
+
+void SaveStateReader::ReadBytes(void* bytes, const size_t num_bytes)
+{
+	if (!ok || static_cast<size_t>(end - pos) < num_bytes) {
+		ok  = false;
+		pos = end;
+		memset(bytes, 0, num_bytes);
+		return;
+	}
+	memcpy(bytes, pos, num_bytes);
+	pos += num_bytes;
+}
+
+std::string SaveStateReader::ReadString()
+{
+	uint32_t size = 0;
+	Read(size);
+	if (!ok || static_cast<size_t>(end - pos) < size) {
+		ok  = false;
+		pos = end;
+		return {};
+	}
+	std::string value(reinterpret_cast<const char*>(pos), size);
+	pos += size;
+	return value;
+}
+
+const uint8_t* SaveStateReader::ReadSpan(const size_t num_bytes)
+{
+	if (!ok || static_cast<size_t>(end - pos) < num_bytes) {
+		ok  = false;
+		pos = end;
+		return nullptr;
+	}
+	const auto span = pos;
+	pos += num_bytes;
+	return span;
+}
+
+uintptr_t SaveStateReader::ReadFunctionAddress()
+{
+	bool is_set = false;
+	Read(is_set);
+	if (!is_set) {
+		return 0;
+	}
+	uintptr_t offset = 0;
+	Read(offset);
+	return ok ? get_reference_address() + offset : 0;
+}
+
+void SAVESTATE_AddComponent(const std::string& name, const uint32_t version,
+                            SAVESTATE_SaveHandler save_handler,
+                            SAVESTATE_LoadHandler load_handler)
+{
+	assert(save_handler && load_handler);
+	for (auto& component : savestate.components) {
+		if (component.name == name) {
+			component = {name, version, save_handler, load_handler};
+			return;
+		}
+	}
+	savestate.components.push_back({name, version, save_handler, load_handler});
+}
+
+void SAVESTATE_RemoveComponent(const std::string& name)
+{
+	auto& components = savestate.components;
+	components.erase(std::remove_if(components.begin(),
+	                                components.end(),
+	                                [&](const SaveStateComponent& component) {
+		                                return component.name == name;
+	                                }),
+	                 components.end());
+}
+
+void SAVESTATE_AddRegion(const std::string& name, uint8_t* data, const size_t size)
+{
+	assert(data && size);
+	SAVESTATE_RemoveRegion(name);
+	savestate.regions.push_back({name, data, size, {}});
+}
+
+void SAVESTATE_RemoveRegion(const std::string& name)
+{
+	auto& regions = savestate.regions;
+	regions.erase(std::remove_if(regions.begin(),
+	                             regions.end(),
+	                             [&](const SaveStateRegion& region) {
+		                             return region.name == name;
+	                             }),
+	              regions.end());
+
+	// the shadow copies no longer cover all regions
+	savestate.last_path.clear();
+}
+
+// Frees the shadow copies, which makes the next save write all pages
+static void drop_shadows()
+{
+	for (auto& region : savestate.regions) {
+		region.shadow = {};
+	}
+	savestate.last_path.clear();
+}
+
+// Tells apart builds that carry the same version
+static std::string get_fingerprint()
+{
+	const auto offset = reinterpret_cast<uintptr_t>(&DOSBOX_RunMachine) -
+	                    get_reference_address();
+	return std::string(DOSBOX_GetDetailedVersion()) + "/" +
+	       std::to_string(sizeof(void*)) + "/" + std::to_string(offset);
+}
+
+// Writes the pages that differ from the shadow copies, or all of them, and
+// brings the shadow copies up to date
+static void write_regions(SaveStateWriter& writer, const bool all_pages)
+{
+	writer.Write(static_cast<uint32_t>(savestate.regions.size()));
+	for (auto& region : savestate.regions) {
+		writer.WriteString(region.name);
+		writer.Write(static_cast<uint64_t>(region.size));
+
+		if (all_pages) {
+			region.shadow.assign(region.data, region.data + region.size);
+		}
+		std::vector<uint32_t> pages = {};
+		for (size_t offset = 0; offset < region.size;
+		     offset += savestate_page_size) {
+			const auto size = std::min(savestate_page_size,
+			                           region.size - offset);
+			auto& shadow    = region.shadow;
+			if (all_pages ||
+			    memcmp(region.data + offset, shadow.data() + offset, size) != 0) {
+				memcpy(shadow.data() + offset, region.data + offset, size);
+				pages.push_back(static_cast<uint32_t>(
+				        offset / savestate_page_size));
+			}
+		}
+		writer.Write(static_cast<uint32_t>(pages.size()));
+		for (const auto page : pages) {
+			const auto offset = page * savestate_page_size;
+			writer.Write(page);
+			writer.WriteBytes(region.data + offset,
+			                  std::min(savestate_page_size,
+			                           region.size - offset));
+		}
+	}
+}
+
+static void write_components(SaveStateWriter& writer)
+{
+	writer.Write(static_cast<uint32_t>(savestate.components.size()));
+	for (const auto& component : savestate.components) {
+		SaveStateWriter component_writer = {};
+		component.save_handler(component_writer);
+
+		const auto& data = component_writer.GetData();
+		writer.WriteString(component.name);
+		writer.Write(component.version);
+		writer.Write(static_cast<uint64_t>(data.size()));
+		writer.WriteBytes(data.data(), data.size());
+	}
+}
+
+bool SAVESTATE_Save(const std_fs::path& path)
+{
+	const auto start_time = std::chrono::steady_clock::now();
+
+	std::error_code ec = {};
+	const bool append  = (path == savestate.last_path) &&
+	                    savestate.num_records < max_records_per_file &&
+	                    std_fs::file_size(path, ec) == savestate.last_file_size &&
+	                    !ec;
+
+	// On failure the shadow copies might be ahead of the file
+	savestate.last_path.clear();
+
+	SaveStateWriter record = {};
+	write_regions(record, !append);
+	write_components(record);
+
+	const auto& raw = record.GetData();
+	auto compressed_size = compressBound(static_cast<uLong>(raw.size()));
+	std::vector<uint8_t> compressed(compressed_size);
+	if (compress2(compressed.data(),
+	              &compressed_size,
+	              raw.data(),
+	              static_cast<uLong>(raw.size()),
+	              Z_BEST_SPEED) != Z_OK) {
+		LOG_ERR("SAVESTATE: Failed compressing the state");
+		return false;
+	}
+
+	SaveStateWriter out = {};
+	if (!append) {
+		out.WriteBytes(savestate_magic, savestate_magic_size);
+		out.Write(savestate_version);
+		out.WriteString(get_fingerprint());
+	}
+	out.Write(static_cast<uint64_t>(raw.size()));
+	out.Write(static_cast<uint64_t>(compressed_size));
+	out.Write(DOSBOX_GetRunDepth());
+	out.WriteBytes(compressed.data(), compressed_size);
+
+	FILE* file = fopen(path.string().c_str(), append ? "ab" : "wb");
+	if (!file) {
+		LOG_ERR("SAVESTATE: Can't write '%s'", path.string().c_str());
+		return false;
+	}
+	const auto& data      = out.GetData();
+	const bool is_written = fwrite(data.data(), 1, data.size(), file) ==
+	                        data.size();
+	if (fclose(file) != 0 || !is_written) {
+		LOG_ERR("SAVESTATE: Failed writing '%s'", path.string().c_str());
+		return false;
+	}
+
+	savestate.last_path      = path;
+	savestate.last_file_size = std_fs::file_size(path, ec);
+	savestate.num_records    = append ? savestate.num_records + 1 : 1;
+
+	const std::chrono::duration<double, std::milli> elapsed =
+	        std::chrono::steady_clock::now() - start_time;
+	LOG_MSG("SAVESTATE: Saved %s to '%s' in %.1f ms (%zu KB)",
+	        append ? "the changes" : "the state",
+	        path.string().c_str(),
+	        elapsed.count(),
+	        data.size() / 1024);
+	return true;
+}
+
+struct SaveStateLoadedComponent {
+	uint32_t version    = 0;
+	const uint8_t* data = nullptr;
+	uint64_t size       = 0;
+};
+
+static bool read_regions(SaveStateReader& reader,
+                         std::vector<std::vector<uint8_t>>& images)
+{
+	uint32_t num_regions = 0;
+	reader.Read(num_regions);
+	if (num_regions != savestate.regions.size()) {
+		return false;
+	}
+	for (uint32_t i = 0; i < num_regions; ++i) {
+		const auto name = reader.ReadString();
+		uint64_t size   = 0;
+		reader.Read(size);
+
+		const auto& regions = savestate.regions;
+		const auto it = std::find_if(regions.begin(),
+		                             regions.end(),
+		                             [&](const SaveStateRegion& region) {
+			                             return region.name == name;
+		                             });
+		if (it == regions.end() || it->size != size) {
+			return false;
+		}
+		auto& image = images[static_cast<size_t>(it - regions.begin())];
+
+		uint32_t num_pages = 0;
+		reader.Read(num_pages);
+		for (uint32_t j = 0; j < num_pages && reader.IsOk(); ++j) {
+			uint32_t page = 0;
+			reader.Read(page);
+			const auto offset = page * savestate_page_size;
+			if (offset >= size) {
+				return false;
+			}
+			reader.ReadBytes(image.data() + offset,
+			                 std::min(savestate_page_size,
+			                          static_cast<size_t>(size - offset)));
+		}
+	}
+	return reader.IsOk();
+}
+
+// The largest record the registered regions and components can produce
+static uint64_t get_max_record_size()
+{
+	uint64_t size = sizeof(uint32_t);
+	for (const auto& region : savestate.regions) {
+		const auto num_pages = (region.size + savestate_page_size - 1) /
+		                       savestate_page_size;
+		size += sizeof(uint32_t) + region.name.size() + sizeof(uint64_t) +
+		        sizeof(uint32_t) + num_pages * sizeof(uint32_t) + region.size;
+	}
+	size += sizeof(uint32_t);
+	for (const auto& component : savestate.components) {
+		size += sizeof(uint32_t) + component.name.size() +
+		        sizeof(uint32_t) + sizeof(uint64_t) + max_component_size;
+	}
+	return size;
+}
+
+// Reads the run depth of the last record from the record headers, without
+// reading and uncompressing the whole file. Returns false if the file can't
+// be loaded by this build.
+static bool read_last_run_depth(const std_fs::path& path, int& run_depth)
+{
+	std::ifstream file(path, std::ios::binary);
+	const auto read = [&](auto& value) {
+		return static_cast<bool>(
+		        file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+	};
+	char magic[savestate_magic_size] = {};
+	uint32_t version                 = 0;
+	uint32_t fingerprint_size        = 0;
+	if (!read(magic) || !read(version) || !read(fingerprint_size) ||
+	    memcmp(magic, savestate_magic, savestate_magic_size) != 0 ||
+	    version != savestate_version) {
+		return false;
+	}
+	// The size comes from the file, so it's checked before allocating
+	const auto expected_fingerprint = get_fingerprint();
+	if (fingerprint_size != expected_fingerprint.size()) {
+		return false;
+	}
+	std::string fingerprint(fingerprint_size, '\0');
+	if (!file.read(fingerprint.data(), fingerprint_size) ||
+	    fingerprint != expected_fingerprint) {
+		return false;
+	}
+	bool has_record          = false;
+	uint64_t raw_size        = 0;
+	uint64_t compressed_size = 0;
+	while (read(raw_size) && read(compressed_size) && read(run_depth)) {
+		has_record = true;
+		file.seekg(static_cast<std::streamoff>(compressed_size),
+		           std::ios::cur);
+	}
+	return has_record;
+}
+
+enum class SaveStateLoadResult { Loaded, Failed, OtherRunDepth };
+
+// On OtherRunDepth the run depth the state was saved at is returned
+static SaveStateLoadResult load_state(const std_fs::path& path, int& saved_run_depth)
+{
+	const auto start_time = std::chrono::steady_clock::now();
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		LOG_ERR("SAVESTATE: Can't open '%s'", path.string().c_str());
+		return SaveStateLoadResult::Failed;
+	}
+	const std::vector<uint8_t> data(std::istreambuf_iterator<char>(file), {});
+	file.close();
+
+	SaveStateReader reader(data.data(), data.size());
+	char magic[savestate_magic_size] = {};
+	uint32_t version                 = 0;
+	reader.ReadBytes(magic, savestate_magic_size);
+	reader.Read(version);
+	if (!reader.IsOk() || memcmp(magic, savestate_magic, savestate_magic_size) != 0) {
+		LOG_ERR("SAVESTATE: '%s' isn't a saved state", path.string().c_str());
+		return SaveStateLoadResult::Failed;
+	}
+	if (version != savestate_version || reader.ReadString() != get_fingerprint()) {
+		LOG_ERR("SAVESTATE: '%s' was saved by a different build",
+		        path.string().c_str());
+		return SaveStateLoadResult::Failed;
+	}
+
+	// Apply the records to copies of the regions first, so a broken file
+	// doesn't leave a half-loaded machine behind
+	std::vector<std::vector<uint8_t>> images = {};
+	for (const auto& region : savestate.regions) {
+		images.emplace_back(region.data, region.data + region.size);
+	}
+	std::vector<uint8_t> record = {};
+	int run_depth               = 0;
+	uint32_t num_records        = 0;
+
+	const auto max_record_size = get_max_record_size();
+
+	std::vector<std::pair<std::string, SaveStateLoadedComponent>> components = {};
+	while (!reader.AtEnd()) {
+		uint64_t raw_size        = 0;
+		uint64_t compressed_size = 0;
+		reader.Read(raw_size);
+		reader.Read(compressed_size);
+		reader.Read(run_depth);
+
+		// Check the sizes before allocating anything, a damaged file
+		// could ask for any amount of memory
+		const bool is_size_ok = reader.IsOk() &&
+		                        raw_size <= max_record_size &&
+		                        compressed_size <= data.size();
+		const auto compressed = reader.ReadSpan(
+		        is_size_ok ? static_cast<size_t>(compressed_size) : 0);
+
+		record.resize(is_size_ok && reader.IsOk() ? raw_size : 0);
+		auto record_size = static_cast<uLong>(record.size());
+		if (!is_size_ok || !reader.IsOk() ||
+		    uncompress(record.data(),
+		               &record_size,
+		               compressed,
+		               static_cast<uLong>(compressed_size)) != Z_OK ||
+		    record_size != raw_size) {
+			LOG_ERR("SAVESTATE: '%s' is damaged", path.string().c_str());
+			return SaveStateLoadResult::Failed;
+		}
+
+		SaveStateReader record_reader(record.data(), record.size());
+		if (!read_regions(record_reader, images)) {
+			LOG_ERR("SAVESTATE: '%s' was saved with a different memory configuration",
+			        path.string().c_str());
+			return SaveStateLoadResult::Failed;
+		}
+
+		// Only the components of the last record are loaded
+		components.clear();
+		uint32_t num_components = 0;
+		record_reader.Read(num_components);
+		for (uint32_t i = 0; i < num_components && record_reader.IsOk(); ++i) {
+			auto name = record_reader.ReadString();
+			SaveStateLoadedComponent component = {};
+			record_reader.Read(component.version);
+			record_reader.Read(component.size);
+			component.data = record_reader.ReadSpan(
+			        static_cast<size_t>(component.size));
+			components.emplace_back(std::move(name), component);
+		}
+		if (!record_reader.IsOk() || !record_reader.AtEnd()) {
+			LOG_ERR("SAVESTATE: '%s' is damaged", path.string().c_str());
+			return SaveStateLoadResult::Failed;
+		}
+		++num_records;
+	}
+	if (num_records == 0) {
+		LOG_ERR("SAVESTATE: '%s' is empty", path.string().c_str());
+		return SaveStateLoadResult::Failed;
+	}
+
+	// The state has to match the components of this configuration
+	bool is_matching = (components.size() == savestate.components.size());
+	for (const auto& component : savestate.components) {
+		const auto it = std::find_if(components.begin(),
+		                             components.end(),
+		                             [&](const auto& loaded) {
+			                             return loaded.first == component.name;
+		                             });
+		if (it == components.end() || it->second.version != component.version) {
+			is_matching = false;
+		}
+	}
+	if (!is_matching) {
+		LOG_ERR("SAVESTATE: '%s' was saved with a different configuration",
+		        path.string().c_str());
+		return SaveStateLoadResult::Failed;
+	}
+	if (run_depth != DOSBOX_GetRunDepth()) {
+		saved_run_depth = run_depth;
+		return SaveStateLoadResult::OtherRunDepth;
+	}
+
+	// Only write the pages that differ, so the pages of RAM that's mapped
+	// from a shared image stay shared
+	for (size_t i = 0; i < images.size(); ++i) {
+		auto& region = savestate.regions[i];
+		for (size_t offset = 0; offset < region.size;
+		     offset += savestate_page_size) {
+			const auto size = std::min(savestate_page_size,
+			                           region.size - offset);
+			const auto page = images[i].data() + offset;
+			if (memcmp(region.data + offset, page, size) != 0) {
+				memcpy(region.data + offset, page, size);
+			}
+		}
+		region.shadow = std::move(images[i]);
+	}
+	for (const auto& component : savestate.components) {
+		const auto it = std::find_if(components.begin(),
+		                             components.end(),
+		                             [&](const auto& loaded) {
+			                             return loaded.first == component.name;
+		                             });
+		const auto& loaded = it->second;
+		SaveStateReader component_reader(loaded.data,
+		                                 static_cast<size_t>(loaded.size));
+		component.load_handler(component_reader);
+		if (!component_reader.IsOk() || !component_reader.AtEnd()) {
+			LOG_WARNING("SAVESTATE: The state of '%s' didn't load cleanly",
+			            component.name.c_str());
+		}
+	}
+
+	std::error_code ec = {};
+	savestate.last_path      = path;
+	savestate.last_file_size = std_fs::file_size(path, ec);
+	savestate.num_records    = num_records;
+
+	const std::chrono::duration<double, std::milli> elapsed =
+	        std::chrono::steady_clock::now() - start_time;
+	LOG_MSG("SAVESTATE: Loaded the state from '%s' in %.1f ms",
+	        path.string().c_str(),
+	        elapsed.count());
+	return SaveStateLoadResult::Loaded;
+}
+
+bool SAVESTATE_Load(const std_fs::path& path)
+{
+	int saved_run_depth = 0;
+	switch (load_state(path, saved_run_depth)) {
+	case SaveStateLoadResult::Loaded: return true;
+	case SaveStateLoadResult::Failed: return false;
+	case SaveStateLoadResult::OtherRunDepth:
+		LOG_ERR("SAVESTATE: '%s' can't be loaded at this point; it was saved "
+		        "at a different depth of programs started by the shell",
+		        path.string().c_str());
+		return false;
+	}
+	return false;
+}
+
+static std_fs::path get_slot_path(const int slot)
+{
+	return get_platform_config_dir() / "savestates" /
+	       ("slot" + std::to_string(slot) + ".sav");
+}
+
+static void request_action(const SaveStateAction action)
+{
+	savestate.pending_action = action;
+	savestate_pending        = true;
+}
+
+static void handle_save_state(const bool pressed)
+{
+	if (pressed) {
+		request_action(SaveStateAction::Save);
+	}
+}
+
+static void handle_load_state(const bool pressed)
+{
+	if (pressed) {
+		request_action(SaveStateAction::Load);
+	}
+}
+
+static void handle_next_slot(const bool pressed)
+{
+	if (!pressed) {
+		return;
+	}
+	savestate.slot = savestate.slot % num_slots + 1;
+
+	const auto path    = get_slot_path(savestate.slot);
+	std::error_code ec = {};
+	LOG_MSG("SAVESTATE: Selected slot %d%s",
+	        savestate.slot,
+	        std_fs::exists(path, ec) ? "" : " (empty)");
+}
+
+void SAVESTATE_LoadAtStart(const std_fs::path& path)
+{
+	savestate.start_path = path;
+	request_action(SaveStateAction::LoadAtStart);
+}
+
+// Returns true once the state is loaded or has failed to load
+static bool load_at_start()
+{
+	// This runs every millisecond while waiting for the run depth, so
+	// only the record headers are read until it matches. A file that
+	// can't be read this way is left to the full load to report.
+	int saved_run_depth = 0;
+	if (read_last_run_depth(savestate.start_path, saved_run_depth) &&
+	    saved_run_depth != DOSBOX_GetRunDepth()) {
+		if (DOSBOX_GetRunDepth() > saved_run_depth) {
+			LOG_ERR("SAVESTATE: '%s' was saved before the shell started "
+			        "the programs that are running now",
+			        savestate.start_path.string().c_str());
+			return true;
+		}
+		if (!savestate.is_waiting_at_start) {
+			LOG_MSG("SAVESTATE: Waiting for the shell to start the "
+			        "programs '%s' was saved in",
+			        savestate.start_path.string().c_str());
+			savestate.is_waiting_at_start = true;
+		}
+		return false;
+	}
+	if (load_state(savestate.start_path, saved_run_depth) !=
+	    SaveStateLoadResult::Loaded) {
+		return true;
+	}
+	// The image is written from the loaded state, so the next machine
+	// started from it shares the pages that stay the same. The shadow
+	// copies would be private copies of all of them, so they're dropped
+	// and the next save writes its slot anew.
+	MEM_WriteImage();
+	drop_shadows();
+	return true;
+}
+
+void SAVESTATE_RunPending()
+{
+	savestate_pending        = false;
+	const auto action        = savestate.pending_action;
+	savestate.pending_action = SaveStateAction::None;
+
+	// The recording and the replay can't skip back and forth in time
+	if (replay_active) {
+		LOG_WARNING("SAVESTATE: Not available while recording or replaying");
+		return;
+	}
+	if (action == SaveStateAction::LoadAtStart) {
+		if (!load_at_start()) {
+			request_action(SaveStateAction::LoadAtStart);
+		}
+		return;
+	}
+	const auto path = get_slot_path(savestate.slot);
+	switch (action) {
+	case SaveStateAction::None: break;
+	case SaveStateAction::Save: {
+		std::error_code ec = {};
+		std_fs::create_directories(path.parent_path(), ec);
+		SAVESTATE_Save(path);
+		break;
+	}
+	case SaveStateAction::Load: SAVESTATE_Load(path); break;
+	case SaveStateAction::LoadAtStart: break;
+	}
+}
+
+void SAVESTATE_Init()
+{
+	MAPPER_AddHandler(handle_save_state, SDL_SCANCODE_F8, PRIMARY_MOD,
+	                  "savestate", "Save State");
+	MAPPER_AddHandler(handle_load_state, SDL_SCANCODE_F8, MMOD2,
+	                  "loadstate", "Load State");
+	MAPPER_AddHandler(handle_next_slot, SDL_SCANCODE_UNKNOWN, 0,
+	                  "nextslot", "Next Slot");
+}
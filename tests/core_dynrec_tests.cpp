@@ -0,0 +1,254 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "dosbox_test_fixture.h"
+#include "mem.h"
+#include "regs.h"
+
+#if C_DYNREC
+
+void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+void CPU_Core_Dynrec_SetProfiling(bool enable);
+void CPU_Core_Dynrec_GetFpuRunStats(uint64_t& instructions, uint64_t& calls);
+size_t CPU_Core_Dynrec_CodeSize();
+
+namespace {
+
+class CPU_Core_DynrecTest : public DOSBoxTestFixture {};
+
+constexpr uint16_t code_segment = 0x8000;
+
+// A loop whose block becomes a superblock once it is hot. The 'jz' is then
+// turned into a side exit and translation continues with the 'sub', which
+// overwrites all flags. The CF of the 'add' is still live on the side exit
+// path though, because the 'adc' behind it reads it.
+//
+//   loop: add ax,bx
+//         inc cx
+//         jz done
+//         sub di,di
+//         mov ax,1
+//         jmp loop
+//   done: adc dx,0
+//         hlt
+//
+constexpr uint8_t side_exit_loop[] = {
+        0x01, 0xd8,       // add ax,bx
+        0x41,             // inc cx
+        0x74, 0x07,       // jz done
+        0x29, 0xff,       // sub di,di
+        0xb8, 0x01, 0x00, // mov ax,1
+        0xeb, 0xf4,       // jmp loop
+        0x83, 0xd2, 0x00, // adc dx,0
+        0xf4,             // hlt
+};
+// the halted CPU points behind the 'hlt'
+constexpr uint32_t halted_offset = sizeof(side_exit_loop);
+
+TEST_F(CPU_Core_DynrecTest, SideExitKeepsLiveCarry)
+{
+	CPU_Core_Dynrec_Cache_Init(true);
+
+	const PhysPt code = PhysicalMake(code_segment, 0);
+	for (size_t i = 0; i < sizeof(side_exit_loop); ++i) {
+		mem_writeb(code + static_cast<PhysPt>(i), side_exit_loop[i]);
+	}
+	SegSet16(cs, code_segment);
+	reg_eip = 0;
+	reg_ax  = 1;
+	reg_bx  = 0xffff;
+	reg_dx  = 0;
+	// enough iterations for the loop to become a superblock before the
+	// side exit is taken
+	constexpr int loops = 1000;
+	reg_cx = static_cast<uint16_t>(0x10000 - loops);
+
+	// run about one iteration per call so that every iteration passes
+	// the dispatcher, which is where hot blocks are retranslated
+	for (int i = 0; i < loops * 2 && reg_eip != halted_offset; ++i) {
+		CPU_Cycles = 5;
+		CPU_Core_Dynrec_Run();
+	}
+	ASSERT_EQ(reg_eip, halted_offset);
+	EXPECT_EQ(reg_cx, 0);
+	// 'add ax,bx' with ax = 1 and bx = 0ffffh always carries
+	EXPECT_EQ(reg_dx, 1);
+}
+
+// Consecutive FPU instructions are translated into a single call. The loop
+// body is one run of four instructions with a memory operand each, it's
+// flushed by the 'loop' at the end of the block. The 'fldz' joins the run of
+// the first iteration and the final 'fstp' is flushed by the 'hlt'.
+//
+//         fninit
+//         fldz
+//   loop: fadd dword [a]
+//         fild word [c]
+//         fiadd word [c]
+//         fistp word [d]
+//         loop loop
+//         fstp qword [sum]
+//         hlt
+//
+constexpr uint16_t fpu_a   = 0x100;
+constexpr uint16_t fpu_c   = 0x104;
+constexpr uint16_t fpu_d   = 0x106;
+constexpr uint16_t fpu_sum = 0x108;
+
+constexpr uint8_t fpu_loop[] = {
+        0xdb, 0xe3,             // fninit
+        0xd9, 0xee,             // fldz
+        0xd8, 0x06, 0x00, 0x01, // fadd dword [a]
+        0xdf, 0x06, 0x04, 0x01, // fild word [c]
+        0xde, 0x06, 0x04, 0x01, // fiadd word [c]
+        0xdf, 0x1e, 0x06, 0x01, // fistp word [d]
+        0xe2, 0xee,             // loop loop
+        0xdd, 0x1e, 0x08, 0x01, // fstp qword [sum]
+        0xf4,                   // hlt
+};
+
+TEST_F(CPU_Core_DynrecTest, FpuRunsKeepResultsAndSaveCalls)
+{
+	CPU_Core_Dynrec_Cache_Init(true);
+	CPU_Core_Dynrec_SetProfiling(true);
+
+	const PhysPt code = PhysicalMake(code_segment, 0);
+	for (size_t i = 0; i < sizeof(fpu_loop); ++i) {
+		mem_writeb(code + static_cast<PhysPt>(i), fpu_loop[i]);
+	}
+	const float a = 1.5f;
+	uint32_t a_bits = 0;
+	std::memcpy(&a_bits, &a, sizeof(a_bits));
+	mem_writed(code + fpu_a, a_bits);
+	mem_writew(code + fpu_c, 7);
+	mem_writew(code + fpu_d, 0);
+
+	SegSet16(cs, code_segment);
+	SegSet16(ds, code_segment);
+	reg_eip = 0;
+	constexpr int loops = 100;
+	reg_cx = loops;
+
+	uint64_t instructions_before = 0;
+	uint64_t calls_before        = 0;
+	CPU_Core_Dynrec_GetFpuRunStats(instructions_before, calls_before);
+
+	constexpr uint32_t halted = sizeof(fpu_loop);
+	for (int i = 0; i < loops * 2 && reg_eip != halted; ++i) {
+		CPU_Cycles = 50;
+		CPU_Core_Dynrec_Run();
+	}
+	CPU_Core_Dynrec_SetProfiling(false);
+	ASSERT_EQ(reg_eip, halted);
+
+	const uint64_t sum_bits = mem_readd(code + fpu_sum) |
+	                          (static_cast<uint64_t>(mem_readd(code + fpu_sum + 4)) << 32);
+	double sum = 0.0;
+	std::memcpy(&sum, &sum_bits, sizeof(sum));
+	EXPECT_EQ(sum, loops * 1.5);
+	EXPECT_EQ(mem_readw(code + fpu_d), 14);
+
+	uint64_t instructions = 0;
+	uint64_t calls        = 0;
+	CPU_Core_Dynrec_GetFpuRunStats(instructions, calls);
+	EXPECT_EQ(instructions - instructions_before, 1 + loops * 4 + 1);
+	EXPECT_EQ(calls - calls_before, loops + 1);
+}
+
+// A byte copy loop, the flags of the 'inc' instructions are overwritten
+// before anything reads them:
+//
+//   loop: mov al,[si]
+//         mov [di],al
+//         inc si
+//         inc di
+//         dec cx
+//         jnz loop
+//         jmp loop
+//
+constexpr uint8_t copy_loop[] = {
+        0x8a, 0x04, // mov al,[si]
+        0x88, 0x05, // mov [di],al
+        0x46,       // inc si
+        0x47,       // inc di
+        0x49,       // dec cx
+        0x75, 0xf7, // jnz loop
+        0xeb, 0xf5, // jmp loop
+};
+constexpr int copy_loop_instructions = 6;
+
+// Prints the host code emitted for a hot loop and the emulation speed. The
+// result is only informative, it doesn't decide whether the test passes. Run
+// it with --gtest_also_run_disabled_tests.
+TEST_F(CPU_Core_DynrecTest, DISABLED_Benchmark)
+{
+	CPU_Core_Dynrec_Cache_Init(true);
+
+	const PhysPt code = PhysicalMake(code_segment, 0);
+	for (size_t i = 0; i < sizeof(copy_loop); ++i) {
+		mem_writeb(code + static_cast<PhysPt>(i), copy_loop[i]);
+	}
+	SegSet16(cs, code_segment);
+	SegSet16(ds, 0x9000);
+	reg_eip = 0;
+	reg_si  = 0;
+	reg_di  = 0;
+	reg_cx  = 0;
+
+	// let the loop become hot and turn into a superblock
+	for (int i = 0; i < 200; ++i) {
+		CPU_Cycles = copy_loop_instructions;
+		CPU_Core_Dynrec_Run();
+	}
+	const auto code_size = CPU_Core_Dynrec_CodeSize();
+
+	using clock = std::chrono::steady_clock;
+	constexpr int64_t num_instructions = 400000000;
+	double best_seconds = 1e9;
+	for (int run = 0; run < 5; ++run) {
+		int64_t remaining = num_instructions;
+		const auto start_time = clock::now();
+		while (remaining > 0) {
+			CPU_Cycles = 1 << 20;
+			remaining -= CPU_Cycles;
+			CPU_Core_Dynrec_Run();
+		}
+		const std::chrono::duration<double> elapsed = clock::now() - start_time;
+		best_seconds = std::min(best_seconds, elapsed.count());
+	}
+
+	printf("Dynamic core: %zu bytes of host code, %.1f million instructions "
+	       "per second (copy loop)\n",
+	       code_size,
+	       static_cast<double>(num_instructions) / best_seconds / 1000000.0);
+}
+
+} // namespace
+
+#endif
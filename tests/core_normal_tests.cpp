@@ -0,0 +1,277 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <initializer_list>
+
+#include "dosbox_test_fixture.h"
+#include "mem.h"
+#include "paging.h"
+#include "regs.h"
+
+namespace {
+
+class CPU_Core_NormalTest : public DOSBoxTestFixture {};
+
+constexpr uint16_t code_segment   = 0x8000;
+constexpr uint16_t data_segment   = 0x9000;
+constexpr uint16_t counter_offset = 0x3000;
+constexpr uint16_t dest_offset    = 0x1000;
+
+// A MOV/ADD loop that keeps the memory operands busy:
+//
+//   loop: mov ax,[si]
+//         add ax,bx
+//         mov [di+1000h],ax
+//         add si,2
+//         and si,0ffeh
+//         inc word [3000h]
+//         jmp loop
+//
+constexpr uint8_t mov_add_loop[] = {
+        0x8b, 0x04,                   // mov ax,[si]
+        0x01, 0xd8,                   // add ax,bx
+        0x89, 0x85, 0x00, 0x10,       // mov [di+1000h],ax
+        0x83, 0xc6, 0x02,             // add si,2
+        0x81, 0xe6, 0xfe, 0x0f,       // and si,0ffeh
+        0xff, 0x06, 0x00, 0x30,       // inc word [3000h]
+        0xeb, 0xeb,                   // jmp loop
+};
+constexpr int instructions_per_loop = 7;
+
+void load_mov_add_loop()
+{
+	const PhysPt code = PhysicalMake(code_segment, 0);
+	for (size_t i = 0; i < sizeof(mov_add_loop); ++i) {
+		mem_writeb(code + static_cast<PhysPt>(i), mov_add_loop[i]);
+	}
+	const PhysPt data = PhysicalMake(data_segment, 0);
+	for (uint16_t i = 0; i < 0x800; ++i) {
+		mem_writew(data + i * 2u, i);
+	}
+	mem_writew(data + counter_offset, 0);
+
+	SegSet16(cs, code_segment);
+	SegSet16(ds, data_segment);
+	reg_eip = 0;
+	reg_si  = 0;
+	reg_di  = 0;
+	reg_bx  = 0x100;
+}
+
+// Runs the normal core for the given number of instructions and returns the
+// number of instructions emulated per second
+double run_normal_core(const int64_t num_instructions)
+{
+	using clock = std::chrono::steady_clock;
+
+	auto remaining        = num_instructions;
+	constexpr auto slice  = int64_t{1} << 20;
+	const auto start_time = clock::now();
+	while (remaining > 0) {
+		CPU_Cycles = static_cast<int32_t>(std::min(remaining, slice));
+		remaining -= CPU_Cycles;
+		CPU_Core_Normal_Run();
+	}
+	const std::chrono::duration<double> elapsed = clock::now() - start_time;
+	return static_cast<double>(num_instructions) / elapsed.count();
+}
+
+TEST_F(CPU_Core_NormalTest, MovAddLoop)
+{
+	load_mov_add_loop();
+
+	constexpr int loops = 1000;
+	run_normal_core(loops * instructions_per_loop);
+
+	const PhysPt data = PhysicalMake(data_segment, 0);
+	EXPECT_EQ(mem_readw(data + counter_offset), loops);
+	EXPECT_EQ(reg_eip, 0u);
+	EXPECT_EQ(reg_si, (loops * 2) & 0x0ffe);
+	// the last loop read the word at (loops - 1) * 2
+	EXPECT_EQ(mem_readw(data + dest_offset), (loops - 1) + 0x100);
+}
+
+// Prints the emulation speed of a CPU-bound program. The result is only
+// informative, it doesn't decide whether the test passes. Run it with
+// --gtest_also_run_disabled_tests.
+TEST_F(CPU_Core_NormalTest, DISABLED_Benchmark)
+{
+	load_mov_add_loop();
+
+	constexpr int loops = 5000000;
+	const auto per_second = run_normal_core(loops * instructions_per_loop);
+
+	const PhysPt data = PhysicalMake(data_segment, 0);
+	EXPECT_EQ(mem_readw(data + counter_offset), loops & 0xffff);
+
+	printf("Normal core: %.1f million instructions per second (MOV/ADD loop)\n",
+	       per_second / 1000000.0);
+}
+
+// Runs the MOV/ADD loop for the given number of cycles and returns the
+// number of loops it got through
+int run_loops_for_cycles(const CycleTiming timing, const int32_t cycles)
+{
+	load_mov_add_loop();
+	CPU_Core_Normal_SetTiming(timing);
+	CPU_Cycles = cycles;
+	while (CPU_Cycles > 0) {
+		CPU_Core_Normal_Run();
+	}
+	CPU_Core_Normal_SetTiming(CycleTiming::Flat);
+	return mem_readw(PhysicalMake(data_segment, 0) + counter_offset);
+}
+
+TEST_F(CPU_Core_NormalTest, TimingChargesClocksPerInstruction)
+{
+	constexpr int32_t cycles = 100 * instructions_per_loop;
+	EXPECT_EQ(run_loops_for_cycles(CycleTiming::Flat, cycles), 100);
+
+	// 16 + 3 + 17 + 4 + 4 + 23 + 15 clocks on the 8086
+	EXPECT_EQ(run_loops_for_cycles(CycleTiming::Intel8086, 82 * 10), 10);
+
+	const auto loops_286 = run_loops_for_cycles(CycleTiming::Intel286, cycles);
+	const auto loops_486 = run_loops_for_cycles(CycleTiming::Intel486, cycles);
+	EXPECT_LT(loops_286, loops_486);
+	EXPECT_LT(loops_486, 100);
+}
+
+TEST_F(CPU_Core_NormalTest, TimingOfTwoByteOpcodesWithoutModrm)
+{
+	// RDTSC has no ModRM byte, so the NOP behind it must not be taken for
+	// the ModRM byte of a memory operand
+	const PhysPt code = PhysicalMake(code_segment, 0);
+	mem_writeb(code + 0, 0x0f);
+	mem_writeb(code + 1, 0x31); // rdtsc
+	mem_writeb(code + 2, 0x90); // nop
+	mem_writeb(code + 3, 0x90); // nop
+
+	const auto arch_type = CPU_ArchitectureType;
+	CPU_ArchitectureType = ArchitectureType::PentiumSlow;
+	CPU_Core_Normal_SetTiming(CycleTiming::Intel486);
+	SegSet16(cs, code_segment);
+	reg_eip    = 0;
+	CPU_Cycles = 10 + 1;
+	while (CPU_Cycles > 0) {
+		CPU_Core_Normal_Run();
+	}
+	CPU_Core_Normal_SetTiming(CycleTiming::Flat);
+	CPU_ArchitectureType = arch_type;
+
+	EXPECT_EQ(reg_eip, 3u);
+}
+
+TEST_F(CPU_Core_NormalTest, AccessesCrossingPages)
+{
+	// the slow path splits these into byte accesses
+	const PhysPt page_end = PhysicalMake(data_segment, 0x0fff);
+
+	mem_writed(page_end - 1, 0x44332211);
+	EXPECT_EQ(mem_readd(page_end - 1), 0x44332211u);
+	EXPECT_EQ(mem_readw(page_end), 0x3322);
+	EXPECT_EQ(mem_readb(page_end + 1), 0x33);
+
+	mem_writew(page_end, 0xbbaa);
+	EXPECT_EQ(mem_readd(page_end - 1), 0x44bbaa11u);
+
+	uint32_t val = 0;
+	EXPECT_FALSE(mem_writed_checked(page_end - 2, 0x87654321));
+	EXPECT_FALSE(mem_readd_checked(page_end - 2, &val));
+	EXPECT_EQ(val, 0x87654321u);
+}
+
+// Runs a single string instruction at the start of the code segment
+void run_string_instruction(const std::initializer_list<uint8_t> code)
+{
+	const PhysPt code_base = PhysicalMake(code_segment, 0);
+	PhysPt address         = code_base;
+	for (const auto byte : code) {
+		mem_writeb(address++, byte);
+	}
+	mem_writeb(address, 0xf4); // hlt
+
+	SegSet16(cs, code_segment);
+	SegSet16(ds, data_segment);
+	SegSet16(es, data_segment);
+	reg_eip = 0;
+	CPU_Cycles = 0x10000;
+	while (reg_eip < code.size() && CPU_Cycles > 0) {
+		CPU_Core_Normal_Run();
+	}
+}
+
+TEST_F(CPU_Core_NormalTest, RepMovsAndStosAcrossPages)
+{
+	const PhysPt data = PhysicalMake(data_segment, 0);
+
+	// rep stosw from 0ff0h up to 2010h, crossing two page boundaries
+	mem_writew(data + 0x0fee, 0);
+	mem_writew(data + 0x2010, 0);
+	reg_cx = 0x810;
+	reg_di = 0x0ff0;
+	reg_ax = 0xa55a;
+	cpu.direction = 1;
+	run_string_instruction({0xf3, 0xab});
+	EXPECT_EQ(reg_cx, 0);
+	EXPECT_EQ(reg_di, 0x2010);
+	EXPECT_EQ(mem_readw(data + 0x0fee), 0x0000);
+	EXPECT_EQ(mem_readw(data + 0x0ff0), 0xa55a);
+	EXPECT_EQ(mem_readw(data + 0x1fff), 0x5aa5);
+	EXPECT_EQ(mem_readw(data + 0x200e), 0xa55a);
+	EXPECT_EQ(mem_readw(data + 0x2010), 0x0000);
+
+	// rep movsb with the destination one byte ahead of the source
+	// replicates the first byte, like the real thing
+	mem_writeb(data + 0x3000, 0x11);
+	mem_writeb(data + 0x3001, 0x22);
+	reg_cx = 0x100;
+	reg_si = 0x3000;
+	reg_di = 0x3001;
+	run_string_instruction({0xf3, 0xa4});
+	EXPECT_EQ(reg_cx, 0);
+	EXPECT_EQ(mem_readb(data + 0x3001), 0x11);
+	EXPECT_EQ(mem_readb(data + 0x3100), 0x11);
+
+	// backwards rep movsd of a block to a lower address
+	for (uint16_t i = 0; i < 0x200; ++i) {
+		mem_writew(data + 0x5000 + i * 2u, i);
+	}
+	reg_cx = 0x100;
+	reg_si = 0x53fc;
+	reg_di = 0x43fc;
+	cpu.direction = -1;
+	run_string_instruction({0x66, 0xf3, 0xa5});
+	cpu.direction = 1;
+	EXPECT_EQ(reg_cx, 0);
+	EXPECT_EQ(reg_si, 0x4ffc);
+	EXPECT_EQ(reg_di, 0x3ffc);
+	for (uint16_t i = 0; i < 0x200; ++i) {
+		ASSERT_EQ(mem_readw(data + 0x4000 + i * 2u), i);
+	}
+}
+
+} // namespace
@@ -0,0 +1,287 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "fpu_float.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+constexpr bool host_has_float80 = (LDBL_MANT_DIG == 64);
+
+using DD = FPU_DoubleDouble;
+
+long double to_long_double(const DD val)
+{
+	return static_cast<long double>(val.hi) + static_cast<long double>(val.lo);
+}
+
+void expect_same_float80(const FPU_Float80 a, const FPU_Float80 b)
+{
+	EXPECT_EQ(a.mantissa, b.mantissa);
+	EXPECT_EQ(a.sign_exponent, b.sign_exponent);
+}
+
+const std::vector<FPU_Float80> float80_values = {
+        {0x8000000000000000, 0x3fff}, // 1.0
+        {0x8000000000000000, 0xbfff}, // -1.0
+        {0xc90fdaa22168c235, 0x4000}, // pi
+        {0xffffffffffffffff, 0x403d}, // 2^63 - 1
+        {0x8000000000000001, 0x3f00}, // 1 + 2^-63, scaled down
+        {0xa5a5a5a5a5a5a5a5, 0x43f0}, // large, still within double range
+        {0x0000000000000000, 0x0000}, // 0.0
+        {0x0000000000000000, 0x8000}, // -0.0
+        {0x8000000000000000, 0x7fff}, // infinity
+        {0x8000000000000000, 0xffff}, // minus infinity
+};
+
+TEST(FPU_DoubleDouble, Float80RoundTrip)
+{
+	for (const auto& val : float80_values) {
+		expect_same_float80(fpu_to_float80(fpu_from_float80<DD>(val)), val);
+	}
+	// just below a power of two, by less than the 64-bit format can hold
+	expect_same_float80(fpu_to_float80(DD(1.0, -std::ldexp(1.0, -80))),
+	                    {0x8000000000000000, 0x3fff});
+
+	const auto nan = fpu_from_float80<DD>({0xc000000000000000, 0xffff});
+	EXPECT_TRUE(fpu_isnan(nan));
+	expect_same_float80(fpu_to_float80(nan), {0xc000000000000000, 0xffff});
+}
+
+TEST(FPU_LongDouble, Float80RoundTrip)
+{
+	if (!host_has_float80) {
+		GTEST_SKIP() << "long double isn't the 80-bit format on this host";
+	}
+	for (const auto& val : float80_values) {
+		expect_same_float80(fpu_to_float80(fpu_from_float80<long double>(val)), val);
+	}
+	// beyond the range of a double, and a denormal
+	const std::vector<FPU_Float80> extended_range = {
+	        {0x8000000000000000, 0x7ffe},
+	        {0x8000000000000000, 0x0001},
+	        {0x0000000000000123, 0x0000},
+	};
+	for (const auto& val : extended_range) {
+		expect_same_float80(fpu_to_float80(fpu_from_float80<long double>(val)), val);
+	}
+}
+
+TEST(FPU_LongDouble, ConstantsMatchRoundedValues)
+{
+	if (!host_has_float80) {
+		GTEST_SKIP() << "long double isn't the 80-bit format on this host";
+	}
+	EXPECT_EQ(fpu_from_float80<long double>(fpu_const_pi),
+	          3.141592653589793238462643383279502884L);
+	EXPECT_EQ(fpu_from_float80<long double>(fpu_const_l2t),
+	          3.321928094887362347870319429489390176L);
+	EXPECT_EQ(fpu_from_float80<long double>(fpu_const_l2e),
+	          1.442695040888963407359924681001892137L);
+	EXPECT_EQ(fpu_from_float80<long double>(fpu_const_lg2),
+	          0.301029995663981195213738894724493027L);
+	EXPECT_EQ(fpu_from_float80<long double>(fpu_const_ln2),
+	          0.693147180559945309417232121458176568L);
+}
+
+TEST(FPU_DoubleDouble, KeepsBitsBeyondDouble)
+{
+	const DD tiny = std::ldexp(1.0, -70);
+	EXPECT_EQ((DD(1.0) + tiny) - DD(1.0), tiny);
+
+	const DD third = DD(1.0) / DD(3.0);
+	EXPECT_LT(std::fabs(fpu_to_double((third * DD(3.0)) - DD(1.0))), std::ldexp(1.0, -104));
+
+	const DD root = fpu_sqrt(DD(2.0));
+	EXPECT_LT(std::fabs(fpu_to_double((root * root) - DD(2.0))), std::ldexp(1.0, -102));
+	EXPECT_LT(root, DD(1.5));
+	EXPECT_GT(root, DD(1.25));
+}
+
+TEST(FPU_DoubleDouble, Int64RoundTrip)
+{
+	const std::vector<int64_t> values = {0,
+	                                     -1,
+	                                     (int64_t{1} << 53) + 1,
+	                                     -(int64_t{1} << 53) - 1,
+	                                     INT64_MAX,
+	                                     INT64_MIN,
+	                                     INT64_MAX - 1000};
+	for (const auto val : values) {
+		EXPECT_EQ(fpu_to_int64(fpu_from_int64<DD>(val)), val);
+	}
+}
+
+TEST(FPU_DoubleDouble, RoundNearestTiesToEven)
+{
+	EXPECT_EQ(fpu_round_nearest(DD(2.5)), DD(2.0));
+	EXPECT_EQ(fpu_round_nearest(DD(3.5)), DD(4.0));
+	EXPECT_EQ(fpu_round_nearest(DD(-2.5)), DD(-2.0));
+	EXPECT_EQ(fpu_round_nearest(DD(-2.75)), DD(-3.0));
+
+	const double big = std::ldexp(1.0, 60);
+	EXPECT_EQ(fpu_round_nearest(DD(big, 0.5)), DD(big));
+	EXPECT_EQ(fpu_round_nearest(DD(big, 1.5)), DD(big, 2.0));
+	EXPECT_EQ(fpu_floor(-DD(big, 0.5)), -DD(big, 1.0));
+	EXPECT_EQ(fpu_trunc(-DD(big, 0.5)), -DD(big));
+	EXPECT_EQ(fpu_ceil(DD(big, 0.25)), DD(big, 1.0));
+}
+
+TEST(FPU_DoubleDouble, AccumulatesLikeExtendedPrecision)
+{
+	if (!host_has_float80) {
+		GTEST_SKIP() << "long double isn't the 80-bit format on this host";
+	}
+	DD dd_sum         = {};
+	double double_sum = 0.0;
+	long double sum   = 0.0L;
+	for (int i = 1; i <= 100000; ++i) {
+		dd_sum += DD(1.0) / DD(i);
+		double_sum += 1.0 / i;
+		sum += 1.0L / i;
+	}
+	const auto dd_error     = std::fabs(to_long_double(dd_sum) - sum);
+	const auto double_error = std::fabs(static_cast<long double>(double_sum) - sum);
+	// the long double sum has rounding errors of its own
+	EXPECT_LT(dd_error, 1e-15L);
+	EXPECT_LT(dd_error * 100, double_error);
+}
+
+// FSIN, FPATAN and FYL2X of the double-double path against long double
+TEST(FPU_DoubleDouble, TranscendentalsMatchLongDouble)
+{
+	if (!host_has_float80) {
+		GTEST_SKIP() << "long double isn't the 80-bit format on this host";
+	}
+	const auto expect_close = [](const DD val, const long double expected) {
+		const auto tolerance = std::fabs(expected) * 1e-15L + 1e-300L;
+		EXPECT_NEAR(static_cast<double>(to_long_double(val) - expected), 0.0,
+		            static_cast<double>(tolerance));
+	};
+	for (int i = -50; i <= 50; ++i) {
+		const DD x      = DD(i * 0.1234567) + DD(std::ldexp(i, -60));
+		const auto x_ld = to_long_double(x);
+
+		expect_close(fpu_sin(x), std::sin(x_ld));
+		expect_close(fpu_cos(x), std::cos(x_ld));
+		expect_close(fpu_atan2(x, DD(0.75)), std::atan2(x_ld, 0.75L));
+		expect_close(fpu_atan2(DD(-1.5), x), std::atan2(-1.5L, x_ld));
+		if (i > 0) {
+			expect_close(fpu_log2(x), std::log2(x_ld));
+			expect_close(DD(2.5) * fpu_log2(x), 2.5L * std::log2(x_ld));
+		}
+		if (i > -8 && i < 8) {
+			expect_close(fpu_log2_1p(x), std::log1p(x_ld) / fpu_ln2);
+			expect_close(fpu_exp2_m1(x), std::expm1(x_ld * fpu_ln2));
+		}
+	}
+	EXPECT_TRUE(std::isinf(fpu_log2(DD(0.0)).hi));
+	EXPECT_TRUE(fpu_isnan(fpu_log2(DD(-1.0))));
+}
+
+// Plain double versions, to compare with the emulation of the old FPU core
+double fpu_to_double(const double val)
+{
+	return val;
+}
+double fpu_sin(const double val)
+{
+	return std::sin(val);
+}
+double fpu_atan2(const double y, const double x)
+{
+	return std::atan2(y, x);
+}
+double fpu_log2(const double val)
+{
+	return std::log2(val);
+}
+
+// Prints the throughput of FSIN, FPATAN and FYL2X for each number type. The
+// timings are only informative, they don't decide whether the test passes.
+// Run it with --gtest_also_run_disabled_tests.
+template <typename T>
+double time_per_op(T (*op)(T, T), const std::vector<double>& inputs)
+{
+	using clock = std::chrono::steady_clock;
+	constexpr int rounds = 200;
+
+	volatile double sink = 0.0;
+	const auto start     = clock::now();
+	for (int round = 0; round < rounds; ++round) {
+		T acc = {};
+		for (size_t i = 1; i < inputs.size(); ++i) {
+			acc += op(T(inputs[i - 1]), T(inputs[i]));
+		}
+		sink = sink + fpu_to_double(acc);
+	}
+	const std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+	return elapsed.count() / (rounds * static_cast<double>(inputs.size() - 1));
+}
+
+template <typename T>
+T op_fsin(const T a, const T)
+{
+	return fpu_sin(a);
+}
+
+template <typename T>
+T op_fpatan(const T a, const T b)
+{
+	return fpu_atan2(a, b);
+}
+
+template <typename T>
+T op_fyl2x(const T a, const T b)
+{
+	return b * fpu_log2(a);
+}
+
+TEST(FPU_Float, DISABLED_Benchmark)
+{
+	std::vector<double> inputs(4096);
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		inputs[i] = 0.001 + static_cast<double>(i % 1000) * 0.00737;
+	}
+	const auto print = [](const char* name, const double f, const double dd,
+	                      const double ld) {
+		printf("%-7s %6.1f ns (double), %6.1f ns (double-double), %6.1f ns (long double)\n",
+		       name, f, dd, ld);
+	};
+	print("FSIN",
+	      time_per_op<double>(op_fsin, inputs),
+	      time_per_op<DD>(op_fsin, inputs),
+	      time_per_op<long double>(op_fsin, inputs));
+	print("FPATAN",
+	      time_per_op<double>(op_fpatan, inputs),
+	      time_per_op<DD>(op_fpatan, inputs),
+	      time_per_op<long double>(op_fpatan, inputs));
+	print("FYL2X",
+	      time_per_op<double>(op_fyl2x, inputs),
+	      time_per_op<DD>(op_fyl2x, inputs),
+	      time_per_op<long double>(op_fyl2x, inputs));
+}
+
+} // namespace
@@ -0,0 +1,278 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "pic_event_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <random>
+#include <vector>
+
+namespace {
+
+void handler_a(uint32_t) {}
+void handler_b(uint32_t) {}
+
+PIC_EventQueue::Event make_event(const double index,
+                                 const uint32_t value,
+                                 PIC_EventHandler handler = handler_a)
+{
+	PIC_EventQueue::Event event = {};
+	event.index   = index;
+	event.handler = handler;
+	event.value   = value;
+	return event;
+}
+
+std::vector<uint32_t> drain_values(PIC_EventQueue& queue)
+{
+	std::vector<uint32_t> values = {};
+	while (!queue.IsEmpty()) {
+		values.push_back(queue.Pop().value);
+	}
+	return values;
+}
+
+TEST(PIC_EventQueue, PopsInIndexOrder)
+{
+	PIC_EventQueue queue;
+	queue.Add(make_event(0.5, 5));
+	queue.Add(make_event(0.1, 1));
+	queue.Add(make_event(0.9, 9));
+	queue.Add(make_event(0.3, 3));
+	queue.Add(make_event(0.7, 7));
+
+	EXPECT_EQ(queue.Size(), 5);
+	EXPECT_EQ(queue.Top().value, 1);
+	EXPECT_EQ(drain_values(queue), std::vector<uint32_t>({1, 3, 5, 7, 9}));
+	EXPECT_TRUE(queue.IsEmpty());
+}
+
+TEST(PIC_EventQueue, EqualIndexesKeepInsertionOrder)
+{
+	PIC_EventQueue queue;
+	queue.Add(make_event(1.0, 10));
+	queue.Add(make_event(0.0, 0));
+	queue.Add(make_event(1.0, 11));
+	queue.Add(make_event(1.0, 12));
+	queue.Add(make_event(0.0, 1));
+
+	EXPECT_EQ(drain_values(queue), std::vector<uint32_t>({0, 1, 10, 11, 12}));
+}
+
+TEST(PIC_EventQueue, RemoveByHandle)
+{
+	PIC_EventQueue queue;
+	std::vector<PIC_EventHandle> handles = {};
+	for (uint32_t i = 0; i < 8; ++i) {
+		handles.push_back(queue.Add(make_event(i * 0.125, i)));
+	}
+	EXPECT_TRUE(queue.Remove(handles[0]));
+	EXPECT_TRUE(queue.Remove(handles[5]));
+	EXPECT_TRUE(queue.Remove(handles[3]));
+	EXPECT_FALSE(queue.Remove(handles[3]));
+	EXPECT_FALSE(queue.IsPending(handles[5]));
+	EXPECT_TRUE(queue.IsPending(handles[4]));
+
+	EXPECT_EQ(drain_values(queue), std::vector<uint32_t>({1, 2, 4, 6, 7}));
+}
+
+TEST(PIC_EventQueue, StaleHandleDoesNotMatchReusedSlot)
+{
+	PIC_EventQueue queue;
+	const auto old_handle = queue.Add(make_event(0.5, 1));
+	EXPECT_EQ(queue.Pop().value, 1);
+
+	const auto new_handle = queue.Add(make_event(0.5, 2));
+	EXPECT_EQ(old_handle.slot, new_handle.slot);
+	EXPECT_FALSE(queue.Remove(old_handle));
+	EXPECT_EQ(queue.Size(), 1);
+	EXPECT_TRUE(queue.Remove(new_handle));
+	EXPECT_FALSE(queue.Remove(PIC_EventHandle{}));
+}
+
+TEST(PIC_EventQueue, RemoveIf)
+{
+	PIC_EventQueue queue;
+	for (uint32_t i = 0; i < 16; ++i) {
+		queue.Add(make_event(16 - i, i, (i % 3) ? handler_a : handler_b));
+	}
+	queue.RemoveIf([](const PIC_EventQueue::Event& event) {
+		return event.handler == handler_a && event.value > 7;
+	});
+	EXPECT_EQ(drain_values(queue),
+	          std::vector<uint32_t>({15, 12, 9, 7, 6, 5, 4, 3, 2, 1, 0}));
+}
+
+TEST(PIC_EventQueue, ShiftIndexes)
+{
+	PIC_EventQueue queue;
+	queue.Add(make_event(2.5, 2));
+	queue.Add(make_event(1.25, 1));
+	queue.ShiftIndexes(1.0);
+
+	EXPECT_DOUBLE_EQ(queue.Pop().index, 0.25);
+	EXPECT_DOUBLE_EQ(queue.Pop().index, 1.5);
+}
+
+TEST(PIC_EventQueue, GetEventsRecreatesTheQueue)
+{
+	PIC_EventQueue queue;
+	queue.Add(make_event(1.0, 10));
+	queue.Add(make_event(0.0, 0));
+	queue.Add(make_event(1.0, 11));
+	queue.Add(make_event(0.5, 5, handler_b));
+	queue.Add(make_event(1.0, 12));
+
+	const auto events = queue.GetEvents();
+	ASSERT_EQ(events.size(), 5u);
+	EXPECT_EQ(events[1].handler, handler_b);
+
+	PIC_EventQueue copy;
+	for (const auto& event : events) {
+		copy.Add(event);
+	}
+	// events due at the same index stay in the order they were added
+	queue.Add(make_event(1.0, 13));
+	copy.Add(make_event(1.0, 13));
+	EXPECT_EQ(drain_values(copy), std::vector<uint32_t>({0, 5, 10, 11, 12, 13}));
+	EXPECT_EQ(drain_values(queue), std::vector<uint32_t>({0, 5, 10, 11, 12, 13}));
+}
+
+TEST(PIC_EventQueue, GrowsBeyondFormerCapacity)
+{
+	// the linked list this replaced was limited to 512 events
+	constexpr uint32_t num_events = 4096;
+
+	PIC_EventQueue queue;
+	for (uint32_t i = 0; i < num_events; ++i) {
+		queue.Add(make_event(num_events - i, i));
+	}
+	EXPECT_EQ(queue.Size(), num_events);
+
+	uint32_t expected = num_events;
+	while (!queue.IsEmpty()) {
+		EXPECT_EQ(queue.Pop().value, --expected);
+	}
+}
+
+TEST(PIC_EventQueue, MatchesSortedListUnderRandomLoad)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<double> delay(0.0, 4.0);
+
+	PIC_EventQueue queue;
+	std::vector<std::pair<PIC_EventHandle, uint32_t>> pending = {};
+	std::list<PIC_EventQueue::Event> reference = {};
+
+	for (uint32_t i = 0; i < 20000; ++i) {
+		const auto op = rng() % 4;
+		if (op < 2 || reference.empty()) {
+			const auto event = make_event(delay(rng), i);
+			pending.emplace_back(queue.Add(event), i);
+			auto it = reference.begin();
+			while (it != reference.end() && it->index <= event.index) {
+				++it;
+			}
+			reference.insert(it, event);
+		} else if (op == 2) {
+			const auto event = queue.Pop();
+			EXPECT_EQ(event.value, reference.front().value);
+			reference.pop_front();
+		} else {
+			const auto& [handle, value] = pending[rng() % pending.size()];
+			const auto removed = queue.Remove(handle);
+			const auto it = std::find_if(reference.begin(),
+			                             reference.end(),
+			                             [value = value](const auto& event) {
+				                             return event.value == value;
+			                             });
+			EXPECT_EQ(removed, it != reference.end());
+			if (it != reference.end()) {
+				reference.erase(it);
+			}
+		}
+		ASSERT_EQ(queue.Size(), reference.size());
+	}
+}
+
+// Rough comparison against the sorted linked list the PIC used before; the
+// timings are only printed, they don't decide whether the test passes. Run it
+// with --gtest_also_run_disabled_tests.
+TEST(PIC_EventQueue, DISABLED_Microbenchmark)
+{
+	using clock = std::chrono::steady_clock;
+
+	constexpr int rounds     = 200;
+	constexpr int queue_size = 256;
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<double> delay(0.0, 1.0);
+	std::vector<double> indexes(queue_size);
+	for (auto& index : indexes) {
+		index = delay(rng);
+	}
+
+	uint64_t checksum = 0;
+
+	const auto heap_start = clock::now();
+	PIC_EventQueue queue;
+	for (int round = 0; round < rounds; ++round) {
+		for (uint32_t i = 0; i < queue_size; ++i) {
+			queue.Add(make_event(indexes[i], i));
+		}
+		while (!queue.IsEmpty()) {
+			checksum += queue.Pop().value;
+		}
+	}
+	const auto heap_time = clock::now() - heap_start;
+
+	const auto list_start = clock::now();
+	std::list<PIC_EventQueue::Event> list = {};
+	for (int round = 0; round < rounds; ++round) {
+		for (uint32_t i = 0; i < queue_size; ++i) {
+			auto it = list.begin();
+			while (it != list.end() && it->index <= indexes[i]) {
+				++it;
+			}
+			list.insert(it, make_event(indexes[i], i));
+		}
+		while (!list.empty()) {
+			checksum -= list.front().value;
+			list.pop_front();
+		}
+	}
+	const auto list_time = clock::now() - list_start;
+
+	EXPECT_EQ(checksum, 0);
+
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+	constexpr auto num_ops = static_cast<double>(rounds * queue_size);
+	printf("PIC event queue: %.1f ns per event (heap), %.1f ns per event (sorted list)\n",
+	       static_cast<double>(duration_cast<nanoseconds>(heap_time).count()) / num_ops,
+	       static_cast<double>(duration_cast<nanoseconds>(list_time).count()) / num_ops);
+}
+
+} // namespace
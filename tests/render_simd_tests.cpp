@@ -0,0 +1,188 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/gui/render_simd.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace {
+
+class RenderSimdTest : public ::testing::TestWithParam<bool> {
+protected:
+	void SetUp() override
+	{
+		RENDER_EnableSimd(GetParam());
+	}
+
+	void TearDown() override
+	{
+		RENDER_EnableSimd(true);
+	}
+};
+
+template <typename T>
+std::vector<T> make_noise(const size_t size)
+{
+	std::minstd_rand generator(42);
+	std::vector<T> values(size);
+	for (auto& value : values) {
+		value = static_cast<T>(generator());
+	}
+	return values;
+}
+
+uint32_t expand_5_bits(const uint32_t value)
+{
+	return (value << 3) | (value >> 2);
+}
+
+uint32_t expand_6_bits(const uint32_t value)
+{
+	return (value << 2) | (value >> 4);
+}
+
+TEST_P(RenderSimdTest, CountEqualBytesStopsAtTheFirstDifference)
+{
+	const auto a = make_noise<uint8_t>(1000);
+	for (size_t length : {0, 1, 7, 15, 16, 17, 64, 999, 1000}) {
+		auto b = a;
+		EXPECT_EQ(RENDER_CountEqualBytes(a.data(), b.data(), length), length);
+		for (size_t difference : {0, 5, 15, 16, 31, 500, 999}) {
+			if (difference >= length) {
+				continue;
+			}
+			b = a;
+			b[difference] ^= 0x80;
+			EXPECT_EQ(RENDER_CountEqualBytes(a.data(), b.data(), length),
+			          difference);
+		}
+	}
+}
+
+TEST_P(RenderSimdTest, Expand8To32LooksUpThePalette)
+{
+	const auto palette = make_noise<uint32_t>(256);
+	const auto src     = make_noise<uint8_t>(37);
+	std::vector<uint32_t> dst(src.size());
+	RENDER_Expand8To32(src.data(), dst.data(), src.size(), palette.data());
+	for (size_t i = 0; i < src.size(); ++i) {
+		EXPECT_EQ(dst[i], palette[src[i]]);
+	}
+}
+
+TEST_P(RenderSimdTest, Convert15To32)
+{
+	std::vector<uint16_t> src(0x10000);
+	for (size_t i = 0; i < src.size(); ++i) {
+		src[i] = static_cast<uint16_t>(i);
+	}
+	std::vector<uint32_t> dst(src.size());
+	RENDER_Convert15To32(src.data(), dst.data(), src.size());
+	for (size_t i = 0; i < src.size(); ++i) {
+		const uint32_t expected = (expand_5_bits((i >> 10) & 0x1f) << 16) |
+		                          (expand_5_bits((i >> 5) & 0x1f) << 8) |
+		                          expand_5_bits(i & 0x1f);
+		ASSERT_EQ(dst[i], expected) << "pixel " << i;
+	}
+}
+
+TEST_P(RenderSimdTest, Convert16To32)
+{
+	std::vector<uint16_t> src(0x10000);
+	for (size_t i = 0; i < src.size(); ++i) {
+		src[i] = static_cast<uint16_t>(i);
+	}
+	std::vector<uint32_t> dst(src.size());
+	RENDER_Convert16To32(src.data(), dst.data(), src.size());
+	for (size_t i = 0; i < src.size(); ++i) {
+		const uint32_t expected = (expand_5_bits((i >> 11) & 0x1f) << 16) |
+		                          (expand_6_bits((i >> 5) & 0x3f) << 8) |
+		                          expand_5_bits(i & 0x1f);
+		ASSERT_EQ(dst[i], expected) << "pixel " << i;
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(RenderSimd, RenderSimdTest, ::testing::Values(false, true));
+
+// Returns the milliseconds it takes to run the kernel once per line of a frame
+double time_frames(const int num_frames, const int height,
+                   const std::function<void()>& draw_line)
+{
+	using clock = std::chrono::steady_clock;
+
+	const auto start_time = clock::now();
+	for (int frame = 0; frame < num_frames; ++frame) {
+		for (int line = 0; line < height; ++line) {
+			draw_line();
+		}
+	}
+	const std::chrono::duration<double, std::milli> elapsed = clock::now() -
+	                                                          start_time;
+	return elapsed.count() / num_frames;
+}
+
+void benchmark_frame(const int width, const int height)
+{
+	constexpr int num_frames = 200;
+
+	const auto palette  = make_noise<uint32_t>(256);
+	const auto line8    = make_noise<uint8_t>(width);
+	const auto line16   = make_noise<uint16_t>(width);
+	const auto cache16  = line16;
+	std::vector<uint32_t> line32(width);
+
+	const auto compare = [&] {
+		RENDER_CountEqualBytes(line16.data(), cache16.data(), width * 2);
+	};
+	const auto expand = [&] {
+		RENDER_Expand8To32(line8.data(), line32.data(), width, palette.data());
+	};
+	const auto convert = [&] {
+		RENDER_Convert16To32(line16.data(), line32.data(), width);
+	};
+
+	for (const bool use_simd : {false, true}) {
+		RENDER_EnableSimd(use_simd);
+		printf("%dx%d frame (%s): compare %.3f ms, 8->32 %.3f ms, 16->32 %.3f ms\n",
+		       width,
+		       height,
+		       RENDER_GetSimdName(),
+		       time_frames(num_frames, height, compare),
+		       time_frames(num_frames, height, expand),
+		       time_frames(num_frames, height, convert));
+	}
+}
+
+// Prints the time the kernels take per frame. The results are only
+// informative, they don't decide whether the test passes. Run it with
+// --gtest_also_run_disabled_tests.
+TEST(RenderSimd, DISABLED_Benchmark)
+{
+	benchmark_frame(320, 200);
+	benchmark_frame(1024, 768);
+}
+
+} // namespace
@@ -0,0 +1,125 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "replay.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+std::vector<ReplayEvent> make_events()
+{
+	std::vector<ReplayEvent> events(7);
+
+	events[0].type              = ReplayEventType::Cycles;
+	events[0].cycle_max         = 123456;
+	events[0].cycle_auto_adjust = true;
+
+	events[1].type    = ReplayEventType::Key;
+	events[1].code    = 42;
+	events[1].pressed = true;
+
+	events[2].type = ReplayEventType::ClearKeyboard;
+
+	events[3].type            = ReplayEventType::MouseMoved;
+	events[3].mouse_interface = 0xff;
+	events[3].x_rel           = -1.5f;
+	events[3].y_rel           = 0.25f;
+	events[3].x_abs           = 640;
+	events[3].y_abs           = 0xffffffff;
+
+	events[4].type            = ReplayEventType::MouseButton;
+	events[4].mouse_interface = 2;
+	events[4].code            = 1;
+	events[4].pressed         = false;
+
+	events[5].type  = ReplayEventType::MouseWheel;
+	events[5].wheel = -3;
+
+	events[6].type = ReplayEventType::End;
+	return events;
+}
+
+TEST(Replay, EventsRoundTrip)
+{
+	const auto events = make_events();
+	const std::vector<int64_t> deltas = {0, 1, 127, 128, 300000, 0, 1ll << 40};
+
+	std::vector<uint8_t> data = {};
+	for (size_t i = 0; i < events.size(); ++i) {
+		REPLAY_EncodeEvent(data, deltas[i], events[i]);
+	}
+
+	const uint8_t* pos = data.data();
+	const uint8_t* end = pos + data.size();
+	for (size_t i = 0; i < events.size(); ++i) {
+		int64_t delta     = -1;
+		ReplayEvent event = {};
+		ASSERT_TRUE(REPLAY_DecodeEvent(pos, end, delta, event));
+		EXPECT_EQ(delta, deltas[i]);
+		EXPECT_TRUE(event == events[i]) << "event " << i;
+	}
+	EXPECT_EQ(pos, end);
+}
+
+TEST(Replay, EventsAreCompact)
+{
+	ReplayEvent key = {};
+	key.type        = ReplayEventType::Key;
+	key.code        = 30;
+	key.pressed     = true;
+
+	std::vector<uint8_t> data = {};
+	REPLAY_EncodeEvent(data, 50, key);
+	EXPECT_EQ(data.size(), 4u);
+
+	data.clear();
+	REPLAY_EncodeEvent(data, 0, {});
+	EXPECT_EQ(data.size(), 2u);
+}
+
+TEST(Replay, TruncatedEventsAreRejected)
+{
+	for (const auto& event : make_events()) {
+		std::vector<uint8_t> data = {};
+		REPLAY_EncodeEvent(data, 1000, event);
+
+		for (size_t size = 0; size < data.size(); ++size) {
+			const uint8_t* pos = data.data();
+			int64_t delta      = 0;
+			ReplayEvent decoded = {};
+			EXPECT_FALSE(REPLAY_DecodeEvent(pos, data.data() + size, delta, decoded));
+		}
+	}
+}
+
+TEST(Replay, UnknownEventIsRejected)
+{
+	const std::vector<uint8_t> data = {0x00, 0x7f};
+
+	const uint8_t* pos = data.data();
+	int64_t delta      = 0;
+	ReplayEvent event  = {};
+	EXPECT_FALSE(REPLAY_DecodeEvent(pos, data.data() + data.size(), delta, event));
+}
+
+} // namespace
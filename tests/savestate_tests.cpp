@@ -0,0 +1,222 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "savestate.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace {
+
+void function_a(int) {}
+void function_b(int) {}
+
+TEST(SaveState, WriterReaderRoundTrip)
+{
+	SaveStateWriter writer = {};
+	writer.Write(uint16_t{0x1234});
+	writer.WriteString("slot");
+	writer.Write(2.5);
+	writer.WriteFunction(function_b);
+	writer.WriteFunction<void(int)>(nullptr);
+
+	const auto& data = writer.GetData();
+	SaveStateReader reader(data.data(), data.size());
+
+	uint16_t word = 0;
+	reader.Read(word);
+	EXPECT_EQ(word, 0x1234);
+	EXPECT_EQ(reader.ReadString(), "slot");
+	double number = 0.0;
+	reader.Read(number);
+	EXPECT_EQ(number, 2.5);
+
+	void (*function)(int) = function_a;
+	reader.ReadFunction(function);
+	EXPECT_EQ(function, function_b);
+	reader.ReadFunction(function);
+	EXPECT_EQ(function, nullptr);
+
+	EXPECT_TRUE(reader.IsOk());
+	EXPECT_TRUE(reader.AtEnd());
+}
+
+TEST(SaveState, ReadingPastTheEndFails)
+{
+	const uint8_t data[] = {1, 2, 3};
+	SaveStateReader reader(data, sizeof(data));
+
+	uint32_t value = 0xffffffff;
+	reader.Read(value);
+	EXPECT_EQ(value, 0u);
+	EXPECT_FALSE(reader.IsOk());
+	EXPECT_TRUE(reader.ReadString().empty());
+}
+
+// A region spanning a few pages and a component with a single value
+std::vector<uint8_t> region(3 * 4096 + 100);
+uint32_t component_value = 0;
+
+void save_component(SaveStateWriter& writer)
+{
+	writer.Write(component_value);
+}
+
+void load_component(SaveStateReader& reader)
+{
+	reader.Read(component_value);
+}
+
+class SaveStateFile : public ::testing::Test {
+protected:
+	void SetUp() override
+	{
+		// fill with noise so the pages don't compress away
+		std::minstd_rand generator(42);
+		for (auto& byte : region) {
+			byte = static_cast<uint8_t>(generator());
+		}
+		component_value = 1;
+		SAVESTATE_AddRegion("test_region", region.data(), region.size());
+		SAVESTATE_AddComponent("test", 1, save_component, load_component);
+	}
+
+	void TearDown() override
+	{
+		SAVESTATE_RemoveRegion("test_region");
+		SAVESTATE_RemoveComponent("test");
+		SAVESTATE_RemoveComponent("other");
+		std::error_code ec = {};
+		std_fs::remove(path, ec);
+	}
+
+	const std_fs::path path = std_fs::temp_directory_path() /
+	                          "dosbox_savestate_tests.sav";
+};
+
+TEST_F(SaveStateFile, LoadRestoresTheSavedState)
+{
+	ASSERT_TRUE(SAVESTATE_Save(path));
+	const auto saved = region;
+
+	region[5]       = 0xaa;
+	region.back()   = 0xbb;
+	component_value = 2;
+
+	ASSERT_TRUE(SAVESTATE_Load(path));
+	EXPECT_EQ(region, saved);
+	EXPECT_EQ(component_value, 1u);
+}
+
+TEST_F(SaveStateFile, AppendsOnlyTheChangedPages)
+{
+	ASSERT_TRUE(SAVESTATE_Save(path));
+	const auto full_size = std_fs::file_size(path);
+
+	region[4096]    = 0xaa;
+	component_value = 2;
+	ASSERT_TRUE(SAVESTATE_Save(path));
+	const auto saved = region;
+
+	// the appended record holds a single page out of four
+	EXPECT_LT(std_fs::file_size(path) - full_size, full_size / 2);
+
+	region[0]       = 0xcc;
+	region[4096]    = 0xdd;
+	component_value = 3;
+	ASSERT_TRUE(SAVESTATE_Load(path));
+	EXPECT_EQ(region, saved);
+	EXPECT_EQ(component_value, 2u);
+}
+
+TEST_F(SaveStateFile, RefusesAnotherConfiguration)
+{
+	ASSERT_TRUE(SAVESTATE_Save(path));
+
+	SAVESTATE_AddComponent("other", 1, save_component, load_component);
+	region[0] = 0xaa;
+	EXPECT_FALSE(SAVESTATE_Load(path));
+	EXPECT_EQ(region[0], 0xaa);
+}
+
+TEST_F(SaveStateFile, LoadAtStartDropsTheShadowCopies)
+{
+	ASSERT_TRUE(SAVESTATE_Save(path));
+	const auto full_size = std_fs::file_size(path);
+	const auto saved     = region;
+
+	region[5] = 0xaa;
+	SAVESTATE_LoadAtStart(path);
+	SAVESTATE_RunPending();
+	EXPECT_FALSE(savestate_pending);
+	EXPECT_EQ(region, saved);
+
+	// without the shadow copies the slot is written anew
+	region[4096] = 0xbb;
+	ASSERT_TRUE(SAVESTATE_Save(path));
+	EXPECT_EQ(std_fs::file_size(path), full_size);
+}
+
+// Overwrites the 64-bit value at the given offset of the file
+void patch_file(const std_fs::path& path, const std::streamoff offset,
+                const uint64_t value)
+{
+	std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+	file.seekp(offset);
+	file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+TEST_F(SaveStateFile, RefusesOversizedLengths)
+{
+	// the record appended by a second save starts with its raw and
+	// compressed sizes
+	constexpr uint64_t huge_size = uint64_t{1} << 62;
+	for (const std::streamoff field_offset : {0, 8}) {
+		std_fs::remove(path);
+		ASSERT_TRUE(SAVESTATE_Save(path));
+		const auto record_offset = static_cast<std::streamoff>(
+		        std_fs::file_size(path));
+		region[0] = 0xaa;
+		ASSERT_TRUE(SAVESTATE_Save(path));
+
+		patch_file(path, record_offset + field_offset, huge_size);
+		region[0] = 0xbb;
+		EXPECT_FALSE(SAVESTATE_Load(path));
+		EXPECT_EQ(region[0], 0xbb);
+	}
+}
+
+TEST_F(SaveStateFile, LoadAtStartRefusesOversizedFingerprint)
+{
+	ASSERT_TRUE(SAVESTATE_Save(path));
+
+	// the fingerprint size follows the magic and the version
+	patch_file(path, 12, 0xffffffff);
+	region[0] = 0xaa;
+	SAVESTATE_LoadAtStart(path);
+	SAVESTATE_RunPending();
+	EXPECT_FALSE(savestate_pending);
+	EXPECT_EQ(region[0], 0xaa);
+}
+
+} // namespace
@@ -0,0 +1,102 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "vga.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> make_noise(const size_t size)
+{
+	std::minstd_rand generator(42);
+	std::vector<uint8_t> values(size);
+	for (auto& value : values) {
+		value = static_cast<uint8_t>(generator());
+	}
+	return values;
+}
+
+TEST(VgaMemory, PlanesToPixels)
+{
+	for (size_t num_groups : {0, 1, 2, 3, 17}) {
+		const auto planes = make_noise(num_groups * 4);
+		std::vector<uint8_t> pixels(num_groups * 8);
+		VGA_PlanesToPixels(planes.data(), pixels.data(), num_groups);
+		for (size_t i = 0; i < pixels.size(); ++i) {
+			const auto group = &planes[(i / 8) * 4];
+			const auto bit   = 7 - (i % 8);
+			uint8_t expected = 0;
+			for (int plane = 0; plane < 4; ++plane) {
+				expected |= ((group[plane] >> bit) & 1) << plane;
+			}
+			ASSERT_EQ(pixels[i], expected) << "pixel " << i;
+		}
+	}
+}
+
+// Returns the milliseconds it takes to convert the groups of planes of a
+// frame, in writes of the given number of bytes
+double time_planar_frame(const std::vector<uint8_t>& planes,
+                         std::vector<uint8_t>& pixels, const int write_size)
+{
+	using clock = std::chrono::steady_clock;
+
+	constexpr int num_frames = 200;
+	const auto num_groups    = static_cast<int>(planes.size() / 4);
+
+	const auto start_time = clock::now();
+	for (int frame = 0; frame < num_frames; ++frame) {
+		for (int i = 0; i < num_groups; i += write_size) {
+			VGA_PlanesToPixels(&planes[i * 4], &pixels[i * 8], write_size);
+		}
+	}
+	const std::chrono::duration<double, std::milli> elapsed = clock::now() -
+	                                                          start_time;
+	return elapsed.count() / num_frames;
+}
+
+// The EGA handlers convert the groups of planes each write changes; this
+// prints the time it takes for a full 16-colour frame in the sizes of 8-bit,
+// 16-bit and 32-bit writes. The results are only informative, they don't
+// decide whether the test passes. Run it with
+// --gtest_also_run_disabled_tests.
+TEST(VgaMemory, DISABLED_Benchmark)
+{
+	constexpr int width  = 640;
+	constexpr int height = 480;
+
+	const auto planes = make_noise(width * height / 8 * 4);
+	std::vector<uint8_t> pixels(width * height);
+
+	printf("%dx%dx16 planar frame: bytes %.3f ms, words %.3f ms, dwords %.3f ms\n",
+	       width,
+	       height,
+	       time_planar_frame(planes, pixels, 1),
+	       time_planar_frame(planes, pixels, 2),
+	       time_planar_frame(planes, pixels, 4));
+}
+
+} // namespace